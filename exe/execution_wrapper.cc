@@ -6,6 +6,23 @@
 #include <boost/nowide/iostream.hpp>
 #include <boost/nowide/fstream.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
 namespace lth_loc = leatherman::locale;
 namespace lth_jc = leatherman::json_container;
 namespace lth_exec = leatherman::execution;
@@ -17,6 +34,319 @@ namespace fs = boost::filesystem;
 static const fs::perms FILE_PERMS { fs::owner_read | fs::owner_write | fs::group_read };
 #endif
 
+static constexpr size_t CHUNK_SIZE = 0x8000;  // 32 kB
+
+// How many bytes of each output stream are kept when capping it; no
+// cap is applied when both are zero
+struct OutputLimit {
+    uint64_t head_bytes;
+    uint64_t tail_bytes;
+
+    bool enabled() const { return head_bytes > 0 || tail_bytes > 0; }
+};
+
+static std::string truncationMarker(uint64_t omitted_bytes, uint64_t total_bytes)
+{
+    return lth_loc::format("\n[output truncated: {1} of {2} bytes omitted]\n",
+                           omitted_bytes, total_bytes);
+}
+
+// Writes the first head_bytes of a stream to file as they arrive and
+// keeps the last tail_bytes in a ring buffer; the tail is appended,
+// after a truncation marker if anything was dropped, by finish().
+class OutputCapture {
+  public:
+    OutputCapture(const std::string& path, OutputLimit limit)
+            : ofs_ { path, std::ios::binary | std::ios::trunc },
+              limit_ (limit),
+              ring_ (static_cast<size_t>(limit.tail_bytes)),
+              ring_next_ { 0 },
+              ring_used_ { 0 },
+              total_bytes_ { 0 }
+    {
+#ifndef _WIN32
+        fs::permissions(path, FILE_PERMS);
+#endif
+    }
+
+    void write(const char* data, size_t size)
+    {
+        if (total_bytes_ < limit_.head_bytes) {
+            auto n = static_cast<size_t>(
+                std::min<uint64_t>(size, limit_.head_bytes - total_bytes_));
+            ofs_.write(data, n);
+            ofs_.flush();
+            total_bytes_ += n;
+            data += n;
+            size -= n;
+        }
+
+        total_bytes_ += size;
+
+        if (ring_.empty())
+            return;
+
+        // Only the last ring_.size() bytes of the chunk can survive
+        if (size > ring_.size()) {
+            data += size - ring_.size();
+            size = ring_.size();
+        }
+
+        while (size > 0) {
+            auto n = std::min(size, ring_.size() - ring_next_);
+            memcpy(&ring_[ring_next_], data, n);
+            ring_next_ = (ring_next_ + n) % ring_.size();
+            ring_used_ = std::min(ring_used_ + n, ring_.size());
+            data += n;
+            size -= n;
+        }
+    }
+
+    // Accounts for bytes of the stream that could not be read
+    void skip(size_t size)
+    {
+        total_bytes_ += size;
+    }
+
+    void finish()
+    {
+        if (truncated())
+            ofs_ << truncationMarker(total_bytes_ - keptBytes(), total_bytes_);
+
+        auto start = (ring_next_ + ring_.size() - ring_used_) % (ring_.empty() ? 1 : ring_.size());
+        auto first = std::min(ring_used_, ring_.size() - start);
+        if (first > 0)
+            ofs_.write(&ring_[start], first);
+        if (ring_used_ > first)
+            ofs_.write(&ring_[0], ring_used_ - first);
+
+        ofs_.close();
+    }
+
+    uint64_t totalBytes() const { return total_bytes_; }
+
+    bool truncated() const
+    {
+        return total_bytes_ > keptBytes();
+    }
+
+  private:
+    uint64_t keptBytes() const
+    {
+        return std::min<uint64_t>(total_bytes_, limit_.head_bytes) + ring_used_;
+    }
+
+    boost::nowide::ofstream ofs_;
+    OutputLimit limit_;
+    std::vector<char> ring_;
+    size_t ring_next_;
+    size_t ring_used_;
+    uint64_t total_bytes_;
+};
+
+// Caps a complete output file in place, by keeping its first and
+// last bytes. Used where the output can't be captured while the
+// executable runs. Returns true if the file was truncated.
+static bool trimOutputFile(const std::string& path, OutputLimit limit, uint64_t& total_bytes)
+{
+    boost::system::error_code ec;
+    total_bytes = fs::file_size(path, ec);
+
+    if (ec || total_bytes <= limit.head_bytes + limit.tail_bytes)
+        return false;
+
+    auto tmp_path = path + "." + fs::unique_path("%%%%-%%%%").string();
+
+    {
+        boost::nowide::ifstream ifs { path, std::ios::binary };
+        boost::nowide::ofstream ofs { tmp_path, std::ios::binary | std::ios::trunc };
+        std::vector<char> buffer(CHUNK_SIZE);
+
+        auto copy = [&](uint64_t size) {
+            while (size > 0 && ifs) {
+                ifs.read(buffer.data(),
+                         static_cast<std::streamsize>(std::min<uint64_t>(size, CHUNK_SIZE)));
+                ofs.write(buffer.data(), ifs.gcount());
+                size -= static_cast<uint64_t>(ifs.gcount());
+            }
+        };
+
+        copy(limit.head_bytes);
+        ofs << truncationMarker(total_bytes - limit.head_bytes - limit.tail_bytes,
+                                total_bytes);
+        ifs.seekg(static_cast<std::streamoff>(total_bytes - limit.tail_bytes));
+        copy(limit.tail_bytes);
+    }
+
+#ifndef _WIN32
+    fs::permissions(tmp_path, FILE_PERMS);
+#endif
+    fs::rename(tmp_path, path);
+    return true;
+}
+
+#ifndef _WIN32
+
+// Streams the output of the executable from a FIFO to an
+// OutputCapture, so that the output files never exceed the limit.
+//
+// The FIFO is opened for reading before the executable runs, together
+// with a write end held by the wrapper itself; that way opening it
+// never blocks and the reader does not see an end of file before the
+// executable opens it (or if it never does, e.g. when it can't be
+// found). Once the execution ends, the held write end is closed and
+// the reader drains the FIFO.
+class FifoCapture {
+  public:
+    FifoCapture(const std::string& path, OutputLimit limit)
+            : fifo_path_ { path + ".fifo" },
+              capture_ { path, limit },
+              read_fd_ { -1 },
+              hold_fd_ { -1 },
+              done_ { false }
+    {
+        ::unlink(fifo_path_.c_str());
+
+        if (::mkfifo(fifo_path_.c_str(), S_IRUSR | S_IWUSR) != 0)
+            throw std::runtime_error { strerror(errno) };
+
+        read_fd_ = ::open(fifo_path_.c_str(), O_RDONLY | O_NONBLOCK);
+        if (read_fd_ != -1)
+            hold_fd_ = ::open(fifo_path_.c_str(), O_WRONLY);
+
+        if (read_fd_ == -1 || hold_fd_ == -1) {
+            auto err = strerror(errno);
+            cleanup();
+            throw std::runtime_error { err };
+        }
+
+        reader_ = std::thread(&FifoCapture::read, this);
+    }
+
+    ~FifoCapture()
+    {
+        finish();
+    }
+
+    const std::string& fifoPath() const { return fifo_path_; }
+
+    OutputCapture& capture() { return capture_; }
+
+    void finish()
+    {
+        if (hold_fd_ != -1) {
+            ::close(hold_fd_);
+            hold_fd_ = -1;
+        }
+
+        done_ = true;
+
+        if (reader_.joinable()) {
+            reader_.join();
+            capture_.finish();
+        }
+
+        cleanup();
+    }
+
+  private:
+    std::string fifo_path_;
+    OutputCapture capture_;
+    int read_fd_;
+    int hold_fd_;
+    std::atomic<bool> done_;
+    std::thread reader_;
+
+    // Give up on the FIFO if no data arrives for this long after the
+    // execution ended; a background process spawned by the
+    // executable may keep its write end open indefinitely
+    static constexpr int DRAIN_TIMEOUT_MS { 1000 };
+    static constexpr int POLL_INTERVAL_MS { 100 };
+
+    void read()
+    {
+        std::vector<char> buffer(CHUNK_SIZE);
+        int idle_ms { 0 };
+        // Set after a read error: the FIFO is still drained until all
+        // write ends are closed, so that the executable never blocks
+        // writing to it, but the data is only counted from then on
+        bool discard { false };
+
+        while (true) {
+            struct pollfd pfd { read_fd_, POLLIN, 0 };
+            auto ready = ::poll(&pfd, 1, POLL_INTERVAL_MS);
+
+            if (ready == -1) {
+                if (errno == EINTR)
+                    continue;
+                // e.g. ENOMEM; retry after a pause, as for a timeout
+                waitBeforeRetry();
+                ready = 0;
+            }
+
+            if (ready == 0) {
+                if (done_ && (idle_ms += POLL_INTERVAL_MS) >= DRAIN_TIMEOUT_MS)
+                    break;
+                continue;
+            }
+
+            auto n = ::read(read_fd_, buffer.data(), buffer.size());
+
+            if (n == 0)
+                break;  // all write ends are closed
+
+            if (n == -1) {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                discard = true;
+                waitBeforeRetry();
+                if (done_ && (idle_ms += POLL_INTERVAL_MS) >= DRAIN_TIMEOUT_MS)
+                    break;
+                continue;
+            }
+
+            idle_ms = 0;
+            if (discard) {
+                capture_.skip(static_cast<size_t>(n));
+            } else {
+                capture_.write(buffer.data(), static_cast<size_t>(n));
+            }
+        }
+    }
+
+    static void waitBeforeRetry()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+    }
+
+    void cleanup()
+    {
+        if (read_fd_ != -1) {
+            ::close(read_fd_);
+            read_fd_ = -1;
+        }
+
+        ::unlink(fifo_path_.c_str());
+    }
+};
+
+#endif  // _WIN32
+
+static OutputLimit getOutputLimit(const lth_jc::JsonContainer& params)
+{
+    OutputLimit limit { 0, 0 };
+
+    if (params.includes("output_head_bytes"))
+        limit.head_bytes = static_cast<uint64_t>(
+            std::max(0, params.get<int>("output_head_bytes")));
+
+    if (params.includes("output_tail_bytes"))
+        limit.tail_bytes = static_cast<uint64_t>(
+            std::max(0, params.get<int>("output_tail_bytes")));
+
+    return limit;
+}
+
 int main(int argc, char *argv[])
 {
     // Read JSON input from stdin. Input should take the following format:
@@ -26,21 +356,53 @@ int main(int argc, char *argv[])
     //    "input": "(string to pass to the executable on stdin)",
     //    "stdout": "(filepath to write stdout to)",
     //    "stderr": "(filepath to write stderr to)",
-    //    "exitcode": "(filepath to write exitcode to)"
+    //    "exitcode": "(filepath to write exitcode to)",
+    //    "output_head_bytes": (optional; bytes to keep from the start of each stream),
+    //    "output_tail_bytes": (optional; bytes to keep from the end of each stream),
+    //    "truncation": "(optional; filepath to write the total size of the
+    //                    truncated streams to)"
     // }
+    // In case output_head_bytes or output_tail_bytes are set, the streams
+    // larger than their sum are truncated; the bytes in between are
+    // replaced by a marker.
     boost::nowide::cin >> std::noskipws;
     std::istream_iterator<char> i_s_i(boost::nowide::cin), end;
     auto params = lth_jc::JsonContainer(std::string { i_s_i, end });
     auto executable = params.get<std::string>("executable");
+    auto stdout_path = params.get<std::string>("stdout");
+    auto stderr_path = params.get<std::string>("stderr");
+    auto limit = getOutputLimit(params);
     int exitcode;
 
+    // By default the executable writes directly to the output files
+    std::string stdout_target { stdout_path };
+    std::string stderr_target { stderr_path };
+
+#ifndef _WIN32
+    std::unique_ptr<FifoCapture> stdout_capture;
+    std::unique_ptr<FifoCapture> stderr_capture;
+
+    if (limit.enabled()) {
+        try {
+            stdout_capture.reset(new FifoCapture(stdout_path, limit));
+            stderr_capture.reset(new FifoCapture(stderr_path, limit));
+            stdout_target = stdout_capture->fifoPath();
+            stderr_target = stderr_capture->fifoPath();
+        } catch (const std::exception&) {
+            // Fall back to trimming the files once the execution ends
+            stdout_capture.reset();
+            stderr_capture.reset();
+        }
+    }
+#endif
+
     try {
         auto exec = lth_exec::execute(
             executable,
             params.get<std::vector<std::string>>("arguments"),
             params.get<std::string>("input"),
-            params.get<std::string>("stdout"),
-            params.get<std::string>("stderr"),
+            stdout_target,
+            stderr_target,
             {},       // environment
             nullptr,  // PID callback
             0,        // timeout
@@ -55,16 +417,53 @@ int main(int argc, char *argv[])
                 lth_exec::execution_options::inherit_locale });
         exitcode = exec.exit_code;
     } catch (lth_exec::execution_exception &e) {
+#ifndef _WIN32
+        if (stderr_capture)
+            stderr_capture->finish();
+#endif
         // Avoid atomic update to allow testing against /dev/stderr. There should never be
         // multiple processes trying to write this output.
-        boost::nowide::ofstream ofs { params.get<std::string>("stderr"), std::ios::binary };
+        boost::nowide::ofstream ofs { stderr_path, std::ios::binary };
 #ifndef _WIN32
-        fs::permissions(params.get<std::string>("stderr"), FILE_PERMS);
+        fs::permissions(stderr_path, FILE_PERMS);
 #endif
         ofs << lth_loc::format("Executable '{1}' failed to run: {2}", executable, e.what());
         exitcode = 127;
     }
 
+    if (limit.enabled()) {
+        std::string truncation {};
+        uint64_t total_bytes;
+
+        for (const auto& stream : { std::make_pair(std::string { "stdout" }, stdout_path),
+                                    std::make_pair(std::string { "stderr" }, stderr_path) }) {
+            bool truncated { false };
+#ifndef _WIN32
+            auto& capture = (stream.first == "stdout" ? stdout_capture : stderr_capture);
+            if (capture) {
+                capture->finish();
+                truncated = capture->capture().truncated();
+                total_bytes = capture->capture().totalBytes();
+            } else {
+                truncated = trimOutputFile(stream.second, limit, total_bytes);
+            }
+#else
+            truncated = trimOutputFile(stream.second, limit, total_bytes);
+#endif
+            if (truncated)
+                truncation += stream.first + " " + std::to_string(total_bytes) + "\n";
+        }
+
+        if (!truncation.empty() && params.includes("truncation")) {
+#ifdef _WIN32
+            lth_file::atomic_write_to_file(truncation, params.get<std::string>("truncation"));
+#else
+            lth_file::atomic_write_to_file(truncation, params.get<std::string>("truncation"),
+                                           FILE_PERMS, std::ios::binary);
+#endif
+        }
+    }
+
     // Write the exit code; at this point, stdout and stderr are already written
 #ifdef _WIN32
     lth_file::atomic_write_to_file(std::to_string(exitcode), params.get<std::string>("exitcode"));
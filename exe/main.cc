@@ -1,5 +1,6 @@
 #include <pxp-agent/agent.hpp>
 #include <pxp-agent/configuration.hpp>
+#include <pxp-agent/module_cache_dir.hpp>
 
 #include <pxp-agent/util/daemonize.hpp>
 
@@ -95,6 +96,35 @@ int startAgent(std::vector<std::string> arguments) {
     return exit_code;
 }
 
+// Import the task cache bundle specified with --import-task-cache-bundle,
+// rather than starting the agent, and print the outcome.
+static int importTaskCacheBundle(const std::string& bundle) {
+    const auto& agent_configuration = Configuration::Instance().getAgentConfiguration();
+
+    try {
+        ModuleCacheDir module_cache_dir { agent_configuration.task_cache_dir,
+                                          agent_configuration.task_cache_dir_purge_ttl,
+                                          agent_configuration.task_cache_dir_quota,
+                                          agent_configuration.task_download_concurrency,
+                                          agent_configuration.task_cache_dir_reverify_ttl };
+        auto result = module_cache_dir.importBundle(bundle);
+        boost::nowide::cout
+            << lth_loc::format("Imported {1} files ({2} bytes) into {3}; "
+                               "{4} were already cached, {5} were rejected",
+                               result.imported, result.bytes,
+                               agent_configuration.task_cache_dir,
+                               result.already_cached, result.rejected)
+            << std::endl;
+        return result.rejected == 0 ? PXP_AGENT_SUCCESS : PXP_AGENT_GENERAL_FAILURE;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to import the task cache bundle: {1}", e.what());
+        boost::nowide::cout << lth_loc::format("Failed to import the task cache bundle: {1}",
+                                               e.what())
+                            << std::endl;
+        return PXP_AGENT_GENERAL_FAILURE;
+    }
+}
+
 // Try to configure logging and log the specified message.
 // Return true if succeeds.
 // In case a Configuration::Error is thrown (so, an unknown
@@ -209,6 +239,10 @@ int main(int argc, char *argv[]) {
         return PXP_AGENT_CONFIGURATION_FAILURE;
     }
 
+    auto bundle = HW::GetFlag<std::string>("import-task-cache-bundle");
+    if (!bundle.empty())
+        return importTaskCacheBundle(bundle);
+
     return HW::Start();
 }
 
@@ -128,6 +128,53 @@ TEST_CASE("runs an executable") {
     }
 }
 
+TEST_CASE("caps the output") {
+    temp_directory tmpdir;
+    auto dir = tmpdir.name();
+#ifdef _WIN32
+    auto executable = dir+"/init.bat";
+#else
+    auto executable = dir+"/init";
+#endif
+    auto input = "{\"executable\": \""+executable+"\", \"arguments\": [], \"input\": \"\", "
+        "\"stdout\": \""+dir+"/out\", \"stderr\": \""+dir+"/err\", \"exitcode\": \""+dir+"/exit\", "
+        "\"output_head_bytes\": 4, \"output_tail_bytes\": 6, \"truncation\": \""+dir+"/truncation\"}";
+
+    ofstream foo(executable);
+#ifdef _WIN32
+    foo << "@echo off" << endl;
+    foo << "echo 0123456789abcdefghij" << endl;
+    foo << "echo short 1>&2" << endl;
+#else
+    foo << "#!/bin/sh" << endl;
+    foo << "echo 0123456789abcdefghij" << endl;
+    foo << "echo short 1>&2" << endl;
+#endif
+    foo.close();
+
+#ifndef _WIN32
+    fs::permissions(executable, fs::owner_read|fs::owner_write|fs::owner_exe);
+#endif
+
+    auto exec = execute(input);
+    REQUIRE(exec.exit_code == 0);
+
+    auto output = read(dir+"/out");
+    REQUIRE(output.substr(0, 4) == "0123");
+    REQUIRE(output.find("[output truncated: ") != string::npos);
+    REQUIRE(output.substr(output.size() - 6).find("ghij") != string::npos);
+
+    auto error = read(dir+"/err");
+    boost::trim(error);
+    REQUIRE(error == "short");
+
+    auto truncation = read(dir+"/truncation");
+    REQUIRE(truncation.find("stdout ") == 0);
+    REQUIRE(truncation.find("stderr") == string::npos);
+    REQUIRE(read(dir+"/exit") == "0");
+    REQUIRE_FALSE(fs::exists(dir+"/out.fifo"));
+}
+
 int main(int argc, char** argv) {
     exec_prefix = fs::absolute(fs::path(argv[0]).parent_path());
 
@@ -4,13 +4,32 @@
 #include <leatherman/json_container/json_container.hpp>
 
 #include <string>
+#include <cstdint>
+#include <utility>
 
 namespace PXPAgent {
 
 struct ActionOutput {
+    ActionOutput() : ActionOutput { 0, "", "" } {}
+
+    ActionOutput(int exitcode_,
+                 std::string std_out_,
+                 std::string std_err_,
+                 uint64_t std_out_total_bytes_ = 0,
+                 uint64_t std_err_total_bytes_ = 0)
+            : exitcode { exitcode_ },
+              std_out { std::move(std_out_) },
+              std_err { std::move(std_err_) },
+              std_out_total_bytes { std_out_total_bytes_ },
+              std_err_total_bytes { std_err_total_bytes_ } {}
+
     int exitcode;
     std::string std_out;
     std::string std_err;
+    // Total size of the streams that were truncated when stored;
+    // zero if the stream was not truncated
+    uint64_t std_out_total_bytes;
+    uint64_t std_err_total_bytes;
 };
 
 }  // namespace PXPAgent
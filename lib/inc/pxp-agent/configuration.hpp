@@ -164,6 +164,20 @@ class Configuration
         uint32_t task_download_connect_timeout_s;
         uint32_t task_download_timeout_s;
         uint32_t max_message_size;
+        uint32_t output_limit_head;
+        uint32_t output_limit_tail;
+        bool spool_dir_compress_output;
+        uint64_t spool_dir_quota;
+        uint64_t task_cache_dir_quota;
+        uint32_t task_download_concurrency;
+        std::string task_cache_dir_reverify_ttl;
+        uint64_t task_download_rate_limit;
+        uint32_t task_download_splay_s;
+        uint32_t file_download_parallelism;
+        uint32_t module_workers;
+        std::string modules_metadata_cache;
+        uint64_t module_results_max_size;
+        uint32_t module_results_max_depth;
         leatherman::logging::log_level loglevel;
     };
 
@@ -5,8 +5,11 @@
 #include <pxp-agent/thread_container.hpp>
 #include <pxp-agent/action_response.hpp>
 #include <pxp-agent/module_type.hpp>
+#include <pxp-agent/module_metadata_cache.hpp>
+#include <pxp-agent/module_worker_pool.hpp>
 #include <pxp-agent/results_storage.hpp>
 
+#include <exception>  // std::exception_ptr
 #include <map>
 #include <string>
 #include <vector>
@@ -22,20 +25,32 @@ class ExternalModule : public Module {
     /// Run the specified executable; its output must define the
     /// module by providing the metadata in JSON format.
     ///
+    /// In case a metadata cache is given, the module is only run if
+    /// its metadata is not cached already, and then stored in it.
+    ///
     /// After retrieving the metadata, validate it and, for each
     /// action defined in it, ensure that the specified input and
     /// output schemas are valid JSON schemas
     ///
+    /// In case the metadata has a "worker" entry, the blocking
+    /// actions are run by up to max_workers long-lived worker processes (see
+    /// ModuleWorkerPool), or by a process of their own when none is
+    /// available; max_workers set to 0 disables the workers.
+    ///
     /// Throw a Module::LoadingError if: it fails to load the external
     /// module metadata; if the metadata is invalid; in case of
     /// invalid input or output schemas.
     explicit ExternalModule(const std::string& exec_path,
-                            std::shared_ptr<ResultsStorage> storage);
+                            std::shared_ptr<ResultsStorage> storage,
+                            uint32_t max_workers = 0,
+                            std::shared_ptr<ModuleMetadataCache> metadata_cache = nullptr);
 
     explicit ExternalModule(
         const std::string& path,
         const leatherman::json_container::JsonContainer& config,
-        std::shared_ptr<ResultsStorage> storage);
+        std::shared_ptr<ResultsStorage> storage,
+        uint32_t max_workers = 0,
+        std::shared_ptr<ModuleMetadataCache> metadata_cache = nullptr);
 
     /// The type of the module.
     ModuleType type() override { return ModuleType::External; }
@@ -43,11 +58,20 @@ class ExternalModule : public Module {
     /// Whether or not the module supports non-blocking / asynchronous requests.
     bool supportsAsync() override { return true; }
 
+    /// Whether the metadata was found in the metadata cache, rather
+    /// than retrieved by running the module.
+    bool hasCachedMetadata() const { return metadata_cached_; }
+
     /// If a configuration schema has been registered for this module,
     /// validate configuration data. In that case, throw a
     /// PCPClient::validation_error for invalid configuration data.
     void validateConfiguration();
 
+    /// Limit the size and the nesting depth of the JSON results that
+    /// the module's actions may print on stdout; results exceeding
+    /// them are reported as invalid. A limit set to 0 is not enforced.
+    void setResultsLimits(uint64_t max_size, uint32_t max_depth);
+
     /// Log information about the output of the performed action
     /// while validating the JSON format of the output.
     /// Update the metadata of the ActionResponse instance (the
@@ -69,10 +93,39 @@ class ExternalModule : public Module {
     /// Results Storage
     std::shared_ptr<ResultsStorage> storage_;
 
+    /// Worker processes; null unless the module supports them
+    std::shared_ptr<ModuleWorkerPool> worker_pool_;
+
+    bool metadata_cached_;
+
+    /// Limits of the results on stdout; 0 if not enforced
+    uint64_t results_max_size_;
+    uint32_t results_max_depth_;
+
     /// Metadata validator
     static const PCPClient::Validator metadata_validator_;
 
-    const leatherman::json_container::JsonContainer getModuleMetadata();
+    /// Same as processOutputAndUpdateMetadata(), for results already
+    /// checked on file by checkResultsFile(): results_error is what
+    /// the check threw, if anything.
+    void processOutput(ActionResponse& response,
+                       bool results_checked,
+                       std::exception_ptr results_error);
+
+    /// Checks the results a non-blocking action wrote on file, in
+    /// chunks and against the limits, before they are read; a file
+    /// larger than the maximum size is rejected without being read.
+    /// Returns false in case they can't be checked this way (no
+    /// limits, no results, or the file can't be read), so that they
+    /// are checked once read. Throws a Util::JsonStreamParser::Error in case
+    /// they're invalid or a LimitError in case they exceed the limits.
+    bool checkResultsFile(const ActionRequest& request);
+
+    const leatherman::json_container::JsonContainer getModuleMetadata(
+        const std::shared_ptr<ModuleMetadataCache>& metadata_cache);
+
+    /// Runs the module to get its metadata
+    const leatherman::json_container::JsonContainer runMetadata();
 
     void registerConfiguration(
         const leatherman::json_container::JsonContainer& config);
@@ -83,6 +136,10 @@ class ExternalModule : public Module {
     void registerAction(
         const leatherman::json_container::JsonContainer& action);
 
+    void registerWorkers(
+        const leatherman::json_container::JsonContainer& metadata,
+        uint32_t max_workers);
+
     /// Returns a string containing the arguments, in JSON format, for
     /// the requested action.
     /// The arguments of the PXP request will be added to an "input"
@@ -1,41 +1,193 @@
 #ifndef SRC_UTIL_MODULE_CACHE_DIR_HPP_
 #define SRC_UTIL_MODULE_CACHE_DIR_HPP_
 
+#include <pxp-agent/util/disk_quota.hpp>
+#include <pxp-agent/util/http_client_pool.hpp>
+#include <pxp-agent/util/rate_limiter.hpp>
+#include <pxp-agent/util/server_selector.hpp>
+
 #include <cpp-pcp-client/util/thread.hpp>
 #include <leatherman/curl/client.hpp>
 #include <leatherman/json_container/json_container.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <map>
+#include <ctime>
+#include <memory>
+
 namespace PXPAgent {
 
+  // In case a quota is set, the size of each cache entry (the
+  // <cache_dir>/<sha256> directories) is tracked as files get
+  // downloaded, and the least recently used entries are removed as
+  // soon as the usage crosses the high-water mark (see
+  // Util::DiskQuota). Entries in use by an action are pinned (see
+  // EntryPin) and are never removed, either to enforce the quota or
+  // by purgeCache.
+  //
+  // Files are downloaded in parallel, up to the configured number of
+  // concurrent downloads; concurrent requests for the same sha256 wait
+  // for a single download, and then copy the verified file locally in
+  // case they need it at a different destination. Each download tries
+  // the fastest healthy master-uri first (see Util::ServerSelector).
+  //
+  // So that a fleet of agents receiving the same task at once does not
+  // overload the master-uris, the bytes received by all the downloads
+  // can be limited (see Util::RateLimiter), the downloads of the files
+  // that are not cached can be delayed by a random splay, and the
+  // master-uris that answer with a Retry-After hint are not contacted
+  // again until then.
+  //
+  // Once a file is verified, a sidecar record with its sha256 and its
+  // fingerprint (see Util::FileFingerprint) is stored in the cache
+  // entry, so that the file is not hashed again on each use while its
+  // fingerprint matches. In case a re-verification TTL is set, the
+  // files verified earlier than that are hashed again by purgeCache.
   class ModuleCacheDir {
     public:
+      // TLS and proxy settings of the HTTPS requests used to download
+      // files. The requests of all the modules are performed with the
+      // handles of a single Util::HttpClientPool, so that they reuse
+      // open connections and TLS sessions; downloads don't have to be
+      // serialized, as each one borrows its own handle.
+      struct ClientSettings {
+          std::string ca;
+          std::string crt;
+          std::string key;
+          std::string crl;
+          std::string proxy;
+      };
+
+      // No limit on the number of concurrent downloads
+      static const uint32_t UNLIMITED_DOWNLOADS;
+
+      // Pins the cache entries of the specified digests (or names, for
+      // the entries that are not keyed by sha256) for its lifetime.
+      class EntryPin {
+        public:
+          EntryPin(ModuleCacheDir& cache, std::vector<std::string> entries);
+          ~EntryPin();
+          EntryPin(const EntryPin&) = delete;
+          EntryPin& operator=(const EntryPin&) = delete;
+
+        private:
+          ModuleCacheDir& cache_;
+          std::vector<std::string> entries_;
+      };
+
       ModuleCacheDir() = delete;
       ModuleCacheDir(const ModuleCacheDir&) = delete;
       ModuleCacheDir& operator=(const ModuleCacheDir&) = delete;
       ModuleCacheDir(const std::string& cache_dir,
-                     const std::string& cache_dir_purge_ttl);
+                     const std::string& cache_dir_purge_ttl,
+                     uint64_t quota_bytes = 0,
+                     uint32_t max_concurrent_downloads = UNLIMITED_DOWNLOADS,
+                     std::string reverify_ttl = "0d",
+                     uint64_t download_rate_limit = 0,
+                     uint32_t download_splay_s = 0);
+
+      // Flushes the last use times kept in memory.
+      ~ModuleCacheDir();
 
       boost::filesystem::path createCacheDir(const std::string& sha256);
+      // The number of bytes received from the master-uris, including
+      // those of the failed attempts, is added to bytes_received, if
+      // given; it's 0 for a cached file, or one downloaded by a
+      // concurrent request.
       boost::filesystem::path getCachedFile(const std::vector<std::string>& master_uris,
                                       uint32_t connect_timeout,
                                       uint32_t timeout,
-                                      leatherman::curl::client& client,
+                                      const ClientSettings& client_settings,
                                       const boost::filesystem::path& cache_dir,
-                                      leatherman::json_container::JsonContainer& file);
+                                      leatherman::json_container::JsonContainer& file,
+                                      uint64_t* bytes_received = nullptr);
+
+      // Returns true if the file is already verified in the cache
+      // entry, i.e. getCachedFile would not download it.
+      bool isCached(const boost::filesystem::path& cache_dir,
+                    const leatherman::json_container::JsonContainer& file);
 
+      // Numbers of the files of a bundle processed by importBundle.
+      struct BundleImport {
+          unsigned int imported;
+          unsigned int already_cached;
+          unsigned int rejected;
+          uint64_t bytes;
+      };
+
+      // Imports the files of a bundle, a tar archive (optionally gzip
+      // compressed) of <sha256>/<filename> entries, into the cache as if
+      // they were downloaded. Each file is hashed while it's extracted
+      // and is rejected in case it does not match the sha256 of its
+      // entry; so are the entries that don't follow that layout.
+      // Throws a Module::ProcessingError in case the bundle can't be
+      // read.
+      BundleImport importBundle(const boost::filesystem::path& bundle_path);
+
+      // In case the file is not cached, its download is delayed by a
+      // random splay, unless splay_download is false (e.g. for retries).
+      // The bytes received are added to bytes_received, if given (see
+      // getCachedFile).
       boost::filesystem::path downloadFileFromMaster(const std::vector<std::string>& master_uris,
                                                     uint32_t connect_timeout,
                                                     uint32_t timeout,
-                                                    leatherman::curl::client& client,
+                                                    const ClientSettings& client_settings,
                                                     const boost::filesystem::path& cache_dir,
                                                     const boost::filesystem::path& destination,
-                                                    const leatherman::json_container::JsonContainer& file);
+                                                    const leatherman::json_container::JsonContainer& file,
+                                                    bool splay_download = true,
+                                                    uint64_t* bytes_received = nullptr);
+
+      // Downloads a tar archive (optionally gzip compressed) and
+      // extracts its files and directories into the destination
+      // directory, merging them with its content, if any; the archive
+      // is streamed from the response, without being stored on disk or
+      // cached. Throws a Module::ProcessingError in case the archive
+      // can't be downloaded, does not match its sha256 or has entries
+      // out of the destination (absolute paths or "..").
+      void downloadArchiveFromMaster(const std::vector<std::string>& master_uris,
+                                     uint32_t connect_timeout,
+                                     uint32_t timeout,
+                                     const ClientSettings& client_settings,
+                                     const boost::filesystem::path& destination,
+                                     const leatherman::json_container::JsonContainer& file);
+
+      // Returns the directory of the cache entry with the specified
+      // name, for content derived from the cached files (e.g. the
+      // install dir of a multi-file task). In case it does not exist,
+      // build_dir is called to populate a temporary directory, which is
+      // then made read-only, listed in a manifest and moved into place;
+      // concurrent callers may both build it, in which case the first
+      // one in place is kept. The entry should be pinned (see EntryPin)
+      // while in use. An entry whose files no longer match its manifest
+      // is built again (the files added are ignored); the replaced
+      // tree is kept while the entry is pinned, and then purged.
+      boost::filesystem::path getDerivedEntry(
+          const std::string& name,
+          std::function<void(const boost::filesystem::path& dir)> build_dir);
+
+      // Restores the write permissions of an entry made read-only by
+      // getDerivedEntry, so that it can be removed.
+      static void makeEntryWritable(const boost::filesystem::path& entry_dir);
+
+      // Makes a file obtained with getCachedFile available at the
+      // destination, cloning it rather than copying it when possible
+      // (see Util::stageFile); the task may modify the destination
+      // without affecting the cached file.
+      void stageCachedFile(const boost::filesystem::path& cached_file,
+                           const boost::filesystem::path& destination);
 
       unsigned int purgeCache(const std::string& ttl,
                               std::vector<std::string> ongoing_transactions,
                               std::function<void(const std::string& dir_path)> purge_callback);
 
+      // Returns the disk usage tracked for the quota, in bytes.
+      uint64_t getDiskUsage();
+
+      // Returns the number of download requests and of the connections
+      // they opened.
+      Util::HttpClientPool::Stats getDownloadStats();
+
       std::string cache_dir_;
       std::string purge_ttl_;
 
@@ -43,14 +195,93 @@ namespace PXPAgent {
       std::tuple<bool, std::string> downloadFileWithCurl(const std::vector<std::string>& master_uris,
                                                         uint32_t connect_timeout_s,
                                                         uint32_t timeout_s,
-                                                        leatherman::curl::client& client,
+                                                        const ClientSettings& client_settings,
                                                         const boost::filesystem::path& file_path,
-                                                        const leatherman::json_container::JsonContainer& uri);
+                                                        const leatherman::json_container::JsonContainer& uri,
+                                                        uint64_t expected_size,
+                                                        std::string& downloaded_sha256,
+                                                        uint64_t& bytes_received);
+
+      // A download shared by the concurrent requests for a sha256; the
+      // path of the verified file is empty in case the download failed.
+      struct InFlightDownload {
+          PCPClient::Util::mutex mutex;
+          PCPClient::Util::condition_variable cond_var;
+          bool done;
+          boost::filesystem::path file_path;
+          std::string error;
+      };
+
+      boost::filesystem::path waitForDownload(InFlightDownload& in_flight,
+                                              const std::string& sha256,
+                                              const boost::filesystem::path& cache_dir,
+                                              const boost::filesystem::path& destination);
+
+      // Moves the verified temporary file to its destination.
+      void placeFile(const boost::filesystem::path& tempname,
+                     const boost::filesystem::path& destination);
+
+      // Returns true if the destination file matches the sha256,
+      // relying on its verified record when its fingerprint matches.
+      bool isVerified(const boost::filesystem::path& cache_dir,
+                      const boost::filesystem::path& destination,
+                      const std::string& sha256);
+
+      // Stores the verified record of the destination file.
+      void recordVerified(const boost::filesystem::path& cache_dir,
+                          const boost::filesystem::path& destination,
+                          const std::string& sha256);
+
+      // Hashes again the files verified before the re-verification
+      // TTL; the files that no longer match are removed from the cache.
+      unsigned int reverifyCache();
+
+      void acquireDownloadSlot();
+      void releaseDownloadSlot();
 
       std::string createUrlEndpoint(const leatherman::json_container::JsonContainer& uri);
       std::string calculateSha256(const std::string& path);
+
+      // Updates the disk usage with the size of the specified cache
+      // entry and removes the least recently used entries in case the
+      // usage is above the high-water mark.
+      void updateDiskUsage(const boost::filesystem::path& entry_dir);
+
+      // The following functions must be called while holding the
+      // cache_purge_mutex_
+      void initializeDiskUsage();
+      void evictEntries();
+      bool isPinned(const std::string& entry) const;
+      std::time_t getLastUse(const boost::filesystem::path& entry_dir,
+                             std::time_t last_write_time) const;
+      void flushLastUses();
+
+      std::string reverify_ttl_;
+
+      Util::DiskQuota disk_quota_;
+      bool disk_usage_initialized_;
+      std::map<std::string, unsigned int> pinned_entries_;
+      // Trees of the derived entries replaced by getDerivedEntry, by
+      // their directory name, with the name of the entry they were
+      std::map<std::string, std::string> replaced_entries_;
+      // Last use times of the entries, not written to their
+      // directories yet
+      std::map<std::string, std::time_t> last_uses_;
       PCPClient::Util::mutex cache_purge_mutex_;
-      PCPClient::Util::mutex curl_mutex_;
+
+      std::map<std::string, std::shared_ptr<InFlightDownload>> in_flight_downloads_;
+      PCPClient::Util::mutex in_flight_downloads_mutex_;
+
+      Util::HttpClientPool http_clients_;
+      Util::ServerSelector server_selector_;
+      // Shared by the downloads, in bytes per second
+      Util::RateLimiter download_rate_limiter_;
+      uint32_t download_splay_s_;
+
+      uint32_t max_concurrent_downloads_;
+      uint32_t num_downloads_;
+      PCPClient::Util::mutex download_slots_mutex_;
+      PCPClient::Util::condition_variable download_slots_cond_var_;
   };
 }
 #endif
@@ -0,0 +1,74 @@
+#ifndef SRC_MODULE_METADATA_CACHE_HPP_
+#define SRC_MODULE_METADATA_CACHE_HPP_
+
+#include <leatherman/json_container/json_container.hpp>
+
+#include <cpp-pcp-client/util/thread.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace PXPAgent {
+
+// Metadata of the external modules, stored in a single JSON file so
+// that the modules that did not change since the last start are loaded
+// without running them. An entry is only used as long as the module
+// file has the same path, size, modification time and sha256 as when
+// its metadata was retrieved; note that the files the module loads
+// (e.g. its libraries) are not taken into account.
+class ModuleMetadataCache {
+  public:
+    struct Key {
+        uint64_t size;
+        int64_t mtime_ns;
+        std::string sha256;
+
+        bool operator==(const Key& other) const;
+        // Space-separated values
+        std::string toString() const;
+    };
+
+    ModuleMetadataCache() = delete;
+    ModuleMetadataCache(const ModuleMetadataCache&) = delete;
+    ModuleMetadataCache& operator=(const ModuleMetadataCache&) = delete;
+
+    // Loads the entries of the cache file, if it exists; a file that
+    // can't be read or parsed is ignored, and replaced by save().
+    explicit ModuleMetadataCache(std::string cache_file);
+
+    // Gets the key of the module file, to be obtained before running
+    // the module. Returns false in case the file can't be read.
+    static bool getKey(const std::string& module_path, Key& key);
+
+    // Returns true and sets metadata in case the module's metadata is
+    // cached with the same key.
+    bool get(const std::string& module_path,
+             const Key& key,
+             leatherman::json_container::JsonContainer& metadata);
+
+    void set(const std::string& module_path,
+             const Key& key,
+             const leatherman::json_container::JsonContainer& metadata);
+
+    // Writes the entries obtained or set since the cache was loaded,
+    // dropping the others (i.e. the modules that were removed), in
+    // case any changed. Errors are logged, not thrown.
+    void save();
+
+  private:
+    struct Entry {
+        Key key;
+        leatherman::json_container::JsonContainer metadata;
+        bool used;
+    };
+
+    std::string cache_file_;
+    PCPClient::Util::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    bool changed_;
+};
+
+}  // namespace PXPAgent
+
+#endif  // SRC_MODULE_METADATA_CACHE_HPP_
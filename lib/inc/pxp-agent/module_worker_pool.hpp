@@ -0,0 +1,116 @@
+#ifndef SRC_MODULE_WORKER_POOL_HPP_
+#define SRC_MODULE_WORKER_POOL_HPP_
+
+#include <pxp-agent/util/module_worker.hpp>
+
+#include <cpp-pcp-client/util/thread.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PXPAgent {
+
+// Long-lived worker processes of an external module that declares a
+// "worker" entry in its metadata, so that its actions don't pay for
+// starting its interpreter each time. Each worker runs one action at
+// once; the requests are JSON lines written to its stdin:
+//
+//   {"id": "<id>", "type": "action", "action": "<name>", "arguments": {...}}
+//   {"id": "<id>", "type": "ping"}
+//
+// where the arguments are what the module would otherwise read on its
+// stdin, and the worker answers each with a JSON line on its stdout:
+//
+//   {"id": "<id>", "stdout": "...", "stderr": "...", "exitcode": 0}
+//   {"id": "<id>"}
+//
+// The workers idle for longer than HEALTH_CHECK_INTERVAL are pinged
+// before being reused, and each worker is replaced after the maximum
+// number of requests. Any worker that fails is discarded, including
+// one that doesn't answer an action within the action timeout or whose
+// response exceeds the maximum size; it's killed, unless it exits once
+// its stdin is closed.
+class ModuleWorkerPool {
+  public:
+    struct Result {
+        int exitcode;
+        std::string std_out;
+        std::string std_err;
+    };
+
+    static const std::chrono::seconds HEALTH_CHECK_INTERVAL;
+    static const std::chrono::seconds HEALTH_CHECK_TIMEOUT;
+    // Starting workers is given up after this number of consecutive
+    // failures; the actions are then always run by a process of their
+    // own
+    static const unsigned int MAX_START_FAILURES;
+
+    ModuleWorkerPool() = delete;
+    ModuleWorkerPool(const ModuleWorkerPool&) = delete;
+    ModuleWorkerPool& operator=(const ModuleWorkerPool&) = delete;
+
+    // An action timeout of zero is not enforced.
+    ModuleWorkerPool(std::string exec_path,
+                     uint32_t max_workers,
+                     uint32_t max_requests_per_worker,
+                     std::chrono::seconds action_timeout);
+
+    // Runs the action in a worker. Returns false, without running the action, in case no
+    // worker can take it (all busy, or they can't be started) or the
+    // request can't be delivered, so that the caller runs it with a
+    // process of its own.
+    // Throws a Module::ProcessingError in case the worker fails once it
+    // got the request, or its response is larger than max_response_size
+    // bytes (unless zero); the action is not run again, as its effects
+    // are unknown.
+    bool run(const std::string& action,
+             const std::string& arguments,
+             uint64_t max_response_size,
+             Result& result);
+
+    // Returns the number of running workers.
+    size_t size();
+
+    // Returns false once starting workers was given up.
+    bool enabled();
+
+  private:
+    struct Worker {
+        std::unique_ptr<Util::ModuleWorker> process;
+        uint32_t num_requests;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    std::string exec_path_;
+    uint32_t max_workers_;
+    uint32_t max_requests_per_worker_;
+    std::chrono::seconds action_timeout_;
+
+    PCPClient::Util::mutex mutex_;
+    std::vector<std::unique_ptr<Worker>> idle_workers_;
+    // Both idle and busy
+    uint32_t num_workers_;
+    unsigned int num_start_failures_;
+    uint64_t next_request_id_;
+
+    // Returns null in case no worker is available.
+    std::unique_ptr<Worker> acquire();
+    // Keeps the worker for the next actions, unless it failed or
+    // reached the maximum number of requests.
+    void release(std::unique_ptr<Worker> worker, bool failed);
+    std::unique_ptr<Worker> start();
+    // Pings the worker in case it idled for longer than
+    // HEALTH_CHECK_INTERVAL.
+    bool isHealthy(Worker& worker);
+    // Returns false in case the worker does not answer the ping within
+    // HEALTH_CHECK_TIMEOUT.
+    bool ping(Worker& worker);
+    std::string nextRequestId();
+};
+
+}  // namespace PXPAgent
+
+#endif  // SRC_MODULE_WORKER_POOL_HPP_
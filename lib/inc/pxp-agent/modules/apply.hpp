@@ -26,6 +26,8 @@ class Apply : public PXPAgent::Util::BoltModule, public PXPAgent::Util::Purgeabl
 
         Util::CommandObject buildCommandObject(const ActionRequest& request) override;
 
+        std::vector<std::string> cacheEntries(const ActionRequest& request) override;
+
         /// Utility to purge files from the cache_dir that have surpassed the ttl.
         /// If a purge_callback is not specified, the boost filesystem's remove_all() will be used.
         /// Returns number of directories purged.
@@ -11,7 +11,6 @@
 #include <cpp-pcp-client/util/thread.hpp>
 
 #include <leatherman/locale/locale.hpp>
-#include <leatherman/curl/client.hpp>
 #include <set>
 
 namespace PXPAgent {
@@ -28,7 +27,13 @@ namespace Modules {
                   uint32_t download_connect_timeout,
                   uint32_t download_timeout,
                   std::shared_ptr<ModuleCacheDir> module_cache_dir,
-                  std::shared_ptr<ResultsStorage> storage);
+                  std::shared_ptr<ResultsStorage> storage,
+                  uint32_t max_parallel_entries = DEFAULT_PARALLEL_ENTRIES);
+
+      // Default maximum number of files, symlinks and archives of a request
+      // placed at once; the downloads among them are further bounded
+      // by the ModuleCacheDir
+      static const uint32_t DEFAULT_PARALLEL_ENTRIES;
 
       /// Utility to purge files from the cache_dir that have surpassed the ttl.
       /// If a purge_callback is not specified, the boost filesystem's remove_all() will be used.
@@ -43,7 +48,9 @@ namespace Modules {
 
       uint32_t file_download_connect_timeout_, file_download_timeout_;
 
-      leatherman::curl::client client_;
+      uint32_t max_parallel_entries_;
+
+      ModuleCacheDir::ClientSettings client_settings_;
 
       // callAction is normally implemented in the BoltModule base class. However:
       // DownloadFile will not execute any external processes, so it does not need the
@@ -54,6 +61,10 @@ namespace Modules {
       // files.
       ActionResponse callAction(const ActionRequest& request) override;
 
+      // Places the destination of an entry of the files array; returns
+      // "unchanged" in case it already matches.
+      std::string placeEntry(const leatherman::json_container::JsonContainer& file);
+
       // Since DownloadFile overrides callAction there's no reason to define
       // buildCommandObject (since it will never be called)
       Util::CommandObject buildCommandObject(const ActionRequest& request) override {
@@ -8,7 +8,6 @@
 #include <pxp-agent/module_cache_dir.hpp>
 
 #include <leatherman/locale/locale.hpp>
-#include <leatherman/curl/client.hpp>
 
 namespace PXPAgent {
 namespace Modules {
@@ -29,6 +28,8 @@ class Script : public PXPAgent::Util::BoltModule, public PXPAgent::Util::Purgeab
 
         Util::CommandObject buildCommandObject(const ActionRequest& request) override;
 
+        std::vector<std::string> cacheEntries(const ActionRequest& request) override;
+
         /// Utility to purge files from the cache_dir that have surpassed the ttl.
         /// If a purge_callback is not specified, the boost filesystem's remove_all() will be used.
         /// Returns number of directories purged.
@@ -42,7 +43,7 @@ class Script : public PXPAgent::Util::BoltModule, public PXPAgent::Util::Purgeab
 
       uint32_t download_connect_timeout_, download_timeout_;
 
-      leatherman::curl::client client_;
+      ModuleCacheDir::ClientSettings client_settings_;
 };
 
 }  // namespace Modules
@@ -8,7 +8,6 @@
 #include <pxp-agent/util/purgeable.hpp>
 #include <pxp-agent/util/bolt_module.hpp>
 
-#include <leatherman/curl/client.hpp>
 #include <set>
 
 namespace PXPAgent {
@@ -46,16 +45,30 @@ class Task : public PXPAgent::Util::BoltModule, public PXPAgent::Util::Purgeable
 
     std::set<std::string> features_;
 
-    leatherman::curl::client client_;
+    ModuleCacheDir::ClientSettings client_settings_;
 
-    boost::filesystem::path downloadMultiFile(std::vector<leatherman::json_container::JsonContainer> const& files,
+    void downloadMultiFile(std::vector<leatherman::json_container::JsonContainer> const& files,
         std::set<std::string> const& download_set,
-        boost::filesystem::path const& spool_dir);
+        boost::filesystem::path const& install_dir);
+
+    // Gets the files into the cache, downloading them in parallel if
+    // necessary, and returns a report of the cache hits and misses
+    leatherman::json_container::JsonContainer prefetchFiles(std::vector<leatherman::json_container::JsonContainer> files);
+
+    // Imports the task files of a local bundle into the cache, and
+    // returns a report of the imported and rejected files
+    leatherman::json_container::JsonContainer importBundle(const std::string& bundle_path);
 
     leatherman::json_container::JsonContainer selectLibFile(std::vector<leatherman::json_container::JsonContainer> const& files,
         std::string const& file_name);
 
     Util::CommandObject buildCommandObject(const ActionRequest& request) override;
+
+    // Performs the prefetch and import_bundle actions, and defers the
+    // run action to the BoltModule
+    ActionResponse callAction(const ActionRequest& request) override;
+
+    std::vector<std::string> cacheEntries(const ActionRequest& request) override;
 };
 
 }  // namespace Modules
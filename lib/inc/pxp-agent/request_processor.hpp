@@ -3,6 +3,7 @@
 
 #include <pxp-agent/module.hpp>
 #include <pxp-agent/module_cache_dir.hpp>
+#include <pxp-agent/module_metadata_cache.hpp>
 #include <pxp-agent/thread_container.hpp>
 #include <pxp-agent/action_request.hpp>
 #include <pxp-agent/pxp_connector.hpp>
@@ -14,6 +15,7 @@
 #include <boost/filesystem/path.hpp>
 
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -23,6 +25,8 @@ namespace Util {
     class Purgeable;
 }
 
+class ExternalModule;
+
 class RequestProcessor {
   public:
     struct Error : public std::runtime_error {
@@ -68,6 +72,15 @@ class RequestProcessor {
     /// specified module
     std::string getModuleConfig(const std::string& module_name) const;
 
+    /// Returns the specified module; null if it's not loaded
+    std::shared_ptr<Module> getModule(const std::string& module_name) const;
+
+    /// Reload the external modules, and the configuration of the
+    /// modules, affected by the changed files; the modules that are
+    /// removed, or that fail to load, are unloaded. Called by the
+    /// modules watcher with the paths it reports.
+    void reloadExternalModules(const std::set<std::string>& changed_paths);
+
   private:
     /// Manages the lifecycle of non-blocking action jobs
     ThreadContainer thread_container_;
@@ -86,15 +99,26 @@ class RequestProcessor {
     /// non-blocking actions will be created
     const boost::filesystem::path spool_dir_path_;
 
-    /// Modules
+    /// Modules; an entry may be replaced by the modules watcher, so
+    /// that the actions in progress keep their own pointer to the
+    /// module they started with
     std::map<std::string, std::shared_ptr<Module>> modules_;
 
+    /// Where the external modules are stored
+    const std::string modules_dir_;
+
     /// Where the configuration files of modules are stored
     const std::string modules_config_dir_;
 
     /// Modules configuration
     std::map<std::string, leatherman::json_container::JsonContainer> modules_config_;
 
+    /// Guards modules_ and modules_config_
+    mutable PCPClient::Util::mutex modules_mutex_;
+
+    /// Reloads the external modules whose files change
+    std::unique_ptr<PCPClient::Util::thread> modules_watcher_thread_ptr_;
+
     /// To manage the spool purge task
     std::unique_ptr<PCPClient::Util::thread> purge_thread_ptr_;
     PCPClient::Util::mutex purge_mutex_;
@@ -104,6 +128,19 @@ class RequestProcessor {
     bool is_destructing_;
     const uint32_t max_message_size_;
 
+    /// Maximum number of worker processes of each external module
+    const uint32_t max_module_workers_;
+
+    /// Path of the external modules metadata cache; empty if disabled
+    const std::string modules_metadata_cache_;
+
+    /// Null if disabled
+    std::shared_ptr<ModuleMetadataCache> metadata_cache_;
+
+    /// Limits of the results of the external modules' actions
+    const uint64_t module_results_max_size_;
+    const uint32_t module_results_max_depth_;
+
     /// Resources to purge
     std::vector<std::shared_ptr<Util::Purgeable>> purgeables_;
 
@@ -128,6 +165,9 @@ class RequestProcessor {
     /// Load the modules configuration files
     void loadModulesConfiguration();
 
+    /// Load the configuration file of a module
+    void loadModuleConfiguration(const std::string& config_path);
+
     /// Register module in the module map
     void registerModule(std::shared_ptr<Module>);
 
@@ -140,6 +180,15 @@ class RequestProcessor {
     /// Load the external modules contained in the specified directory
     void loadExternalModulesFrom(boost::filesystem::path modules_dir_path);
 
+    /// Load the external module; returns null in case of failure,
+    /// after logging it
+    std::shared_ptr<ExternalModule> loadExternalModule(
+        const boost::filesystem::path& module_path);
+
+    /// Watch the modules and modules config directories for changes,
+    /// until the dtor is called
+    void watchModulesTask();
+
     /// Log the loaded modules
     void logLoadedModules() const;
 
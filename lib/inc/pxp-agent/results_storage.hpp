@@ -3,13 +3,20 @@
 
 #include <pxp-agent/action_output.hpp>
 #include <pxp-agent/util/purgeable.hpp>
+#include <pxp-agent/util/dir_handle.hpp>
+#include <pxp-agent/util/disk_quota.hpp>
 
 #include <leatherman/json_container/json_container.hpp>
 
+#include <cpp-pcp-client/util/thread.hpp>
+
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
+#include <memory>
 #include <string>
 #include <stdexcept>
 #include <functional>  // std::function
@@ -19,14 +26,38 @@ namespace PXPAgent {
 // NOTE(ale): possible execptions thrown while inspecting files are
 // propagated by ResultsStorage methods (more specifically, errors
 // raised by boost::filesystem::exists() are not filtered).
+//
+// The spool directory is kept open and the results files are
+// accessed relative to it (see Util::DirHandle), so that the spool
+// path is not resolved again for each file of each transaction. The
+// spool handle is reopened in case the directory gets removed.
+//
+// In case a quota is set, the size of the results directories is
+// tracked as the actions start and complete (see updateDiskUsage) and
+// the oldest results of completed actions are removed as soon as the
+// usage crosses the high-water mark (see Util::DiskQuota), regardless
+// of their TTL. The output of running actions is written by the
+// execution wrapper and only accounted once they complete, so the
+// quota can be exceeded while they run.
 class ResultsStorage final : public PXPAgent::Util::Purgeable {
   public:
     struct Error : public std::runtime_error {
         explicit Error(std::string const& msg) : std::runtime_error(msg) {}
     };
 
+    // Cumulative figures about the compressed output files.
+    struct CompressionStats {
+        uint64_t num_files;
+        uint64_t original_bytes;
+        uint64_t compressed_bytes;
+        uint64_t cpu_time_ms;
+    };
+
     ResultsStorage() = delete;
-    ResultsStorage(std::string spool_dir, std::string spool_dir_ttl);
+    ResultsStorage(std::string spool_dir,
+                   std::string spool_dir_ttl,
+                   bool compress_output = false,
+                   uint64_t quota_bytes = 0);
     ResultsStorage(const ResultsStorage&) = delete;
     ResultsStorage& operator=(const ResultsStorage&) = delete;
 
@@ -78,9 +109,45 @@ class ResultsStorage final : public PXPAgent::Util::Purgeable {
     //  - it fails to read a valid integer exit code.
     ActionOutput getOutput(const std::string& transaction_id);
 
-    // Same as above, but does not retrieve the exit code from file.
+    // Same as above, but does not retrieve the exit code from file
+    // and, unless get_stdout is set, leaves the stdout out (e.g. once
+    // it was checked with readStdoutChunks() and rejected).
     ActionOutput getOutput(const std::string& transaction_id,
-                           int exitcode);
+                           int exitcode,
+                           bool get_stdout = true);
+
+    // Passes the content of the stdout file of the specified
+    // transaction to the callback in chunks, as it's read, so that it
+    // can be checked without being loaded into memory.
+    // Returns false in case the file does not exist (e.g. it was
+    // compressed) or can't be read.
+    bool readStdoutChunks(const std::string& transaction_id,
+                          std::function<void(const char* data, size_t size)> callback);
+
+    // In case output compression is enabled, replaces the non-empty
+    // stdout and stderr files of the specified transaction with
+    // their gzip version (the getOutput functions transparently
+    // decompress them). Must be called once the action has completed
+    // and its output files won't be written anymore.
+    // Failures are logged and otherwise ignored; the uncompressed
+    // files are kept in that case.
+    void compressOutput(const std::string& transaction_id);
+
+    CompressionStats getCompressionStats() const;
+
+    // In case a quota is set, updates the disk usage with the size
+    // of the results directory of the specified transaction and, if
+    // the usage is now above the high-water mark, removes the results
+    // of the least recently completed actions (actions whose status is
+    // 'running' are skipped) until it drops below the low-water mark.
+    // Called as the action starts, to make room for its output, and
+    // once it has completed, as the output written meanwhile is not
+    // accounted.
+    // Failures are logged and otherwise ignored.
+    void updateDiskUsage(const std::string& transaction_id);
+
+    // Returns the disk usage tracked for the quota, in bytes.
+    uint64_t getDiskUsage();
 
     // Cleans up the spool directory by removing the results
     // directories that are older than the specified ttl and skipping
@@ -95,9 +162,41 @@ class ResultsStorage final : public PXPAgent::Util::Purgeable {
 
   private:
     boost::filesystem::path spool_dir_path_;
+    std::shared_ptr<Util::DirHandle> spool_dir_handle_;
+    PCPClient::Util::mutex spool_dir_handle_mutex_;
+    bool compress_output_;
+    std::atomic<uint64_t> num_compressed_files_;
+    std::atomic<uint64_t> original_bytes_;
+    std::atomic<uint64_t> compressed_bytes_;
+    std::atomic<uint64_t> compression_cpu_time_ms_;
+    Util::DiskQuota disk_quota_;
+    bool disk_usage_initialized_;
+    PCPClient::Util::mutex disk_quota_mutex_;
+
+    // Returns the handle on the spool directory, after (re)opening
+    // it if necessary, or nullptr in case the directory can't be
+    // opened (e.g. it does not exist yet).
+    std::shared_ptr<Util::DirHandle> getSpoolDir();
+
+    // Returns the handle on the results directory of the specified
+    // transaction or nullptr in case it can't be opened.
+    std::unique_ptr<Util::DirHandle> getResultsDir(const std::string& transaction_id);
 
     ActionOutput getOutput_(const std::string& transaction_id,
-                            bool get_exitcode);
+                            bool get_exitcode,
+                            bool get_stdout);
+
+    void compressOutputFile(const Util::DirHandle& results_dir,
+                            const std::string& name);
+
+    // The following functions must be called while holding the
+    // disk_quota_mutex_
+
+    // Computes the size of each results directory, the first time
+    // the usage is needed and after each purge.
+    void initializeDiskUsage(const Util::DirHandle& spool_dir);
+
+    void evictResults(const Util::DirHandle& spool_dir);
 };
 
 }  // namespace PXPAgent
@@ -22,6 +22,15 @@ struct CommandObject {
     std::function<void(size_t)> pid_callback;
 };
 
+// OutputLimit specifies how many bytes of the stdout and stderr of
+// non-blocking actions are stored; when a stream is larger than
+// head_bytes + tail_bytes, only its first head_bytes and last
+// tail_bytes are kept. No limit applies when both are zero.
+struct OutputLimit {
+    uint32_t head_bytes;
+    uint32_t tail_bytes;
+};
+
 // This module is a basis for PXP modules supporting bolt functionality
 class BoltModule : public PXPAgent::Module {
     public:
@@ -49,10 +58,19 @@ class BoltModule : public PXPAgent::Module {
         // Construct a CommandObject based on an ActionRequest - all inheriting classes must implement this method.
         virtual CommandObject buildCommandObject(const ActionRequest& request) = 0;
 
+        // The ModuleCacheDir entries used by the action, which are pinned
+        // while it runs so that they are not removed from the cache.
+        virtual std::vector<std::string> cacheEntries(const ActionRequest&) { return {}; }
+
+        /// Set the limit on the stored output of non-blocking actions;
+        /// requests can lower it through their 'output_limit' parameter.
+        void setOutputLimit(const OutputLimit& output_limit) { output_limit_ = output_limit; }
+
     protected:
         boost::filesystem::path exec_prefix_;
         std::shared_ptr<ResultsStorage> storage_;
         std::shared_ptr<ModuleCacheDir> module_cache_dir_;
+        OutputLimit output_limit_ { 0, 0 };
 
         // Execute a CommandObject synchronously
         virtual leatherman::execution::result run_sync(const CommandObject &cmd);
@@ -71,6 +89,13 @@ class BoltModule : public PXPAgent::Module {
                 ActionResponse &response);
 
         ActionResponse callAction(const ActionRequest& request) override;
+
+        // Write the output of an action that runs no command to the
+        // results_dir, as the execution wrapper would, and return it
+        static ActionOutput writeOutput(const boost::filesystem::path& results_dir,
+                                        const int exit_code,
+                                        const std::string& std_out,
+                                        const std::string& std_err);
 };
 
 }  // namespace Util
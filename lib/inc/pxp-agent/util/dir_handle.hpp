@@ -0,0 +1,98 @@
+#ifndef SRC_UTIL_DIR_HANDLE_HPP_
+#define SRC_UTIL_DIR_HANDLE_HPP_
+
+#include <boost/filesystem/operations.hpp>
+
+#include <string>
+#include <stdexcept>
+#include <functional>
+
+namespace PXPAgent {
+namespace Util {
+
+// Handle on an open directory.
+//
+// On POSIX platforms the directory is kept open for the lifetime of
+// the handle and its entries are accessed through the *at() system
+// calls (openat, fstatat, mkdirat, renameat), relative to the open
+// file descriptor; the directory path is resolved only once, when
+// the handle is created. On Windows, where there is no equivalent,
+// the entries are accessed by path through boost::filesystem.
+//
+// Entry names are expected to be simple file names (no separators).
+class DirHandle {
+  public:
+    struct Error : public std::runtime_error {
+        explicit Error(std::string const& msg) : std::runtime_error(msg) {}
+    };
+
+    DirHandle() = delete;
+    DirHandle(const DirHandle&) = delete;
+    DirHandle& operator=(const DirHandle&) = delete;
+
+    // Open the specified directory.
+    // Throw a DirHandle::Error in case it fails to open it.
+    explicit DirHandle(const std::string& dir_path);
+
+    // Open the 'name' sub-directory of the specified parent.
+    // Throw a DirHandle::Error in case it fails to open it.
+    DirHandle(const DirHandle& parent, const std::string& name);
+
+    ~DirHandle();
+
+    // The path of the directory, as provided when opened.
+    const std::string& path() const { return path_; }
+
+    // The path of the specified entry.
+    std::string entryPath(const std::string& name) const;
+
+    // Return true if the directory was removed after being opened,
+    // in which case the handle should be discarded and reopened.
+    bool isStale() const;
+
+    // Return true if the specified entry exists, false otherwise.
+    bool exists(const std::string& name) const;
+
+    // Return true if the specified entry exists and is a directory.
+    bool isDirectory(const std::string& name) const;
+
+    // Read the whole content of the specified file into 'content'.
+    // Return false in case the file does not exist or can't be read.
+    bool read(const std::string& name, std::string& content) const;
+
+    // Pass the content of the specified file to the callback in
+    // chunks, as it's read, without keeping it in memory.
+    // Return false in case the file does not exist or can't be read.
+    // Exceptions thrown by the callback are propagated.
+    bool readChunks(const std::string& name,
+                    std::function<void(const char* data, size_t size)> callback) const;
+
+    // Write the content to a temporary file and then rename it to
+    // the specified entry, so that readers never see a partial file.
+    // Throw a DirHandle::Error in case of failure.
+    void atomicWrite(const std::string& name,
+                     const std::string& content,
+                     boost::filesystem::perms perms) const;
+
+    // Create the specified sub-directory, if it does not exist, and
+    // set its permissions.
+    // Throw a DirHandle::Error in case of failure.
+    void createDirectory(const std::string& name,
+                         boost::filesystem::perms perms) const;
+
+    // Call the callback with the name of each sub-directory until
+    // the callback returns false.
+    // Throw a DirHandle::Error in case the directory can't be listed.
+    void eachSubdirectory(std::function<bool(const std::string& name)> callback) const;
+
+  private:
+    std::string path_;
+#ifndef _WIN32
+    int fd_;
+#endif
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_DIR_HANDLE_HPP_
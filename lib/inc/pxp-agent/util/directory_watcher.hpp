@@ -0,0 +1,63 @@
+#ifndef SRC_UTIL_DIRECTORY_WATCHER_HPP_
+#define SRC_UTIL_DIRECTORY_WATCHER_HPP_
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+namespace PXPAgent {
+namespace Util {
+
+// Reports the files created, written, removed, renamed or whose
+// permissions changed in a set of directories (not recursively).
+// Uses inotify on Linux; elsewhere, the directories are listed and the
+// fingerprints of their files compared periodically.
+//
+// The directories that don't exist when the watcher is created are
+// not watched.
+class DirectoryWatcher {
+  public:
+    struct Error : public std::runtime_error {
+        explicit Error(std::string const& msg) : std::runtime_error(msg) {}
+    };
+
+    // Changes are collected until none happened for this time, so that
+    // a file written in several steps is reported once
+    static const std::chrono::milliseconds SETTLE_TIME;
+
+    DirectoryWatcher() = delete;
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Throws a DirectoryWatcher::Error in case inotify can't be set up.
+    explicit DirectoryWatcher(const std::vector<std::string>& dir_paths);
+
+    ~DirectoryWatcher();
+
+    // Waits up to timeout for changes. Returns the paths of the changed
+    // files, made of the watched directory path and the file name, or
+    // none in case nothing changed meanwhile.
+    std::set<std::string> waitForChanges(std::chrono::milliseconds timeout);
+
+  private:
+    std::vector<std::string> dir_paths_;
+    // inotify descriptor and the directory of each watch; -1 when
+    // polling
+    int inotify_fd_;
+    std::map<int, std::string> watches_;
+    // Fingerprint of each file, when polling
+    std::map<std::string, std::string> snapshot_;
+
+    // Returns the changes that happened within timeout, without
+    // waiting for them to settle.
+    std::set<std::string> readChanges(std::chrono::milliseconds timeout);
+    std::map<std::string, std::string> takeSnapshot() const;
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_DIRECTORY_WATCHER_HPP_
@@ -0,0 +1,86 @@
+#ifndef SRC_UTIL_DISK_QUOTA_HPP_
+#define SRC_UTIL_DISK_QUOTA_HPP_
+
+#include <boost/filesystem/path.hpp>
+
+#include <map>
+#include <ctime>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+namespace PXPAgent {
+namespace Util {
+
+// Keeps track of the disk usage of a set of entries (e.g. the
+// results directories of the spool or the task cache directories),
+// so that the total can be checked against a byte quota without
+// walking the whole tree.
+//
+// Once the usage goes above the high-water mark, the owner is
+// expected to evict entries, least recently used first, until the
+// usage drops below the low-water mark; the gap between the two
+// avoids evicting on every new entry.
+//
+// This class is not thread safe.
+class DiskQuota {
+  public:
+    struct Error : public std::runtime_error {
+        explicit Error(std::string const& msg) : std::runtime_error(msg) {}
+    };
+
+    // Percentages of the quota
+    static const uint64_t HIGH_WATER_MARK;
+    static const uint64_t LOW_WATER_MARK;
+
+    // A quota of 0 bytes means no quota.
+    explicit DiskQuota(uint64_t quota_bytes);
+
+    bool enabled() const { return quota_bytes_ > 0; }
+    uint64_t quota() const { return quota_bytes_; }
+    uint64_t usage() const { return usage_bytes_; }
+
+    bool isAboveHighWaterMark() const;
+    bool isAboveLowWaterMark() const;
+
+    // Sets the size and the last use time of the specified entry,
+    // adding it in case it's not tracked yet.
+    void update(const std::string& name, uint64_t bytes, std::time_t last_use);
+
+    // Updates the last use time of the specified entry, if tracked.
+    void touch(const std::string& name, std::time_t last_use);
+
+    void remove(const std::string& name);
+
+    void clear();
+
+    // Returns the names of the tracked entries, least recently used
+    // first.
+    std::vector<std::string> entriesByLastUse() const;
+
+    // Returns the total size of the regular files in the specified
+    // directory and in its sub-directories; entries that can't be
+    // inspected (e.g. removed meanwhile) are ignored.
+    static uint64_t directorySize(const boost::filesystem::path& dir_path);
+
+    // Parses a size in bytes, optionally followed by one of the
+    // 'k', 'm', 'g' or 't' (binary) multiplier suffixes.
+    // Throws an Error in case of invalid value.
+    static uint64_t parseSize(const std::string& size_txt);
+
+  private:
+    struct Entry {
+        uint64_t bytes;
+        std::time_t last_use;
+    };
+
+    uint64_t quota_bytes_;
+    uint64_t usage_bytes_;
+    std::map<std::string, Entry> entries_;
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_DISK_QUOTA_HPP_
@@ -0,0 +1,39 @@
+#ifndef SRC_UTIL_FILE_FINGERPRINT_HPP_
+#define SRC_UTIL_FILE_FINGERPRINT_HPP_
+
+#include <string>
+#include <cstdint>
+
+namespace PXPAgent {
+namespace Util {
+
+// Cheap identity of a file's content, obtained with a single stat():
+// the file is assumed to be unchanged as long as its fingerprint
+// matches, as any write updates its modification and change times.
+// On Windows, where there's no change time nor inode, only the size
+// and the modification time are used.
+struct FileFingerprint {
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t inode;
+    uint64_t device;
+
+    bool operator==(const FileFingerprint& other) const;
+    bool operator!=(const FileFingerprint& other) const { return !(*this == other); }
+
+    // Space-separated values, as parsed by fromString().
+    std::string toString() const;
+
+    // Returns false in case the string is not a valid fingerprint.
+    static bool fromString(const std::string& txt, FileFingerprint& fingerprint);
+};
+
+// Gets the fingerprint of the specified file.
+// Returns false in case the file does not exist or can't be inspected.
+bool getFileFingerprint(const std::string& file_path, FileFingerprint& fingerprint);
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_FILE_FINGERPRINT_HPP_
@@ -0,0 +1,27 @@
+#ifndef SRC_UTIL_FILE_STAGING_HPP_
+#define SRC_UTIL_FILE_STAGING_HPP_
+
+#include <boost/filesystem/path.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+enum class StagingMethod { Reflink, KernelCopy, Copy };
+
+// Makes the content of the source file available at the destination,
+// which must not exist, avoiding to copy its data when possible: the
+// file is cloned (reflink, on Linux filesystems that support it). In
+// case it can't be (e.g. the two paths are on different filesystems),
+// the data is copied within the kernel (on Linux, with
+// copy_file_range or sendfile), and only as a last resort through a
+// buffer. The destination never shares the source's inode, so either
+// can be modified without affecting the other.
+// Returns the method used; throws a boost filesystem_error in case
+// the file can't be copied either.
+StagingMethod stageFile(const boost::filesystem::path& source,
+                        const boost::filesystem::path& destination);
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_FILE_STAGING_HPP_
@@ -0,0 +1,31 @@
+#ifndef SRC_UTIL_GZIP_HPP_
+#define SRC_UTIL_GZIP_HPP_
+
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+namespace PXPAgent {
+namespace Util {
+
+struct GzipError : public std::runtime_error {
+    explicit GzipError(std::string const& msg) : std::runtime_error(msg) {}
+};
+
+// Compresses the source file into the destination one, in gzip
+// format; both files are processed in chunks, so that the whole
+// content is never held in memory.
+// Returns the size in bytes of the source file.
+// Throws a GzipError in case of failure.
+uint64_t gzipFile(const std::string& src_path, const std::string& dst_path);
+
+// Decompresses the gzip file, chunk by chunk, appending its content
+// to 'content'.
+// Throws a GzipError in case the file can't be read or its content
+// is not valid gzip data.
+void gunzipFile(const std::string& src_path, std::string& content);
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_GZIP_HPP_
@@ -0,0 +1,98 @@
+#ifndef SRC_UTIL_HTTP_CLIENT_POOL_HPP_
+#define SRC_UTIL_HTTP_CLIENT_POOL_HPP_
+
+#include <cpp-pcp-client/util/thread.hpp>
+
+#include <curl/curl.h>
+
+#include <vector>
+#include <cstdint>
+
+namespace PXPAgent {
+namespace Util {
+
+// Pool of libcurl easy handles shared by the downloads of all the
+// modules. A handle returned to the pool keeps its open connections,
+// so that the next request to the same server reuses one (HTTP
+// keepalive) rather than doing a new TCP and TLS handshake. The
+// handles also share, through a curl share handle, their DNS cache
+// and their TLS sessions, so that new connections resume a previous
+// session. Connections are not shared, as libcurl does not support
+// sharing them between concurrent threads; the most recently used
+// handle is handed out first instead.
+//
+// The options of a handle are reset when it's returned to the pool,
+// so each request must set all the options it needs.
+class HttpClientPool {
+  public:
+    struct Stats {
+        uint64_t requests;
+        // Connections opened by the requests; the others reused an
+        // open connection, saving their TCP and TLS handshakes
+        uint64_t new_connections;
+
+        uint64_t handshakesSaved() const {
+            return requests > new_connections ? requests - new_connections : 0;
+        }
+    };
+
+    // Idle handles (and their connections) kept by default
+    static const size_t DEFAULT_MAX_IDLE_HANDLES;
+
+    // A handle borrowed from the pool, returned to it on destruction;
+    // it must not outlive the pool.
+    class Lease {
+      public:
+        Lease(HttpClientPool& pool, CURL* handle);
+        Lease(Lease&& other);
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        // nullptr in case a new handle could not be created
+        CURL* handle() const { return handle_; }
+
+      private:
+        HttpClientPool& pool_;
+        CURL* handle_;
+    };
+
+    explicit HttpClientPool(size_t max_idle_handles = DEFAULT_MAX_IDLE_HANDLES);
+    ~HttpClientPool();
+
+    HttpClientPool(const HttpClientPool&) = delete;
+    HttpClientPool& operator=(const HttpClientPool&) = delete;
+
+    // Returns an idle handle, or a new one if none is available.
+    Lease acquire();
+
+    // Accounts the last transfer performed with the handle in the
+    // stats; it should have completed, as failed connections are not
+    // counted as opened.
+    void recordTransfer(CURL* handle);
+
+    Stats stats();
+
+  private:
+    size_t max_idle_handles_;
+    CURLSH* share_;
+    std::vector<CURL*> idle_handles_;
+    PCPClient::Util::mutex idle_handles_mutex_;
+    Stats stats_;
+    PCPClient::Util::mutex stats_mutex_;
+    // One per curl_lock_data, used by the share handle callbacks
+    std::vector<PCPClient::Util::mutex> share_mutexes_;
+
+    void release(CURL* handle);
+
+    static void lockShared(CURL* handle, curl_lock_data data,
+                           curl_lock_access access, void* pool);
+    static void unlockShared(CURL* handle, curl_lock_data data, void* pool);
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_HTTP_CLIENT_POOL_HPP_
@@ -0,0 +1,107 @@
+#ifndef SRC_UTIL_JSON_STREAM_PARSER_HPP_
+#define SRC_UTIL_JSON_STREAM_PARSER_HPP_
+
+#include <cstddef>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+
+namespace PXPAgent {
+namespace Util {
+
+// Incremental, bounded checker of JSON text, such as the output of
+// an external module. The text is consumed in chunks, as it becomes
+// available, and is rejected as soon as it's known to be invalid or
+// to exceed the maximum size or nesting depth, without keeping any
+// of it. Once the whole text is accepted, it can be parsed into a
+// DOM knowing that the parse will succeed and stay within the limits.
+//
+// It follows the grammar accepted by rapidjson with its default
+// flags: a single value of any type, no comments, no NaN or
+// Infinity, and no validation of the string encoding.
+class JsonStreamParser {
+  public:
+    struct Error : public std::runtime_error {
+        explicit Error(std::string const& msg) : std::runtime_error(msg) {}
+    };
+
+    // The text exceeds the maximum size or nesting depth
+    struct LimitError : public Error {
+        explicit LimitError(std::string const& msg) : Error(msg) {}
+    };
+
+    // A limit set to 0 is not enforced.
+    explicit JsonStreamParser(uint64_t max_size = 0,
+                              uint32_t max_depth = 0);
+
+    // Consumes the next chunk of the text.
+    // Throws a LimitError in case the text exceeds a limit, or an
+    // Error in case it's invalid JSON; the following calls throw too.
+    void feed(const char* data, size_t size);
+    void feed(const std::string& chunk) { feed(chunk.data(), chunk.size()); }
+
+    // Checks the total size of the text upfront, when it's known,
+    // so that a text that is too large is rejected before being read.
+    // Throws a LimitError in case it exceeds the maximum size.
+    void checkSize(uint64_t total_size);
+
+    // To be called once the whole text was consumed.
+    // Throws an Error in case the text is incomplete or has no value.
+    void finish();
+
+    // Number of bytes consumed so far.
+    uint64_t size() const { return offset_; }
+
+  private:
+    enum class State {
+        Value,              // expecting a value
+        ArrayFirst,         // after '[': a value or ']'
+        ObjectFirst,        // after '{': a key or '}'
+        Key,                // after ',' in an object
+        Colon,              // after a key
+        AfterValue,         // after a value in a container: ',' or its end
+        Done,               // after the root value: whitespace only
+        String,
+        StringEscape,
+        StringUnicode,
+        SurrogateBackslash, // after a high surrogate: "\u" and a low one
+        SurrogateU,
+        Literal,            // true, false or null
+        NumberMinus,
+        NumberZero,
+        NumberInt,
+        NumberDot,
+        NumberFrac,
+        NumberExp,
+        NumberExpSign,
+        NumberExpDigits
+    };
+
+    uint64_t max_size_;
+    uint32_t max_depth_;
+    uint64_t offset_;
+    State state_;
+    // '{' or '[' for each open container
+    std::string containers_;
+    bool string_is_key_;
+    bool expect_low_surrogate_;
+    unsigned int hex_digits_;
+    unsigned int code_unit_;
+    const char* literal_;
+    size_t literal_pos_;
+    std::string error_;
+
+    // Returns false in case the character ends a number and must be
+    // consumed again in the new state.
+    bool consume(char c);
+    void startValue(char c);
+    void endValue();
+    void openContainer(char c);
+    void closeContainer(char c);
+    [[noreturn]] void fail(const std::string& reason);
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_JSON_STREAM_PARSER_HPP_
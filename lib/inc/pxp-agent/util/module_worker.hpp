@@ -0,0 +1,69 @@
+#ifndef SRC_UTIL_MODULE_WORKER_HPP_
+#define SRC_UTIL_MODULE_WORKER_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+
+namespace PXPAgent {
+namespace Util {
+
+// Long-lived process of an external module, started with the "worker"
+// argument, that reads requests on its stdin and writes a response to
+// each on its stdout, one line each (see ModuleWorkerPool for the
+// protocol). Its stdin and stdout are the two ends of a socket pair, so
+// that writing to a process that exited fails rather than raising
+// SIGPIPE; its stderr is discarded. The process is expected to exit
+// once its stdin is closed.
+//
+// Workers are only supported on POSIX platforms; on Windows the
+// constructor always throws.
+class ModuleWorker {
+  public:
+    struct Error : public std::runtime_error {
+        explicit Error(std::string const& msg) : std::runtime_error(msg) {}
+    };
+
+    ModuleWorker() = delete;
+    ModuleWorker(const ModuleWorker&) = delete;
+    ModuleWorker& operator=(const ModuleWorker&) = delete;
+
+    // Starts the process.
+    // Throws a ModuleWorker::Error in case it can't be started.
+    explicit ModuleWorker(const std::string& exec_path);
+
+    // Closes the stdin of the process and waits up to a second for it
+    // to exit, before killing it.
+    ~ModuleWorker();
+
+    int pid() const { return pid_; }
+
+    // Returns false once the process has exited.
+    bool isRunning();
+
+    // Writes the line, followed by a newline.
+    // Throws a ModuleWorker::Error in case it can't be written (e.g.
+    // the process exited).
+    void writeLine(const std::string& line);
+
+    // Returns the next line written by the process, without its
+    // newline. Throws a ModuleWorker::Error in case the process closed
+    // its stdout (e.g. it exited), in case, unless timeout is zero, it
+    // did not write a whole line meanwhile or in case, unless max_size
+    // is zero, the line is longer than max_size bytes; the line is not
+    // read any further then.
+    std::string readLine(std::chrono::milliseconds timeout, size_t max_size = 0);
+
+  private:
+    int pid_;
+    int fd_;
+    bool exited_;
+    // What was read after the last line returned
+    std::string buffer_;
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_MODULE_WORKER_HPP_
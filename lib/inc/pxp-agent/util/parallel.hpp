@@ -0,0 +1,21 @@
+#ifndef SRC_UTIL_PARALLEL_HPP_
+#define SRC_UTIL_PARALLEL_HPP_
+
+#include <cstddef>
+#include <functional>
+
+namespace PXPAgent {
+namespace Util {
+
+// Calls run_item for each of the num_items items, with up to
+// max_parallel threads (including the calling one) taking the items in
+// order. The first error stops running further items and is rethrown
+// once the items in progress are done.
+void runInParallel(size_t num_items,
+                   size_t max_parallel,
+                   std::function<void(size_t item_idx)> run_item);
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_PARALLEL_HPP_
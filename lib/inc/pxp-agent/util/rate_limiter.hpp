@@ -0,0 +1,46 @@
+#ifndef SRC_UTIL_RATE_LIMITER_HPP_
+#define SRC_UTIL_RATE_LIMITER_HPP_
+
+#include <cpp-pcp-client/util/thread.hpp>
+
+#include <chrono>
+#include <cstdint>
+
+namespace PXPAgent {
+namespace Util {
+
+// Limits the rate at which bytes are consumed, e.g. received by the
+// concurrent downloads, to a number of bytes per second shared by all
+// the callers; up to one second worth of bytes can be consumed at once
+// after an idle period.
+//
+// This class is thread safe.
+class RateLimiter {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    // A limit of 0 bytes per second disables the limiter.
+    explicit RateLimiter(uint64_t bytes_per_second);
+
+    // Returns how long the caller must wait before consuming the
+    // specified number of bytes, and accounts for them; the bytes of
+    // the callers that wait are accounted in turn, so that they are
+    // served in order.
+    clock::duration reserve(uint64_t bytes, clock::time_point now = clock::now());
+
+    // Waits until the specified number of bytes can be consumed.
+    void consume(uint64_t bytes);
+
+    uint64_t bytesPerSecond() const { return bytes_per_second_; }
+
+  private:
+    uint64_t bytes_per_second_;
+    // Time at which all the reserved bytes will have been consumed
+    clock::time_point available_at_;
+    PCPClient::Util::mutex mutex_;
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_RATE_LIMITER_HPP_
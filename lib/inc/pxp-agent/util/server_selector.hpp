@@ -0,0 +1,86 @@
+#ifndef SRC_UTIL_SERVER_SELECTOR_HPP_
+#define SRC_UTIL_SERVER_SELECTOR_HPP_
+
+#include <cpp-pcp-client/util/thread.hpp>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace PXPAgent {
+namespace Util {
+
+// Keeps the health and the latency of the servers files are
+// downloaded from, so that the fastest healthy server is tried first.
+//
+// The latency of a server is a moving average of the time to the
+// first byte of its responses. A server that fails is ejected for a
+// while, doubling at each consecutive failure (see EJECTION_BASE and
+// EJECTION_MAX); ejected servers are still tried, but only after the
+// healthy ones. Healthy servers that were never used are tried before
+// the measured ones, so that their latency gets known.
+//
+// A server that is overloaded can ask for the requests to be retried
+// later (e.g. with the Retry-After header of a 429 or 503 response);
+// it's ejected at least until then, and it's not tried meanwhile (see
+// retryAfter).
+//
+// This class is thread safe.
+class ServerSelector {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static const clock::duration EJECTION_BASE;
+    static const clock::duration EJECTION_MAX;
+
+    // Returns the specified servers, the healthy ones first, fastest
+    // first, then the ejected ones, the ones to be restored first
+    // first; the configuration order is kept for ties.
+    std::vector<std::string> order(const std::vector<std::string>& servers,
+                                   clock::time_point now = clock::now());
+
+    void recordSuccess(const std::string& server,
+                       std::chrono::milliseconds time_to_first_byte);
+
+    // The retry_after hint of the server, if any, is capped to
+    // EJECTION_MAX.
+    void recordFailure(const std::string& server,
+                       clock::time_point now = clock::now(),
+                       clock::duration retry_after = clock::duration::zero());
+
+    // Returns true if the server is ejected.
+    bool isEjected(const std::string& server,
+                   clock::time_point now = clock::now());
+
+    // Returns how long the server asked for its requests to be held
+    // off; zero if it did not.
+    clock::duration retryAfter(const std::string& server,
+                               clock::time_point now = clock::now());
+
+  private:
+    struct Health {
+        // Moving average of the time to first byte; negative if never
+        // measured
+        double latency_ms;
+        unsigned int consecutive_failures;
+        clock::time_point ejected_until;
+        clock::time_point retry_after_until;
+    };
+
+    std::map<std::string, Health> servers_;
+    PCPClient::Util::mutex servers_mutex_;
+};
+
+// Returns the time to wait before the specified retry attempt
+// (starting from 1): an exponential backoff from base, capped at max,
+// with a random jitter of up to half of it, so that the agents that
+// failed at once don't retry at once.
+std::chrono::milliseconds jitteredBackoff(unsigned int attempt,
+                                          std::chrono::milliseconds base,
+                                          std::chrono::milliseconds max);
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_SERVER_SELECTOR_HPP_
@@ -0,0 +1,34 @@
+#ifndef SRC_UTIL_SHA256_HPP_
+#define SRC_UTIL_SHA256_HPP_
+
+#include <string>
+#include <cstddef>
+
+namespace PXPAgent {
+namespace Util {
+
+// Incremental SHA-256 digest, so that data can be hashed chunk by
+// chunk as it's read or received, without a further pass over it.
+class Sha256 {
+  public:
+    Sha256();
+    ~Sha256();
+
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    void update(const char* data, size_t size);
+
+    // Returns the lower case hex digest of the data hashed so far;
+    // no further data can be hashed afterwards.
+    std::string hexDigest();
+
+  private:
+    // EVP_MD_CTX, not exposed to avoid including the OpenSSL headers
+    void* ctx_;
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_SHA256_HPP_
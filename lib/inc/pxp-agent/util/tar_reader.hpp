@@ -0,0 +1,96 @@
+#ifndef SRC_UTIL_TAR_READER_HPP_
+#define SRC_UTIL_TAR_READER_HPP_
+
+#include <boost/nowide/fstream.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+namespace PXPAgent {
+namespace Util {
+
+struct TarError : public std::runtime_error {
+    explicit TarError(std::string const& msg) : std::runtime_error(msg) {}
+};
+
+// Reads the entries of a tar archive (ustar, with the GNU long names
+// and the pax path records), optionally gzip compressed, one after
+// the other; the archive is read in chunks, from a file or from any
+// other source (e.g. a download in progress), so that neither the whole
+// archive nor an entry is ever held in memory.
+//
+// Only the path, the size and the type of the entries are read; their
+// owners, permissions and times are ignored.
+class TarReader {
+  public:
+    struct Entry {
+        // Without any leading "./"
+        std::string path;
+        uint64_t size;
+        bool is_file;
+        bool is_directory;
+    };
+
+    // Returns up to size bytes of the archive, 0 at its end; it may
+    // throw, in which case the error is passed on to the caller of
+    // next() or read().
+    using Source = std::function<size_t(char* buffer, size_t size)>;
+
+    // Throws a TarError in case the file can't be opened.
+    explicit TarReader(const std::string& archive_path);
+
+    // Reads the archive from the source; archive_name is only used in
+    // the error messages.
+    TarReader(std::string archive_name, Source source);
+
+    ~TarReader();
+
+    TarReader(const TarReader&) = delete;
+    TarReader& operator=(const TarReader&) = delete;
+
+    // Moves to the next entry, skipping what was not read of the
+    // current one. Returns false at the end of the archive.
+    // Throws a TarError in case the archive is not valid.
+    bool next(Entry& entry);
+
+    // Reads up to size bytes of the current entry's content; returns
+    // the number of bytes read, 0 once the whole content was read.
+    // Throws a TarError in case the archive is truncated.
+    size_t read(char* buffer, size_t size);
+
+  private:
+    std::string archive_name_;
+    // Only for the archives read from a file
+    std::unique_ptr<boost::nowide::ifstream> ifs_;
+    Source source_;
+    // z_stream, not exposed to avoid including the zlib header; null
+    // if the archive is not compressed
+    void* zstrm_;
+    // What was read from the source and not consumed yet
+    std::vector<char> in_buffer_;
+    size_t in_pos_;
+    size_t in_size_;
+    bool z_stream_end_;
+    uint64_t remaining_;
+    uint64_t padding_;
+
+    // Detects the compression of the archive
+    void init();
+    // Reads more of the source into the input buffer; returns false
+    // at its end.
+    bool fillInput();
+    // Reads exactly size bytes of the (decompressed) archive; returns
+    // false in case it ends before.
+    bool readArchive(char* buffer, size_t size);
+    void skip(uint64_t size);
+    std::string readContent(uint64_t size);
+};
+
+}  // namespace Util
+}  // namespace PXPAgent
+
+#endif  // SRC_UTIL_TAR_READER_HPP_
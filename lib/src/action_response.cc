@@ -266,13 +266,28 @@ lth_jc::JsonContainer ActionResponse::toJSON(R_T response_type) const
                 }
             }
 
-            if (!action_results.includes("stdout") && !output.std_out.empty())
-                action_results.set<std::string>("stdout", output.std_out);
-            if (!output.std_err.empty())
-                action_results.set<std::string>("stderr", output.std_err);
+            bool has_error_stdout { action_results.includes("stdout") };
+            // NB: the sizes are set as double, as they may not fit an int
+            if (output.std_out_total_bytes > 0) {
+                action_results.set<bool>("stdout_truncated", true);
+                action_results.set<double>("stdout_total_bytes",
+                    static_cast<double>(output.std_out_total_bytes));
+            }
+            if (output.std_err_total_bytes > 0) {
+                action_results.set<bool>("stderr_truncated", true);
+                action_results.set<double>("stderr_total_bytes",
+                    static_cast<double>(output.std_err_total_bytes));
+            }
 
             r.set<lth_jc::JsonContainer>(RESULTS, action_results);
 
+            // Set the output directly on the response, rather than
+            // on action_results, so that it's not copied twice
+            if (!has_error_stdout && !output.std_out.empty())
+                r.set<std::string>({ RESULTS, "stdout" }, output.std_out);
+            if (!output.std_err.empty())
+                r.set<std::string>({ RESULTS, "stderr" }, output.std_err);
+
             break;
         }
         case (R_T::RPCError):
@@ -1,5 +1,6 @@
 #include <pxp-agent/configuration.hpp>
 #include <pxp-agent/time.hpp>
+#include <pxp-agent/util/disk_quota.hpp>
 
 #include "version-inl.hpp"
 
@@ -103,6 +104,7 @@ namespace lth_util = leatherman::util;
     static fs::path log_dir() { return sys_dir() / "var" / "log"; }
     static std::string spool_dir() { return (sys_dir() / "var" / "spool").string(); }
     static std::string cache_dir() { return (sys_dir() / "tasks-cache").string(); }
+    static std::string metadata_cache() { return (sys_dir() / "modules-metadata.json").string(); }
 #else
     static const fs::path DATA_DIR = []() {
         if (getuid()) {
@@ -126,6 +128,7 @@ namespace lth_util = leatherman::util;
     static fs::path log_dir()      { return "/var/log/puppetlabs/pxp-agent"; }
     static std::string spool_dir() { return "/opt/puppetlabs/pxp-agent/spool"; }
     static std::string cache_dir() { return "/opt/puppetlabs/pxp-agent/tasks-cache"; }
+    static std::string metadata_cache() { return "/opt/puppetlabs/pxp-agent/modules-metadata.json"; }
 #endif
 
 // DATA_DIR defines the non-root data directory. Functions define the system default.
@@ -135,6 +138,8 @@ const std::string DEFAULT_SPOOL_DIR { DATA_DIR.empty() ?
     spool_dir() : (DATA_DIR / "opt" / "pxp-agent" / "spool").string() };
 static const std::string DEFAULT_TASK_CACHE_DIR { DATA_DIR.empty() ?
     cache_dir() : (DATA_DIR / "opt" / "pxp-agent" / "tasks-cache").string() };
+static const std::string DEFAULT_MODULES_METADATA_CACHE { DATA_DIR.empty() ?
+    metadata_cache() : (DATA_DIR / "opt" / "pxp-agent" / "modules-metadata.json").string() };
 
 static const std::string DEFAULT_LOG_FILE { (DEFAULT_LOG_DIR / "pxp-agent.log").string() };
 static const std::string DEFAULT_PCP_ACCESS_FILE { (DEFAULT_LOG_DIR / "pcp-access.log").string() };
@@ -463,6 +468,20 @@ const Configuration::Agent& Configuration::getAgentConfiguration() const
         static_cast<uint32_t >(HW::GetFlag<int>("task-download-connect-timeout")),
         static_cast<uint32_t >(HW::GetFlag<int>("task-download-timeout")),
         HW::GetFlag<uint32_t>("max-message-size"),
+        static_cast<uint32_t >(HW::GetFlag<int>("output-limit-head")),
+        static_cast<uint32_t >(HW::GetFlag<int>("output-limit-tail")),
+        HW::GetFlag<bool>("spool-dir-compress-output"),
+        Util::DiskQuota::parseSize(HW::GetFlag<std::string>("spool-dir-quota")),
+        Util::DiskQuota::parseSize(HW::GetFlag<std::string>("task-cache-dir-quota")),
+        static_cast<uint32_t >(HW::GetFlag<int>("task-download-concurrency")),
+        HW::GetFlag<std::string>("task-cache-dir-reverify-ttl"),
+        Util::DiskQuota::parseSize(HW::GetFlag<std::string>("task-download-rate-limit")),
+        static_cast<uint32_t >(HW::GetFlag<int>("task-download-splay")),
+        static_cast<uint32_t >(HW::GetFlag<int>("file-download-parallelism")),
+        static_cast<uint32_t >(HW::GetFlag<int>("module-workers")),
+        HW::GetFlag<std::string>("modules-metadata-cache"),
+        Util::DiskQuota::parseSize(HW::GetFlag<std::string>("module-results-max-size")),
+        static_cast<uint32_t >(HW::GetFlag<int>("module-results-max-depth")),
         string_to_log_level(HW::GetFlag<std::string>("loglevel")) };
     return agent_configuration_;
 }
@@ -646,6 +665,100 @@ void Configuration::defineDefaultValues()
                     Types::Int,
                     30*60) } });
 
+    defaults_.insert(
+        Option { "task-download-concurrency",
+                 Base_ptr { new Entry<int>(
+                    "task-download-concurrency",
+                    "",
+                    lth_loc::translate("Maximum number of task, script and file downloads "
+                                       "in progress at once, default: 4 (0 for no limit)"),
+                    Types::Int,
+                    4) } });
+
+    defaults_.insert(
+        Option { "task-download-rate-limit",
+                 Base_ptr { new Entry<std::string>(
+                    "task-download-rate-limit",
+                    "",
+                    lth_loc::translate("Maximum bytes per second received by all the task, "
+                                       "script and file downloads together, with a k, m or "
+                                       "g suffix, default: 0 (no limit)"),
+                    Types::String,
+                    "0") } });
+
+    defaults_.insert(
+        Option { "task-download-splay",
+                 Base_ptr { new Entry<int>(
+                    "task-download-splay",
+                    "",
+                    lth_loc::translate("Maximum random delay, in seconds, before downloading "
+                                       "a file that is not cached, default: 0 (no delay)"),
+                    Types::Int,
+                    0) } });
+
+    defaults_.insert(
+        Option { "file-download-parallelism",
+                 Base_ptr { new Entry<int>(
+                    "file-download-parallelism",
+                    "",
+                    lth_loc::translate("Maximum number of entries of a file download request "
+                                       "placed at once, default: 8"),
+                    Types::Int,
+                    8) } });
+
+    defaults_.insert(
+        Option { "module-workers",
+                 Base_ptr { new Entry<int>(
+                    "module-workers",
+                    "",
+                    lth_loc::translate("Maximum number of worker processes of each external "
+                                       "module that supports them, default: 2 (0 disables them)"),
+                    Types::Int,
+                    2) } });
+
+    defaults_.insert(
+        Option { "module-results-max-size",
+                 Base_ptr { new Entry<std::string>(
+                    "module-results-max-size",
+                    "",
+                    lth_loc::translate("Maximum size of the JSON results of external module "
+                                       "actions, in bytes or with a k, m, g or t suffix, "
+                                       "default: 64m (0 for no limit)"),
+                    Types::String,
+                    "64m") } });
+
+    defaults_.insert(
+        Option { "module-results-max-depth",
+                 Base_ptr { new Entry<int>(
+                    "module-results-max-depth",
+                    "",
+                    lth_loc::translate("Maximum nesting depth of the JSON results of external "
+                                       "module actions, default: 0 (no limit)"),
+                    Types::Int,
+                    0) } });
+
+    defaults_.insert(
+        Option { "output-limit-head",
+                 Base_ptr { new Entry<int>(
+                    "output-limit-head",
+                    "",
+                    lth_loc::translate("Bytes kept from the start of the stdout and stderr "
+                                       "of non-blocking tasks, commands and scripts that "
+                                       "exceed the output limit, default: 0 (no limit)"),
+                    Types::Int,
+                    0) } });
+
+    defaults_.insert(
+        Option { "output-limit-tail",
+                 Base_ptr { new Entry<int>(
+                    "output-limit-tail",
+                    "",
+                    lth_loc::translate("Bytes kept from the end of the stdout and stderr "
+                                       "of non-blocking tasks, commands and scripts that "
+                                       "exceed the output limit, default: 0 (no limit)"),
+                    Types::Int,
+                    0) } });
+
     defaults_.insert(
         Option { "ssl-ca-cert",
                  Base_ptr { new Entry<std::string>(
@@ -755,6 +868,17 @@ void Configuration::defineDefaultValues()
                     Types::String,
                     DEFAULT_MODULES_CONF_DIR) } });
 
+    defaults_.insert(
+        Option { "modules-metadata-cache",
+                 Base_ptr { new Entry<std::string>(
+                    "modules-metadata-cache",
+                    "",
+                    lth_loc::format("External modules metadata cache file, empty to "
+                                    "always run the modules, default: {1}",
+                                    DEFAULT_MODULES_METADATA_CACHE),
+                    Types::String,
+                    DEFAULT_MODULES_METADATA_CACHE) } });
+
     defaults_.insert(
         Option { "task-cache-dir",
                  Base_ptr { new Entry<std::string>(
@@ -786,6 +910,48 @@ void Configuration::defineDefaultValues()
                     Types::String,
                     DEFAULT_DIR_PURGE_TTL) } });
 
+    defaults_.insert(
+        Option { "task-cache-dir-reverify-ttl",
+                 Base_ptr { new Entry<std::string>(
+                    "task-cache-dir-reverify-ttl",
+                    "",
+                    lth_loc::translate("TTL for the verification of cached files before "
+                                       "being hashed again, default: '0d' (never)"),
+                    Types::String,
+                    "0d") } });
+
+    defaults_.insert(
+        Option { "spool-dir-compress-output",
+                 Base_ptr { new Entry<bool>(
+                    "spool-dir-compress-output",
+                    "",
+                    lth_loc::translate("Compress the output of completed actions "
+                                       "stored in the spool directory, default: false"),
+                    Types::Bool,
+                    false) } });
+
+    defaults_.insert(
+        Option { "spool-dir-quota",
+                 Base_ptr { new Entry<std::string>(
+                    "spool-dir-quota",
+                    "",
+                    lth_loc::translate("Maximum disk space for action results, in bytes "
+                                       "or with a k, m, g or t suffix; the oldest results "
+                                       "are removed when exceeded, default: 0 (no quota)"),
+                    Types::String,
+                    "0") } });
+
+    defaults_.insert(
+        Option { "task-cache-dir-quota",
+                 Base_ptr { new Entry<std::string>(
+                    "task-cache-dir-quota",
+                    "",
+                    lth_loc::translate("Maximum disk space for cached tasks, in bytes "
+                                       "or with a k, m, g or t suffix; the least recently "
+                                       "used are removed when exceeded, default: 0 (no quota)"),
+                    Types::String,
+                    "0") } });
+
     defaults_.insert(
         Option { "task-cache-dir-purge-ttl",
                  Base_ptr { new Entry<std::string>(
@@ -797,6 +963,17 @@ void Configuration::defineDefaultValues()
                     Types::String,
                     DEFAULT_DIR_PURGE_TTL) } });
 
+    defaults_.insert(
+        Option { "import-task-cache-bundle",
+                 Base_ptr { new Entry<std::string>(
+                    "import-task-cache-bundle",
+                    "",
+                    lth_loc::translate("Import the files of the specified bundle, a tar "
+                                       "archive of <sha256>/<filename> entries, into the "
+                                       "tasks cache directory and exit"),
+                    Types::String,
+                    "") } });
+
     defaults_.insert(
         Option { "broker-ws-proxy",
                  Base_ptr { new Entry<std::string>(
@@ -1154,6 +1331,25 @@ void Configuration::validateAndNormalizeOtherSettings()
         check_and_create_dir(val_path, option.first, option.second);
     }
 
+    auto metadata_cache = HW::GetFlag<std::string>("modules-metadata-cache");
+    if (!metadata_cache.empty()) {
+        metadata_cache = lth_file::tilde_expand(metadata_cache);
+        if (fs::is_directory(metadata_cache))
+            throw Configuration::Error {
+                lth_loc::format("the modules-metadata-cache '{1}' is a directory",
+                                metadata_cache) };
+        HW::SetFlag<std::string>("modules-metadata-cache", metadata_cache);
+    }
+
+    auto bundle = HW::GetFlag<std::string>("import-task-cache-bundle");
+    if (!bundle.empty()) {
+        bundle = lth_file::tilde_expand(bundle);
+        if (!fs::is_regular_file(bundle))
+            throw Configuration::Error {
+                lth_loc::format("the import-task-cache-bundle '{1}' is not a file", bundle) };
+        HW::SetFlag<std::string>("import-task-cache-bundle", bundle);
+    }
+
     fs::path spool_dir_path = HW::GetFlag<std::string>("spool-dir");
     fs::path tmp_path;
     do {
@@ -1191,7 +1387,9 @@ void Configuration::validateAndNormalizeOtherSettings()
     }
 #endif
 
-    for (auto purge_ttl : {"spool-dir-purge-ttl", "task-cache-dir-purge-ttl"}) {
+    for (auto purge_ttl : {"spool-dir-purge-ttl",
+                           "task-cache-dir-purge-ttl",
+                           "task-cache-dir-reverify-ttl"}) {
         try {
             Timestamp(HW::GetFlag<std::string>(purge_ttl));
         } catch (const Timestamp::Error& e) {
@@ -1201,11 +1399,31 @@ void Configuration::validateAndNormalizeOtherSettings()
         }
     }
 
+    for (auto quota : {"spool-dir-quota",
+                       "task-cache-dir-quota",
+                       "task-download-rate-limit",
+                       "module-results-max-size"}) {
+        try {
+            Util::DiskQuota::parseSize(HW::GetFlag<std::string>(quota));
+        } catch (const Util::DiskQuota::Error& e) {
+            throw Configuration::Error {
+                // LOCALE: invalid configuration option
+                lth_loc::format("invalid {1}: {2}", quota, e.what()) };
+        }
+    }
+
     for (auto msg_ttl : {"association-timeout",
                          "association-request-ttl",
                          "pcp-message-ttl",
                          "task-download-connect-timeout",
-                         "task-download-timeout"}) {
+                         "task-download-timeout",
+                         "task-download-concurrency",
+                         "task-download-splay",
+                         "file-download-parallelism",
+                         "module-workers",
+                         "module-results-max-depth",
+                         "output-limit-head",
+                         "output-limit-tail"}) {
         if (HW::GetFlag<int>(msg_ttl) < 0)
             throw Configuration::Error {
                 lth_loc::format("{1} must be positive", msg_ttl) };
@@ -2,6 +2,7 @@
 #include <pxp-agent/module_type.hpp>
 #include <pxp-agent/action_output.hpp>
 #include <pxp-agent/configuration.hpp>
+#include <pxp-agent/util/json_stream_parser.hpp>
 
 #include <leatherman/execution/execution.hpp>
 
@@ -34,6 +35,15 @@ static const std::string ACTION_SCHEMA_NAME { "action_metadata" };
 
 static const std::string METADATA_CONFIGURATION_ENTRY { "configuration" };
 static const std::string METADATA_ACTIONS_ENTRY { "actions" };
+static const std::string METADATA_WORKER_ENTRY { "worker" };
+
+// Number of actions after which a worker is replaced, unless the
+// module's metadata says otherwise
+static const int DEFAULT_MAX_WORKER_REQUESTS { 100 };
+
+// Seconds after which a worker that did not answer an action is
+// replaced, unless the module's metadata says otherwise
+static const int DEFAULT_WORKER_ACTION_TIMEOUT { 600 };
 
 static const int EXTERNAL_MODULE_FILE_ERROR_EC { 5 };
 
@@ -58,6 +68,7 @@ PCPClient::Validator getMetadataValidator()
     metadata_schema.addConstraint("description", T_C::String, true);
     metadata_schema.addConstraint(METADATA_CONFIGURATION_ENTRY, T_C::Object, false);
     metadata_schema.addConstraint(METADATA_ACTIONS_ENTRY, T_C::Array, true);
+    metadata_schema.addConstraint(METADATA_WORKER_ENTRY, T_C::Object, false);
 
     // 'actions' is an array of actions; define the action sub_schema
     PCPClient::Schema action_schema { ACTION_SCHEMA_NAME,
@@ -80,14 +91,20 @@ PCPClient::Validator getMetadataValidator()
 
 ExternalModule::ExternalModule(const std::string& path,
                                const lth_jc::JsonContainer& config,
-                               std::shared_ptr<ResultsStorage> storage)
+                               std::shared_ptr<ResultsStorage> storage,
+                               uint32_t max_workers,
+                               std::shared_ptr<ModuleMetadataCache> metadata_cache)
         : path_ { path },
           config_ { config },
-          storage_ { std::move(storage) }
+          storage_ { std::move(storage) },
+          worker_pool_ {},
+          metadata_cached_ { false },
+          results_max_size_ { 0 },
+          results_max_depth_ { 0 }
 {
     fs::path module_path { path };
     module_name = module_path.stem().string();
-    auto metadata = getModuleMetadata();
+    auto metadata = getModuleMetadata(metadata_cache);
 
     try {
         if (metadata.includes(METADATA_CONFIGURATION_ENTRY)) {
@@ -98,6 +115,7 @@ ExternalModule::ExternalModule(const std::string& path,
         }
 
         registerActions(metadata);
+        registerWorkers(metadata, max_workers);
     } catch (lth_jc::data_error& e) {
         LOG_ERROR("Failed to retrieve metadata of module {1}: {2}",
                   module_name, e.what());
@@ -107,17 +125,24 @@ ExternalModule::ExternalModule(const std::string& path,
 }
 
 ExternalModule::ExternalModule(const std::string& path,
-                               std::shared_ptr<ResultsStorage> storage)
+                               std::shared_ptr<ResultsStorage> storage,
+                               uint32_t max_workers,
+                               std::shared_ptr<ModuleMetadataCache> metadata_cache)
         : path_ { path },
           config_ { "{}" },
-          storage_ { std::move(storage) }
+          storage_ { std::move(storage) },
+          worker_pool_ {},
+          metadata_cached_ { false },
+          results_max_size_ { 0 },
+          results_max_depth_ { 0 }
 {
     fs::path module_path { path };
     module_name = module_path.stem().string();
-    auto metadata = getModuleMetadata();
+    auto metadata = getModuleMetadata(metadata_cache);
 
     try {
        registerActions(metadata);
+       registerWorkers(metadata, max_workers);
     } catch (lth_jc::data_error& e) {
         LOG_ERROR("Failed to retrieve metadata of module {1}: {2}",
                   module_name, e.what());
@@ -126,6 +151,12 @@ ExternalModule::ExternalModule(const std::string& path,
     }
 }
 
+void ExternalModule::setResultsLimits(uint64_t max_size, uint32_t max_depth)
+{
+    results_max_size_ = max_size;
+    results_max_depth_ = max_depth;
+}
+
 void ExternalModule::validateConfiguration()
 {
     if (config_validator_.includesSchema(module_name)) {
@@ -145,7 +176,21 @@ const int ExternalModule::OUTPUT_DELAY_MS { 100 };
 
 void ExternalModule::processOutputAndUpdateMetadata(ActionResponse& response)
 {
-    if (response.output.std_out.empty()) {
+    processOutput(response, false, nullptr);
+}
+
+//
+// Private interface
+//
+
+void ExternalModule::processOutput(ActionResponse& response,
+                                   bool results_checked,
+                                   std::exception_ptr results_error)
+{
+    if (results_error) {
+        LOG_TRACE("Results on stdout for the {1} were rejected before being read",
+                  response.prettyRequestLabel());
+    } else if (response.output.std_out.empty()) {
         LOG_TRACE("Obtained no results on stdout for the {1}",
                   response.prettyRequestLabel());
     } else {
@@ -164,37 +209,121 @@ void ExternalModule::processOutputAndUpdateMetadata(ActionResponse& response)
                   response.prettyRequestLabel(), response.output.std_err);
     }
 
-    try {
-        // Ensure output format is valid JSON by instantiating
-        // JsonContainer (NB: its ctor does not accept empty strings)
-        lth_jc::JsonContainer results {
-            (response.output.std_out.empty() ? "null" : response.output.std_out) };
-        response.setValidResultsAndEnd(std::move(results));
-    } catch (lth_jc::data_parse_error& e) {
+    // NB: the JsonContainer ctor does not accept empty strings
+    if (response.output.std_out.empty() && !results_error) {
+        response.setValidResultsAndEnd(lth_jc::JsonContainer { "null" });
+        return;
+    }
+
+    std::string execution_error {};
+    auto invalid_json = [&](const std::string& error) {
         LOG_DEBUG("Obtained invalid JSON on stdout for the {1}; (validation "
                   "error: {2}); stdout:\n{3}",
-                  response.prettyRequestLabel(), e.what(), response.output.std_out);
-        std::string execution_error {
-            lth_loc::format("The task executed for the {1} returned invalid "
-                            "JSON on stdout - stderr:{2}",
-                            response.prettyRequestLabel(),
-                            (response.output.std_err.empty()
-                                ? lth_loc::translate(" (empty)")
-                                : "\n" + response.output.std_err)) };
-        response.setBadResultsAndEnd(execution_error);
+                  response.prettyRequestLabel(), error, response.output.std_out);
+        execution_error = lth_loc::format("The task executed for the {1} returned "
+                                          "invalid JSON on stdout - stderr:",
+                                          response.prettyRequestLabel());
+    };
+
+    try {
+        if (results_error)
+            std::rethrow_exception(results_error);
+
+        // The size of stdout is known; only the nesting depth needs
+        // the output to be checked before building the DOM, in a
+        // single pass that stops as soon as it exceeds the limit.
+        // Otherwise the check is skipped, as it only adds to the cost
+        // of the DOM parse, which rejects invalid JSON anyway
+        if (!results_checked) {
+            Util::JsonStreamParser parser { results_max_size_, results_max_depth_ };
+            parser.checkSize(response.output.std_out.size());
+            if (results_max_depth_ > 0) {
+                parser.feed(response.output.std_out);
+                parser.finish();
+            }
+        }
+        response.setValidResultsAndEnd(lth_jc::JsonContainer { response.output.std_out });
+        return;
+    } catch (Util::JsonStreamParser::LimitError& e) {
+        LOG_DEBUG("Obtained results exceeding the limits on stdout for the {1}: {2}",
+                  response.prettyRequestLabel(), e.what());
+        execution_error = lth_loc::format("The task executed for the {1} returned "
+                                          "results on stdout that are too large ({2}) "
+                                          "- stderr:",
+                                          response.prettyRequestLabel(), e.what());
+    } catch (Util::JsonStreamParser::Error& e) {
+        invalid_json(e.what());
+    } catch (lth_jc::data_parse_error& e) {
+        invalid_json(e.what());
     }
+
+    execution_error += (response.output.std_err.empty()
+                            ? lth_loc::translate(" (empty)")
+                            : "\n" + response.output.std_err);
+    response.setBadResultsAndEnd(execution_error);
 }
 
-//
-// Private interface
-//
+bool ExternalModule::checkResultsFile(const ActionRequest& request)
+{
+    if (results_max_size_ == 0 && results_max_depth_ == 0)
+        return false;
+
+    boost::system::error_code ec;
+    auto size = fs::file_size(fs::path { request.resultsDir() } / "stdout", ec);
+    // NB: an empty file means no results (null); nothing to check
+    if (ec || size == 0)
+        return false;
+
+    Util::JsonStreamParser parser { results_max_size_, results_max_depth_ };
+    parser.checkSize(size);
+
+    if (!storage_->readStdoutChunks(request.transactionId(),
+                                    [&parser](const char* data, size_t size) {
+                                        parser.feed(data, size);
+                                    }))
+        return false;
+
+    parser.finish();
+    return true;
+}
 
 // Metadata validator (static member)
 const PCPClient::Validator ExternalModule::metadata_validator_ {
         getMetadataValidator() };
 
 // Retrieve and validate the module's metadata
-const lth_jc::JsonContainer ExternalModule::getModuleMetadata()
+const lth_jc::JsonContainer ExternalModule::getModuleMetadata(
+    const std::shared_ptr<ModuleMetadataCache>& metadata_cache)
+{
+    // The key is obtained first, so that a module changed meanwhile is
+    // not cached with its old metadata
+    ModuleMetadataCache::Key cache_key;
+    bool cacheable { metadata_cache
+                     && ModuleMetadataCache::getKey(path_, cache_key) };
+    lth_jc::JsonContainer metadata;
+
+    if (cacheable && metadata_cache->get(path_, cache_key, metadata)) {
+        LOG_DEBUG("External module {1}: using the cached metadata", module_name);
+        metadata_cached_ = true;
+    } else {
+        metadata = runMetadata();
+    }
+
+    try {
+        metadata_validator_.validate(metadata, METADATA_SCHEMA_NAME);
+        LOG_DEBUG("External module {1}: metadata validation OK", module_name);
+    } catch (PCPClient::validation_error& e) {
+        throw Module::LoadingError {
+            lth_loc::format("metadata validation failure: {1}", e.what()) };
+    }
+
+    if (cacheable && !metadata_cached_)
+        metadata_cache->set(path_, cache_key, metadata);
+
+    return metadata;
+}
+
+const lth_jc::JsonContainer ExternalModule::runMetadata()
 {
     auto exec = lth_exec::execute(
 #ifdef _WIN32
@@ -224,14 +353,6 @@ const lth_jc::JsonContainer ExternalModule::getModuleMetadata()
             lth_loc::format("metadata is not in a valid JSON format: {1}", e.what()) };
     }
 
-    try {
-        metadata_validator_.validate(metadata, METADATA_SCHEMA_NAME);
-        LOG_DEBUG("External module {1}: metadata validation OK", module_name);
-    } catch (PCPClient::validation_error& e) {
-        throw Module::LoadingError {
-            lth_loc::format("metadata validation failure: {1}", e.what()) };
-    }
-
     return metadata;
 }
 
@@ -289,6 +410,44 @@ void ExternalModule::registerAction(const lth_jc::JsonContainer& action)
     }
 }
 
+void ExternalModule::registerWorkers(const lth_jc::JsonContainer& metadata,
+                                     uint32_t max_workers)
+{
+    if (!metadata.includes(METADATA_WORKER_ENTRY))
+        return;
+
+#ifdef _WIN32
+    LOG_DEBUG("Module '{1}' supports workers, but they are not available on Windows",
+              module_name);
+#else
+    if (max_workers == 0) {
+        LOG_DEBUG("Module '{1}' supports workers, but they are disabled", module_name);
+        return;
+    }
+
+    auto worker = metadata.get<lth_jc::JsonContainer>(METADATA_WORKER_ENTRY);
+    auto max_requests = worker.includes("max_requests")
+                      ? worker.get<int>("max_requests")
+                      : DEFAULT_MAX_WORKER_REQUESTS;
+    if (max_requests <= 0)
+        throw Module::LoadingError {
+            lth_loc::format("invalid worker max_requests of module {1}", module_name) };
+
+    auto timeout = worker.includes("timeout")
+                 ? worker.get<int>("timeout")
+                 : DEFAULT_WORKER_ACTION_TIMEOUT;
+    if (timeout < 0)
+        throw Module::LoadingError {
+            lth_loc::format("invalid worker timeout of module {1}", module_name) };
+
+    LOG_DEBUG("Module '{1}' will run its actions with up to {2} workers, each "
+              "replaced after {3} actions", module_name, max_workers, max_requests);
+    worker_pool_ = std::make_shared<ModuleWorkerPool>(
+        path_, max_workers, static_cast<uint32_t>(max_requests),
+        std::chrono::seconds(timeout));
+#endif
+}
+
 std::string ExternalModule::getActionArguments(const ActionRequest& request)
 {
     lth_jc::JsonContainer action_args {};
@@ -318,6 +477,16 @@ ActionResponse ExternalModule::callBlockingAction(const ActionRequest& request)
     LOG_INFO("Executing the {1}", request.prettyLabel());
     LOG_TRACE("Input for the {1}: {2}", request.prettyLabel(), action_args);
 
+    ModuleWorkerPool::Result worker_result;
+    if (worker_pool_
+            && worker_pool_->run(action_name, action_args, results_max_size_, worker_result)) {
+        response.output = ActionOutput { worker_result.exitcode,
+                                         worker_result.std_out,
+                                         worker_result.std_err };
+        processOutputAndUpdateMetadata(response);
+        return response;
+    }
+
     auto exec = lth_exec::execute(
 #ifdef _WIN32
         "cmd.exe", { "/c", path_, action_name },
@@ -351,8 +520,9 @@ ActionResponse ExternalModule::callNonBlockingAction(const ActionRequest& reques
     // tree when the pxp-agent service stops, we use the
     // `create_detached_process` execution option which ensures
     // the child process is executed in a new process contract
-    // on Solaris and a new process group on Windows
-
+    // on Solaris and a new process group on Windows. For the same
+    // reason, non-blocking actions are never run by the workers of
+    // the module, which do not outlive pxp-agent.
     auto exec = lth_exec::execute(
 #ifdef _WIN32
         "cmd.exe", { "/c", path_, action_name },
@@ -395,9 +565,20 @@ ActionResponse ExternalModule::callNonBlockingAction(const ActionRequest& reques
     pcp_util::this_thread::sleep_for(
         pcp_util::chrono::milliseconds(OUTPUT_DELAY_MS));
 
-    // Stdout / stderr output should be on file; read it
-    response.output = storage_->getOutput(request.transactionId(), exec.exit_code);
-    processOutputAndUpdateMetadata(response);
+    // Stdout / stderr output should be on file. Check the results in
+    // chunks first, so that results that are invalid or exceed the
+    // limits are never loaded; then read the output
+    bool results_checked { false };
+    std::exception_ptr results_error { nullptr };
+    try {
+        results_checked = checkResultsFile(request);
+    } catch (Util::JsonStreamParser::Error&) {
+        results_error = std::current_exception();
+    }
+
+    response.output = storage_->getOutput(request.transactionId(), exec.exit_code,
+                                          results_error == nullptr);
+    processOutput(response, results_checked, results_error);
     return response;
 }
 
@@ -4,24 +4,31 @@
 #include <pxp-agent/util/bolt_helpers.hpp>
 #include <pxp-agent/configuration.hpp>
 #include <pxp-agent/time.hpp>
+#include <pxp-agent/util/file_fingerprint.hpp>
+#include <pxp-agent/util/file_staging.hpp>
+#include <pxp-agent/util/sha256.hpp>
+#include <pxp-agent/util/tar_reader.hpp>
 #include <cpp-pcp-client/util/thread.hpp>   // this_thread::sleep_for
 #include <cpp-pcp-client/util/chrono.hpp>
 
 #include <leatherman/locale/locale.hpp>
 #include <leatherman/file_util/file.hpp>
 #include <leatherman/file_util/directory.hpp>
+#include <leatherman/util/scope_exit.hpp>
 
-#include <boost/algorithm/hex.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/system/error_code.hpp>
+#include <boost/nowide/fstream.hpp>
 
-#include <openssl/evp.h>
+#include <algorithm>  // std::all_of, std::min, std::max
+#include <random>
+#include <sstream>
+#include <curl/curl.h>
 
 #define LEATHERMAN_LOGGING_NAMESPACE "puppetlabs.pxp_agent.util.module_cache_dir"
 #include <leatherman/logging/logging.hpp>
 
-namespace alg         = boost::algorithm;
 namespace fs          = boost::filesystem;
 namespace boost_error = boost::system::errc;
 namespace pcp_util    = PCPClient::Util;
@@ -29,26 +36,80 @@ namespace lth_curl    = leatherman::curl;
 namespace lth_loc     = leatherman::locale;
 namespace lth_file    = leatherman::file_util;
 namespace lth_jc      = leatherman::json_container;
+namespace lth_util    = leatherman::util;
 namespace pcp_util = PCPClient::Util;
 
 namespace PXPAgent {
+  const uint32_t ModuleCacheDir::UNLIMITED_DOWNLOADS { 0 };
+
+  // Waits between the download attempts of getCachedFile
+  static const std::chrono::milliseconds RETRY_WAIT_BASE { std::chrono::seconds(1) };
+  static const std::chrono::milliseconds RETRY_WAIT_MAX { std::chrono::seconds(8) };
+
+  ModuleCacheDir::EntryPin::EntryPin(ModuleCacheDir& cache, std::vector<std::string> entries) :
+    cache_ { cache },
+    entries_ { std::move(entries) }
+  {
+    pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_.cache_purge_mutex_ };
+    for (const auto& entry : entries_) {
+      cache_.pinned_entries_[entry]++;
+    }
+  }
+
+  ModuleCacheDir::EntryPin::~EntryPin()
+  {
+    pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_.cache_purge_mutex_ };
+    for (const auto& entry : entries_) {
+      auto it = cache_.pinned_entries_.find(entry);
+      if (it != cache_.pinned_entries_.end() && --(it->second) == 0) {
+        cache_.pinned_entries_.erase(it);
+      }
+    }
+  }
+
   ModuleCacheDir::ModuleCacheDir(const std::string& cache_dir,
-                                 const std::string& cache_dir_purge_ttl) :
+                                 const std::string& cache_dir_purge_ttl,
+                                 uint64_t quota_bytes,
+                                 uint32_t max_concurrent_downloads,
+                                 std::string reverify_ttl,
+                                 uint64_t download_rate_limit,
+                                 uint32_t download_splay_s) :
     cache_dir_ { cache_dir },
-    purge_ttl_ { cache_dir_purge_ttl }
+    purge_ttl_ { cache_dir_purge_ttl },
+    reverify_ttl_ { std::move(reverify_ttl) },
+    disk_quota_ { quota_bytes },
+    disk_usage_initialized_ { false },
+    http_clients_ {},
+    server_selector_ {},
+    download_rate_limiter_ { download_rate_limit },
+    download_splay_s_ { download_splay_s },
+    max_concurrent_downloads_ { max_concurrent_downloads },
+    num_downloads_ { 0 }
   {}
 
+  ModuleCacheDir::~ModuleCacheDir()
+  {
+    pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+    flushLastUses();
+  }
+
   // Creates the <cache_dir>/<sha256> directory (and parent dirs), ensuring that its permissions are readable by
   // the PXP agent owner/group (for unix OSes), writable for the PXP agent owner,
   // and executable by both PXP agent owner and group. Returns the path to this directory.
-  // Note that the last modified time of the directory is updated, and that this routine
-  // will not fail if the directory already exists.
+  // Note that the last use of the directory is recorded, and that this routine
+  // will not fail if the directory already exists. The last use is kept in memory
+  // and only written as the last modified time of the directory by the purge (see
+  // flushLastUses), to avoid a filesystem metadata write on every use.
   fs::path ModuleCacheDir::createCacheDir(const std::string& sha256) {
     pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
     auto file_cache_dir = static_cast<fs::path>(cache_dir_) / sha256;
     try {
-      Util::createDir(file_cache_dir);
-      fs::last_write_time(file_cache_dir, time(nullptr));
+      if (!fs::is_directory(file_cache_dir)) {
+        Util::createDir(file_cache_dir);
+      }
+      auto now = time(nullptr);
+      last_uses_[sha256] = now;
+      disk_quota_.touch(sha256, now);
     } catch (fs::filesystem_error& e) {
       auto err_code = e.code();
       if (err_code == boost_error::no_such_file_or_directory) {
@@ -60,6 +121,178 @@ namespace PXPAgent {
     return file_cache_dir;
   }
 
+  // The files of a derived entry, listed with their fingerprint, so
+  // that any change made to the entry after it was built is detected
+  static const std::string MANIFEST { ".manifest" };
+
+  static const fs::perms WRITE_PERMS { fs::owner_write | fs::group_write | fs::others_write };
+
+  // Returns the fingerprints of the files of a derived entry, by
+  // their path relative to it, or false in case it contains other
+  // than files and directories
+  static bool getEntryFingerprints(const fs::path& entry_dir,
+                                   std::map<std::string, Util::FileFingerprint>& fingerprints) {
+    boost::system::error_code ec;
+    for (fs::recursive_directory_iterator it { entry_dir, ec }, end; !ec && it != end; it.increment(ec)) {
+      auto status = it->symlink_status(ec);
+      if (ec || fs::is_directory(status)) {
+        continue;
+      }
+      Util::FileFingerprint fingerprint;
+      if (!fs::is_regular_file(status) || !Util::getFileFingerprint(it->path().string(), fingerprint)) {
+        return false;
+      }
+      auto relative_path = it->path().string().substr(entry_dir.string().size() + 1);
+      if (relative_path != MANIFEST) {
+        fingerprints[relative_path] = fingerprint;
+      }
+    }
+    return !ec;
+  }
+
+  static void setEntryWritable(const fs::path& entry_dir, bool writable) {
+    boost::system::error_code ec;
+    auto perms = (writable ? fs::add_perms | fs::owner_write : fs::remove_perms | WRITE_PERMS);
+    // The directories are made read-only last, and writable first
+    if (writable) {
+      fs::permissions(entry_dir, perms, ec);
+    }
+    std::vector<fs::path> dirs;
+    for (fs::recursive_directory_iterator it { entry_dir, ec }, end; !ec && it != end; it.increment(ec)) {
+      auto status = it->symlink_status(ec);
+      if (fs::is_directory(status)) {
+        if (writable) {
+          fs::permissions(it->path(), perms, ec);
+        } else {
+          dirs.push_back(it->path());
+        }
+      } else if (fs::is_regular_file(status)) {
+        fs::permissions(it->path(), perms, ec);
+      }
+    }
+    if (!writable) {
+      for (const auto& dir : dirs) {
+        fs::permissions(dir, perms, ec);
+      }
+      fs::permissions(entry_dir, perms, ec);
+    }
+  }
+
+  // Makes the files and directories of a freshly built entry read-only
+  // and lists them, with their fingerprint, in its manifest
+  static void sealEntry(const fs::path& entry_dir) {
+    std::map<std::string, Util::FileFingerprint> fingerprints;
+    // NB: changing the permissions updates the change time of the
+    // files, which is part of their fingerprint
+    setEntryWritable(entry_dir, false);
+    fs::permissions(entry_dir, fs::add_perms | fs::owner_write);
+    if (!getEntryFingerprints(entry_dir, fingerprints)) {
+      throw Module::ProcessingError(lth_loc::format(
+        "Failed to list the files of {1}", entry_dir.string()));
+    }
+
+    std::string manifest;
+    for (const auto& entry : fingerprints) {
+      manifest += entry.first + "\n" + entry.second.toString() + "\n";
+    }
+    auto manifest_path = entry_dir / MANIFEST;
+    lth_file::atomic_write_to_file(manifest, manifest_path.string(), std::ios::binary);
+    fs::permissions(manifest_path, fs::remove_perms | WRITE_PERMS);
+    fs::permissions(entry_dir, fs::remove_perms | WRITE_PERMS);
+  }
+
+  // Whether the files listed in the manifest of an entry are still
+  // unchanged. The files added are ignored, as the tasks may write
+  // some next to their own (e.g. Python's __pycache__), which the
+  // read-only permissions don't prevent when running as root
+  static bool isEntryIntact(const fs::path& entry_dir) {
+    std::string manifest;
+    if (!lth_file::read((entry_dir / MANIFEST).string(), manifest)) {
+      return false;
+    }
+
+    std::istringstream manifest_stream { manifest };
+    std::string relative_path, fingerprint_txt;
+    while (std::getline(manifest_stream, relative_path) && std::getline(manifest_stream, fingerprint_txt)) {
+      Util::FileFingerprint expected, fingerprint;
+      if (!Util::FileFingerprint::fromString(fingerprint_txt, expected)
+          || !Util::getFileFingerprint((entry_dir / relative_path).string(), fingerprint)
+          || fingerprint != expected) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void ModuleCacheDir::makeEntryWritable(const fs::path& entry_dir) {
+    setEntryWritable(entry_dir, true);
+  }
+
+  fs::path ModuleCacheDir::getDerivedEntry(const std::string& name,
+                                           std::function<void(const fs::path& dir)> build_dir)
+  {
+    auto entry_dir = fs::path(cache_dir_) / name;
+    if (fs::is_directory(entry_dir)) {
+      if (isEntryIntact(entry_dir)) {
+        LOG_TRACE("Reusing the cache entry '{1}'", entry_dir.string());
+        return createCacheDir(name);
+      }
+      LOG_WARNING("The cache entry '{1}' was modified since it was built; building it again",
+                  entry_dir.string());
+    }
+
+    // Pin the temporary directory, so that it's not purged meanwhile
+    auto unique_suffix = fs::unique_path("_%%%%-%%%%-%%%%-%%%%").string();
+    auto temp_name = "temp_" + name + unique_suffix;
+    auto replaced_name = "replaced_" + name + unique_suffix;
+    auto temp_dir = fs::path(cache_dir_) / temp_name;
+    auto replaced_dir = fs::path(cache_dir_) / replaced_name;
+    EntryPin temp_pin { *this, { temp_name } };
+    boost::system::error_code ec;
+    lth_util::scope_exit remove_temp_dir {
+      [&]() {
+        boost::system::error_code remove_ec;
+        if (fs::exists(temp_dir, remove_ec)) {
+          makeEntryWritable(temp_dir);
+          fs::remove_all(temp_dir, remove_ec);
+        }
+      }
+    };
+
+    Util::createDir(temp_dir);
+    build_dir(temp_dir);
+    sealEntry(temp_dir);
+
+    bool replaced { false };
+    {
+      pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+      // Replace the modified entry, unless it was rebuilt meanwhile.
+      // The tasks that pinned the entry may still run from the
+      // replaced tree; it's kept until the entry is no longer pinned
+      // and then removed by the purge (see isPinned)
+      if (fs::is_directory(entry_dir) && !isEntryIntact(entry_dir)) {
+        fs::rename(entry_dir, replaced_dir, ec);
+        if (ec) {
+          throw Module::ProcessingError(lth_loc::format(
+            "Failed to move {1} to {2}: {3}", entry_dir.string(), replaced_dir.string(), ec.message()));
+        }
+        replaced_entries_[replaced_name] = name;
+        replaced = true;
+      }
+      fs::rename(temp_dir, entry_dir, ec);
+    }
+    if (ec && !fs::is_directory(entry_dir)) {
+      throw Module::ProcessingError(lth_loc::format(
+        "Failed to move {1} to {2}: {3}", temp_dir.string(), entry_dir.string(), ec.message()));
+    }
+
+    if (replaced) {
+      updateDiskUsage(replaced_dir);
+    }
+    updateDiskUsage(entry_dir);
+    return createCacheDir(name);
+  }
+
   unsigned int ModuleCacheDir::purgeCache(const std::string& ttl,
                                           std::vector<std::string> ongoing_transactions,
                                           std::function<void(const std::string& dir_path)> purge_callback)
@@ -70,6 +303,11 @@ namespace PXPAgent {
     LOG_INFO("About to purge cached files from '{1}'; TTL = {2}",
         cache_dir_, ttl);
 
+    {
+      pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+      flushLastUses();
+    }
+
     lth_file::each_subdirectory(
       cache_dir_,
       // Lambda function
@@ -79,14 +317,20 @@ namespace PXPAgent {
 
         boost::system::error_code ec;
         pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
-        auto last_update = fs::last_write_time(dir_path, ec);
+        // Entries may have been used since the last uses were flushed
+        auto last_update = getLastUse(dir_path, fs::last_write_time(dir_path, ec));
         if (ec) {
           LOG_ERROR("Failed to remove '{1}': {2}", sub_dir, ec.message());
+        } else if (isPinned(dir_path.filename().string())) {
+          LOG_TRACE("Skipping '{1}' as it is in use", sub_dir);
         } else if (ts.isNewerThan(last_update)) {
           LOG_TRACE("Removing '{1}'", sub_dir);
 
           try {
+            makeEntryWritable(dir_path);
             purge_callback(dir_path.string());
+            last_uses_.erase(dir_path.filename().string());
+            replaced_entries_.erase(dir_path.filename().string());
             num_purged_dirs++;
           } catch (const std::exception& e) {
             LOG_ERROR("Failed to remove '{1}': {2}", sub_dir, e.what());
@@ -100,47 +344,183 @@ namespace PXPAgent {
       "Removed {1} directory from '{2}'",
       "Removed {1} directories from '{2}'",
       num_purged_dirs, num_purged_dirs, cache_dir_));
+
+    if (Timestamp::getMinutes(reverify_ttl_) > 0) {
+      reverifyCache();
+    }
+
+    auto download_stats = http_clients_.stats();
+    if (download_stats.requests > 0) {
+      LOG_DEBUG("{1} download requests so far; {2} of them reused an open connection",
+                download_stats.requests, download_stats.handshakesSaved());
+    }
+
+    if (disk_quota_.enabled()) {
+      // Recompute the usage on the next update, as directories
+      // were removed (possibly by the purge callback)
+      pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+      disk_usage_initialized_ = false;
+    }
+
     return num_purged_dirs;
   }
 
+  uint64_t ModuleCacheDir::getDiskUsage() {
+    pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+    return disk_quota_.usage();
+  }
+
+  Util::HttpClientPool::Stats ModuleCacheDir::getDownloadStats() {
+    return http_clients_.stats();
+  }
+
+  bool ModuleCacheDir::isPinned(const std::string& entry) const {
+    if (pinned_entries_.find(entry) != pinned_entries_.end()) {
+      return true;
+    }
+    // A replaced tree is in use as long as the entry it was is pinned
+    auto replaced_it = replaced_entries_.find(entry);
+    return replaced_it != replaced_entries_.end()
+           && pinned_entries_.find(replaced_it->second) != pinned_entries_.end();
+  }
+
+  std::time_t ModuleCacheDir::getLastUse(const fs::path& entry_dir, std::time_t last_write_time) const {
+    auto it = last_uses_.find(entry_dir.filename().string());
+    return (it != last_uses_.end() && it->second > last_write_time) ? it->second : last_write_time;
+  }
+
+  // Writes the last uses as the last modified time of the entries, so
+  // that they are not lost on restart
+  void ModuleCacheDir::flushLastUses() {
+    for (const auto& last_use : last_uses_) {
+      auto entry_dir = fs::path(cache_dir_) / last_use.first;
+      boost::system::error_code ec;
+      auto last_update = fs::last_write_time(entry_dir, ec);
+      if (!ec && last_update < last_use.second) {
+        fs::last_write_time(entry_dir, last_use.second, ec);
+      }
+      if (ec) {
+        LOG_DEBUG("Failed to update the last modified time of '{1}': {2}",
+                  entry_dir.string(), ec.message());
+      }
+    }
+    last_uses_.clear();
+  }
+
+  void ModuleCacheDir::updateDiskUsage(const fs::path& entry_dir) {
+    if (!disk_quota_.enabled()) {
+      return;
+    }
+
+    pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+
+    if (!disk_usage_initialized_) {
+      // Includes the specified entry
+      initializeDiskUsage();
+    } else {
+      disk_quota_.update(entry_dir.filename().string(),
+                         Util::DiskQuota::directorySize(entry_dir),
+                         time(nullptr));
+    }
+
+    LOG_TRACE("Cache disk usage: {1} of {2} bytes", disk_quota_.usage(), disk_quota_.quota());
+
+    if (disk_quota_.isAboveHighWaterMark()) {
+      evictEntries();
+    }
+  }
+
+  void ModuleCacheDir::initializeDiskUsage() {
+    disk_quota_.clear();
+
+    if (!fs::is_directory(cache_dir_)) {
+      return;
+    }
+
+    lth_file::each_subdirectory(
+      cache_dir_,
+      [&](std::string const& sub_dir) -> bool {
+        fs::path dir_path { sub_dir };
+        boost::system::error_code ec;
+        auto last_update = getLastUse(dir_path, fs::last_write_time(dir_path, ec));
+        if (!ec) {
+          disk_quota_.update(dir_path.filename().string(),
+                             Util::DiskQuota::directorySize(dir_path),
+                             last_update);
+        }
+        return true;
+      });
+    disk_usage_initialized_ = true;
+  }
+
+  void ModuleCacheDir::evictEntries() {
+    unsigned int num_evicted_dirs { 0 };
+
+    LOG_INFO("The cache disk usage ({1} bytes) is above {2}% of the quota ({3} bytes); "
+             "removing the least recently used entries",
+             disk_quota_.usage(), Util::DiskQuota::HIGH_WATER_MARK, disk_quota_.quota());
+
+    for (const auto& entry : disk_quota_.entriesByLastUse()) {
+      if (!disk_quota_.isAboveLowWaterMark()) {
+        break;
+      }
+
+      if (isPinned(entry)) {
+        LOG_TRACE("Skipping cache entry '{1}' as it is in use", entry);
+        continue;
+      }
+
+      auto dir_path = (fs::path(cache_dir_) / entry).string();
+      boost::system::error_code ec;
+      makeEntryWritable(dir_path);
+      fs::remove_all(dir_path, ec);
+
+      if (ec) {
+        LOG_ERROR("Failed to remove '{1}': {2}", dir_path, ec.message());
+      } else {
+        LOG_DEBUG("Removed '{1}' to free cache space", dir_path);
+        disk_quota_.remove(entry);
+        last_uses_.erase(entry);
+        replaced_entries_.erase(entry);
+        num_evicted_dirs++;
+      }
+    }
+
+    LOG_INFO(lth_loc::format_n(
+      // LOCALE: info
+      "Removed {1} directory from '{2}'; the cache disk usage is {3} bytes",
+      "Removed {1} directories from '{2}'; the cache disk usage is {3} bytes",
+      num_evicted_dirs, num_evicted_dirs, cache_dir_, disk_quota_.usage()));
+
+    if (disk_quota_.isAboveHighWaterMark()) {
+      LOG_WARNING("The cache disk usage is still above {1}% of the quota, as the "
+                  "remaining entries are in use or can't be removed",
+                  Util::DiskQuota::HIGH_WATER_MARK);
+    }
+  }
+
   // NIX_DIR_PERMS is defined in pxp-agent/configuration
   #define NIX_DOWNLOADED_FILE_PERMS NIX_DIR_PERMS
 
   // Computes the sha256 of the file denoted by path. Assumes that
   // the file designated by "path" exists.
   std::string ModuleCacheDir::calculateSha256(const std::string& path) {
-    auto mdctx = EVP_MD_CTX_create();
-
-    EVP_DigestInit_ex(mdctx, EVP_sha256(), nullptr);
+    Util::Sha256 digest;
     {
       constexpr std::streamsize CHUNK_SIZE = 0x8000;  // 32 kB
       char buffer[CHUNK_SIZE];
       boost::nowide::ifstream ifs(path, std::ios::binary);
 
       while (ifs.read(buffer, CHUNK_SIZE)) {
-        EVP_DigestUpdate(mdctx, buffer, CHUNK_SIZE);
+        digest.update(buffer, CHUNK_SIZE);
       }
       if (!ifs.eof()) {
-        EVP_MD_CTX_destroy(mdctx);
         throw Module::ProcessingError(lth_loc::format("Error while reading {1}", path));
       }
-      EVP_DigestUpdate(mdctx, buffer, ifs.gcount());
+      digest.update(buffer, ifs.gcount());
     }
 
-    unsigned char md_value[EVP_MAX_MD_SIZE];
-    unsigned int md_len;
-
-    EVP_DigestFinal_ex(mdctx, md_value, &md_len);
-    EVP_MD_CTX_destroy(mdctx);
-
-    std::string md_value_hex;
-
-    md_value_hex.reserve(2*md_len);
-    // TODO use boost::algorithm::hex_lower and drop the std::transform below when we upgrade to boost 1.62.0 or newer
-    alg::hex(md_value, md_value+md_len, std::back_inserter(md_value_hex));
-    std::transform(md_value_hex.begin(), md_value_hex.end(), md_value_hex.begin(), ::tolower);
-
-    return md_value_hex;
+    return digest.hexDigest();
   }
 
   std::string ModuleCacheDir::createUrlEndpoint(const lth_jc::JsonContainer& uri) {
@@ -161,107 +541,864 @@ namespace PXPAgent {
     return url;
   }
 
-  // Downloads the file at the specified url into the provided path.
-  // The downloaded file's permissions will be set to rwx for user and rx for
-  // group for non-Windows OSes.
+  // Where a download is streamed to: the file, hashed as it's written,
+  // or, for error responses, the (truncated) body to report.
+  struct DownloadSink {
+    boost::nowide::ofstream* ofs;
+    Util::Sha256* digest;
+    CURL* curl;
+    Util::RateLimiter* rate_limiter;
+    std::string file_path;
+    uint64_t resume_from;
+    uint64_t expected_size;
+    uint64_t received_size;
+    bool started;
+    bool too_large;
+    bool write_failed;
+    std::string error_body;
+  };
+
+  // CURLOPT_PROTOCOLS is deprecated since curl 7.85.0
+  static CURLcode restrictToHttps(CURL* curl) {
+#if LIBCURL_VERSION_NUM >= 0x075500
+    return curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, "https");
+#else
+    return curl_easy_setopt(curl, CURLOPT_PROTOCOLS, static_cast<long>(CURLPROTO_HTTPS));
+#endif
+  }
+
+  // Sets the options shared by the download requests; the error
+  // buffer must be CURL_ERROR_SIZE bytes. Request timeouts are set in
+  // milliseconds.
+  static bool setUpDownloadRequest(CURL* curl,
+                                   const std::string& url,
+                                   uint32_t connect_timeout_s,
+                                   uint32_t timeout_s,
+                                   const ModuleCacheDir::ClientSettings& client_settings,
+                                   char* error_buffer) {
+    return curl_easy_setopt(curl, CURLOPT_URL, url.c_str()) == CURLE_OK
+      && curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L) == CURLE_OK
+      && curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L) == CURLE_OK
+      && curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer) == CURLE_OK
+      && restrictToHttps(curl) == CURLE_OK
+      && curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(connect_timeout_s)*1000) == CURLE_OK
+      && curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(timeout_s)*1000) == CURLE_OK
+      && (client_settings.ca.empty()
+          || curl_easy_setopt(curl, CURLOPT_CAINFO, client_settings.ca.c_str()) == CURLE_OK)
+      && (client_settings.crt.empty()
+          || curl_easy_setopt(curl, CURLOPT_SSLCERT, client_settings.crt.c_str()) == CURLE_OK)
+      && (client_settings.key.empty()
+          || curl_easy_setopt(curl, CURLOPT_SSLKEY, client_settings.key.c_str()) == CURLE_OK)
+      && (client_settings.crl.empty()
+          || curl_easy_setopt(curl, CURLOPT_CRLFILE, client_settings.crl.c_str()) == CURLE_OK)
+      && (client_settings.proxy.empty()
+          || curl_easy_setopt(curl, CURLOPT_PROXY, client_settings.proxy.c_str()) == CURLE_OK);
+  }
+
+  static constexpr size_t MAX_ERROR_BODY_SIZE = 0x1000;  // 4 kB
+
+  static constexpr long HTTP_RANGE_NOT_SATISFIABLE { 416 };
+  static constexpr long HTTP_TOO_MANY_REQUESTS { 429 };
+  static constexpr long HTTP_SERVER_ERROR { 500 };
+  static constexpr long HTTP_SERVICE_UNAVAILABLE { 503 };
+
+  // Returns the time the server asked to wait before the next request
+  // with the Retry-After header of a 429 or 503 response, if any; the
+  // header is ignored by the versions of curl older than 7.66.0.
+  static std::chrono::seconds getRetryAfter(CURL* curl, long status_code) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+    if (status_code == HTTP_TOO_MANY_REQUESTS || status_code == HTTP_SERVICE_UNAVAILABLE) {
+      curl_off_t retry_after_s { 0 };
+      if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after_s) == CURLE_OK && retry_after_s > 0) {
+        return std::chrono::seconds(retry_after_s);
+      }
+    }
+#endif
+    return std::chrono::seconds(0);
+  }
+
+  // Called before the content of a successful response is written. In
+  // case the download is resumed, the content received earlier is
+  // hashed first (curl fails with CURLE_RANGE_ERROR in case the server
+  // does not resume it).
+  static bool startDownloadContent(DownloadSink& sink) {
+    sink.started = true;
+    if (sink.resume_from == 0) {
+      return true;
+    }
+
+    LOG_DEBUG("Resuming the download of {1} from byte {2}", sink.file_path, sink.resume_from);
+    constexpr std::streamsize CHUNK_SIZE = 0x8000;  // 32 kB
+    char buffer[CHUNK_SIZE];
+    boost::nowide::ifstream ifs(sink.file_path, std::ios::binary);
+    uint64_t remaining { sink.resume_from };
+    while (remaining > 0
+           && ifs.read(buffer, static_cast<std::streamsize>(std::min<uint64_t>(remaining, CHUNK_SIZE)))) {
+      sink.digest->update(buffer, static_cast<size_t>(ifs.gcount()));
+      remaining -= static_cast<uint64_t>(ifs.gcount());
+    }
+    sink.received_size = sink.resume_from;
+    return remaining == 0;
+  }
+
+  static size_t writeDownloadChunk(char* data, size_t size, size_t nmemb, void* userdata) {
+    auto& sink = *static_cast<DownloadSink*>(userdata);
+    auto chunk_size = size * nmemb;
+
+    long status_code { 0 };
+    curl_easy_getinfo(sink.curl, CURLINFO_RESPONSE_CODE, &status_code);
+    if (status_code >= 400) {
+      sink.error_body.append(data, std::min(chunk_size, MAX_ERROR_BODY_SIZE - sink.error_body.size()));
+      return chunk_size;
+    }
+
+    if (!sink.started && !startDownloadContent(sink)) {
+      sink.write_failed = true;
+      return 0;
+    }
+
+    // Stop as soon as the file can't match its SHA anymore
+    sink.received_size += chunk_size;
+    if (sink.expected_size > 0 && sink.received_size > sink.expected_size) {
+      sink.too_large = true;
+      return 0;
+    }
+
+    // Throttling the writes throttles the transfer, as curl does not
+    // read more from the connection meanwhile
+    sink.rate_limiter->consume(chunk_size);
+
+    sink.digest->update(data, chunk_size);
+    if (!sink.ofs->write(data, chunk_size)) {
+      sink.write_failed = true;
+      return 0;
+    }
+    return chunk_size;
+  }
+
+  // Downloads the file at the specified url into the provided path,
+  // computing its sha256 while it's received, so that the file is not
+  // read back to be verified. The downloaded file's permissions will be
+  // set to rwx for user and rx for group for non-Windows OSes.
+  //
+  // In case the file at the provided path is a partial download (e.g.
+  // the connection dropped), only the rest of it is requested, with an
+  // HTTP Range request; a failed attempt keeps what was received, so
+  // that the next one (with the next master-uri or by getCachedFile)
+  // resumes it as well. In case the server does not support ranges,
+  // the download is started over.
+  //
+  // The master-uris are tried in the order given by the server
+  // selector, i.e. the fastest healthy one first; each attempt updates
+  // the health and the latency of its server. The master-uris that
+  // asked to retry later are skipped until then.
+  //
+  // The sha256 of the received content is stored in downloaded_sha256;
+  // in case the file is larger than the expected size (if not 0), the
+  // transfer is aborted early and downloaded_sha256 is left empty, as
+  // the file can't match its sha256 anyway. The bytes of the file
+  // received by all the attempts are added to bytes_received.
   //
   // The method returns a tuple (success, err_msg). success is true if the file was downloaded;
-  // false otherwise. err_msg contains the most recent http_file_download_exception's error
-  // message; it is initially empty.
+  // false otherwise. err_msg contains the error message of the most recent failed
+  // attempt; it is initially empty.
   std::tuple<bool, std::string> ModuleCacheDir::downloadFileWithCurl(const std::vector<std::string>& master_uris,
                                                                      uint32_t connect_timeout_s,
                                                                      uint32_t timeout_s,
-                                                                     lth_curl::client& client,
+                                                                     const ClientSettings& client_settings,
                                                                      const fs::path& file_path,
-                                                                     const lth_jc::JsonContainer& uri) {
-    pcp_util::lock_guard<pcp_util::mutex> curl_lock { curl_mutex_ };
+                                                                     const lth_jc::JsonContainer& uri,
+                                                                     uint64_t expected_size,
+                                                                     std::string& downloaded_sha256,
+                                                                     uint64_t& bytes_received) {
     auto endpoint = createUrlEndpoint(uri);
     std::tuple<bool, std::string> result = std::make_tuple(false, "");
-    for (auto& master_uri : master_uris) {
+    auto ordered_uris = server_selector_.order(master_uris);
+    if (!ordered_uris.empty() && ordered_uris.front() != master_uris.front()) {
+      LOG_DEBUG("Trying the master-uri '{1}' first, as the fastest healthy one", ordered_uris.front());
+    }
+    for (size_t master_idx = 0; master_idx < ordered_uris.size(); master_idx++) {
+      auto& master_uri = ordered_uris[master_idx];
       auto url = master_uri + endpoint;
-      lth_curl::request req(url);
+      if (server_selector_.retryAfter(master_uri) > Util::ServerSelector::clock::duration::zero()) {
+        LOG_DEBUG("Skipping the master-uri '{1}', as it asked to retry later", master_uri);
+        std::get<1>(result) = lth_loc::format("{1} asked to retry later", master_uri);
+        continue;
+      }
+      // Set to request the whole file again from the same master-uri,
+      // in case it does not support resuming the download; otherwise,
+      // leaving the loop moves on to the next master-uri
+      bool retry_without_range { false };
+      do {
+        retry_without_range = false;
+        auto client = http_clients_.acquire();
+        CURL* curl = client.handle();
+        if (curl == nullptr) {
+          throw Module::ProcessingError(lth_loc::format("Downloading the file failed. Reason: failed to set up the request for {1}", url));
+        }
+        char error_buffer[CURL_ERROR_SIZE] = {};
 
-      // Request timeouts expect milliseconds.
-      req.connection_timeout(connect_timeout_s*1000);
-      req.timeout(timeout_s*1000);
+        boost::system::error_code ec;
+        uint64_t resume_from { 0 };
+        if (fs::exists(file_path, ec)) {
+          resume_from = fs::file_size(file_path, ec);
+          if (ec || (expected_size > 0 && resume_from >= expected_size)) {
+            resume_from = 0;
+          }
+        }
 
-      try {
-        lth_curl::response resp;
-        client.download_file(req, file_path.string(), resp, NIX_DOWNLOADED_FILE_PERMS);
-        if (resp.status_code() >= 400) {
-          throw lth_curl::http_file_download_exception(
-            req,
-            file_path.string(),
-            lth_loc::format("{1} returned a response with HTTP status {2}. Response body: {3}", url, resp.status_code(), resp.body()));
-        }
-      } catch (lth_curl::http_file_download_exception& e) {
-        // Server-side error, do nothing here -- we want to try the next master-uri.
-        LOG_WARNING("Downloading the file from the master-uri '{1}' failed. Reason: {2}", master_uri, e.what());
-        std::get<1>(result) = e.what();
-      } catch (lth_curl::http_request_exception& e) {
-        // For http_curl_setup and http_file_operation exceptions
-        throw Module::ProcessingError(lth_loc::format("Downloading the file failed. Reason: {1}", e.what()));
-      }
-
-      if (fs::exists(file_path)) {
+        boost::nowide::ofstream ofs(file_path.string(),
+                                    std::ios::binary | (resume_from > 0 ? std::ios::app : std::ios::trunc));
+        if (!ofs) {
+          throw Module::ProcessingError(lth_loc::format("Downloading the file failed. Reason: failed to open '{1}'", file_path.string()));
+        }
+        Util::Sha256 digest;
+        DownloadSink sink { &ofs, &digest, curl, &download_rate_limiter_, file_path.string(), resume_from, expected_size, 0, false, false, false, "" };
+
+        bool setup_ok =
+             setUpDownloadRequest(curl, url, connect_timeout_s, timeout_s, client_settings, error_buffer)
+          && curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeDownloadChunk) == CURLE_OK
+          && curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink) == CURLE_OK
+          && (resume_from == 0
+              || curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(resume_from)) == CURLE_OK);
+        if (!setup_ok) {
+          throw Module::ProcessingError(lth_loc::format("Downloading the file failed. Reason: failed to set up the request for {1}", url));
+        }
+
+        auto curl_result = curl_easy_perform(curl);
+        if (curl_result == CURLE_OK) {
+          http_clients_.recordTransfer(curl);
+        }
+
+        long status_code { 0 };
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+
+        // Aborted transfers and error responses for the file itself
+        // (e.g. 404) don't say anything about the server's health
+        if ((curl_result != CURLE_OK && curl_result != CURLE_WRITE_ERROR && curl_result != CURLE_RANGE_ERROR)
+            || status_code >= HTTP_SERVER_ERROR || status_code == HTTP_TOO_MANY_REQUESTS) {
+          server_selector_.recordFailure(master_uri, Util::ServerSelector::clock::now(),
+                                         getRetryAfter(curl, status_code));
+        } else if (curl_result == CURLE_OK) {
+          double time_to_first_byte_s { 0 };
+          curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &time_to_first_byte_s);
+          server_selector_.recordSuccess(
+            master_uri, std::chrono::milliseconds(static_cast<int64_t>(time_to_first_byte_s * 1000)));
+        }
+
+        // An empty response body, e.g. for an empty file
+        if (curl_result == CURLE_OK && status_code < 400 && !sink.started
+            && !startDownloadContent(sink)) {
+          sink.write_failed = true;
+        }
+        ofs.close();
+        if (sink.started) {
+          bytes_received += sink.received_size - sink.resume_from;
+        }
+
+        if (sink.too_large) {
+          LOG_WARNING("Aborted the download from '{1}' as it exceeded the expected size of {2} bytes",
+                      url, expected_size);
+          fs::remove(file_path, ec);
+          downloaded_sha256.clear();
+          std::get<0>(result) = true;
+          return result;
+        }
+
+        if (sink.write_failed) {
+          fs::remove(file_path, ec);
+          throw Module::ProcessingError(lth_loc::format("Downloading the file failed. Reason: failed to write '{1}'", file_path.string()));
+        }
+
+        if (curl_result == CURLE_RANGE_ERROR && resume_from > 0) {
+          LOG_DEBUG("'{1}' does not support resuming downloads; starting over", master_uri);
+          fs::remove(file_path, ec);
+          retry_without_range = true;
+          continue;
+        }
+
+        if (curl_result != CURLE_OK || status_code >= 400) {
+          // Server-side error, do nothing here -- we want to try the next master-uri.
+          auto reason = curl_result != CURLE_OK
+            ? std::string { error_buffer[0] != '\0' ? error_buffer : curl_easy_strerror(curl_result) }
+            : lth_loc::format("{1} returned a response with HTTP status {2}. Response body: {3}", url, status_code, sink.error_body);
+          LOG_WARNING("Downloading the file from the master-uri '{1}' failed. Reason: {2}", master_uri, reason);
+          std::get<1>(result) = reason;
+          // What was received is kept to be resumed, unless the server
+          // can't serve the requested range
+          if (status_code == HTTP_RANGE_NOT_SATISFIABLE) {
+            fs::remove(file_path, ec);
+          }
+          continue;
+        }
+
+        downloaded_sha256 = digest.hexDigest();
+        fs::permissions(file_path, NIX_DOWNLOADED_FILE_PERMS);
         std::get<0>(result) = true;
         return result;
-      }
+      } while (retry_without_range);
     }
 
     return result;
   }
 
+  // Returns a random wait of up to the specified number of seconds.
+  static std::chrono::milliseconds randomSplay(uint32_t max_splay_s) {
+    if (max_splay_s == 0) {
+      return std::chrono::milliseconds(0);
+    }
+    static pcp_util::mutex generator_mutex;
+    static std::mt19937 generator { std::random_device {}() };
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> splay { 0, max_splay_s * 1000 };
+    pcp_util::lock_guard<pcp_util::mutex> generator_lock { generator_mutex };
+    return std::chrono::milliseconds(splay(generator));
+  }
+
   // Downloads a file if it does not already exist on the filesystem. A check is made
   // on the filesystem to determine if the file at destination already exists and if
   // it already matches the sha256 provided with the file. If the file already exists
   // the function immediately returns.
   //
-  // If the file does not exist attempt to download with leatherman.curl. Once the
-  // download finishes a sha256 check occurs to ensure file contents are correct. Then
-  // the file is moved to destination with boost::filesystem::rename.
+  // If the file does not exist attempt to download with curl, hashing its content
+  // as it's received. Once the download finishes its sha256 is checked to ensure file
+  // contents are correct. Then the file is moved to destination with boost::filesystem::rename.
   fs::path ModuleCacheDir::downloadFileFromMaster(const std::vector<std::string>& master_uris,
                                                   uint32_t connect_timeout,
                                                   uint32_t timeout,
-                                                  lth_curl::client& client,
+                                                  const ClientSettings& client_settings,
                                                   const fs::path& cache_dir,
                                                   const fs::path& destination,
-                                                  const lth_jc::JsonContainer& file) {
+                                                  const lth_jc::JsonContainer& file,
+                                                  bool splay_download,
+                                                  uint64_t* bytes_received) {
     auto filename = destination.filename();
     auto sha256 = file.get<std::string>("sha256");
 
-    if (fs::exists(destination) && boost::to_upper_copy<std::string>(sha256) == boost::to_upper_copy<std::string>(calculateSha256(destination.string()))) {
-      fs::permissions(destination, NIX_DOWNLOADED_FILE_PERMS);
-      return destination;
+    if (fs::exists(destination)) {
+      // Changing the permissions updates the change time of the file;
+      // do it only when needed and before checking its fingerprint
+      if (fs::status(destination).permissions() != NIX_DOWNLOADED_FILE_PERMS) {
+        fs::permissions(destination, NIX_DOWNLOADED_FILE_PERMS);
+      }
+      if (isVerified(cache_dir, destination, sha256)) {
+        return destination;
+      }
     }
 
     if (master_uris.empty()) {
       throw Module::ProcessingError(lth_loc::format("Cannot download file. No master-uris were provided"));
     }
 
-    auto tempname = cache_dir / fs::unique_path("temp_file_%%%%-%%%%-%%%%-%%%%");
-    // Note that the provided tempname argument is a temporary file, call it "tempA".
-    // Leatherman.curl during the download method will create another temporary file,
-    // call it "tempB", to save the downloaded file's contents in chunks before
-    // renaming it to "tempA." The rationale behind this solution is that:
-    //    (1) After download, we still need to check "tempA" to ensure that its sha matches
-    //    the provided sha. So the downloaded file is not quite a "valid" file after this
-    //    method is called; it's still temporary.
-    //
-    //    (2) It somewhat simplifies error handling if multiple threads try to download
-    //    the same file.
-    auto download_result = downloadFileWithCurl(master_uris, connect_timeout, timeout, client, tempname, file.get<lth_jc::JsonContainer>("uri"));
+    // Only the first concurrent request for a given sha256 downloads it
+    std::shared_ptr<InFlightDownload> in_flight;
+    {
+      pcp_util::lock_guard<pcp_util::mutex> in_flight_lock { in_flight_downloads_mutex_ };
+      auto it = in_flight_downloads_.find(sha256);
+      if (it != in_flight_downloads_.end()) {
+        in_flight = it->second;
+      } else {
+        in_flight_downloads_[sha256] = std::make_shared<InFlightDownload>();
+        in_flight_downloads_[sha256]->done = false;
+      }
+    }
+
+    if (in_flight != nullptr) {
+      return waitForDownload(*in_flight, sha256, cache_dir, destination);
+    }
+
+    fs::path downloaded_file {};
+    std::string download_error { lth_loc::translate("the download was interrupted") };
+    lth_util::scope_exit publish_result {
+      [&]() {
+        std::shared_ptr<InFlightDownload> done_download;
+        {
+          pcp_util::lock_guard<pcp_util::mutex> in_flight_lock { in_flight_downloads_mutex_ };
+          done_download = in_flight_downloads_[sha256];
+          in_flight_downloads_.erase(sha256);
+        }
+        {
+          pcp_util::lock_guard<pcp_util::mutex> done_lock { done_download->mutex };
+          done_download->done = true;
+          done_download->file_path = downloaded_file;
+          done_download->error = download_error;
+        }
+        done_download->cond_var.notify_all();
+      }
+    };
+
+    // The file is hashed while downloaded into partial_file, which is
+    // only moved to its destination once the sha256 matches; this keeps
+    // a partial or corrupted download from ever being at destination.
+    // As only one download of a sha256 is in progress at once, its name
+    // is fixed, so that a failed download can be resumed by the next one.
+    auto partial_file = cache_dir / ("." + sha256 + ".partial");
+    uint64_t expected_size { 0 };
+    if (file.includes("size_bytes") && file.type("size_bytes") == lth_jc::DataType::Int
+        && file.get<int>("size_bytes") >= 0) {
+      expected_size = static_cast<uint64_t>(file.get<int>("size_bytes"));
+    }
+
+    // Spreads the downloads of the agents that receive the same task at
+    // once; the wait does not hold a download slot
+    auto splay = randomSplay(splay_download ? download_splay_s_ : 0);
+    if (splay.count() > 0) {
+      LOG_DEBUG("Waiting {1} ms before downloading the file with SHA {2}", splay.count(), sha256);
+      pcp_util::this_thread::sleep_for(pcp_util::chrono::milliseconds(splay.count()));
+    }
+
+    std::string downloaded_sha256;
+    std::tuple<bool, std::string> download_result;
+    uint64_t downloaded_bytes { 0 };
+    {
+      acquireDownloadSlot();
+      lth_util::scope_exit release_slot { [this]() { releaseDownloadSlot(); } };
+      download_result = downloadFileWithCurl(master_uris, connect_timeout, timeout, client_settings, partial_file, file.get<lth_jc::JsonContainer>("uri"),
+                                             expected_size, downloaded_sha256, downloaded_bytes);
+    }
+    if (bytes_received != nullptr) {
+      *bytes_received += downloaded_bytes;
+    }
+
     if (!std::get<0>(download_result)) {
+      download_error = std::get<1>(download_result);
       throw Module::ProcessingError(lth_loc::format(
         "Downloading file {1} failed after trying all the available master-uris. Most recent error message: {2}",
         filename,
         std::get<1>(download_result)));
     }
 
-    if (sha256 != calculateSha256(tempname.string())) {
-      fs::remove(tempname);
+    if (sha256 != downloaded_sha256) {
+      boost::system::error_code ec;
+      fs::remove(partial_file, ec);
+      download_error = lth_loc::translate("the downloaded file has a different SHA");
       throw Module::ProcessingError(lth_loc::format("The downloaded file {1} has a SHA that differs from the provided SHA", filename));
     }
+    placeFile(partial_file, destination);
+    recordVerified(cache_dir, destination, sha256);
+    updateDiskUsage(cache_dir);
+    downloaded_file = destination;
+    return destination;
+  }
+
+  // Waits for the download of the same sha256 started by another
+  // request. In case the file is needed at a different destination,
+  // it's copied from the downloaded one and verified again, as the
+  // latter may have been modified meanwhile.
+  fs::path ModuleCacheDir::waitForDownload(InFlightDownload& in_flight,
+                                           const std::string& sha256,
+                                           const fs::path& cache_dir,
+                                           const fs::path& destination) {
+    LOG_DEBUG("Waiting for the ongoing download of the file with SHA {1}", sha256);
+    fs::path downloaded_file;
+    std::string download_error;
+    {
+      pcp_util::unique_lock<pcp_util::mutex> done_lock { in_flight.mutex };
+      in_flight.cond_var.wait(done_lock, [&in_flight]() { return in_flight.done; });
+      downloaded_file = in_flight.file_path;
+      download_error = in_flight.error;
+    }
+
+    if (downloaded_file.empty()) {
+      throw Module::ProcessingError(lth_loc::format(
+        "The concurrent download of the file with SHA {1} failed: {2}", sha256, download_error));
+    }
+
+    if (downloaded_file == destination && fs::exists(destination)) {
+      return destination;
+    }
+
+    auto tempname = cache_dir / fs::unique_path("temp_file_%%%%-%%%%-%%%%-%%%%");
+    boost::system::error_code ec;
+    try {
+      Util::stageFile(downloaded_file, tempname);
+    } catch (const fs::filesystem_error& e) {
+      ec = e.code();
+    }
+    if (ec || sha256 != calculateSha256(tempname.string())) {
+      fs::remove(tempname, ec);
+      throw Module::ProcessingError(lth_loc::format(
+        "Failed to copy the concurrently downloaded file {1} to {2}", downloaded_file, destination));
+    }
+    fs::permissions(tempname, NIX_DOWNLOADED_FILE_PERMS);
+    placeFile(tempname, destination);
+    recordVerified(cache_dir, destination, sha256);
+    updateDiskUsage(cache_dir);
+    return destination;
+  }
+
+  // Thrown by ArchiveStream in case the transfer fails or the server
+  // answers with an error
+  struct ArchiveTransferError : public std::runtime_error {
+    ArchiveTransferError(const std::string& msg, CURLcode curl_result_, long status_code_) :
+      std::runtime_error(msg),
+      curl_result { curl_result_ },
+      status_code { status_code_ }
+    {}
+    CURLcode curl_result;
+    long status_code;
+  };
+
+  // The response of an archive download, read by the TarReader that
+  // extracts it. The transfer is driven with curl's multi interface as
+  // the archive is read, so that it only progresses at the pace of the
+  // extraction and no more than what the last curl_multi_perform call
+  // received is held in memory; the archive is never written to disk.
+  // The response is hashed as it's read.
+  class ArchiveStream {
+    public:
+      ArchiveStream(CURL* curl, Util::RateLimiter& rate_limiter, const char* error_buffer) :
+        curl_ { curl },
+        multi_ { curl_multi_init() },
+        rate_limiter_ { rate_limiter },
+        error_buffer_ { error_buffer },
+        received_ {},
+        position_ { 0 },
+        done_ { false },
+        curl_result_ { CURLE_OK },
+        error_body_ {}
+      {
+        if (multi_ == nullptr
+            || curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, writeChunk) != CURLE_OK
+            || curl_easy_setopt(curl_, CURLOPT_WRITEDATA, this) != CURLE_OK
+            || curl_multi_add_handle(multi_, curl_) != CURLM_OK) {
+          if (multi_ != nullptr) {
+            curl_multi_cleanup(multi_);
+          }
+          throw Module::ProcessingError(lth_loc::translate(
+            "Downloading the archive failed. Reason: failed to set up the request"));
+        }
+      }
+
+      // Aborts the transfer if it's still in progress
+      ~ArchiveStream() {
+        curl_multi_remove_handle(multi_, curl_);
+        curl_multi_cleanup(multi_);
+      }
+
+      ArchiveStream(const ArchiveStream&) = delete;
+      ArchiveStream& operator=(const ArchiveStream&) = delete;
+
+      // Returns 0 once the whole response was read. Throws an
+      // ArchiveTransferError in case the transfer failed.
+      size_t read(char* buffer, size_t size) {
+        while (position_ == received_.size()) {
+          if (done_) {
+            checkResult();
+            return 0;
+          }
+          received_.clear();
+          position_ = 0;
+          perform();
+        }
+        auto chunk = std::min(size, received_.size() - position_);
+        received_.copy(buffer, chunk, position_);
+        position_ += chunk;
+        return chunk;
+      }
+
+      // Reads what the TarReader did not need (e.g. the padding after
+      // the end-of-archive blocks), so that the whole response is
+      // hashed; returns its sha256.
+      std::string finish() {
+        char buffer[0x8000];
+        while (read(buffer, sizeof(buffer)) > 0) {}
+        return digest_.hexDigest();
+      }
+
+    private:
+      CURL* curl_;
+      CURLM* multi_;
+      Util::RateLimiter& rate_limiter_;
+      const char* error_buffer_;
+      Util::Sha256 digest_;
+      std::string received_;
+      size_t position_;
+      bool done_;
+      CURLcode curl_result_;
+      std::string error_body_;
+
+      // Waits for more of the response, up to a second at once
+      void perform() {
+        int running { 0 };
+        auto multi_result = curl_multi_perform(multi_, &running);
+        if (multi_result != CURLM_OK) {
+          throw ArchiveTransferError { curl_multi_strerror(multi_result), CURLE_RECV_ERROR, 0 };
+        }
+
+        if (running == 0) {
+          int pending { 0 };
+          CURLMsg* msg;
+          while ((msg = curl_multi_info_read(multi_, &pending)) != nullptr) {
+            if (msg->msg == CURLMSG_DONE) {
+              curl_result_ = msg->data.result;
+            }
+          }
+          done_ = true;
+        } else if (received_.empty()) {
+          curl_multi_wait(multi_, nullptr, 0, 1000, nullptr);
+        }
+      }
+
+      void checkResult() {
+        long status_code { 0 };
+        curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &status_code);
+        if (curl_result_ != CURLE_OK) {
+          throw ArchiveTransferError {
+            error_buffer_[0] != '\0' ? error_buffer_ : curl_easy_strerror(curl_result_),
+            curl_result_, status_code };
+        }
+        if (status_code >= 400) {
+          char* url { nullptr };
+          curl_easy_getinfo(curl_, CURLINFO_EFFECTIVE_URL, &url);
+          throw ArchiveTransferError {
+            lth_loc::format("{1} returned a response with HTTP status {2}. Response body: {3}",
+                            (url != nullptr ? url : ""), status_code, error_body_),
+            curl_result_, status_code };
+        }
+      }
+
+      static size_t writeChunk(char* data, size_t size, size_t nmemb, void* userdata) {
+        auto& stream = *static_cast<ArchiveStream*>(userdata);
+        auto chunk_size = size * nmemb;
+
+        long status_code { 0 };
+        curl_easy_getinfo(stream.curl_, CURLINFO_RESPONSE_CODE, &status_code);
+        if (status_code >= 400) {
+          stream.error_body_.append(data, std::min(chunk_size, MAX_ERROR_BODY_SIZE - stream.error_body_.size()));
+          return chunk_size;
+        }
+
+        stream.rate_limiter_.consume(chunk_size);
+        stream.digest_.update(data, chunk_size);
+        stream.received_.append(data, chunk_size);
+        return chunk_size;
+      }
+  };
+
+  // Returns the components of the path of an archive entry, or false
+  // in case it's absolute or climbs up; so are the paths with
+  // backslashes or drive letters on Windows, where they'd be separators
+  // or roots.
+  static bool splitArchivePath(const std::string& path, std::vector<std::string>& components) {
+    components.clear();
+#ifdef _WIN32
+    if (path.find_first_of("\\:") != std::string::npos) {
+      return false;
+    }
+#endif
+    if (!path.empty() && path[0] == '/') {
+      return false;
+    }
+    std::vector<std::string> tokens;
+    boost::split(tokens, path, boost::is_any_of("/"));
+    for (const auto& token : tokens) {
+      if (token == "..") {
+        return false;
+      }
+      if (!token.empty() && token != ".") {
+        components.push_back(token);
+      }
+    }
+    return true;
+  }
+
+  // Extracts the files and the directories of the archive into dir;
+  // the entries of any other type (e.g. symlinks) are skipped. Returns
+  // the number of files extracted.
+  static unsigned int extractArchive(Util::TarReader& reader,
+                                     const fs::path& dir,
+                                     const std::string& archive_name) {
+    unsigned int num_files { 0 };
+    Util::TarReader::Entry entry;
+    std::vector<std::string> components;
+
+    while (reader.next(entry)) {
+      if (!splitArchivePath(entry.path, components)) {
+        throw Module::ProcessingError(lth_loc::format(
+          "The archive {1} has an entry out of its destination: '{2}'", archive_name, entry.path));
+      }
+      if (components.empty()) {
+        continue;
+      }
+      auto path = dir;
+      for (const auto& component : components) {
+        path /= component;
+      }
+
+      if (entry.is_directory) {
+        if (!fs::is_directory(path)) {
+          Util::createDir(path);
+        }
+        continue;
+      }
+      if (!entry.is_file) {
+        LOG_WARNING("Skipping '{1}' of the archive {2}, as it's neither a file nor a directory",
+                    entry.path, archive_name);
+        continue;
+      }
+
+      if (!fs::is_directory(path.parent_path())) {
+        Util::createDir(path.parent_path());
+      }
+      boost::nowide::ofstream ofs { path.string(), std::ios::binary | std::ios::trunc };
+      char buffer[0x8000];
+      size_t size;
+      while (ofs && (size = reader.read(buffer, sizeof(buffer))) > 0) {
+        ofs.write(buffer, static_cast<std::streamsize>(size));
+      }
+      ofs.close();
+      if (!ofs) {
+        throw Module::ProcessingError(lth_loc::format(
+          "Failed to extract '{1}' of the archive {2}", entry.path, archive_name));
+      }
+      fs::permissions(path, NIX_DOWNLOADED_FILE_PERMS);
+      num_files++;
+    }
+
+    return num_files;
+  }
+
+  // Moves the content of src_dir into dst_dir, merging the directories
+  // that already exist and replacing the files. The symlinks found in
+  // dst_dir are replaced rather than followed, so that nothing is moved
+  // out of it.
+  static void mergeDirectory(const fs::path& src_dir, const fs::path& dst_dir) {
+    std::vector<fs::path> items { fs::directory_iterator(src_dir), fs::directory_iterator() };
+    for (const auto& item : items) {
+      auto target = dst_dir / item.filename();
+      auto target_status = fs::symlink_status(target);
+      if (fs::is_directory(fs::symlink_status(item))) {
+        if (!fs::exists(target_status)) {
+          fs::rename(item, target);
+        } else if (fs::is_directory(target_status)) {
+          mergeDirectory(item, target);
+        } else {
+          throw Module::ProcessingError(lth_loc::format(
+            "Destination {1} already exists and is not a directory!", target));
+        }
+      } else {
+        if (fs::is_directory(target_status)) {
+          throw Module::ProcessingError(lth_loc::format(
+            "Destination {1} already exists and is a directory!", target));
+        }
+        fs::rename(item, target);
+      }
+    }
+  }
+
+  // The archive is extracted into a temporary directory next to the
+  // destination, which is only moved into place once the sha256 of the
+  // whole archive matches; so a corrupted or partial archive never
+  // changes the destination. A failed transfer is started over with the
+  // next master-uri, as the extraction can't be resumed.
+  void ModuleCacheDir::downloadArchiveFromMaster(const std::vector<std::string>& master_uris,
+                                                 uint32_t connect_timeout,
+                                                 uint32_t timeout,
+                                                 const ClientSettings& client_settings,
+                                                 const fs::path& destination,
+                                                 const lth_jc::JsonContainer& file) {
+    auto sha256 = file.get<std::string>("sha256");
+    auto endpoint = createUrlEndpoint(file.get<lth_jc::JsonContainer>("uri"));
+
+    if (master_uris.empty()) {
+      throw Module::ProcessingError(lth_loc::format("Cannot download archive. No master-uris were provided"));
+    }
+    if (fs::exists(destination) && !fs::is_directory(destination)) {
+      throw Module::ProcessingError(lth_loc::format("Destination {1} already exists and is not a directory!", destination));
+    }
+    if (!fs::exists(destination.parent_path())) {
+      Util::createDir(destination.parent_path());
+    }
+
+    auto splay = randomSplay(download_splay_s_);
+    if (splay.count() > 0) {
+      LOG_DEBUG("Waiting {1} ms before downloading the archive {2}", splay.count(), endpoint);
+      pcp_util::this_thread::sleep_for(pcp_util::chrono::milliseconds(splay.count()));
+    }
+
+    acquireDownloadSlot();
+    lth_util::scope_exit release_slot { [this]() { releaseDownloadSlot(); } };
+
+    std::string last_error;
+    for (const auto& master_uri : server_selector_.order(master_uris)) {
+      auto url = master_uri + endpoint;
+      if (server_selector_.retryAfter(master_uri) > Util::ServerSelector::clock::duration::zero()) {
+        LOG_DEBUG("Skipping the master-uri '{1}', as it asked to retry later", master_uri);
+        last_error = lth_loc::format("{1} asked to retry later", master_uri);
+        continue;
+      }
+
+      auto temp_dir = destination.parent_path()
+        / fs::unique_path("." + destination.filename().string() + ".partial_%%%%-%%%%-%%%%-%%%%");
+      boost::system::error_code ec;
+      lth_util::scope_exit temp_dir_remover { [&temp_dir, &ec]() { fs::remove_all(temp_dir, ec); } };
+      Util::createDir(temp_dir);
+
+      auto client = http_clients_.acquire();
+      CURL* curl = client.handle();
+      char error_buffer[CURL_ERROR_SIZE] = {};
+      if (curl == nullptr
+          || !setUpDownloadRequest(curl, url, connect_timeout, timeout, client_settings, error_buffer)) {
+        throw Module::ProcessingError(lth_loc::format("Downloading the archive failed. Reason: failed to set up the request for {1}", url));
+      }
+
+      unsigned int num_files { 0 };
+      std::string received_sha256;
+      try {
+        ArchiveStream stream { curl, download_rate_limiter_, error_buffer };
+        Util::TarReader reader { url, [&stream](char* buffer, size_t size) { return stream.read(buffer, size); } };
+        num_files = extractArchive(reader, temp_dir, url);
+        received_sha256 = stream.finish();
+      } catch (const ArchiveTransferError& e) {
+        if (e.curl_result != CURLE_OK || e.status_code >= HTTP_SERVER_ERROR
+            || e.status_code == HTTP_TOO_MANY_REQUESTS) {
+          server_selector_.recordFailure(master_uri, Util::ServerSelector::clock::now(),
+                                         getRetryAfter(curl, e.status_code));
+        }
+        LOG_WARNING("Downloading the archive from the master-uri '{1}' failed. Reason: {2}", master_uri, e.what());
+        last_error = e.what();
+        continue;
+      } catch (const Util::TarError& e) {
+        // The copy of the archive on this master-uri may be corrupted;
+        // the server itself is healthy
+        last_error = lth_loc::format("The archive downloaded from {1} is not valid: {2}", url, e.what());
+        LOG_WARNING("Downloading the archive from the master-uri '{1}' failed. Reason: {2}", master_uri, last_error);
+        continue;
+      } catch (const fs::filesystem_error& e) {
+        // Entries that can't be extracted, e.g. a directory with the
+        // path of a file, make the archive invalid just the same
+        last_error = lth_loc::format("The archive downloaded from {1} is not valid: {2}", url, e.what());
+        LOG_WARNING("Downloading the archive from the master-uri '{1}' failed. Reason: {2}", master_uri, last_error);
+        continue;
+      }
+
+      http_clients_.recordTransfer(curl);
+      double time_to_first_byte_s { 0 };
+      curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &time_to_first_byte_s);
+      server_selector_.recordSuccess(
+        master_uri, std::chrono::milliseconds(static_cast<int64_t>(time_to_first_byte_s * 1000)));
+
+      if (received_sha256 != sha256) {
+        last_error = lth_loc::format("The downloaded archive {1} has a SHA that differs from the provided SHA", endpoint);
+        LOG_WARNING("Downloading the archive from the master-uri '{1}' failed. Reason: {2}", master_uri, last_error);
+        continue;
+      }
+
+      if (fs::exists(destination)) {
+        mergeDirectory(temp_dir, destination);
+      } else {
+        fs::rename(temp_dir, destination);
+      }
+      LOG_DEBUG("Extracted {1} files of the archive {2} into {3}", num_files, url, destination.string());
+      return;
+    }
+
+    throw Module::ProcessingError(lth_loc::format(
+      "Downloading archive {1} failed after trying all the available master-uris. Most recent error message: {2}",
+      endpoint, last_error));
+  }
+
+  void ModuleCacheDir::placeFile(const fs::path& tempname, const fs::path& destination) {
     if (!fs::exists(destination.parent_path())) {
       Util::createDir(destination.parent_path());
     }
@@ -269,18 +1406,321 @@ namespace PXPAgent {
       fs::rename(tempname, destination);
     } catch (boost::filesystem::filesystem_error& fs_error) {
       // Catch EXDEV (tempname and destination on different filesystems) and attempt to retry the file
-      // move with `copy` then `remove`
+      // move with a copy (see Util::stageFile) then `remove`; the copy is made next to the destination
+      // and renamed over it, so that the destination is replaced at once
       // Note that EXDEV should be available on windows too: https://docs.microsoft.com/en-us/cpp/c-runtime-library/errno-constants?view=vs-2019
       if (fs_error.code().value() == EXDEV) {
-        fs::copy(tempname, destination);
+        auto destination_temp = destination.parent_path()
+          / fs::unique_path("." + destination.filename().string() + ".temp_%%%%-%%%%-%%%%-%%%%");
+        boost::system::error_code ec;
+        lth_util::scope_exit destination_temp_remover { [&]() { fs::remove(destination_temp, ec); } };
+        Util::stageFile(tempname, destination_temp);
+        fs::rename(destination_temp, destination);
         fs::remove(tempname);
       } else {
         throw fs_error;
       }
     }
-    return destination;
   }
 
+  void ModuleCacheDir::stageCachedFile(const fs::path& cached_file,
+                                       const fs::path& destination) {
+    Util::stageFile(cached_file, destination);
+  }
+
+  static const std::string VERIFIED_SUFFIX { ".verified" };
+
+  // What's stored in the sidecar record of a verified file
+  struct VerifiedRecord {
+    std::string sha256;
+    Util::FileFingerprint fingerprint;
+    std::time_t verified_at;
+    std::string destination;
+  };
+
+  // The files placed out of the cache entry by the file module may share
+  // their name (e.g. the same file deployed in many directories), so the
+  // name of their record includes a digest of their path.
+  static fs::path verifiedRecordPath(const fs::path& cache_dir, const fs::path& destination) {
+    auto record_name = "." + destination.filename().string();
+    if (destination.parent_path() != cache_dir) {
+      Util::Sha256 digest;
+      digest.update(destination.string().data(), destination.string().size());
+      record_name += "." + digest.hexDigest().substr(0, 16);
+    }
+    return cache_dir / (record_name + VERIFIED_SUFFIX);
+  }
+
+  // The record has one line for each of the sha256, the fingerprint,
+  // the verification time and the destination path
+  static bool readVerifiedRecord(const fs::path& record_path, VerifiedRecord& record) {
+    std::string record_txt;
+    if (!lth_file::read(record_path.string(), record_txt)) {
+      return false;
+    }
+
+    std::istringstream record_stream { record_txt };
+    std::string fingerprint_txt, verified_at_txt;
+    if (!std::getline(record_stream, record.sha256)
+        || !std::getline(record_stream, fingerprint_txt)
+        || !std::getline(record_stream, verified_at_txt)
+        || !std::getline(record_stream, record.destination)
+        || !Util::FileFingerprint::fromString(fingerprint_txt, record.fingerprint)) {
+      return false;
+    }
+
+    try {
+      record.verified_at = static_cast<std::time_t>(std::stoll(verified_at_txt));
+    } catch (const std::exception&) {
+      return false;
+    }
+    return true;
+  }
+
+  void ModuleCacheDir::recordVerified(const fs::path& cache_dir,
+                                      const fs::path& destination,
+                                      const std::string& sha256) {
+    Util::FileFingerprint fingerprint;
+    if (!Util::getFileFingerprint(destination.string(), fingerprint)) {
+      return;
+    }
+
+    auto record_path = verifiedRecordPath(cache_dir, destination);
+    try {
+      lth_file::atomic_write_to_file(sha256 + "\n"
+                                     + fingerprint.toString() + "\n"
+                                     + std::to_string(time(nullptr)) + "\n"
+                                     + destination.string() + "\n",
+                                     record_path.string(),
+                                     std::ios::binary);
+    } catch (const std::exception& e) {
+      // The file will just be hashed again on its next use
+      LOG_DEBUG("Failed to write '{1}': {2}", record_path.string(), e.what());
+    }
+  }
+
+  bool ModuleCacheDir::isVerified(const fs::path& cache_dir,
+                                  const fs::path& destination,
+                                  const std::string& sha256) {
+    Util::FileFingerprint fingerprint;
+    if (!Util::getFileFingerprint(destination.string(), fingerprint)) {
+      return false;
+    }
+
+    VerifiedRecord record;
+    if (readVerifiedRecord(verifiedRecordPath(cache_dir, destination), record)
+        && record.destination == destination.string()
+        && boost::iequals(record.sha256, sha256)
+        && record.fingerprint == fingerprint) {
+      LOG_TRACE("The file {1} was verified already and did not change", destination.string());
+      return true;
+    }
+
+    if (!boost::iequals(sha256, calculateSha256(destination.string()))) {
+      return false;
+    }
+
+    recordVerified(cache_dir, destination, sha256);
+    return true;
+  }
+
+  unsigned int ModuleCacheDir::reverifyCache() {
+    unsigned int num_reverified_files { 0 };
+    Timestamp ts { reverify_ttl_ };
+
+    if (!fs::is_directory(cache_dir_)) {
+      return num_reverified_files;
+    }
+
+    LOG_INFO("About to verify again the cached files from '{1}'; TTL = {2}",
+             cache_dir_, reverify_ttl_);
+
+    lth_file::each_subdirectory(
+      cache_dir_,
+      [&](std::string const& sub_dir) -> bool {
+        fs::path entry_dir { sub_dir };
+        pcp_util::lock_guard<pcp_util::mutex> purge_lock { cache_purge_mutex_ };
+        if (isPinned(entry_dir.filename().string())) {
+          return true;
+        }
+
+        // Verifying the files again is not a use of the entry, so
+        // keep its last write time, which is what the purge relies on
+        boost::system::error_code time_ec;
+        auto last_update = fs::last_write_time(entry_dir, time_ec);
+        lth_util::scope_exit restore_last_update {
+          [&]() {
+            if (!time_ec) {
+              boost::system::error_code ec;
+              fs::last_write_time(entry_dir, last_update, ec);
+            }
+          }
+        };
+
+        lth_file::each_file(
+          sub_dir,
+          [&](std::string const& file_path) -> bool {
+            fs::path record_path { file_path };
+            VerifiedRecord record;
+            if (!boost::ends_with(record_path.filename().string(), VERIFIED_SUFFIX)
+                || !readVerifiedRecord(record_path, record)
+                || !ts.isNewerThan(record.verified_at)) {
+              return true;
+            }
+
+            boost::system::error_code ec;
+            fs::path destination { record.destination };
+            if (fs::exists(destination)
+                && boost::iequals(record.sha256, calculateSha256(destination.string()))) {
+              recordVerified(entry_dir, destination, record.sha256);
+              num_reverified_files++;
+              return true;
+            }
+
+            LOG_WARNING("The file {1} no longer matches its SHA {2}; removing it from the cache",
+                        destination.string(), record.sha256);
+            fs::remove(record_path, ec);
+            // Files placed elsewhere by the file module are not ours to remove
+            if (destination.parent_path() == entry_dir) {
+              fs::remove(destination, ec);
+            }
+            return true;
+          });
+        return true;
+      });
+
+    LOG_INFO(lth_loc::format_n(
+      // LOCALE: info
+      "Verified again {1} cached file from '{2}'",
+      "Verified again {1} cached files from '{2}'",
+      num_reverified_files, num_reverified_files, cache_dir_));
+    return num_reverified_files;
+  }
+
+  void ModuleCacheDir::acquireDownloadSlot() {
+    pcp_util::unique_lock<pcp_util::mutex> slots_lock { download_slots_mutex_ };
+    if (max_concurrent_downloads_ != UNLIMITED_DOWNLOADS && num_downloads_ >= max_concurrent_downloads_) {
+      LOG_DEBUG("{1} downloads in progress; waiting for one to complete", num_downloads_);
+      download_slots_cond_var_.wait(slots_lock, [this]() {
+        return num_downloads_ < max_concurrent_downloads_;
+      });
+    }
+    num_downloads_++;
+  }
+
+  void ModuleCacheDir::releaseDownloadSlot() {
+    {
+      pcp_util::lock_guard<pcp_util::mutex> slots_lock { download_slots_mutex_ };
+      num_downloads_--;
+    }
+    download_slots_cond_var_.notify_one();
+  }
+
+
+  bool ModuleCacheDir::isCached(const fs::path& cache_dir, const lth_jc::JsonContainer& file) {
+    auto destination = cache_dir / fs::path(file.get<std::string>("filename")).filename();
+    return fs::exists(destination) && isVerified(cache_dir, destination, file.get<std::string>("sha256"));
+  }
+
+  static bool isSha256(const std::string& name) {
+    return name.size() == 64
+      && std::all_of(name.begin(), name.end(),
+                     [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+  }
+
+  ModuleCacheDir::BundleImport ModuleCacheDir::importBundle(const fs::path& bundle_path) {
+    BundleImport result { 0, 0, 0, 0 };
+    LOG_INFO("Importing the bundle {1} into the cache {2}", bundle_path.string(), cache_dir_);
+
+    // The files are extracted into a temporary entry, so that no
+    // <sha256> directory is created for the ones rejected; it's pinned,
+    // so that it's not purged meanwhile
+    auto temp_name = "temp_import" + fs::unique_path("_%%%%-%%%%-%%%%-%%%%").string();
+    auto temp_dir = fs::path(cache_dir_) / temp_name;
+    EntryPin temp_pin { *this, { temp_name } };
+    lth_util::scope_exit temp_dir_remover {
+      [&temp_dir]() {
+        boost::system::error_code ec;
+        fs::remove_all(temp_dir, ec);
+      }
+    };
+    Util::createDir(temp_dir);
+
+    try {
+      Util::TarReader reader { bundle_path.string() };
+      Util::TarReader::Entry entry;
+
+      while (reader.next(entry)) {
+        // The <sha256> directories carry no content
+        if (!entry.is_file) {
+          continue;
+        }
+
+        fs::path entry_path { entry.path };
+        auto sha256 = entry_path.parent_path().string();
+        auto filename = entry_path.filename().string();
+        if (!isSha256(sha256) || filename.empty() || filename[0] == '.') {
+          LOG_WARNING("Skipping '{1}' of the bundle {2}, as it's not a <sha256>/<filename> entry",
+                      entry.path, bundle_path.string());
+          result.rejected++;
+          continue;
+        }
+
+        // Keeps the entry from being purged while the file is placed
+        EntryPin pin { *this, { sha256 } };
+        auto cache_dir = fs::path(cache_dir_) / sha256;
+        auto destination = cache_dir / filename;
+        if (fs::exists(destination) && isVerified(cache_dir, destination, sha256)) {
+          createCacheDir(sha256);
+          result.already_cached++;
+          continue;
+        }
+
+        auto tempname = temp_dir / sha256;
+        boost::system::error_code ec;
+        lth_util::scope_exit temp_remover { [&tempname, &ec]() { fs::remove(tempname, ec); } };
+
+        Util::Sha256 digest;
+        {
+          boost::nowide::ofstream ofs { tempname.string(), std::ios::binary | std::ios::trunc };
+          char buffer[0x8000];
+          size_t size;
+          while (ofs && (size = reader.read(buffer, sizeof(buffer))) > 0) {
+            digest.update(buffer, size);
+            ofs.write(buffer, static_cast<std::streamsize>(size));
+          }
+          ofs.close();
+          if (!ofs) {
+            throw Module::ProcessingError(lth_loc::format(
+              "Failed to import the bundle {1}: failed to write '{2}'", bundle_path.string(), tempname.string()));
+          }
+        }
+
+        auto actual_sha256 = digest.hexDigest();
+        if (actual_sha256 != sha256) {
+          LOG_WARNING("Skipping '{1}' of the bundle {2}, as its sha256 is {3}",
+                      entry.path, bundle_path.string(), actual_sha256);
+          result.rejected++;
+          continue;
+        }
+
+        fs::permissions(tempname, NIX_DOWNLOADED_FILE_PERMS);
+        createCacheDir(sha256);
+        placeFile(tempname, destination);
+        recordVerified(cache_dir, destination, sha256);
+        updateDiskUsage(cache_dir);
+        result.imported++;
+        result.bytes += entry.size;
+      }
+    } catch (const Util::TarError& e) {
+      throw Module::ProcessingError(lth_loc::format(
+        "Failed to import the bundle {1}: {2}", bundle_path.string(), e.what()));
+    }
+
+    LOG_INFO("Imported {1} files ({2} bytes) of the bundle {3}; {4} were already cached, {5} were rejected",
+             result.imported, result.bytes, bundle_path.string(), result.already_cached, result.rejected);
+    return result;
+  }
 
   // Verify (this includes checking the SHA256 checksums) that a file is present
   // in the cache, downloading it if necessary.
@@ -288,9 +1728,10 @@ namespace PXPAgent {
   fs::path ModuleCacheDir::getCachedFile(const std::vector<std::string>& master_uris,
                                          uint32_t connect_timeout,
                                          uint32_t timeout,
-                                         lth_curl::client& client,
+                                         const ClientSettings& client_settings,
                                          const fs::path&   cache_dir,
-                                         lth_jc::JsonContainer& file) {
+                                         lth_jc::JsonContainer& file,
+                                         uint64_t* bytes_received) {
       LOG_DEBUG("Verifying file based on {1}", file.toString());
 
       // files remain in the cache_dir rather than being written out to a destination
@@ -298,26 +1739,47 @@ namespace PXPAgent {
       auto destination = cache_dir / fs::path(file.get<std::string>("filename")).filename();
 
       // Try to download the file at most retry_count times. Catch any error and retry, on the last
-      // loop through throw the last caught error.
-      int retry_count = 5;
-      int retry_wait = 1;
-      for (int i = 1; i <= retry_count; i++) {
+      // loop through throw the last caught error. The waits double at each retry, with a jitter,
+      // so that the agents that failed at once don't retry at once; they don't hold a download slot.
+      // NB: the retries are not scheduled off the thread of the action, which needs the file to
+      // proceed; the waits hold it (for blocking requests, the thread that processes the requests).
+      // They are therefore kept short, and the download fails right away in case the servers asked
+      // to retry later than RETRY_WAIT_MAX.
+      unsigned int retry_count = 5;
+      for (unsigned int i = 1; i <= retry_count; i++) {
         try {
           LOG_DEBUG("getCachedFile: try max #{1} times", retry_count);
           // Return early on success
-          return downloadFileFromMaster(master_uris, connect_timeout, timeout, client, cache_dir, destination, file);
+          return downloadFileFromMaster(master_uris, connect_timeout, timeout, client_settings, cache_dir, destination, file, i == 1,
+                                        bytes_received);
         }
         catch (std::runtime_error &e) {
           if (i == retry_count) {
             throw Module::ProcessingError{lth_loc::format("Failed to download file with: {1}", e.what())};
           }
-          LOG_ERROR("getCachedFile: (std::runtime_error) {1}, waiting {2} seconds", e.what(), retry_wait);
-          auto wait_seconds = pcp_util::chrono::seconds(retry_wait);
-          pcp_util::this_thread::sleep_for(wait_seconds);
-          retry_wait *= 2;
+          auto retry_wait = Util::jitteredBackoff(i, RETRY_WAIT_BASE, RETRY_WAIT_MAX);
+          // In case all the master-uris asked to retry later, wait until
+          // the first one accepts requests again, with a jitter
+          auto retry_after = Util::ServerSelector::clock::duration::max();
+          for (const auto& master_uri : master_uris) {
+            retry_after = std::min(retry_after, server_selector_.retryAfter(master_uri));
+          }
+          if (!master_uris.empty() && retry_after > RETRY_WAIT_MAX) {
+            throw Module::ProcessingError{lth_loc::format(
+              "Failed to download file with: {1}; the master-uris asked to retry in {2} seconds",
+              e.what(), std::chrono::duration_cast<std::chrono::seconds>(retry_after).count())};
+          }
+          if (!master_uris.empty() && retry_after > Util::ServerSelector::clock::duration::zero()) {
+            retry_wait = std::max(retry_wait,
+                                  std::chrono::duration_cast<std::chrono::milliseconds>(retry_after)
+                                    + Util::jitteredBackoff(1, RETRY_WAIT_BASE, RETRY_WAIT_BASE));
+          }
+          LOG_ERROR("getCachedFile: (std::runtime_error) {1}, waiting {2} ms", e.what(), retry_wait.count());
+          pcp_util::this_thread::sleep_for(pcp_util::chrono::milliseconds(retry_wait.count()));
         }
       }
     // This line should never be hit (either returns early or raises), just satisfying warning about no return
-    return downloadFileFromMaster(master_uris, connect_timeout, timeout, client, cache_dir, destination, file);
+    return downloadFileFromMaster(master_uris, connect_timeout, timeout, client_settings, cache_dir, destination, file, false,
+                                  bytes_received);
   }
 }  // PXPAgent
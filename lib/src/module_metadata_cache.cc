@@ -0,0 +1,163 @@
+#include <pxp-agent/module_metadata_cache.hpp>
+#include <pxp-agent/configuration.hpp>
+#include <pxp-agent/util/file_fingerprint.hpp>
+#include <pxp-agent/util/sha256.hpp>
+
+#include <leatherman/file_util/file.hpp>
+#include <leatherman/locale/locale.hpp>
+
+#define LEATHERMAN_LOGGING_NAMESPACE "puppetlabs.pxp_agent.module_metadata_cache"
+#include <leatherman/logging/logging.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/nowide/fstream.hpp>
+
+#include <sstream>
+#include <utility>  // std::move
+
+namespace PXPAgent {
+
+namespace fs       = boost::filesystem;
+namespace lth_file = leatherman::file_util;
+namespace lth_jc   = leatherman::json_container;
+namespace lth_loc  = leatherman::locale;
+namespace pcp_util = PCPClient::Util;
+
+// Changed whenever the format of the cache file, or the way its keys
+// are computed, changes; the entries of other versions are dropped
+static const int CACHE_FILE_VERSION { 1 };
+
+bool ModuleMetadataCache::Key::operator==(const Key& other) const
+{
+    return size == other.size && mtime_ns == other.mtime_ns && sha256 == other.sha256;
+}
+
+std::string ModuleMetadataCache::Key::toString() const
+{
+    std::ostringstream txt;
+    txt << size << ' ' << mtime_ns << ' ' << sha256;
+    return txt.str();
+}
+
+static bool parseKey(const std::string& txt, ModuleMetadataCache::Key& key)
+{
+    std::istringstream key_stream { txt };
+    return (key_stream >> key.size >> key.mtime_ns >> key.sha256)
+           && (key_stream >> std::ws).eof();
+}
+
+ModuleMetadataCache::ModuleMetadataCache(std::string cache_file)
+        : cache_file_ { std::move(cache_file) },
+          entries_ {},
+          changed_ { false }
+{
+    if (!fs::exists(cache_file_))
+        return;
+
+    try {
+        lth_jc::JsonContainer cache { lth_file::read(cache_file_) };
+        if (cache.get<int>("version") != CACHE_FILE_VERSION) {
+            LOG_DEBUG("Ignoring the module metadata cache {1}, as its version differs",
+                      cache_file_);
+            return;
+        }
+
+        auto modules = cache.get<lth_jc::JsonContainer>("modules");
+        for (const auto& module_path : modules.keys()) {
+            auto module = modules.get<lth_jc::JsonContainer>(module_path);
+            Entry entry { Key {}, module.get<lth_jc::JsonContainer>("metadata"), false };
+            if (parseKey(module.get<std::string>("key"), entry.key))
+                entries_.emplace(module_path, std::move(entry));
+        }
+    } catch (const lth_jc::data_error& e) {
+        LOG_WARNING("Ignoring the invalid module metadata cache {1}: {2}",
+                    cache_file_, e.what());
+        entries_.clear();
+    }
+}
+
+bool ModuleMetadataCache::getKey(const std::string& module_path, Key& key)
+{
+    Util::FileFingerprint fingerprint;
+    if (!Util::getFileFingerprint(module_path, fingerprint))
+        return false;
+
+    boost::nowide::ifstream ifs { module_path, std::ios::binary };
+    if (!ifs)
+        return false;
+
+    Util::Sha256 digest;
+    char buffer[0x8000];
+    while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount() > 0)
+        digest.update(buffer, static_cast<size_t>(ifs.gcount()));
+    if (ifs.bad())
+        return false;
+
+    key.size = fingerprint.size;
+    key.mtime_ns = fingerprint.mtime_ns;
+    key.sha256 = digest.hexDigest();
+    return true;
+}
+
+bool ModuleMetadataCache::get(const std::string& module_path,
+                              const Key& key,
+                              lth_jc::JsonContainer& metadata)
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+    auto entry = entries_.find(module_path);
+    if (entry == entries_.end() || !(entry->second.key == key))
+        return false;
+
+    entry->second.used = true;
+    metadata = entry->second.metadata;
+    return true;
+}
+
+void ModuleMetadataCache::set(const std::string& module_path,
+                              const Key& key,
+                              const lth_jc::JsonContainer& metadata)
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+    entries_[module_path] = Entry { key, metadata, true };
+    changed_ = true;
+}
+
+void ModuleMetadataCache::save()
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+    lth_jc::JsonContainer modules {};
+    bool dropped { false };
+
+    for (const auto& entry : entries_) {
+        if (!entry.second.used) {
+            dropped = true;
+            continue;
+        }
+        lth_jc::JsonContainer module {};
+        module.set<std::string>("key", entry.second.key.toString());
+        module.set<lth_jc::JsonContainer>("metadata", entry.second.metadata);
+        modules.set<lth_jc::JsonContainer>(entry.first, module);
+    }
+
+    if (!changed_ && !dropped)
+        return;
+
+    lth_jc::JsonContainer cache {};
+    cache.set<int>("version", CACHE_FILE_VERSION);
+    cache.set<lth_jc::JsonContainer>("modules", modules);
+
+    try {
+        auto cache_dir = fs::path(cache_file_).parent_path();
+        if (!cache_dir.empty())
+            fs::create_directories(cache_dir);
+        lth_file::atomic_write_to_file(cache.toString() + "\n", cache_file_,
+                                       NIX_FILE_PERMS, std::ios::binary);
+        changed_ = false;
+        LOG_DEBUG("Stored the metadata of {1} modules in {2}", modules.size(), cache_file_);
+    } catch (const std::exception& e) {
+        LOG_WARNING("Failed to write the module metadata cache {1}: {2}",
+                    cache_file_, e.what());
+    }
+}
+
+}  // namespace PXPAgent
@@ -0,0 +1,239 @@
+#include <pxp-agent/module_worker_pool.hpp>
+#include <pxp-agent/module.hpp>
+
+#include <leatherman/json_container/json_container.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#define LEATHERMAN_LOGGING_NAMESPACE "puppetlabs.pxp_agent.module_worker_pool"
+#include <leatherman/logging/logging.hpp>
+
+#include <utility>  // std::move
+
+namespace PXPAgent {
+
+namespace lth_jc   = leatherman::json_container;
+namespace lth_loc  = leatherman::locale;
+namespace pcp_util = PCPClient::Util;
+
+const std::chrono::seconds ModuleWorkerPool::HEALTH_CHECK_INTERVAL { 30 };
+const std::chrono::seconds ModuleWorkerPool::HEALTH_CHECK_TIMEOUT { 5 };
+const unsigned int ModuleWorkerPool::MAX_START_FAILURES { 3 };
+
+ModuleWorkerPool::ModuleWorkerPool(std::string exec_path,
+                                   uint32_t max_workers,
+                                   uint32_t max_requests_per_worker,
+                                   std::chrono::seconds action_timeout)
+        : exec_path_ { std::move(exec_path) },
+          max_workers_ { max_workers },
+          max_requests_per_worker_ { max_requests_per_worker },
+          action_timeout_ { action_timeout },
+          idle_workers_ {},
+          num_workers_ { 0 },
+          num_start_failures_ { 0 },
+          next_request_id_ { 0 }
+{
+}
+
+bool ModuleWorkerPool::run(const std::string& action,
+                           const std::string& arguments,
+                           uint64_t max_response_size,
+                           Result& result)
+{
+    auto request_id = nextRequestId();
+    lth_jc::JsonContainer request {};
+    request.set<std::string>("id", request_id);
+    request.set<std::string>("type", "action");
+    request.set<std::string>("action", action);
+    request.set<lth_jc::JsonContainer>("arguments", lth_jc::JsonContainer { arguments });
+
+    auto worker = acquire();
+    if (!worker)
+        return false;
+
+    try {
+        worker->process->writeLine(request.toString());
+    } catch (Util::ModuleWorker::Error& e) {
+        LOG_DEBUG("Failed to send the '{1}' action to a worker of {2}: {3}",
+                  action, exec_path_, e.what());
+        release(std::move(worker), true);
+        return false;
+    }
+    worker->num_requests++;
+
+    try {
+        lth_jc::JsonContainer response {
+            worker->process->readLine(
+                std::chrono::duration_cast<std::chrono::milliseconds>(action_timeout_),
+                static_cast<size_t>(max_response_size)) };
+        if (response.get<std::string>("id") != request_id)
+            throw lth_jc::data_error { lth_loc::translate("unexpected request id") };
+        result.exitcode = response.get<int>("exitcode");
+        result.std_out = response.includes("stdout") ? response.get<std::string>("stdout") : "";
+        result.std_err = response.includes("stderr") ? response.get<std::string>("stderr") : "";
+    } catch (Util::ModuleWorker::Error& e) {
+        LOG_WARNING("The worker {1} of {2} failed while running the '{3}' action: {4}",
+                    worker->process->pid(), exec_path_, action, e.what());
+        release(std::move(worker), true);
+        throw Module::ProcessingError {
+            lth_loc::format("the module worker failed: {1}", e.what()) };
+    } catch (lth_jc::data_error& e) {
+        LOG_WARNING("The worker {1} of {2} sent an invalid response to the '{3}' action: {4}",
+                    worker->process->pid(), exec_path_, action, e.what());
+        release(std::move(worker), true);
+        throw Module::ProcessingError {
+            lth_loc::format("invalid response of the module worker: {1}", e.what()) };
+    }
+
+    worker->last_used = std::chrono::steady_clock::now();
+    release(std::move(worker), false);
+    return true;
+}
+
+size_t ModuleWorkerPool::size()
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+    return num_workers_;
+}
+
+bool ModuleWorkerPool::enabled()
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+    return num_start_failures_ < MAX_START_FAILURES;
+}
+
+std::unique_ptr<ModuleWorkerPool::Worker> ModuleWorkerPool::acquire()
+{
+    while (true) {
+        std::unique_ptr<Worker> worker;
+        {
+            pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+            if (!idle_workers_.empty()) {
+                worker = std::move(idle_workers_.back());
+                idle_workers_.pop_back();
+            } else if (num_start_failures_ < MAX_START_FAILURES
+                       && num_workers_ < max_workers_) {
+                // Reserves the slot while the worker starts
+                num_workers_++;
+            } else {
+                return nullptr;
+            }
+        }
+
+        if (!worker)
+            return start();
+
+        if (isHealthy(*worker))
+            return worker;
+
+        LOG_DEBUG("Discarding the worker {1} of {2}, as it failed its health check",
+                  worker->process->pid(), exec_path_);
+        release(std::move(worker), true);
+    }
+}
+
+void ModuleWorkerPool::release(std::unique_ptr<Worker> worker, bool failed)
+{
+    bool retire { failed || worker->num_requests >= max_requests_per_worker_ };
+
+    {
+        pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+        if (!retire) {
+            idle_workers_.push_back(std::move(worker));
+            return;
+        }
+        num_workers_--;
+    }
+
+    if (!failed)
+        LOG_DEBUG("Recycling the worker {1} of {2} after {3} requests",
+                  worker->process->pid(), exec_path_, worker->num_requests);
+
+    // Waits for the process to exit; done without holding the lock
+    worker.reset();
+}
+
+std::unique_ptr<ModuleWorkerPool::Worker> ModuleWorkerPool::start()
+{
+    std::unique_ptr<Worker> worker { new Worker {} };
+    worker->num_requests = 0;
+
+    try {
+        worker->process.reset(new Util::ModuleWorker { exec_path_ });
+
+        // The first ping tells whether the process speaks the protocol
+        // at all, before any action is entrusted to it
+        if (!ping(*worker))
+            throw Util::ModuleWorker::Error {
+                lth_loc::translate("the worker did not answer its first ping") };
+    } catch (Util::ModuleWorker::Error& e) {
+        worker.reset();
+        unsigned int num_failures;
+        {
+            pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+            num_workers_--;
+            num_failures = ++num_start_failures_;
+        }
+        if (num_failures >= MAX_START_FAILURES) {
+            LOG_WARNING("Failed to start a worker of {1}: {2}; its actions will be run "
+                        "by a process of their own from now on", exec_path_, e.what());
+        } else {
+            LOG_WARNING("Failed to start a worker of {1}: {2}", exec_path_, e.what());
+        }
+        return nullptr;
+    }
+
+    {
+        pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+        num_start_failures_ = 0;
+    }
+    LOG_DEBUG("Started the worker {1} of {2}", worker->process->pid(), exec_path_);
+    return worker;
+}
+
+bool ModuleWorkerPool::isHealthy(Worker& worker)
+{
+    if (!worker.process->isRunning())
+        return false;
+
+    if (std::chrono::steady_clock::now() - worker.last_used < HEALTH_CHECK_INTERVAL)
+        return true;
+
+    return ping(worker);
+}
+
+bool ModuleWorkerPool::ping(Worker& worker)
+{
+    try {
+        auto request_id = nextRequestId();
+        lth_jc::JsonContainer request {};
+        request.set<std::string>("id", request_id);
+        request.set<std::string>("type", "ping");
+        worker.process->writeLine(request.toString());
+
+        lth_jc::JsonContainer pong {
+            worker.process->readLine(
+                std::chrono::duration_cast<std::chrono::milliseconds>(HEALTH_CHECK_TIMEOUT)) };
+        if (pong.get<std::string>("id") != request_id)
+            return false;
+    } catch (Util::ModuleWorker::Error& e) {
+        LOG_DEBUG("The worker {1} of {2} did not answer the ping: {3}",
+                  worker.process->pid(), exec_path_, e.what());
+        return false;
+    } catch (lth_jc::data_error& e) {
+        LOG_DEBUG("The worker {1} of {2} sent an invalid answer to the ping: {3}",
+                  worker.process->pid(), exec_path_, e.what());
+        return false;
+    }
+
+    worker.last_used = std::chrono::steady_clock::now();
+    return true;
+}
+
+std::string ModuleWorkerPool::nextRequestId()
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+    return std::to_string(++next_request_id_);
+}
+
+}  // namespace PXPAgent
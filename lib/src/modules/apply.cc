@@ -26,6 +26,19 @@ namespace Modules {
             },
             "apply_options": {
                 "type": "object"
+            },
+            "output_limit": {
+                "type": "object",
+                "properties": {
+                    "head_bytes": {
+                        "type": "integer",
+                        "minimum": 1
+                    },
+                    "tail_bytes": {
+                        "type": "integer",
+                        "minimum": 1
+                    }
+                }
             }
         },
         "required": ["catalog", "apply_options"]
@@ -74,6 +87,16 @@ namespace Modules {
     // NIX_DIR_PERMS is defined in pxp-agent/configuration
     #define NIX_DOWNLOADED_FILE_PERMS NIX_DIR_PERMS
 
+    // the plugin cache entry is keyed by environment name
+    std::vector<std::string> Apply::cacheEntries(const ActionRequest& request)
+    {
+        auto params = request.params();
+        if (request.action() == "apply") {
+            return { params.get<std::string>({"catalog", "environment"}) };
+        }
+        return { params.get<std::string>("environment") };
+    }
+
     Util::CommandObject Apply::buildCommandObject(const ActionRequest& request)
     {
         if (crl_ == "") {
@@ -28,6 +28,7 @@ Command::Command(const fs::path& exec_prefix, std::shared_ptr<ResultsStorage> st
     // Command actions require a single "command" string parameter
     PCPClient::Schema input_schema { COMMAND_RUN_ACTION };
     input_schema.addConstraint("command", PCPClient::TypeConstraint::String, true);
+    input_schema.addConstraint("output_limit", PCPClient::TypeConstraint::Object, false);
     input_validator_.registerSchema(input_schema);
 
     PCPClient::Schema output_schema { COMMAND_RUN_ACTION };
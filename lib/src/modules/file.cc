@@ -1,6 +1,8 @@
 #include <pxp-agent/modules/file.hpp>
 #include <pxp-agent/util/bolt_helpers.hpp>
 #include <pxp-agent/util/bolt_module.hpp>
+#include <pxp-agent/util/file_fingerprint.hpp>
+#include <pxp-agent/util/parallel.hpp>
 #include <pxp-agent/configuration.hpp>
 #include <pxp-agent/module.hpp>
 #include <boost/algorithm/hex.hpp>
@@ -10,6 +12,7 @@
 #include <leatherman/file_util/file.hpp>
 #include <leatherman/file_util/directory.hpp>
 
+#include <chrono>
 #include <vector>
 #include <string>
 
@@ -23,6 +26,7 @@ namespace PXPAgent {
 namespace Modules {
 
   static const std::string FILE_ACTION { "download" };
+  static const std::string UNCHANGED_STATUS { "unchanged" };
 
   static const std::string FILE_ACTION_INPUT_SCHEMA { R"(
   {
@@ -65,6 +69,15 @@ namespace Modules {
   }
   )" };
 
+  const uint32_t File::DEFAULT_PARALLEL_ENTRIES { 8 };
+
+  // Outcome of an entry of the files array: whether its destination was
+  // changed, and how long it took
+  struct EntryOutcome {
+    std::string status;
+    int64_t duration_ms;
+  };
+
 
   File::File(const std::vector<std::string>& master_uris,
                              const std::string& ca,
@@ -75,12 +88,14 @@ namespace Modules {
                              uint32_t download_connect_timeout,
                              uint32_t download_timeout,
                              std::shared_ptr<ModuleCacheDir> module_cache_dir,
-                             std::shared_ptr<ResultsStorage> storage) :
+                             std::shared_ptr<ResultsStorage> storage,
+                             uint32_t max_parallel_entries) :
     BoltModule { "", std::move(storage), std::move(module_cache_dir) },
     Purgeable { module_cache_dir_->purge_ttl_ },
     master_uris_ { master_uris },
     file_download_connect_timeout_ { download_connect_timeout },
-    file_download_timeout_ { download_timeout }
+    file_download_timeout_ { download_timeout },
+    max_parallel_entries_ { max_parallel_entries }
   {
     module_name = "file";
     actions.push_back(FILE_ACTION);
@@ -91,84 +106,139 @@ namespace Modules {
     input_validator_.registerSchema(input_schema);
     results_validator_.registerSchema(output_schema);
 
-    client_.set_ca_cert(ca);
-    client_.set_client_cert(crt, key);
-    client_.set_client_crl(crl);
-    client_.set_supported_protocols(CURLPROTO_HTTPS);
-    client_.set_proxy(proxy);
-  }
-
-
-  // Write results to results_dir and return them as
-  // an ActionOutput struct
-  static ActionOutput write_download_results(const fs::path& results_dir,
-                                             const int exit_code,
-                                             const std::string& std_out,
-                                             const std::string& std_err)
-  {
-    lth_file::atomic_write_to_file(std::to_string(exit_code) + "\n",
-                                   (results_dir / "exitcode").string(),
-                                   NIX_FILE_PERMS,
-                                   std::ios::binary);
-    lth_file::atomic_write_to_file(std_out,
-                                   (results_dir / "stdout").string(),
-                                   NIX_FILE_PERMS,
-                                   std::ios::binary);
-    lth_file::atomic_write_to_file(std_err,
-                                   (results_dir / "stderr").string(),
-                                   NIX_FILE_PERMS,
-                                   std::ios::binary);
-    return ActionOutput { exit_code, std_out, std_err };
+    client_settings_ = ModuleCacheDir::ClientSettings { ca, crt, key, crl, proxy };
   }
 
 
   // File overrides callAction from the base BoltModule class since there's no need to run
-  // any commands with File. CallAction will simply download the file and return a result
-  // based on if the download succeeded or failed.
+  // any commands with File. CallAction will simply download the files and return a result
+  // based on if the downloads succeeded or failed.
+  //
+  // The directories are created first, in order, so that the files, symlinks and archives can
+  // then be placed in parallel. The destinations that already match are left untouched; the
+  // files are not hashed again as long as their fingerprint matches their verified record (see
+  // ModuleCacheDir). The results report the outcome and the duration of each entry.
+  //
+  // An archive entry is a tar archive (optionally gzip compressed) extracted into its
+  // destination directory as it's downloaded, which saves a request per file for large trees;
+  // it's extracted again on each request.
   ActionResponse File::callAction(const ActionRequest& request)
   {
     auto file_params = request.params();
     auto files = file_params.get<std::vector<lth_jc::JsonContainer>>("files");
     const fs::path& results_dir = request.resultsDir();
 
-    ActionResponse response { ModuleType::Internal, request };
-    lth_jc::JsonContainer result;
-    for (auto this_file : files) {
-      auto destination = fs::path(this_file.get<std::string>("destination"));
-      auto kind = this_file.get<std::string>("kind");
+    std::vector<std::string> cache_entries;
+    std::vector<size_t> directories, other_entries;
+    for (size_t i = 0; i < files.size(); i++) {
+      auto kind = files[i].get<std::string>("kind");
       if (kind == "file") {
-        module_cache_dir_->downloadFileFromMaster(master_uris_,
-                                                  file_download_connect_timeout_,
-                                                  file_download_timeout_,
-                                                  client_,
-                                                  module_cache_dir_->createCacheDir(this_file.get<std::string>("sha256")),
-                                                  destination,
-                                                  this_file);
-      } else if (kind == "directory"){
-        if (fs::exists(destination)) {
-          if (!fs::is_directory(destination)) {
-            throw Module::ProcessingError { lth_loc::format("Destination {1} already exists and is not a directory!", destination) };
-          }
-        } else {
-          Util::createDir(destination);
-        }
-      } else if (kind == "symlink") {
-        if (fs::exists(destination)) {
-          if (!fs::is_symlink(destination)) {
-            throw Module::ProcessingError { lth_loc::format("Destination {1} already exists and is not a symlink!", destination) };
-          }
-        } else {
-          Util::createSymLink(fs::path(this_file.get<std::string>("link_source")), destination);
-        }
+        cache_entries.push_back(files[i].get<std::string>("sha256"));
+        other_entries.push_back(i);
+      } else if (kind == "symlink" || kind == "archive") {
+        other_entries.push_back(i);
+      } else if (kind == "directory") {
+        directories.push_back(i);
       } else {
         throw Module::ProcessingError { lth_loc::format("Not a valid file type! {1}", kind) };
       }
     }
-    response.output = write_download_results(results_dir, EXIT_SUCCESS, "downloaded", "");
+    ModuleCacheDir::EntryPin cache_pin { *module_cache_dir_, cache_entries };
+
+    std::vector<EntryOutcome> outcomes(files.size(), EntryOutcome { "", 0 });
+    auto timeEntry = [&](size_t file_idx) {
+      auto start = std::chrono::steady_clock::now();
+      outcomes[file_idx].status = placeEntry(files[file_idx]);
+      outcomes[file_idx].duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    };
+
+    for (auto file_idx : directories) {
+      timeEntry(file_idx);
+    }
+    Util::runInParallel(other_entries.size(), max_parallel_entries_, [&](size_t entry_idx) {
+      timeEntry(other_entries[entry_idx]);
+    });
+
+    std::vector<lth_jc::JsonContainer> entry_results;
+    int unchanged { 0 };
+    for (size_t i = 0; i < files.size(); i++) {
+      lth_jc::JsonContainer entry_result;
+      entry_result.set<std::string>("destination", files[i].get<std::string>("destination"));
+      entry_result.set<std::string>("kind", files[i].get<std::string>("kind"));
+      entry_result.set<std::string>("status", outcomes[i].status);
+      entry_result.set<int>("duration_ms", static_cast<int>(outcomes[i].duration_ms));
+      entry_results.push_back(entry_result);
+      if (outcomes[i].status == UNCHANGED_STATUS) {
+        unchanged++;
+      }
+    }
+
+    lth_jc::JsonContainer report;
+    report.set<std::vector<lth_jc::JsonContainer>>("files", entry_results);
+    report.set<int>("changed", static_cast<int>(files.size()) - unchanged);
+    report.set<int>("unchanged", unchanged);
+
+    ActionResponse response { ModuleType::Internal, request };
+    response.output = writeOutput(results_dir, EXIT_SUCCESS, report.toString(), "");
     processOutputAndUpdateMetadata(response);
     return response;
   }
 
+  std::string File::placeEntry(const lth_jc::JsonContainer& file)
+  {
+    auto destination = fs::path(file.get<std::string>("destination"));
+    auto kind = file.get<std::string>("kind");
+
+    if (kind == "directory") {
+      if (fs::exists(destination)) {
+        if (!fs::is_directory(destination)) {
+          throw Module::ProcessingError { lth_loc::format("Destination {1} already exists and is not a directory!", destination) };
+        }
+        return UNCHANGED_STATUS;
+      }
+      Util::createDir(destination);
+      return "created";
+    }
+
+    if (kind == "symlink") {
+      if (fs::exists(destination)) {
+        if (!fs::is_symlink(destination)) {
+          throw Module::ProcessingError { lth_loc::format("Destination {1} already exists and is not a symlink!", destination) };
+        }
+        return UNCHANGED_STATUS;
+      }
+      Util::createSymLink(fs::path(file.get<std::string>("link_source")), destination);
+      return "created";
+    }
+
+    if (kind == "archive") {
+      module_cache_dir_->downloadArchiveFromMaster(master_uris_,
+                                                   file_download_connect_timeout_,
+                                                   file_download_timeout_,
+                                                   client_settings_,
+                                                   destination,
+                                                   file);
+      return "extracted";
+    }
+
+    // A destination that already matches keeps its fingerprint, as
+    // it's neither downloaded nor copied again
+    Util::FileFingerprint before, after;
+    bool existed = Util::getFileFingerprint(destination.string(), before);
+    module_cache_dir_->downloadFileFromMaster(master_uris_,
+                                              file_download_connect_timeout_,
+                                              file_download_timeout_,
+                                              client_settings_,
+                                              module_cache_dir_->createCacheDir(file.get<std::string>("sha256")),
+                                              destination,
+                                              file);
+    if (existed && Util::getFileFingerprint(destination.string(), after) && after == before) {
+      return UNCHANGED_STATUS;
+    }
+    return "downloaded";
+  }
+
 
   unsigned int File::purge(
       const std::string& ttl,
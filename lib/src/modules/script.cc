@@ -49,6 +49,19 @@ namespace Modules {
                 "items": {
                     "type": "string"
                 }
+            },
+            "output_limit": {
+                "type": "object",
+                "properties": {
+                    "head_bytes": {
+                        "type": "integer",
+                        "minimum": 0
+                    },
+                    "tail_bytes": {
+                        "type": "integer",
+                        "minimum": 0
+                    }
+                }
             }
         },
         "required": ["script", "arguments"]
@@ -81,11 +94,12 @@ namespace Modules {
         input_validator_.registerSchema(input_schema);
         results_validator_.registerSchema(output_schema);
 
-        client_.set_ca_cert(ca);
-        client_.set_client_cert(crt, key);
-        client_.set_client_crl(crl);
-        client_.set_supported_protocols(CURLPROTO_HTTPS);
-        client_.set_proxy(proxy);
+        client_settings_ = ModuleCacheDir::ClientSettings { ca, crt, key, crl, proxy };
+    }
+
+    std::vector<std::string> Script::cacheEntries(const ActionRequest& request)
+    {
+        return { request.params().get<std::string>({"script", "sha256"}) };
     }
 
     Util::CommandObject Script::buildCommandObject(const ActionRequest& request)
@@ -99,7 +113,7 @@ namespace Modules {
         auto script_file = module_cache_dir_->getCachedFile(master_uris_,
                                                             download_connect_timeout_,
                                                             download_timeout_,
-                                                            client_,
+                                                            client_settings_,
                                                             module_cache_dir_->createCacheDir(script.get<std::string>("sha256")),
                                                             script);
         Util::CommandObject cmd {
@@ -3,6 +3,8 @@
 #include <pxp-agent/time.hpp>
 #include <pxp-agent/util/utf8.hpp>
 #include <pxp-agent/util/bolt_helpers.hpp>
+#include <pxp-agent/util/parallel.hpp>
+#include <pxp-agent/util/sha256.hpp>
 
 #include <cpp-pcp-client/util/chrono.hpp>
 
@@ -20,7 +22,6 @@
 #include <leatherman/logging/logging.hpp>
 
 #include <openssl/evp.h>
-#include <curl/curl.h>
 
 #include <tuple>
 
@@ -36,7 +37,6 @@ namespace lth_exec = leatherman::execution;
 namespace lth_file = leatherman::file_util;
 namespace lth_jc   = leatherman::json_container;
 namespace lth_loc  = leatherman::locale;
-namespace lth_curl = leatherman::curl;
 
 static const std::string TASK_RUN_ACTION { "run" };
 
@@ -126,12 +126,83 @@ static const std::string TASK_RUN_ACTION_INPUT_SCHEMA { R"(
     },
     "input_method": {
       "type": "string"
+    },
+    "output_limit": {
+      "type": "object",
+      "properties": {
+        "head_bytes": {
+          "type": "integer",
+          "minimum": 1
+        },
+        "tail_bytes": {
+          "type": "integer",
+          "minimum": 1
+        }
+      }
     }
   },
   "required": ["task", "files", "input"]
 }
 )" };
 
+// Downloads and verifies task files into the cache ahead of the runs
+// that need them
+static const std::string TASK_PREFETCH_ACTION { "prefetch" };
+
+static const std::string TASK_PREFETCH_ACTION_INPUT_SCHEMA { R"(
+{
+  "type": "object",
+  "properties": {
+    "files": {
+      "type": "array",
+      "items": {
+        "type": "object",
+        "properties": {
+          "filename": {
+            "type": "string"
+          },
+          "uri": {
+            "type": "object",
+            "properties": {
+              "path": {
+                "type": "string"
+              },
+              "params": {
+                 "type": "object"
+              }
+            },
+            "required": ["path", "params"]
+          },
+          "sha256": {
+            "type": "string"
+          }
+        },
+        "required": ["filename", "uri", "sha256"]
+      },
+      "minItems": 1
+    }
+  },
+  "required": ["files"]
+}
+)" };
+
+// Imports a local bundle of task files (see
+// ModuleCacheDir::importBundle) into the cache, e.g. for the agents
+// that can't reach the master-uris
+static const std::string TASK_IMPORT_BUNDLE_ACTION { "import_bundle" };
+
+static const std::string TASK_IMPORT_BUNDLE_ACTION_INPUT_SCHEMA { R"(
+{
+  "type": "object",
+  "properties": {
+    "path": {
+      "type": "string"
+    }
+  },
+  "required": ["path"]
+}
+)" };
+
 Task::Task(const fs::path& exec_prefix,
            const std::vector<std::string>& primary_uris,
            const std::string& ca,
@@ -156,6 +227,8 @@ Task::Task(const fs::path& exec_prefix,
 {
     module_name = "task";
     actions.push_back(TASK_RUN_ACTION);
+    actions.push_back(TASK_PREFETCH_ACTION);
+    actions.push_back(TASK_IMPORT_BUNDLE_ACTION);
 
     PCPClient::Schema input_schema { TASK_RUN_ACTION, lth_jc::JsonContainer { TASK_RUN_ACTION_INPUT_SCHEMA } };
     PCPClient::Schema output_schema { TASK_RUN_ACTION };
@@ -163,11 +236,19 @@ Task::Task(const fs::path& exec_prefix,
     input_validator_.registerSchema(input_schema);
     results_validator_.registerSchema(output_schema);
 
-    client_.set_ca_cert(ca);
-    client_.set_client_cert(crt, key);
-    client_.set_client_crl(crl);
-    client_.set_supported_protocols(CURLPROTO_HTTPS);
-    client_.set_proxy(proxy);
+    PCPClient::Schema prefetch_input_schema { TASK_PREFETCH_ACTION, lth_jc::JsonContainer { TASK_PREFETCH_ACTION_INPUT_SCHEMA } };
+    PCPClient::Schema prefetch_output_schema { TASK_PREFETCH_ACTION };
+
+    input_validator_.registerSchema(prefetch_input_schema);
+    results_validator_.registerSchema(prefetch_output_schema);
+
+    PCPClient::Schema import_bundle_input_schema { TASK_IMPORT_BUNDLE_ACTION, lth_jc::JsonContainer { TASK_IMPORT_BUNDLE_ACTION_INPUT_SCHEMA } };
+    PCPClient::Schema import_bundle_output_schema { TASK_IMPORT_BUNDLE_ACTION };
+
+    input_validator_.registerSchema(import_bundle_input_schema);
+    results_validator_.registerSchema(import_bundle_output_schema);
+
+    client_settings_ = ModuleCacheDir::ClientSettings { ca, crt, key, crl, proxy };
 }
 
 std::set<std::string> const& Task::features() const
@@ -183,11 +264,8 @@ static void addParametersToEnvironment(const lth_jc::JsonContainer &input, std::
     }
 }
 
-// build a spool dir for the supporting library files requested by a multifile task
-static fs::path createInstallDir(const fs::path& spool_dir, const std::set<std::string>& download_set) {
-    auto install_dir = spool_dir / fs::unique_path("temp_task_%%%%-%%%%-%%%%-%%%%");
-    Util::createDir(install_dir);
-
+// build the directory structure for the supporting library files requested by a multifile task
+static void createInstallDir(const fs::path& install_dir, const std::set<std::string>& download_set) {
     // this should generate a unique collection of directory paths to append to install_dir
     // for example:
     // if files had the paths: /one/two/three.txt, /one/two/one.txt, /one/two.txt
@@ -205,8 +283,6 @@ static fs::path createInstallDir(const fs::path& spool_dir, const std::set<std::
             Util::createDir(tmp);
         }
     }
-
-    return install_dir;
 }
 
 // Get a unique list of "lib" files that the task has specified in metadata
@@ -237,36 +313,151 @@ std::set<std::string> getMultiFiles(std::vector<std::string> const& meta_files,
     return download_set;
 }
 
-// iterate over unique set of filenames to support task
-// copy file from cache to install_dir
-fs::path Task::downloadMultiFile(std::vector<lth_jc::JsonContainer> const& files,
-                                 std::set<std::string> const& download_set,
-                                 fs::path const& spool_dir)
+// Maximum number of files fetched at once for a task; the downloads
+// among them are further bounded by the ModuleCacheDir
+static const size_t MAX_PARALLEL_LIB_FILES { 8 };
+
+// get the unique set of filenames to support task from the cache,
+// downloading them in parallel if necessary, and stage them into
+// install_dir
+void Task::downloadMultiFile(std::vector<lth_jc::JsonContainer> const& files,
+                             std::set<std::string> const& download_set,
+                             fs::path const& install_dir)
 {
-    fs::file_status s = fs::status(spool_dir);
-    fs::path spool;
-    if (fs::is_directory(s)) {
-      spool = spool_dir;
-    } else {
-      spool = module_cache_dir_->cache_dir_;
+    createInstallDir(install_dir, download_set);
+
+    // get file object info based on name
+    std::vector<std::pair<std::string, lth_jc::JsonContainer>> lib_files;
+    for (auto& file_name : download_set) {
+        lib_files.emplace_back(file_name, selectLibFile(files, file_name));
     }
-    auto install_dir = createInstallDir(spool, download_set);
-    for (auto file_name : download_set) {
-        // get file object info based on name
-        auto file_object = selectLibFile(files, file_name);
 
+    Util::runInParallel(lib_files.size(), MAX_PARALLEL_LIB_FILES, [&](size_t file_idx) {
+        auto& file_name = lib_files[file_idx].first;
+        auto& file_object = lib_files[file_idx].second;
+        auto sha256 = file_object.get<std::string>("sha256");
+        auto cache_dir = module_cache_dir_->createCacheDir(sha256);
         // get file from cache, download if necessary
         auto lib_file = module_cache_dir_->getCachedFile(primary_uris_,
                                                          task_download_connect_timeout_,
                                                          task_download_timeout_,
-                                                         client_,
-                                                         module_cache_dir_->createCacheDir(file_object.get<std::string>("sha256")),
+                                                         client_settings_,
+                                                         cache_dir,
                                                          file_object);
-        // copy to expected location in install_dir
-        fs::copy_file(lib_file, install_dir / fs::path(file_name));
+        // clone or copy to expected location in install_dir
+        module_cache_dir_->stageCachedFile(lib_file, install_dir / fs::path(file_name));
+    });
+}
+
+// Outcome of the prefetch of a file: "hit" if it was already cached,
+// "miss" if it was downloaded, or "failed"
+struct PrefetchedFile {
+    std::string status;
+    uint64_t bytes;
+    std::string error;
+};
+
+lth_jc::JsonContainer Task::prefetchFiles(std::vector<lth_jc::JsonContainer> files)
+{
+    std::vector<PrefetchedFile> prefetched(files.size(), PrefetchedFile { "failed", 0, "" });
+
+    // errors are reported for each file, so that the other files are
+    // still fetched
+    Util::runInParallel(files.size(), MAX_PARALLEL_LIB_FILES, [&](size_t file_idx) {
+        auto& file = files[file_idx];
+        auto& outcome = prefetched[file_idx];
+        try {
+            auto cache_dir = module_cache_dir_->createCacheDir(file.get<std::string>("sha256"));
+            bool cached = module_cache_dir_->isCached(cache_dir, file);
+            module_cache_dir_->getCachedFile(primary_uris_,
+                                             task_download_connect_timeout_,
+                                             task_download_timeout_,
+                                             client_settings_,
+                                             cache_dir,
+                                             file,
+                                             &outcome.bytes);
+            outcome.status = cached ? "hit" : "miss";
+        } catch (const std::exception& e) {
+            LOG_WARNING("Failed to prefetch the task file {1}: {2}",
+                        file.get<std::string>("filename"), e.what());
+            outcome.error = e.what();
+        }
+    });
+
+    std::vector<lth_jc::JsonContainer> file_results;
+    int hits { 0 }, misses { 0 }, failures { 0 };
+    uint64_t bytes_transferred { 0 };
+
+    for (size_t i = 0; i < files.size(); i++) {
+        lth_jc::JsonContainer file_result;
+        file_result.set<std::string>("filename", files[i].get<std::string>("filename"));
+        file_result.set<std::string>("sha256", files[i].get<std::string>("sha256"));
+        file_result.set<std::string>("status", prefetched[i].status);
+        // NB: the sizes are set as double, as they may not fit an int
+        file_result.set<double>("bytes", static_cast<double>(prefetched[i].bytes));
+        if (!prefetched[i].error.empty()) {
+            file_result.set<std::string>("error", prefetched[i].error);
+        }
+        file_results.push_back(file_result);
+
+        if (prefetched[i].status == "hit") {
+            hits++;
+        } else if (prefetched[i].status == "miss") {
+            misses++;
+        } else {
+            failures++;
+        }
+        bytes_transferred += prefetched[i].bytes;
+    }
+
+    lth_jc::JsonContainer result;
+    result.set<std::vector<lth_jc::JsonContainer>>("files", file_results);
+    result.set<int>("hits", hits);
+    result.set<int>("misses", misses);
+    result.set<int>("failures", failures);
+    result.set<double>("bytes_transferred", static_cast<double>(bytes_transferred));
+    return result;
+}
+
+lth_jc::JsonContainer Task::importBundle(const std::string& bundle_path)
+{
+    auto imported = module_cache_dir_->importBundle(lth_file::tilde_expand(bundle_path));
+
+    lth_jc::JsonContainer result;
+    result.set<int>("imported", static_cast<int>(imported.imported));
+    result.set<int>("already_cached", static_cast<int>(imported.already_cached));
+    result.set<int>("rejected", static_cast<int>(imported.rejected));
+    result.set<double>("bytes_imported", static_cast<double>(imported.bytes));
+    return result;
+}
+
+// the prefetch and import_bundle actions run no command; their report
+// is returned as the stdout of a command would be, failing in case any
+// file failed or was rejected
+ActionResponse Task::callAction(const ActionRequest& request)
+{
+    lth_jc::JsonContainer report;
+    int exit_code;
+
+    if (request.action() == TASK_PREFETCH_ACTION) {
+        ModuleCacheDir::EntryPin cache_pin { *module_cache_dir_, cacheEntries(request) };
+        report = prefetchFiles(request.params().get<std::vector<lth_jc::JsonContainer>>("files"));
+        exit_code = report.get<int>("failures") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (request.action() == TASK_IMPORT_BUNDLE_ACTION) {
+        report = importBundle(request.params().get<std::string>("path"));
+        exit_code = report.get<int>("rejected") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else {
+        return BoltModule::callAction(request);
     }
 
-    return install_dir;
+    ActionResponse response { ModuleType::Internal, request };
+    if (request.resultsDir().empty()) {
+        response.output = ActionOutput { exit_code, report.toString(), "" };
+    } else {
+        response.output = writeOutput(request.resultsDir(), exit_code, report.toString(), "");
+    }
+    processOutputAndUpdateMetadata(response);
+    return response;
 }
 
 lth_jc::JsonContainer Task::selectLibFile(std::vector<lth_jc::JsonContainer> const& files,
@@ -348,10 +539,55 @@ static lth_jc::JsonContainer selectTaskFile(std::vector<lth_jc::JsonContainer> c
     return *file;
 }
 
+static lth_jc::JsonContainer getTaskMetadata(const lth_jc::JsonContainer& task_execution_params)
+{
+    return task_execution_params.getWithDefault<lth_jc::JsonContainer>("metadata", task_execution_params);
+}
+
+// The install dir of a multifile task is shared by the runs of the
+// same task with the same metadata and files; its cache entry is named
+// after a digest of them, so that any change results in a new one
+static std::string getInstallDirEntry(const std::string& task_name,
+                                      const lth_jc::JsonContainer& task_metadata,
+                                      const std::vector<lth_jc::JsonContainer>& files)
+{
+    Util::Sha256 digest;
+    auto add = [&digest](const std::string& value) {
+        // NUL separated, so that different values can't be concatenated alike
+        digest.update(value.data(), value.size() + 1);
+    };
+
+    add(task_name);
+    add(task_metadata.toString());
+    for (auto& file : files) {
+        add(file.get<std::string>("filename"));
+        add(file.get<std::string>("sha256"));
+    }
+
+    return "installdir_" + digest.hexDigest();
+}
+
+// pin every file of the task and its install dir, as the implementation
+// and its library files are selected only when the command is built
+std::vector<std::string> Task::cacheEntries(const ActionRequest& request)
+{
+    std::vector<std::string> entries;
+    auto files = request.params().getWithDefault<std::vector<lth_jc::JsonContainer>>("files", {});
+    for (auto& file : files) {
+        entries.push_back(file.get<std::string>("sha256"));
+    }
+    if (!files.empty() && request.params().includes("task")) {
+        entries.push_back(getInstallDirEntry(request.params().get<std::string>("task"),
+                                             getTaskMetadata(request.params()),
+                                             files));
+    }
+    return entries;
+}
+
 Util::CommandObject Task::buildCommandObject(const ActionRequest& request)
 {
     auto task_execution_params = request.params();
-    auto task_metadata = task_execution_params.getWithDefault<lth_jc::JsonContainer>("metadata", task_execution_params);
+    auto task_metadata = getTaskMetadata(task_execution_params);
     auto task_name = task_execution_params.get<std::string>("task");
 
     std::set<std::string> feats = features();
@@ -374,11 +610,12 @@ Util::CommandObject Task::buildCommandObject(const ActionRequest& request)
 
     auto files = task_execution_params.get<std::vector<lth_jc::JsonContainer>>("files");
     auto file = selectTaskFile(files, implementation);
+    auto task_cache_dir = module_cache_dir_->createCacheDir(file.get<std::string>("sha256"));
     auto task_file = module_cache_dir_->getCachedFile(primary_uris_,
                                                       task_download_connect_timeout_,
                                                       task_download_timeout_,
-                                                      client_,
-                                                      module_cache_dir_->createCacheDir(file.get<std::string>("sha256")),
+                                                      client_settings_,
+                                                      task_cache_dir,
                                                       file);
     // If input_method is unset use the default "powershell" for a powershell task or "both" for any other task
     if (implementation.input_method.empty()) {
@@ -398,13 +635,19 @@ Util::CommandObject Task::buildCommandObject(const ActionRequest& request)
     auto lib_files = getMultiFiles(meta_files, implementation.files, files);
 
     if (lib_files.size() > 0) {
-        auto install_dir = downloadMultiFile(files, lib_files, request.resultsDir());
+        // the install dir is built once and then reused by the next
+        // runs of the task, as long as its metadata and files match
         auto module = task_name.substr(0, task_name.find(':'));
-        Util::createDir(install_dir / module);
-        Util::createDir(install_dir / module / "tasks");
-        auto task_dest = install_dir / module / "tasks" / task_file.filename();
-        fs::copy_file(task_file, task_dest);
-        task_file = task_dest;
+        auto task_dest = fs::path(module) / "tasks" / task_file.filename();
+        auto install_dir = module_cache_dir_->getDerivedEntry(
+            getInstallDirEntry(task_name, task_metadata, files),
+            [&](const fs::path& dir) {
+                downloadMultiFile(files, lib_files, dir);
+                Util::createDir(dir / module);
+                Util::createDir(dir / module / "tasks");
+                module_cache_dir_->stageCachedFile(task_file, dir / task_dest);
+            });
+        task_file = install_dir / task_dest;
 
         LOG_DEBUG("Multi file task _installdir: '{1}'", install_dir.string());
         task_params.set<std::string>("_installdir", install_dir.string());
@@ -4,6 +4,7 @@
 #include <pxp-agent/action_status.hpp>
 #include <pxp-agent/pxp_schemas.hpp>
 #include <pxp-agent/external_module.hpp>
+#include <pxp-agent/module_metadata_cache.hpp>
 #include <pxp-agent/module_type.hpp>
 #include <pxp-agent/request_type.hpp>
 #include <pxp-agent/time.hpp>
@@ -14,6 +15,8 @@
 #include <pxp-agent/modules/file.hpp>
 #include <pxp-agent/modules/script.hpp>
 #include <pxp-agent/modules/apply.hpp>
+#include <pxp-agent/util/directory_watcher.hpp>
+#include <pxp-agent/util/parallel.hpp>
 #include <pxp-agent/util/process.hpp>
 
 #include <leatherman/json_container/json_container.hpp>
@@ -36,6 +39,7 @@
 
 #include <vector>
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <stdexcept>  // out_of_range
 #include <memory>
@@ -55,6 +59,12 @@ namespace pcp_util = PCPClient::Util;
 // named mutex lock, before updating the metadata
 static const uint32_t METADATA_RACE_MS { 100 };
 
+// Maximum number of external modules loaded at once
+static const size_t MAX_PARALLEL_MODULE_LOADS { 8 };
+
+// How often the modules watcher checks whether pxp-agent is stopping
+static const std::chrono::milliseconds MODULES_WATCH_INTERVAL { 500 };
+
 //
 // Static functions
 //
@@ -166,6 +176,10 @@ void nonBlockingActionTask(std::shared_ptr<Module> module_ptr,
         }
     };
 
+    // Frees space for the output of the action, in case the spool
+    // usage is already above the high-water mark of its quota
+    storage_ptr->updateDiskUsage(request.transactionId());
+
     auto response = module_ptr->executeAction(request);
     assert(response.request_type == RequestType::NonBlocking);
 
@@ -201,6 +215,10 @@ void nonBlockingActionTask(std::shared_ptr<Module> module_ptr,
         LOG_ERROR("Failed to write metadata of the {1}: {2}",
                   request.prettyLabel(), e.what());
     }
+
+    // The output files are final now (and we still hold the lock)
+    storage_ptr->compressOutput(request.transactionId());
+    storage_ptr->updateDiskUsage(request.transactionId());
 }
 
 //
@@ -212,16 +230,29 @@ RequestProcessor::RequestProcessor(std::shared_ptr<PXPConnector> connector_ptr,
         : thread_container_ { "Action Executer" },
           thread_container_mutex_ {},
           module_cache_dir_ { new ModuleCacheDir(agent_configuration.task_cache_dir,
-                                                 agent_configuration.task_cache_dir_purge_ttl) },
+                                                 agent_configuration.task_cache_dir_purge_ttl,
+                                                 agent_configuration.task_cache_dir_quota,
+                                                 agent_configuration.task_download_concurrency,
+                                                 agent_configuration.task_cache_dir_reverify_ttl,
+                                                 agent_configuration.task_download_rate_limit,
+                                                 agent_configuration.task_download_splay_s) },
           connector_ptr_ { connector_ptr },
           storage_ptr_ { new ResultsStorage(agent_configuration.spool_dir,
-                                            agent_configuration.spool_dir_purge_ttl) },
+                                            agent_configuration.spool_dir_purge_ttl,
+                                            agent_configuration.spool_dir_compress_output,
+                                            agent_configuration.spool_dir_quota) },
           spool_dir_path_ { agent_configuration.spool_dir },
           modules_ {},
+          modules_dir_ { agent_configuration.modules_dir },
           modules_config_dir_ { agent_configuration.modules_config_dir },
           modules_config_ {},
           is_destructing_ { false },
-          max_message_size_ { agent_configuration.max_message_size }
+          max_message_size_ { agent_configuration.max_message_size },
+          max_module_workers_ { agent_configuration.module_workers },
+          modules_metadata_cache_ { agent_configuration.modules_metadata_cache },
+          metadata_cache_ {},
+          module_results_max_size_ { agent_configuration.module_results_max_size },
+          module_results_max_depth_ { agent_configuration.module_results_max_depth }
 {
     assert(!spool_dir_path_.string().empty());
     registerPurgeable(storage_ptr_);
@@ -237,6 +268,10 @@ RequestProcessor::RequestProcessor(std::shared_ptr<PXPConnector> connector_ptr,
 
     logLoadedModules();
 
+    if (!modules_dir_.empty() && fs::is_directory(modules_dir_))
+        modules_watcher_thread_ptr_.reset(
+            new pcp_util::thread(&RequestProcessor::watchModulesTask, this));
+
     if (!purgeables_.empty()) {
         for (auto purgeable : purgeables_) {
             purgeable->purge(purgeable->get_ttl(), thread_container_.getThreadNames());
@@ -256,6 +291,9 @@ RequestProcessor::~RequestProcessor()
 
     if (purge_thread_ptr_ != nullptr && purge_thread_ptr_->joinable())
         purge_thread_ptr_->join();
+
+    if (modules_watcher_thread_ptr_ != nullptr && modules_watcher_thread_ptr_->joinable())
+        modules_watcher_thread_ptr_->join();
 }
 
 void RequestProcessor::processRequest(const RequestType& request_type,
@@ -315,22 +353,32 @@ void RequestProcessor::processRequest(const RequestType& request_type,
 
 bool RequestProcessor::hasModule(const std::string& module_name) const
 {
-    return modules_.find(module_name) != modules_.end();
+    return getModule(module_name) != nullptr;
 }
 
 bool RequestProcessor::hasModuleConfig(const std::string& module_name) const
 {
+    pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
     return modules_config_.find(module_name) != modules_config_.end();
 }
 
 std::string RequestProcessor::getModuleConfig(const std::string& module_name) const
 {
-    if (!hasModuleConfig(module_name))
+    pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
+    auto config_itr = modules_config_.find(module_name);
+    if (config_itr == modules_config_.end())
         throw RequestProcessor::Error {
             lth_loc::format("no configuration loaded for the module '{1}'",
                             module_name) };
 
-    return modules_config_.at(module_name).toString();
+    return config_itr->second.toString();
+}
+
+std::shared_ptr<Module> RequestProcessor::getModule(const std::string& module_name) const
+{
+    pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
+    auto module_itr = modules_.find(module_name);
+    return (module_itr != modules_.end() ? module_itr->second : nullptr);
 }
 
 //
@@ -342,25 +390,25 @@ void RequestProcessor::validateRequestContent(const ActionRequest& request) cons
     static PCPClient::Validator status_query_validator { getStatusQueryValidator() };
 
     auto is_status_request = isStatusRequest(request);
-
-    try {
-        if (!is_status_request
-                && !modules_.at(request.module())->hasAction(request.action()))
+    std::shared_ptr<Module> module;
+
+    if (!is_status_request) {
+        module = getModule(request.module());
+        if (module == nullptr)
+            throw RequestProcessor::Error { lth_loc::format("unknown module: {1}",
+                                                            request.module()) };
+        if (!module->hasAction(request.action()))
             throw RequestProcessor::Error {
                 lth_loc::format("unknown action '{1}' for module '{2}'",
                                 request.action(), request.module()) };
-    } catch (std::out_of_range& e) {
-        throw RequestProcessor::Error { lth_loc::format("unknown module: {1}",
-                                                        request.module()) };
     }
 
     // Verify the module supports the non-blocking / asynchronous requests
     // if such a request is passed.
-    // NB: we rely on short-circuiting OR (otherwise, modules_ access
-    // could break)
+    // NB: we rely on short-circuiting OR (module is null for the
+    // status requests)
     if (request.type() == RequestType::NonBlocking
-            && (is_status_request
-                || !modules_.at(request.module())->supportsAsync()))
+            && (is_status_request || !module->supportsAsync()))
         throw RequestProcessor::Error {
             lth_loc::format("the module '{1}' supports only blocking PXP requests",
                             request.module()) };
@@ -374,7 +422,7 @@ void RequestProcessor::validateRequestContent(const ActionRequest& request) cons
         // NB: the registred schemas have the same name as the action
         auto& validator = (is_status_request
                                 ? status_query_validator
-                                : modules_.at(request.module())->input_validator_);
+                                : module->input_validator_);
         validator.validate(request.params(), request.action());
     } catch (PCPClient::validation_error& e) {
         LOG_DEBUG("Invalid input parameters of the {1}, request ID {2} by {3}: {4}",
@@ -386,7 +434,13 @@ void RequestProcessor::validateRequestContent(const ActionRequest& request) cons
 
 void RequestProcessor::processBlockingRequest(const ActionRequest& request)
 {
-    auto response = modules_[request.module()]->executeAction(request);
+    // The module may be unloaded meanwhile, if it was removed
+    auto module = getModule(request.module());
+    if (module == nullptr)
+        throw RequestProcessor::Error { lth_loc::format("unknown module: {1}",
+                                                        request.module()) };
+
+    auto response = module->executeAction(request);
     if (response.action_metadata.get<bool>("results_are_valid")) {
         LOG_INFO("The {1}, request ID {2} by {3}, has successfully completed",
                  request.prettyLabel(), request.id(), request.sender());
@@ -436,9 +490,15 @@ void RequestProcessor::processNonBlockingRequest(const ActionRequest& request)
 
                 // NB: we got the_lock, so we're sure this will not throw
                 // due to another stored thread with the same name
+                // The module may be unloaded meanwhile, if it was removed
+                auto module = getModule(request.module());
+                if (module == nullptr)
+                    throw RequestProcessor::Error {
+                        lth_loc::format("unknown module: {1}", request.module()) };
+
                 thread_container_.add(request.transactionId(),
                                       pcp_util::thread(&nonBlockingActionTask,
-                                                       modules_[request.module()],
+                                                       module,
                                                        request,
                                                        connector_ptr_,
                                                        storage_ptr_,
@@ -583,7 +643,8 @@ void RequestProcessor::processStatusRequest(const ActionRequest& request)
         // unexpected otherwise, but we may rely on this later)
         auto mod = metadata.get<std::string>("module");
         auto act = metadata.get<std::string>("action");
-        if (!hasModule(mod) || !modules_.at(mod)->hasAction(act))
+        auto mod_ptr = getModule(mod);
+        if (mod_ptr == nullptr || !mod_ptr->hasAction(act))
             throw Error {
                 lth_loc::format("unknown action stored in metadata file: '{1} {2}'",
                                 mod, act) };
@@ -759,10 +820,12 @@ void RequestProcessor::processStatusRequest(const ActionRequest& request)
         return;
     }
 
-    // We previously verified the module and action pair to exist
-    // so this cannot throw
-    std::shared_ptr<Module> mod_ptr {
-        modules_.at(metadata.get<std::string>("module")) };
+    // We previously verified the module and action pair to exist,
+    // but the module may have been unloaded since
+    auto mod_ptr = getModule(metadata.get<std::string>("module"));
+    if (mod_ptr == nullptr)
+        throw Error { lth_loc::format("unknown module: {1}",
+                                      metadata.get<std::string>("module")) };
 
     // Create a new response object, to process the output
     // NOTE(ale): this is not ideal since we're copying the output; on
@@ -791,6 +854,9 @@ void RequestProcessor::processStatusRequest(const ActionRequest& request)
         } else {
             storage_ptr_->updateMetadataFile(t_id, a_r.action_metadata);
         }
+        // NB: the output is compressed by the next purge, so that the
+        // reply is not delayed
+        storage_ptr_->updateDiskUsage(t_id);
     } catch (const ResultsStorage::Error& err) {
         LOG_ERROR("Failed to update metadata of the transaction {1}: {2}",
                   t_id, err.what());
@@ -823,24 +889,7 @@ void RequestProcessor::loadModulesConfiguration()
         lth_file::each_file(
             modules_config_dir_,
             [this](std::string const& s) -> bool {
-                fs::path s_path { s };
-                auto file_name = s_path.stem().string();
-                // NB: ".conf" suffix guaranteed by each_file()
-                auto pos_suffix = file_name.find(".conf");
-                auto module_name = file_name.substr(0, pos_suffix);
-
-                try {
-                    auto config_json = lth_jc::JsonContainer(lth_file::read(s));
-                    modules_config_[module_name] = std::move(config_json);
-                    LOG_DEBUG("Loaded module configuration for module '{1}' "
-                              "from {2}", module_name, s);
-                } catch (lth_jc::data_parse_error& e) {
-                    LOG_WARNING("Cannot load module config file '{1}'; invalid "
-                                "JSON format. If the module's metadata contains "
-                                "the 'configuration' entry, the module won't be "
-                                "loaded. Error: '{2}'", s, e.what());
-                    modules_config_[module_name] = lth_jc::JsonContainer { "null" };
-                }
+                loadModuleConfiguration(s);
                 return true;
                 // naming convention for config files suffixes; don't
                 // process files that don't end in this extension
@@ -853,8 +902,33 @@ void RequestProcessor::loadModulesConfiguration()
     }
 }
 
+void RequestProcessor::loadModuleConfiguration(const std::string& config_path)
+{
+    fs::path s_path { config_path };
+    auto file_name = s_path.stem().string();
+    // NB: ".conf" suffix guaranteed by the callers
+    auto pos_suffix = file_name.find(".conf");
+    auto module_name = file_name.substr(0, pos_suffix);
+    lth_jc::JsonContainer config_json { "null" };
+
+    try {
+        config_json = lth_jc::JsonContainer(lth_file::read(config_path));
+        LOG_DEBUG("Loaded module configuration for module '{1}' "
+                  "from {2}", module_name, config_path);
+    } catch (lth_jc::data_parse_error& e) {
+        LOG_WARNING("Cannot load module config file '{1}'; invalid "
+                    "JSON format. If the module's metadata contains "
+                    "the 'configuration' entry, the module won't be "
+                    "loaded. Error: '{2}'", config_path, e.what());
+    }
+
+    pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
+    modules_config_[module_name] = std::move(config_json);
+}
+
 void RequestProcessor::registerModule(std::shared_ptr<Module> module_ptr)
 {
+    pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
     if (!modules_.emplace(module_ptr->module_name, module_ptr).second) {
         LOG_WARNING("Ignoring attempt to re-register module: {1}", module_ptr->module_name);
     }
@@ -871,9 +945,12 @@ void RequestProcessor::loadInternalModules(const Configuration::Agent& agent_con
 {
     registerModule(std::make_shared<Modules::Echo>());
     registerModule(std::make_shared<Modules::Ping>());
+    Util::OutputLimit output_limit { agent_configuration.output_limit_head,
+                                     agent_configuration.output_limit_tail };
     auto command = std::make_shared<Modules::Command>(
         Configuration::Instance().getExecPrefix(),
         storage_ptr_);
+    command->setOutputLimit(output_limit);
     registerModule(command);
     auto task = std::make_shared<Modules::Task>(
         Configuration::Instance().getExecPrefix(),
@@ -887,6 +964,7 @@ void RequestProcessor::loadInternalModules(const Configuration::Agent& agent_con
         agent_configuration.task_download_timeout_s,
         module_cache_dir_,
         storage_ptr_);
+    task->setOutputLimit(output_limit);
     registerModule(task);
     registerPurgeable(task);
     auto dl_file = std::make_shared<Modules::File>(
@@ -899,7 +977,8 @@ void RequestProcessor::loadInternalModules(const Configuration::Agent& agent_con
         agent_configuration.task_download_connect_timeout_s,
         agent_configuration.task_download_timeout_s,
         module_cache_dir_,
-        storage_ptr_);
+        storage_ptr_,
+        agent_configuration.file_download_parallelism);
     registerModule(dl_file);
     registerPurgeable(dl_file);
     auto script = std::make_shared<Modules::Script>(
@@ -914,6 +993,7 @@ void RequestProcessor::loadInternalModules(const Configuration::Agent& agent_con
         agent_configuration.task_download_timeout_s,
         module_cache_dir_,
         storage_ptr_);
+    script->setOutputLimit(output_limit);
     registerModule(script);
     registerPurgeable(script);
     auto apply = std::make_shared<Modules::Apply>(
@@ -926,6 +1006,7 @@ void RequestProcessor::loadInternalModules(const Configuration::Agent& agent_con
         agent_configuration.master_proxy,
         module_cache_dir_,
         storage_ptr_);
+    apply->setOutputLimit(output_limit);
     registerModule(apply);
     registerPurgeable(apply);
 }
@@ -939,6 +1020,8 @@ void RequestProcessor::loadExternalModulesFrom(fs::path dir_path)
     }
 
     LOG_INFO("Loading external modules from {1}", dir_path.string());
+    auto loading_start = std::chrono::steady_clock::now();
+    std::vector<fs::path> module_paths;
     fs::directory_iterator end;
 
     for (auto f = fs::directory_iterator(dir_path); f != end; ++f) {
@@ -953,41 +1036,212 @@ void RequestProcessor::loadExternalModulesFrom(fs::path dir_path)
 #else
             if (extension == ".bat" || extension == ".exe") {
 #endif
-                try {
-                    std::shared_ptr<ExternalModule> e_m;
-                    auto config_itr = modules_config_.find(f_p.stem().string());
-
-                    if (config_itr != modules_config_.end()) {
-                        e_m = std::make_shared<ExternalModule>(
-                            f_p.string(), config_itr->second, storage_ptr_);
-                        e_m->validateConfiguration();
-                        LOG_DEBUG("The '{1}' module configuration has been "
-                                  "validated: {2}", e_m->module_name,
-                                  config_itr->second.toString());
-                    } else {
-                        e_m = std::make_shared<ExternalModule>(
-                            f_p.string(), storage_ptr_);
-                    }
-
-                    registerModule(e_m);
-                } catch (Module::LoadingError& e) {
-                    LOG_ERROR("Failed to load {1}; {2}", f_p, e.what());
-                } catch (PCPClient::validation_error& e) {
-                    LOG_ERROR("Failed to configure {1}; {2}", f_p, e.what());
-                } catch (std::exception& e) {
-                    LOG_ERROR("Unexpected error when loading {1}; {2}",
-                              f_p, e.what());
-                } catch (...) {
-                    LOG_ERROR("Unexpected error when loading {1}", f_p);
-                }
+                module_paths.push_back(f_p);
             }
         }
     }
+
+    if (!modules_metadata_cache_.empty())
+        metadata_cache_ = std::make_shared<ModuleMetadataCache>(modules_metadata_cache_);
+
+    // The modules are loaded in parallel, as each may have to be run
+    // to get its metadata, and then registered in the directory order
+    std::vector<std::shared_ptr<ExternalModule>> external_modules(module_paths.size());
+
+    Util::runInParallel(module_paths.size(), MAX_PARALLEL_MODULE_LOADS, [&](size_t idx) {
+        external_modules[idx] = loadExternalModule(module_paths[idx]);
+    });
+
+    for (auto& e_m : external_modules) {
+        if (e_m)
+            registerModule(e_m);
+    }
+
+    if (metadata_cache_)
+        metadata_cache_->save();
+
+    LOG_INFO("Loaded the external modules from {1} in {2} ms", dir_path.string(),
+             std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - loading_start).count());
+}
+
+std::shared_ptr<ExternalModule> RequestProcessor::loadExternalModule(
+    const fs::path& module_path)
+{
+    auto module_start = std::chrono::steady_clock::now();
+    std::unique_ptr<lth_jc::JsonContainer> config_ptr;
+
+    {
+        pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
+        auto config_itr = modules_config_.find(module_path.stem().string());
+        if (config_itr != modules_config_.end())
+            config_ptr.reset(new lth_jc::JsonContainer(config_itr->second));
+    }
+
+    try {
+        std::shared_ptr<ExternalModule> e_m;
+
+        if (config_ptr != nullptr) {
+            e_m = std::make_shared<ExternalModule>(
+                module_path.string(), *config_ptr, storage_ptr_,
+                max_module_workers_, metadata_cache_);
+            e_m->validateConfiguration();
+            LOG_DEBUG("The '{1}' module configuration has been "
+                      "validated: {2}", e_m->module_name,
+                      config_ptr->toString());
+        } else {
+            e_m = std::make_shared<ExternalModule>(
+                module_path.string(), storage_ptr_, max_module_workers_,
+                metadata_cache_);
+        }
+
+        e_m->setResultsLimits(module_results_max_size_, module_results_max_depth_);
+        LOG_INFO("Loaded the '{1}' module in {2} ms{3}", e_m->module_name,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - module_start).count(),
+                 (e_m->hasCachedMetadata()
+                    ? lth_loc::translate(" (cached metadata)")
+                    : ""));
+        return e_m;
+    } catch (Module::LoadingError& e) {
+        LOG_ERROR("Failed to load {1}; {2}", module_path, e.what());
+    } catch (PCPClient::validation_error& e) {
+        LOG_ERROR("Failed to configure {1}; {2}", module_path, e.what());
+    } catch (std::exception& e) {
+        LOG_ERROR("Unexpected error when loading {1}; {2}",
+                  module_path, e.what());
+    } catch (...) {
+        LOG_ERROR("Unexpected error when loading {1}", module_path);
+    }
+
+    return nullptr;
 }
 
+//
+// Modules watcher task (private interface)
+//
+
+// Returns the paths of the files that may be a module with the
+// specified name; valid modules have no extension on *nix, .bat or
+// .exe extensions on Windows
+static std::vector<fs::path> moduleFileCandidates(const fs::path& modules_dir,
+                                                  const std::string& module_name)
+{
+#ifndef _WIN32
+    return { modules_dir / module_name };
+#else
+    return { modules_dir / (module_name + ".bat"),
+             modules_dir / (module_name + ".exe") };
+#endif
+}
+
+static bool isModuleFile(const fs::path& file_path)
+{
+    auto extension = file_path.extension();
+#ifndef _WIN32
+    return extension == "";
+#else
+    return extension == ".bat" || extension == ".exe";
+#endif
+}
+
+void RequestProcessor::reloadExternalModules(const std::set<std::string>& changed_paths)
+{
+    std::set<std::string> module_names;
+
+    for (const auto& changed_path : changed_paths) {
+        fs::path c_p { changed_path };
+
+        if (c_p.parent_path() == fs::path(modules_config_dir_)) {
+            if (c_p.extension() != ".conf")
+                continue;
+            if (fs::is_regular_file(c_p)) {
+                loadModuleConfiguration(changed_path);
+            } else {
+                pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
+                modules_config_.erase(c_p.stem().string());
+            }
+            module_names.insert(c_p.stem().string());
+        } else if (c_p.parent_path() == fs::path(modules_dir_) && isModuleFile(c_p)) {
+            module_names.insert(c_p.stem().string());
+        }
+    }
+
+    for (const auto& module_name : module_names) {
+        // The internal modules can't be replaced
+        auto current_module = getModule(module_name);
+        if (current_module != nullptr && current_module->type() != ModuleType::External) {
+            LOG_WARNING("Ignoring the changes of the '{1}' module files, as "
+                        "it's an internal module", module_name);
+            continue;
+        }
+
+        std::shared_ptr<ExternalModule> e_m;
+        for (const auto& candidate : moduleFileCandidates(modules_dir_, module_name)) {
+            if (fs::is_regular_file(candidate)) {
+                e_m = loadExternalModule(candidate);
+                break;
+            }
+        }
+
+        // The actions in progress keep the module instance they
+        // started with
+        pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
+        if (e_m != nullptr) {
+            modules_[module_name] = e_m;
+            LOG_INFO("Reloaded the '{1}' module", module_name);
+        } else if (modules_.erase(module_name) > 0) {
+            LOG_INFO("Unloaded the '{1}' module", module_name);
+        }
+    }
+
+    if (metadata_cache_ && !module_names.empty())
+        metadata_cache_->save();
+}
+
+void RequestProcessor::watchModulesTask()
+{
+    std::unique_ptr<Util::DirectoryWatcher> watcher_ptr;
+
+    try {
+        watcher_ptr.reset(new Util::DirectoryWatcher({ modules_dir_, modules_config_dir_ }));
+    } catch (const Util::DirectoryWatcher::Error& e) {
+        LOG_WARNING("Failed to watch the modules directories; the modules will "
+                    "not be reloaded when they change: {1}", e.what());
+        return;
+    }
+
+    LOG_DEBUG("Watching {1} and {2} for changes of the external modules",
+              modules_dir_, modules_config_dir_);
+
+    while (true) {
+        auto changed_paths = watcher_ptr->waitForChanges(MODULES_WATCH_INTERVAL);
+
+        {
+            pcp_util::lock_guard<pcp_util::mutex> the_lock { purge_mutex_ };
+            if (is_destructing_)
+                return;
+        }
+
+        if (changed_paths.empty())
+            continue;
+
+        try {
+            reloadExternalModules(changed_paths);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to reload the external modules: {1}", e.what());
+        }
+    }
+}
+
+//
+// Log the loaded modules (private interface)
+//
+
 void RequestProcessor::logLoadedModules() const
 {
     std::string actions_label { lth_loc::translate("actions") };
+    pcp_util::lock_guard<pcp_util::mutex> modules_lock { modules_mutex_ };
 
     for (auto& module : modules_) {
         std::string actions_list { "" };
@@ -1,10 +1,9 @@
 #include <pxp-agent/results_storage.hpp>
 #include <pxp-agent/action_response.hpp>
 #include <pxp-agent/configuration.hpp>
+#include <pxp-agent/results_mutex.hpp>
 #include <pxp-agent/time.hpp>
-
-#include <leatherman/file_util/file.hpp>
-#include <leatherman/file_util/directory.hpp>
+#include <pxp-agent/util/gzip.hpp>
 
 #include <leatherman/locale/locale.hpp>
 
@@ -13,14 +12,18 @@
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/chrono/thread_clock.hpp>
 
 #include <algorithm>  // std::find
+#include <sstream>
+#include <ctime>
 
 namespace PXPAgent {
 
 namespace fs = boost::filesystem;
+namespace pcp_util = PCPClient::Util;
 namespace lth_jc   = leatherman::json_container;
-namespace lth_file = leatherman::file_util;
 namespace lth_loc  = leatherman::locale;
 
 static const std::string METADATA { "metadata" };
@@ -28,25 +31,81 @@ static const std::string STDOUT { "stdout" };
 static const std::string STDERR { "stderr" };
 static const std::string EXITCODE { "exitcode" };
 static const std::string PID { "pid" };
+static const std::string TRUNCATION { "truncation" };
+static const std::string GZIP_SUFFIX { ".gz" };
+
+// Used to measure the CPU time spent compressing; the thread clock
+// is not available on every platform
+#ifdef BOOST_CHRONO_HAS_THREAD_CLOCK
+using CompressionClock = boost::chrono::thread_clock;
+#else
+using CompressionClock = boost::chrono::steady_clock;
+#endif
+
+ResultsStorage::ResultsStorage(std::string spool_dir,
+                               std::string spool_dir_ttl,
+                               bool compress_output,
+                               uint64_t quota_bytes)
+        : Purgeable { std::move(spool_dir_ttl) },
+          spool_dir_path_ { std::move(spool_dir) },
+          compress_output_ { compress_output },
+          num_compressed_files_ { 0 },
+          original_bytes_ { 0 },
+          compressed_bytes_ { 0 },
+          compression_cpu_time_ms_ { 0 },
+          disk_quota_ { quota_bytes },
+          disk_usage_initialized_ { false }
+{
+}
 
-ResultsStorage::ResultsStorage(std::string spool_dir, std::string spool_dir_ttl)
-        : Purgeable { std::move(spool_dir_ttl) }, spool_dir_path_ { std::move(spool_dir) }
+std::shared_ptr<Util::DirHandle> ResultsStorage::getSpoolDir()
 {
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { spool_dir_handle_mutex_ };
+
+    if (spool_dir_handle_ == nullptr || spool_dir_handle_->isStale()) {
+        spool_dir_handle_.reset();
+
+        try {
+            spool_dir_handle_ = std::make_shared<Util::DirHandle>(spool_dir_path_.string());
+        } catch (const Util::DirHandle::Error& e) {
+            LOG_TRACE("Cannot open the spool directory: {1}", e.what());
+        }
+    }
+
+    return spool_dir_handle_;
+}
+
+std::unique_ptr<Util::DirHandle>
+ResultsStorage::getResultsDir(const std::string& transaction_id)
+{
+    auto spool_dir = getSpoolDir();
+
+    if (spool_dir != nullptr && spool_dir->isDirectory(transaction_id)) {
+        try {
+            return std::unique_ptr<Util::DirHandle>(
+                new Util::DirHandle(*spool_dir, transaction_id));
+        } catch (const Util::DirHandle::Error& e) {
+            LOG_DEBUG("Cannot open the results directory: {1}", e.what());
+        }
+    }
+
+    return nullptr;
 }
 
 bool ResultsStorage::find(const std::string& transaction_id)
 {
-    auto p = spool_dir_path_ / transaction_id;
-    return fs::exists(p) && fs::is_directory(p);
+    auto spool_dir = getSpoolDir();
+    return spool_dir != nullptr && spool_dir->isDirectory(transaction_id);
 }
 
-static void writeMetadata(const lth_jc::JsonContainer& metadata, const std::string& file_path) {
+static void writeMetadata(const lth_jc::JsonContainer& metadata,
+                          const Util::DirHandle& results_dir) {
     // Redact "request_params" key in case parameters are sensitive.
     lth_jc::JsonContainer metadata_ { metadata };
     metadata_.set<std::string>("request_params", "{}");
     std::string txt = metadata_.toString() + "\n";
     try {
-        lth_file::atomic_write_to_file(txt, file_path, NIX_FILE_PERMS, std::ios::binary);
+        results_dir.atomicWrite(METADATA, txt, NIX_FILE_PERMS);
     } catch (const std::exception& e) {
         throw ResultsStorage::Error {
             lth_loc::format("failed to write metadata: {1}", e.what()) };
@@ -56,49 +115,67 @@ static void writeMetadata(const lth_jc::JsonContainer& metadata, const std::stri
 void ResultsStorage::initializeMetadataFile(const std::string& transaction_id,
                                             const lth_jc::JsonContainer& metadata)
 {
-    auto results_path = spool_dir_path_ / transaction_id;
+    auto results_dir = getResultsDir(transaction_id);
 
-    if (!fs::exists(results_path)) {
+    if (results_dir == nullptr) {
+        auto results_path = spool_dir_path_ / transaction_id;
         LOG_DEBUG("Creating results directory for the  transaction {1} in '{2}'",
                   transaction_id, results_path.string());
         try {
-            fs::create_directories(results_path);
-            fs::permissions(results_path, NIX_DIR_PERMS);
+            auto spool_dir = getSpoolDir();
+
+            if (spool_dir == nullptr) {
+                fs::create_directories(spool_dir_path_);
+                spool_dir = getSpoolDir();
+            }
+
+            if (spool_dir == nullptr)
+                throw Error {
+                    lth_loc::format("failed to open the spool directory '{1}'",
+                                    spool_dir_path_.string()) };
+
+            spool_dir->createDirectory(transaction_id, NIX_DIR_PERMS);
+            results_dir.reset(new Util::DirHandle(*spool_dir, transaction_id));
         } catch (const fs::filesystem_error& e) {
             throw ResultsStorage::Error {
                 lth_loc::format("failed to create results directory '{1}'",
                                 e.what()) };
+        } catch (const Util::DirHandle::Error& e) {
+            throw ResultsStorage::Error {
+                lth_loc::format("failed to create results directory '{1}'",
+                                e.what()) };
         }
     }
 
-    auto metadata_file = (results_path / METADATA).string();
-    writeMetadata(metadata, metadata_file);
+    writeMetadata(metadata, *results_dir);
 }
 
 void ResultsStorage::updateMetadataFile(const std::string& transaction_id,
                                         const lth_jc::JsonContainer& metadata)
 {
-    if (!find(transaction_id))
+    auto results_dir = getResultsDir(transaction_id);
+
+    if (results_dir == nullptr)
         throw Error {
             lth_loc::format("no results directory for the transaction {1}",
                             transaction_id) };
 
-    auto metadata_file = (spool_dir_path_ / transaction_id / METADATA).string();
-    writeMetadata(metadata, metadata_file);
+    writeMetadata(metadata, *results_dir);
 }
 
 lth_jc::JsonContainer
 ResultsStorage::getActionMetadata(const std::string& transaction_id)
 {
     auto metadata_file = (spool_dir_path_ / transaction_id / METADATA).string();
+    auto results_dir = getResultsDir(transaction_id);
     std::string metadata_txt {};
 
-    if (!fs::exists(metadata_file))
+    if (results_dir == nullptr || !results_dir->exists(METADATA))
         throw Error {
             lth_loc::format("metadata file of the transaction {1} does not exist",
                             transaction_id) };
 
-    if (!lth_file::read(metadata_file, metadata_txt))
+    if (!results_dir->read(METADATA, metadata_txt))
         throw Error {
             lth_loc::format("failed to read metadata file of the transaction {1}",
                             transaction_id) };
@@ -126,14 +203,17 @@ ResultsStorage::getActionMetadata(const std::string& transaction_id)
 
 bool ResultsStorage::pidFileExists(const std::string& transaction_id)
 {
-    return fs::exists(spool_dir_path_ / transaction_id / PID);
+    auto results_dir = getResultsDir(transaction_id);
+    return results_dir != nullptr && results_dir->exists(PID);
 }
 
-static int readIntegerFromFile(const std::string& file_path)
+static int readIntegerFromFile(const Util::DirHandle* results_dir,
+                               const std::string& file_path,
+                               const std::string& file_name)
 {
     std::string number_txt {};
 
-    if (!fs::exists(file_path) || !lth_file::read(file_path, number_txt))
+    if (results_dir == nullptr || !results_dir->read(file_name, number_txt))
         throw ResultsStorage::Error {
             lth_loc::format("failed to read file '{1}'", file_path) };
 
@@ -149,47 +229,106 @@ static int readIntegerFromFile(const std::string& file_path)
 
 int ResultsStorage::getPID(const std::string& transaction_id)
 {
-    return readIntegerFromFile((spool_dir_path_ / transaction_id / PID).string());
+    auto results_dir = getResultsDir(transaction_id);
+    return readIntegerFromFile(results_dir.get(),
+                               (spool_dir_path_ / transaction_id / PID).string(),
+                               PID);
 }
 
 bool ResultsStorage::outputIsReady(const std::string& transaction_id)
 {
-    return fs::exists(spool_dir_path_ / transaction_id / EXITCODE);
+    auto results_dir = getResultsDir(transaction_id);
+    return results_dir != nullptr && results_dir->exists(EXITCODE);
+}
+
+// Reads the specified output file or, once compressed, its gzip
+// version. As compressOutput() may remove the file after checking
+// for it, the gzip version is looked for whenever the file can't be
+// read, rather than beforehand.
+// Returns false in case neither exists. Throws an Error in case the
+// file exists but can't be read, or a GzipError in case the gzip
+// version can't be decompressed.
+static bool readOutputFile(const Util::DirHandle& results_dir,
+                           const std::string& name,
+                           std::string& content)
+{
+    if (results_dir.read(name, content))
+        return true;
+
+    content.clear();
+
+    if (results_dir.exists(name + GZIP_SUFFIX)) {
+        Util::gunzipFile(results_dir.entryPath(name + GZIP_SUFFIX), content);
+        return true;
+    }
+
+    if (results_dir.exists(name))
+        throw ResultsStorage::Error {
+            lth_loc::format("failed to read '{1}'", results_dir.entryPath(name)) };
+
+    return false;
 }
 
 ActionOutput ResultsStorage::getOutput_(const std::string& transaction_id,
-                                        bool get_exitcode)
+                                        bool get_exitcode,
+                                        bool get_stdout)
 {
     auto results_path = (spool_dir_path_ / transaction_id);
+    auto results_dir = getResultsDir(transaction_id);
 
     ActionOutput output {};
 
     if (get_exitcode) {
-        std::string exitcode_txt {};
         auto exitcode_file = (results_path / EXITCODE).string();
-        output.exitcode = readIntegerFromFile(exitcode_file);
+        output.exitcode = readIntegerFromFile(results_dir.get(), exitcode_file, EXITCODE);
     }
 
     auto stderr_file = (results_path / STDERR).string();
     auto stdout_file = (results_path / STDOUT).string();
 
-    if (fs::exists(stderr_file)) {
-        if (!lth_file::read(stderr_file, output.std_err)) {
-            LOG_ERROR("Failed to read error file '{1}'; this failure will be ignored",
-                      stderr_file);
-        } else {
+    if (results_dir == nullptr) {
+        LOG_DEBUG("Results directory '{1}' does not exist", results_path.string());
+        return output;
+    }
+
+    try {
+        if (readOutputFile(*results_dir, STDERR, output.std_err))
             LOG_TRACE("Successfully read error file '{1}'", stderr_file);
+    } catch (const std::exception& e) {
+        output.std_err.clear();
+        LOG_ERROR("Failed to read error file: {1}; this failure will be ignored",
+                  e.what());
+    }
+
+    try {
+        if (!get_stdout) {
+            LOG_TRACE("Output file '{1}' is not read", stdout_file);
+        } else if (!readOutputFile(*results_dir, STDOUT, output.std_out)) {
+            LOG_DEBUG("Output file '{1}' does not exist", stdout_file);
+        } else if (output.std_out.empty()) {
+            LOG_TRACE("Output file '{1}' is empty", stdout_file);
+        } else {
+            LOG_TRACE("Successfully read output file '{1}'", stdout_file);
         }
+    } catch (const Util::GzipError& e) {
+        throw Error { lth_loc::format("failed to read output: {1}", e.what()) };
     }
 
-    if (!fs::exists(stdout_file)) {
-        LOG_DEBUG("Output file '{1}' does not exist", stdout_file);
-    } else if (!lth_file::read(stdout_file, output.std_out)) {
-        throw Error { lth_loc::format("failed to read '{1}'", stdout_file) };
-    } else if (output.std_out.empty()) {
-        LOG_TRACE("Output file '{1}' is empty", stdout_file);
-    } else {
-        LOG_TRACE("Successfully read output file '{1}'", stdout_file);
+    // Written by the execution wrapper in case it truncated a stream;
+    // each line has the stream name and its total size
+    std::string truncation_txt {};
+    if (results_dir->read(TRUNCATION, truncation_txt)) {
+        std::istringstream truncation_stream { truncation_txt };
+        std::string stream_name;
+        uint64_t total_bytes;
+
+        while (truncation_stream >> stream_name >> total_bytes) {
+            if (stream_name == STDOUT) {
+                output.std_out_total_bytes = total_bytes;
+            } else if (stream_name == STDERR) {
+                output.std_err_total_bytes = total_bytes;
+            }
+        }
     }
 
     return output;
@@ -197,17 +336,220 @@ ActionOutput ResultsStorage::getOutput_(const std::string& transaction_id,
 
 ActionOutput ResultsStorage::getOutput(const std::string& transaction_id)
 {
-    return getOutput_(transaction_id, true);
+    return getOutput_(transaction_id, true, true);
 }
 
 ActionOutput ResultsStorage::getOutput(const std::string& transaction_id,
-                                       int exitcode)
+                                       int exitcode,
+                                       bool get_stdout)
 {
-    auto output = getOutput_(transaction_id, false);
+    auto output = getOutput_(transaction_id, false, get_stdout);
     output.exitcode = exitcode;
     return output;
 }
 
+bool ResultsStorage::readStdoutChunks(
+        const std::string& transaction_id,
+        std::function<void(const char* data, size_t size)> callback)
+{
+    auto results_dir = getResultsDir(transaction_id);
+    return results_dir != nullptr && results_dir->readChunks(STDOUT, callback);
+}
+
+void ResultsStorage::compressOutput(const std::string& transaction_id)
+{
+    if (!compress_output_)
+        return;
+
+    auto results_dir = getResultsDir(transaction_id);
+
+    if (results_dir == nullptr) {
+        LOG_DEBUG("No results directory for the transaction {1}; "
+                  "nothing to compress", transaction_id);
+        return;
+    }
+
+    for (const auto& name : { STDOUT, STDERR })
+        compressOutputFile(*results_dir, name);
+}
+
+void ResultsStorage::compressOutputFile(const Util::DirHandle& results_dir,
+                                        const std::string& name)
+{
+    auto file_path = results_dir.entryPath(name);
+    auto gz_path = file_path + GZIP_SUFFIX;
+    auto tmp_path = results_dir.entryPath(
+        "." + name + GZIP_SUFFIX + "." + fs::unique_path("%%%%-%%%%").string());
+    boost::system::error_code ec;
+
+    if (!results_dir.exists(name) || fs::file_size(file_path, ec) == 0 || ec)
+        return;
+
+    auto start = CompressionClock::now();
+
+    try {
+        auto original_size = Util::gzipFile(file_path, tmp_path);
+        auto compressed_size = fs::file_size(tmp_path);
+        fs::permissions(tmp_path, NIX_FILE_PERMS);
+
+        // Once renamed, both files exist; readers pick the
+        // uncompressed one until it gets removed
+        fs::rename(tmp_path, gz_path);
+        fs::remove(file_path);
+
+        auto cpu_time_ms = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+            CompressionClock::now() - start).count();
+
+        num_compressed_files_++;
+        original_bytes_ += original_size;
+        compressed_bytes_ += compressed_size;
+        compression_cpu_time_ms_ += static_cast<uint64_t>(cpu_time_ms);
+
+        LOG_DEBUG("Compressed '{1}' from {2} to {3} bytes (ratio {4}) in {5} ms",
+                  file_path, original_size, compressed_size,
+                  static_cast<double>(original_size)
+                    / static_cast<double>(compressed_size > 0 ? compressed_size : 1),
+                  cpu_time_ms);
+    } catch (const std::exception& e) {
+        LOG_WARNING("Failed to compress '{1}' (the file will be kept "
+                    "uncompressed): {2}", file_path, e.what());
+        fs::remove(tmp_path, ec);
+    }
+}
+
+ResultsStorage::CompressionStats ResultsStorage::getCompressionStats() const
+{
+    return CompressionStats { num_compressed_files_.load(),
+                              original_bytes_.load(),
+                              compressed_bytes_.load(),
+                              compression_cpu_time_ms_.load() };
+}
+
+void ResultsStorage::updateDiskUsage(const std::string& transaction_id)
+{
+    if (!disk_quota_.enabled())
+        return;
+
+    auto spool_dir = getSpoolDir();
+
+    if (spool_dir == nullptr)
+        return;
+
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { disk_quota_mutex_ };
+
+    if (!disk_usage_initialized_) {
+        // Includes the specified transaction
+        initializeDiskUsage(*spool_dir);
+    } else if (spool_dir->isDirectory(transaction_id)) {
+        fs::path results_path { spool_dir->entryPath(transaction_id) };
+        boost::system::error_code ec;
+        auto last_update = fs::last_write_time(results_path, ec);
+        disk_quota_.update(transaction_id,
+                           Util::DiskQuota::directorySize(results_path),
+                           ec ? time(nullptr) : last_update);
+    }
+
+    LOG_TRACE("Spool disk usage: {1} of {2} bytes",
+              disk_quota_.usage(), disk_quota_.quota());
+
+    if (disk_quota_.isAboveHighWaterMark())
+        evictResults(*spool_dir);
+}
+
+uint64_t ResultsStorage::getDiskUsage()
+{
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { disk_quota_mutex_ };
+    return disk_quota_.usage();
+}
+
+void ResultsStorage::initializeDiskUsage(const Util::DirHandle& spool_dir)
+{
+    disk_quota_.clear();
+
+    try {
+        spool_dir.eachSubdirectory(
+            [&](std::string const& transaction_id) -> bool {
+                fs::path results_path { spool_dir.entryPath(transaction_id) };
+                boost::system::error_code ec;
+                auto last_update = fs::last_write_time(results_path, ec);
+
+                if (!ec)
+                    disk_quota_.update(transaction_id,
+                                       Util::DiskQuota::directorySize(results_path),
+                                       last_update);
+                return true;
+            });
+        disk_usage_initialized_ = true;
+    } catch (const Util::DirHandle::Error& e) {
+        LOG_ERROR("Failed to inspect the spool directory: {1}", e.what());
+    }
+}
+
+void ResultsStorage::evictResults(const Util::DirHandle& spool_dir)
+{
+    unsigned int num_evicted_dirs { 0 };
+
+    LOG_INFO("The spool disk usage ({1} bytes) is above {2}% of the quota "
+             "({3} bytes); removing the oldest results",
+             disk_quota_.usage(), Util::DiskQuota::HIGH_WATER_MARK,
+             disk_quota_.quota());
+
+    for (const auto& transaction_id : disk_quota_.entriesByLastUse()) {
+        if (!disk_quota_.isAboveLowWaterMark())
+            break;
+
+        auto dir_path = spool_dir.entryPath(transaction_id);
+
+        // Hold the lock of the transaction mutexes cache while the
+        // directory is inspected and removed: the mutex of an action
+        // started by this process is cached until its task ends, and
+        // the status handler looks it up before reading the results
+        ResultsMutex::LockGuard a_l { ResultsMutex::Instance().access_mtx };
+
+        if (ResultsMutex::Instance().exists(transaction_id)) {
+            LOG_TRACE("Skipping '{1}' as the action is in progress", dir_path);
+            continue;
+        }
+
+        try {
+            if (getActionMetadata(transaction_id).get<std::string>("status") == "running") {
+                LOG_TRACE("Skipping '{1}' as the action status is 'running'", dir_path);
+                continue;
+            }
+        } catch (const Error& e) {
+            // As for purge(), don't remove what we can't make sense of;
+            // the directory may also be gone already
+            LOG_DEBUG("Skipping '{1}': {2}", dir_path, e.what());
+            if (!spool_dir.isDirectory(transaction_id))
+                disk_quota_.remove(transaction_id);
+            continue;
+        }
+
+        boost::system::error_code ec;
+        fs::remove_all(dir_path, ec);
+
+        if (ec) {
+            LOG_ERROR("Failed to remove '{1}': {2}", dir_path, ec.message());
+        } else {
+            LOG_DEBUG("Removed '{1}' to free spool space", dir_path);
+            disk_quota_.remove(transaction_id);
+            num_evicted_dirs++;
+        }
+    }
+
+    LOG_INFO(lth_loc::format_n(
+        // LOCALE: info
+        "Removed {1} directory from '{2}'; the spool disk usage is {3} bytes",
+        "Removed {1} directories from '{2}'; the spool disk usage is {3} bytes",
+        num_evicted_dirs, num_evicted_dirs, spool_dir_path_.string(),
+        disk_quota_.usage()));
+
+    if (disk_quota_.isAboveHighWaterMark())
+        LOG_WARNING("The spool disk usage is still above {1}% of the quota, as "
+                    "the remaining results belong to running actions or can't "
+                    "be removed", Util::DiskQuota::HIGH_WATER_MARK);
+}
+
 unsigned int ResultsStorage::purge(
                 const std::string& ttl,
                 std::vector<std::string> ongoing_transactions,
@@ -221,52 +563,86 @@ unsigned int ResultsStorage::purge(
     LOG_INFO("About to purge the results directories from '{1}'; TTL = {2}",
              spool_dir_path_.string(), ttl);
 
-    lth_file::each_subdirectory(
-        spool_dir_path_.string(),
-        [&](std::string const& s) -> bool {
-            fs::path dir_path { s };
-            auto transaction_id = dir_path.filename().string();
-            LOG_TRACE("Inspecting '{1}' for purging", s);
-
-            if (!ongoing_transactions.empty()
-                    && std::find(ongoing_transactions.begin(),
-                                 ongoing_transactions.end(),
-                                 transaction_id) != ongoing_transactions.end())
-                return true;
-
-            try {
-                auto md = getActionMetadata(transaction_id);
+    auto spool_dir = getSpoolDir();
 
-                if (md.get<std::string>("status") == "running") {
-                    LOG_TRACE("Skipping '{1}' as the action status is 'running'", s);
-                } else if (ts.isNewerThan(md.get<std::string>("start"))) {
-                    LOG_TRACE("Removing '{1}'", s);
+    if (spool_dir == nullptr) {
+        LOG_DEBUG("The spool directory '{1}' does not exist; nothing to purge",
+                  spool_dir_path_.string());
+        return num_purged_dirs;
+    }
 
-                    try {
-                        purge_callback(dir_path.string());
-                        num_purged_dirs++;
-                    } catch (const std::exception& e) {
-                        LOG_ERROR("Failed to remove '{1}': {2}", s, e.what());
+    try {
+        spool_dir->eachSubdirectory(
+            [&](std::string const& transaction_id) -> bool {
+                fs::path dir_path { spool_dir->entryPath(transaction_id) };
+                auto s = dir_path.string();
+                LOG_TRACE("Inspecting '{1}' for purging", s);
+
+                if (!ongoing_transactions.empty()
+                        && std::find(ongoing_transactions.begin(),
+                                     ongoing_transactions.end(),
+                                     transaction_id) != ongoing_transactions.end())
+                    return true;
+
+                try {
+                    auto md = getActionMetadata(transaction_id);
+
+                    if (md.get<std::string>("status") == "running") {
+                        LOG_TRACE("Skipping '{1}' as the action status is 'running'", s);
+                    } else if (ts.isNewerThan(md.get<std::string>("start"))) {
+                        LOG_TRACE("Removing '{1}'", s);
+
+                        try {
+                            purge_callback(dir_path.string());
+                            num_purged_dirs++;
+                        } catch (const std::exception& e) {
+                            LOG_ERROR("Failed to remove '{1}': {2}", s, e.what());
+                        }
+                    } else {
+                        // The output of the actions that completed
+                        // while pxp-agent was not running, and whose
+                        // status was then updated by a status query,
+                        // is compressed here rather than while
+                        // replying to the query (a no-op otherwise)
+                        compressOutput(transaction_id);
                     }
+                } catch (const Error& e) {
+                    LOG_WARNING("Failed to retrieve the metadata for the transaction {1} "
+                                "(the results directory will not be removed): {2}",
+                                transaction_id, e.what());
+                } catch (const Timestamp::Error& e) {
+                    LOG_WARNING("Failed to process the metadata for the transaction {1} "
+                                "(the results directory will not be removed): {2}",
+                                transaction_id, e.what());
                 }
-            } catch (const Error& e) {
-                LOG_WARNING("Failed to retrieve the metadata for the transaction {1} "
-                            "(the results directory will not be removed): {2}",
-                            transaction_id, e.what());
-            } catch (const Timestamp::Error& e) {
-                LOG_WARNING("Failed to process the metadata for the transaction {1} "
-                            "(the results directory will not be removed): {2}",
-                            transaction_id, e.what());
-            }
 
-            return true;
-        });
+                return true;
+            });
+    } catch (const Util::DirHandle::Error& e) {
+        LOG_ERROR("Failed to inspect the spool directory: {1}", e.what());
+    }
 
     LOG_INFO(lth_loc::format_n(
         // LOCALE: info
         "Removed {1} directory from '{2}'",
         "Removed {1} directories from '{2}'",
         num_purged_dirs, num_purged_dirs, spool_dir_path_.string()));
+
+    if (disk_quota_.enabled()) {
+        // Recompute the usage on the next update, as directories
+        // were removed (possibly by the purge callback)
+        pcp_util::lock_guard<pcp_util::mutex> the_lock { disk_quota_mutex_ };
+        disk_usage_initialized_ = false;
+    }
+
+    if (compress_output_) {
+        auto stats = getCompressionStats();
+        LOG_INFO("Output compression since startup: {1} files, {2} bytes "
+                 "compressed to {3} bytes, {4} ms of CPU time",
+                 stats.num_files, stats.original_bytes,
+                 stats.compressed_bytes, stats.cpu_time_ms);
+    }
+
     return num_purged_dirs;
 }
 
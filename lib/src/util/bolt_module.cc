@@ -9,6 +9,8 @@
 #include <leatherman/logging/logging.hpp>
 #include <pxp-agent/configuration.hpp>
 
+#include <algorithm>
+
 namespace PXPAgent {
 namespace Util {
 
@@ -67,6 +69,20 @@ void BoltModule::processOutputAndUpdateMetadata(PXPAgent::ActionResponse &respon
         if (!response.output.std_err.empty()) {
             result.set("stderr", response.output.std_err);
         }
+        if (response.output.std_out_total_bytes > 0) {
+            LOG_DEBUG("The stdout of the {1} was truncated (total size: {2} bytes)",
+                      response.prettyRequestLabel(), response.output.std_out_total_bytes);
+            result.set("stdout_truncated", true);
+            result.set<double>("stdout_total_bytes",
+                               static_cast<double>(response.output.std_out_total_bytes));
+        }
+        if (response.output.std_err_total_bytes > 0) {
+            LOG_DEBUG("The stderr of the {1} was truncated (total size: {2} bytes)",
+                      response.prettyRequestLabel(), response.output.std_err_total_bytes);
+            result.set("stderr_truncated", true);
+            result.set<double>("stderr_total_bytes",
+                               static_cast<double>(response.output.std_err_total_bytes));
+        }
 
         response.setValidResultsAndEnd(std::move(result));
     } else {
@@ -121,6 +137,35 @@ void BoltModule::callBlockingAction(
     processOutputAndUpdateMetadata(response);
 }
 
+// Returns the output limit for the request; requests can only lower
+// the configured limit, unless no limit is configured. A zero (or a
+// missing value) keeps the configured limit, so that a request can't
+// turn off the truncation
+static OutputLimit getRequestOutputLimit(const OutputLimit& configured,
+                                         const lth_jc::JsonContainer& params)
+{
+    if (!params.includes("output_limit")
+            || params.type("output_limit") != lth_jc::DataType::Object)
+        return configured;
+
+    auto requested = params.get<lth_jc::JsonContainer>("output_limit");
+    bool is_configured { configured.head_bytes > 0 || configured.tail_bytes > 0 };
+
+    auto pick = [&](const std::string& key, uint32_t configured_bytes) -> uint32_t {
+        if (!requested.includes(key) || requested.type(key) != lth_jc::DataType::Int)
+            return configured_bytes;
+
+        auto requested_bytes = static_cast<uint32_t>(std::max(0, requested.get<int>(key)));
+        if (requested_bytes == 0)
+            return configured_bytes;
+
+        return is_configured ? std::min(requested_bytes, configured_bytes) : requested_bytes;
+    };
+
+    return OutputLimit { pick("head_bytes", configured.head_bytes),
+                         pick("tail_bytes", configured.tail_bytes) };
+}
+
 void BoltModule::callNonBlockingAction(
         const ActionRequest& request,
         const Util::CommandObject &command,
@@ -140,6 +185,13 @@ void BoltModule::callNonBlockingAction(
     wrapper_input.set<std::string>("stderr", (results_dir / "stderr").string());
     wrapper_input.set<std::string>("exitcode", (results_dir / "exitcode").string());
 
+    auto output_limit = getRequestOutputLimit(output_limit_, request.params());
+    if (output_limit.head_bytes > 0 || output_limit.tail_bytes > 0) {
+        wrapper_input.set<int>("output_head_bytes", static_cast<int>(output_limit.head_bytes));
+        wrapper_input.set<int>("output_tail_bytes", static_cast<int>(output_limit.tail_bytes));
+        wrapper_input.set<std::string>("truncation", (results_dir / "truncation").string());
+    }
+
     CommandObject wrapped_command {
         (exec_prefix_ / EXECUTION_WRAPPER_EXECUTABLE).string(),
         {},
@@ -159,8 +211,32 @@ void BoltModule::callNonBlockingAction(
     processOutputAndUpdateMetadata(response);
 }
 
+ActionOutput BoltModule::writeOutput(const fs::path& results_dir,
+                                     const int exit_code,
+                                     const std::string& std_out,
+                                     const std::string& std_err)
+{
+    lth_file::atomic_write_to_file(std::to_string(exit_code) + "\n",
+                                   (results_dir / "exitcode").string(),
+                                   NIX_FILE_PERMS,
+                                   std::ios::binary);
+    lth_file::atomic_write_to_file(std_out,
+                                   (results_dir / "stdout").string(),
+                                   NIX_FILE_PERMS,
+                                   std::ios::binary);
+    lth_file::atomic_write_to_file(std_err,
+                                   (results_dir / "stderr").string(),
+                                   NIX_FILE_PERMS,
+                                   std::ios::binary);
+    return ActionOutput { exit_code, std_out, std_err };
+}
+
 ActionResponse BoltModule::callAction(const ActionRequest& request)
 {
+    std::unique_ptr<ModuleCacheDir::EntryPin> cache_pin;
+    if (module_cache_dir_ != nullptr)
+        cache_pin.reset(new ModuleCacheDir::EntryPin(*module_cache_dir_, cacheEntries(request)));
+
     auto cmd = buildCommandObject(request);
     ActionResponse response { ModuleType::Internal, request };
 
@@ -0,0 +1,195 @@
+#include <pxp-agent/util/directory_watcher.hpp>
+#include <pxp-agent/util/file_fingerprint.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#define LEATHERMAN_LOGGING_NAMESPACE "puppetlabs.pxp_agent.util.directory_watcher"
+#include <leatherman/logging/logging.hpp>
+
+#include <cpp-pcp-client/util/thread.hpp>   // this_thread::sleep_for
+#include <cpp-pcp-client/util/chrono.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <algorithm>  // std::min
+#include <utility>    // std::move
+
+#ifdef __linux__
+#include <cstring>          // strerror()
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>         // read(), close()
+#endif
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs       = boost::filesystem;
+namespace lth_loc  = leatherman::locale;
+namespace pcp_util = PCPClient::Util;
+
+const std::chrono::milliseconds DirectoryWatcher::SETTLE_TIME { 500 };
+
+// Changes are reported after this time at most, even if they keep
+// happening
+static const int MAX_SETTLE_ROUNDS { 10 };
+
+// Interval between the listings of the directories, when polling
+static const std::chrono::milliseconds POLL_INTERVAL { 1000 };
+
+DirectoryWatcher::DirectoryWatcher(const std::vector<std::string>& dir_paths)
+        : dir_paths_ {},
+          inotify_fd_ { -1 },
+          watches_ {},
+          snapshot_ {}
+{
+    for (const auto& dir_path : dir_paths) {
+        if (fs::is_directory(dir_path)) {
+            dir_paths_.push_back(dir_path);
+        } else {
+            LOG_DEBUG("Not watching '{1}', as it's not a directory", dir_path);
+        }
+    }
+
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0)
+        throw DirectoryWatcher::Error {
+            lth_loc::format("failed to initialize inotify: {1}", strerror(errno)) };
+
+    for (const auto& dir_path : dir_paths_) {
+        auto wd = inotify_add_watch(inotify_fd_, dir_path.c_str(),
+                                    IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE
+                                    | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+        if (wd < 0) {
+            auto error = strerror(errno);
+            close(inotify_fd_);
+            throw DirectoryWatcher::Error {
+                lth_loc::format("failed to watch '{1}': {2}", dir_path, error) };
+        }
+        watches_[wd] = dir_path;
+    }
+#else
+    snapshot_ = takeSnapshot();
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef __linux__
+    if (inotify_fd_ >= 0)
+        close(inotify_fd_);
+#endif
+}
+
+std::set<std::string> DirectoryWatcher::waitForChanges(std::chrono::milliseconds timeout)
+{
+    auto changes = readChanges(timeout);
+
+    for (int round = 0; !changes.empty() && round < MAX_SETTLE_ROUNDS; round++) {
+        auto more_changes = readChanges(SETTLE_TIME);
+        if (more_changes.empty())
+            break;
+        changes.insert(more_changes.begin(), more_changes.end());
+    }
+
+    return changes;
+}
+
+std::map<std::string, std::string> DirectoryWatcher::takeSnapshot() const
+{
+    std::map<std::string, std::string> snapshot;
+
+    for (const auto& dir_path : dir_paths_) {
+        boost::system::error_code ec;
+        fs::directory_iterator end;
+        for (fs::directory_iterator f { dir_path, ec }; !ec && f != end; f.increment(ec)) {
+            auto file_path = (fs::path(dir_path) / f->path().filename()).string();
+            FileFingerprint fingerprint;
+            if (getFileFingerprint(file_path, fingerprint))
+                snapshot[file_path] = fingerprint.toString();
+        }
+    }
+
+    return snapshot;
+}
+
+#ifdef __linux__
+
+std::set<std::string> DirectoryWatcher::readChanges(std::chrono::milliseconds timeout)
+{
+    std::set<std::string> changes;
+
+    pollfd poll_fd { inotify_fd_, POLLIN, 0 };
+    if (poll(&poll_fd, 1, static_cast<int>(timeout.count())) <= 0)
+        return changes;
+
+    // Aligned as inotify_event, as the events are read in place
+    alignas(inotify_event) char buffer[0x10000];
+
+    while (true) {
+        auto size = read(inotify_fd_, buffer, sizeof(buffer));
+        if (size <= 0)
+            break;
+
+        for (ssize_t offset = 0; offset < size; ) {
+            auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Some events were lost; the files that exist are all
+                // reported as changed, the removed ones can't be
+                LOG_WARNING("Too many changes in the watched directories; some "
+                            "removed files may not be detected");
+                for (const auto& file : takeSnapshot())
+                    changes.insert(file.first);
+                continue;
+            }
+
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end() || event->len == 0)
+                continue;
+            changes.insert((fs::path(watch->second) / event->name).string());
+        }
+    }
+
+    return changes;
+}
+
+#else
+
+std::set<std::string> DirectoryWatcher::readChanges(std::chrono::milliseconds timeout)
+{
+    std::set<std::string> changes;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (changes.empty()) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            break;
+        pcp_util::this_thread::sleep_for(
+            pcp_util::chrono::milliseconds(std::min(remaining, POLL_INTERVAL).count()));
+
+        auto snapshot = takeSnapshot();
+        for (const auto& file : snapshot) {
+            auto previous = snapshot_.find(file.first);
+            if (previous == snapshot_.end() || previous->second != file.second)
+                changes.insert(file.first);
+        }
+        for (const auto& file : snapshot_) {
+            if (snapshot.find(file.first) == snapshot.end())
+                changes.insert(file.first);
+        }
+        snapshot_ = std::move(snapshot);
+    }
+
+    return changes;
+}
+
+#endif
+
+}  // namespace Util
+}  // namespace PXPAgent
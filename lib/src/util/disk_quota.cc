@@ -0,0 +1,159 @@
+#include <pxp-agent/util/disk_quota.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>  // std::sort
+#include <cctype>     // std::isdigit, std::tolower
+#include <limits>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs = boost::filesystem;
+namespace lth_loc = leatherman::locale;
+
+const uint64_t DiskQuota::HIGH_WATER_MARK { 90 };
+const uint64_t DiskQuota::LOW_WATER_MARK { 75 };
+
+DiskQuota::DiskQuota(uint64_t quota_bytes)
+        : quota_bytes_ { quota_bytes },
+          usage_bytes_ { 0 },
+          entries_ {}
+{
+}
+
+// NB: the quota is divided first, so that large quotas can't overflow
+
+bool DiskQuota::isAboveHighWaterMark() const
+{
+    return enabled() && usage_bytes_ > quota_bytes_ / 100 * HIGH_WATER_MARK;
+}
+
+bool DiskQuota::isAboveLowWaterMark() const
+{
+    return enabled() && usage_bytes_ > quota_bytes_ / 100 * LOW_WATER_MARK;
+}
+
+void DiskQuota::update(const std::string& name, uint64_t bytes, std::time_t last_use)
+{
+    auto it = entries_.find(name);
+
+    if (it == entries_.end()) {
+        entries_.emplace(name, Entry { bytes, last_use });
+    } else {
+        usage_bytes_ -= it->second.bytes;
+        it->second = Entry { bytes, last_use };
+    }
+
+    usage_bytes_ += bytes;
+}
+
+void DiskQuota::touch(const std::string& name, std::time_t last_use)
+{
+    auto it = entries_.find(name);
+
+    if (it != entries_.end())
+        it->second.last_use = last_use;
+}
+
+void DiskQuota::remove(const std::string& name)
+{
+    auto it = entries_.find(name);
+
+    if (it != entries_.end()) {
+        usage_bytes_ -= it->second.bytes;
+        entries_.erase(it);
+    }
+}
+
+void DiskQuota::clear()
+{
+    entries_.clear();
+    usage_bytes_ = 0;
+}
+
+std::vector<std::string> DiskQuota::entriesByLastUse() const
+{
+    std::vector<std::pair<std::time_t, std::string>> by_last_use {};
+    by_last_use.reserve(entries_.size());
+
+    for (const auto& entry : entries_)
+        by_last_use.emplace_back(entry.second.last_use, entry.first);
+
+    std::sort(by_last_use.begin(), by_last_use.end());
+
+    std::vector<std::string> names {};
+    names.reserve(by_last_use.size());
+
+    for (auto& entry : by_last_use)
+        names.push_back(std::move(entry.second));
+
+    return names;
+}
+
+uint64_t DiskQuota::directorySize(const fs::path& dir_path)
+{
+    uint64_t size { 0 };
+    boost::system::error_code ec;
+    fs::recursive_directory_iterator it { dir_path, ec }, end;
+
+    while (!ec && it != end) {
+        boost::system::error_code entry_ec;
+
+        if (fs::is_regular_file(it->symlink_status(entry_ec))) {
+            auto file_size = fs::file_size(it->path(), entry_ec);
+            if (!entry_ec)
+                size += file_size;
+        }
+
+        it.increment(ec);
+    }
+
+    return size;
+}
+
+uint64_t DiskQuota::parseSize(const std::string& size_txt)
+{
+    auto invalid = [&]() {
+        return Error { lth_loc::format("invalid size '{1}'", size_txt) };
+    };
+
+    size_t num_digits { 0 };
+    while (num_digits < size_txt.size() && std::isdigit(static_cast<unsigned char>(size_txt[num_digits])))
+        num_digits++;
+
+    if (num_digits == 0 || size_txt.size() - num_digits > 1)
+        throw invalid();
+
+    uint64_t multiplier { 1 };
+
+    if (num_digits < size_txt.size()) {
+        static const std::string SUFFIXES { "kmgt" };
+        auto exponent = SUFFIXES.find(
+            static_cast<char>(std::tolower(static_cast<unsigned char>(size_txt.back()))));
+
+        if (exponent == std::string::npos)
+            throw invalid();
+
+        for (size_t i = 0; i <= exponent; i++)
+            multiplier *= 1024;
+    }
+
+    uint64_t value;
+
+    try {
+        value = std::stoull(size_txt.substr(0, num_digits));
+    } catch (const std::out_of_range&) {
+        throw invalid();
+    }
+
+    if (value > std::numeric_limits<uint64_t>::max() / multiplier)
+        throw invalid();
+
+    return value * multiplier;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,39 @@
+#include <pxp-agent/util/file_fingerprint.hpp>
+
+#include <sstream>
+
+namespace PXPAgent {
+namespace Util {
+
+bool FileFingerprint::operator==(const FileFingerprint& other) const
+{
+    return size == other.size
+        && mtime_ns == other.mtime_ns
+        && ctime_ns == other.ctime_ns
+        && inode == other.inode
+        && device == other.device;
+}
+
+std::string FileFingerprint::toString() const
+{
+    std::ostringstream txt;
+    txt << size << ' ' << mtime_ns << ' ' << ctime_ns << ' ' << inode << ' ' << device;
+    return txt.str();
+}
+
+bool FileFingerprint::fromString(const std::string& txt, FileFingerprint& fingerprint)
+{
+    std::istringstream fingerprint_stream { txt };
+    FileFingerprint parsed;
+
+    if (!(fingerprint_stream >> parsed.size >> parsed.mtime_ns >> parsed.ctime_ns
+                             >> parsed.inode >> parsed.device)
+            || !(fingerprint_stream >> std::ws).eof())
+        return false;
+
+    fingerprint = parsed;
+    return true;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
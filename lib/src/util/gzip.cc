@@ -0,0 +1,115 @@
+#include <pxp-agent/util/gzip.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#include <boost/nowide/fstream.hpp>
+
+#include <zlib.h>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace lth_loc = leatherman::locale;
+
+static constexpr std::streamsize CHUNK_SIZE = 0x8000;  // 32 kB
+
+// Adding 16 to the window bits makes zlib write and expect a gzip
+// header and trailer rather than the zlib ones
+static constexpr int GZIP_WINDOW_BITS = 15 + 16;
+
+uint64_t gzipFile(const std::string& src_path, const std::string& dst_path)
+{
+    boost::nowide::ifstream ifs(src_path, std::ios::binary);
+    if (!ifs)
+        throw GzipError { lth_loc::format("failed to open '{1}'", src_path) };
+
+    boost::nowide::ofstream ofs(dst_path, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        throw GzipError { lth_loc::format("failed to open '{1}'", dst_path) };
+
+    z_stream strm {};
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw GzipError { lth_loc::format("failed to initialize zlib: {1}",
+                                          (strm.msg ? strm.msg : "")) };
+
+    char in_buffer[CHUNK_SIZE];
+    char out_buffer[CHUNK_SIZE];
+    uint64_t src_size { 0 };
+    int flush;
+
+    do {
+        ifs.read(in_buffer, CHUNK_SIZE);
+        if (ifs.bad()) {
+            deflateEnd(&strm);
+            throw GzipError { lth_loc::format("error while reading '{1}'", src_path) };
+        }
+
+        src_size += static_cast<uint64_t>(ifs.gcount());
+        flush = ifs.eof() ? Z_FINISH : Z_NO_FLUSH;
+        strm.next_in = reinterpret_cast<Bytef*>(in_buffer);
+        strm.avail_in = static_cast<uInt>(ifs.gcount());
+
+        do {
+            strm.next_out = reinterpret_cast<Bytef*>(out_buffer);
+            strm.avail_out = static_cast<uInt>(CHUNK_SIZE);
+            deflate(&strm, flush);
+            ofs.write(out_buffer, CHUNK_SIZE - strm.avail_out);
+        } while (strm.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    deflateEnd(&strm);
+    ofs.close();
+
+    if (!ofs)
+        throw GzipError { lth_loc::format("error while writing '{1}'", dst_path) };
+
+    return src_size;
+}
+
+void gunzipFile(const std::string& src_path, std::string& content)
+{
+    boost::nowide::ifstream ifs(src_path, std::ios::binary);
+    if (!ifs)
+        throw GzipError { lth_loc::format("failed to open '{1}'", src_path) };
+
+    z_stream strm {};
+    if (inflateInit2(&strm, GZIP_WINDOW_BITS) != Z_OK)
+        throw GzipError { lth_loc::format("failed to initialize zlib: {1}",
+                                          (strm.msg ? strm.msg : "")) };
+
+    char in_buffer[CHUNK_SIZE];
+    char out_buffer[CHUNK_SIZE];
+    int ret { Z_OK };
+
+    while (ret != Z_STREAM_END) {
+        ifs.read(in_buffer, CHUNK_SIZE);
+        if (ifs.bad() || ifs.gcount() == 0) {
+            inflateEnd(&strm);
+            throw GzipError { lth_loc::format("unexpected end of '{1}'", src_path) };
+        }
+
+        strm.next_in = reinterpret_cast<Bytef*>(in_buffer);
+        strm.avail_in = static_cast<uInt>(ifs.gcount());
+
+        do {
+            strm.next_out = reinterpret_cast<Bytef*>(out_buffer);
+            strm.avail_out = static_cast<uInt>(CHUNK_SIZE);
+            ret = inflate(&strm, Z_NO_FLUSH);
+
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                std::string msg { strm.msg ? strm.msg : "" };
+                inflateEnd(&strm);
+                throw GzipError { lth_loc::format("invalid gzip data in '{1}': {2}",
+                                                  src_path, msg) };
+            }
+
+            content.append(out_buffer, CHUNK_SIZE - strm.avail_out);
+        } while (strm.avail_out == 0 && ret != Z_STREAM_END);
+    }
+
+    inflateEnd(&strm);
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,139 @@
+#include <pxp-agent/util/http_client_pool.hpp>
+
+#define LEATHERMAN_LOGGING_NAMESPACE "puppetlabs.pxp_agent.util.http_client_pool"
+#include <leatherman/logging/logging.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace pcp_util = PCPClient::Util;
+
+const size_t HttpClientPool::DEFAULT_MAX_IDLE_HANDLES { 8 };
+
+//
+// HttpClientPool::Lease
+//
+
+HttpClientPool::Lease::Lease(HttpClientPool& pool, CURL* handle)
+        : pool_ (pool),
+          handle_ { handle }
+{
+}
+
+HttpClientPool::Lease::Lease(Lease&& other)
+        : pool_ (other.pool_),
+          handle_ { other.handle_ }
+{
+    other.handle_ = nullptr;
+}
+
+HttpClientPool::Lease::~Lease()
+{
+    if (handle_ != nullptr)
+        pool_.release(handle_);
+}
+
+//
+// HttpClientPool
+//
+
+HttpClientPool::HttpClientPool(size_t max_idle_handles)
+        : max_idle_handles_ { max_idle_handles },
+          share_ { curl_share_init() },
+          idle_handles_ {},
+          stats_ { 0, 0 },
+          share_mutexes_(CURL_LOCK_DATA_LAST)
+{
+    bool share_ok =
+           share_ != nullptr
+        && curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lockShared) == CURLSHE_OK
+        && curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlockShared) == CURLSHE_OK
+        && curl_share_setopt(share_, CURLSHOPT_USERDATA, this) == CURLSHE_OK
+        && curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) == CURLSHE_OK
+        && curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) == CURLSHE_OK;
+
+    if (!share_ok) {
+        LOG_WARNING("Failed to set up the DNS and TLS session cache shared by the downloads");
+        if (share_ != nullptr) {
+            curl_share_cleanup(share_);
+            share_ = nullptr;
+        }
+    }
+}
+
+HttpClientPool::~HttpClientPool()
+{
+    // All the handles must be cleaned up before the share handle
+    for (auto handle : idle_handles_)
+        curl_easy_cleanup(handle);
+
+    if (share_ != nullptr)
+        curl_share_cleanup(share_);
+}
+
+HttpClientPool::Lease HttpClientPool::acquire()
+{
+    CURL* handle { nullptr };
+    {
+        pcp_util::lock_guard<pcp_util::mutex> idle_lock { idle_handles_mutex_ };
+        if (!idle_handles_.empty()) {
+            handle = idle_handles_.back();
+            idle_handles_.pop_back();
+        }
+    }
+
+    if (handle == nullptr)
+        handle = curl_easy_init();
+
+    // Set again for the idle handles, as curl_easy_reset drops it
+    if (handle != nullptr && share_ != nullptr)
+        curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+
+    return Lease { *this, handle };
+}
+
+void HttpClientPool::recordTransfer(CURL* handle)
+{
+    long num_connects { 0 };
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &num_connects);
+
+    pcp_util::lock_guard<pcp_util::mutex> stats_lock { stats_mutex_ };
+    stats_.requests++;
+    stats_.new_connections += static_cast<uint64_t>(num_connects);
+}
+
+HttpClientPool::Stats HttpClientPool::stats()
+{
+    pcp_util::lock_guard<pcp_util::mutex> stats_lock { stats_mutex_ };
+    return stats_;
+}
+
+void HttpClientPool::release(CURL* handle)
+{
+    // Drops the options of the last request (e.g. pointers to its
+    // buffers), keeping the open connections and the share handle
+    curl_easy_reset(handle);
+
+    {
+        pcp_util::lock_guard<pcp_util::mutex> idle_lock { idle_handles_mutex_ };
+        if (idle_handles_.size() < max_idle_handles_) {
+            idle_handles_.push_back(handle);
+            return;
+        }
+    }
+
+    curl_easy_cleanup(handle);
+}
+
+void HttpClientPool::lockShared(CURL*, curl_lock_data data, curl_lock_access, void* pool)
+{
+    static_cast<HttpClientPool*>(pool)->share_mutexes_[static_cast<size_t>(data)].lock();
+}
+
+void HttpClientPool::unlockShared(CURL*, curl_lock_data data, void* pool)
+{
+    static_cast<HttpClientPool*>(pool)->share_mutexes_[static_cast<size_t>(data)].unlock();
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
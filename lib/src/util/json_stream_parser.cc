@@ -0,0 +1,375 @@
+#include <pxp-agent/util/json_stream_parser.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#include <cstring>  // strchr()
+
+namespace PXPAgent {
+namespace Util {
+
+namespace lth_loc = leatherman::locale;
+
+static bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Returns the number of characters before the first one that ends,
+// or must be checked within, a string: '"', '\\' or a control one
+static size_t plainStringLength(const char* data, size_t size)
+{
+    size_t idx { 0 };
+    while (idx < size && data[idx] != '"' && data[idx] != '\\'
+            && static_cast<unsigned char>(data[idx]) >= 0x20)
+        idx++;
+    return idx;
+}
+
+JsonStreamParser::JsonStreamParser(uint64_t max_size, uint32_t max_depth)
+        : max_size_ { max_size },
+          max_depth_ { max_depth },
+          offset_ { 0 },
+          state_ { State::Value },
+          containers_ {},
+          string_is_key_ { false },
+          expect_low_surrogate_ { false },
+          hex_digits_ { 0 },
+          code_unit_ { 0 },
+          literal_ { nullptr },
+          literal_pos_ { 0 },
+          error_ {}
+{
+}
+
+void JsonStreamParser::feed(const char* data, size_t size)
+{
+    if (!error_.empty())
+        throw JsonStreamParser::Error { error_ };
+
+    checkSize(offset_ + size);
+
+    for (size_t idx = 0; idx < size; ) {
+        if (state_ == State::String) {
+            // The plain characters of a string need no state change
+            auto plain = plainStringLength(data + idx, size - idx);
+            idx += plain;
+            offset_ += plain;
+            if (idx == size)
+                break;
+        }
+
+        if (consume(data[idx])) {
+            idx++;
+            offset_++;
+        }
+    }
+}
+
+void JsonStreamParser::checkSize(uint64_t total_size)
+{
+    if (max_size_ > 0 && total_size > max_size_) {
+        error_ = lth_loc::format("the text exceeds the maximum size of {1} bytes",
+                                 max_size_);
+        throw JsonStreamParser::LimitError { error_ };
+    }
+}
+
+void JsonStreamParser::finish()
+{
+    if (!error_.empty())
+        throw JsonStreamParser::Error { error_ };
+
+    if (containers_.empty()) {
+        switch (state_) {
+            case State::NumberZero:
+            case State::NumberInt:
+            case State::NumberFrac:
+            case State::NumberExpDigits:
+                state_ = State::Done;
+                // fall through
+            case State::Done:
+                return;
+            case State::Value:
+                fail(lth_loc::translate("no value found"));
+            default:
+                break;
+        }
+    }
+
+    fail(lth_loc::translate("the text ends before the end of the value"));
+}
+
+bool JsonStreamParser::consume(char c)
+{
+    switch (state_) {
+        case State::Value:
+        case State::ArrayFirst:
+            if (isWhitespace(c))
+                return true;
+            if (c == ']' && state_ == State::ArrayFirst)
+                closeContainer(c);
+            else
+                startValue(c);
+            return true;
+
+        case State::ObjectFirst:
+        case State::Key:
+            if (isWhitespace(c))
+                return true;
+            if (c == '}' && state_ == State::ObjectFirst) {
+                closeContainer(c);
+            } else if (c == '"') {
+                string_is_key_ = true;
+                state_ = State::String;
+            } else {
+                fail(lth_loc::translate("expected a string as object key"));
+            }
+            return true;
+
+        case State::Colon:
+            if (isWhitespace(c))
+                return true;
+            if (c != ':')
+                fail(lth_loc::translate("expected ':' after the object key"));
+            state_ = State::Value;
+            return true;
+
+        case State::AfterValue:
+            if (isWhitespace(c))
+                return true;
+            if (c == ',')
+                state_ = (containers_.back() == '{' ? State::Key : State::Value);
+            else if (c == '}' || c == ']')
+                closeContainer(c);
+            else
+                fail(lth_loc::translate("expected ',' or the end of the object or array"));
+            return true;
+
+        case State::Done:
+            if (!isWhitespace(c))
+                fail(lth_loc::translate("unexpected text after the value"));
+            return true;
+
+        case State::String:
+            if (c == '"') {
+                if (string_is_key_)
+                    state_ = State::Colon;
+                else
+                    endValue();
+            } else if (c == '\\') {
+                state_ = State::StringEscape;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                fail(lth_loc::translate("unescaped control character in a string"));
+            }
+            return true;
+
+        case State::StringEscape:
+            if (c == 'u') {
+                hex_digits_ = 0;
+                code_unit_ = 0;
+                state_ = State::StringUnicode;
+            } else if (c != '\0' && strchr("\"\\/bfnrt", c) != nullptr) {
+                state_ = State::String;
+            } else {
+                fail(lth_loc::translate("invalid escape sequence in a string"));
+            }
+            return true;
+
+        case State::StringUnicode: {
+            auto value = hexValue(c);
+            if (value < 0)
+                fail(lth_loc::translate("invalid unicode escape sequence in a string"));
+            code_unit_ = code_unit_ * 16 + static_cast<unsigned int>(value);
+            if (++hex_digits_ < 4)
+                return true;
+
+            if (expect_low_surrogate_) {
+                if (code_unit_ < 0xDC00 || code_unit_ > 0xDFFF)
+                    fail(lth_loc::translate("invalid surrogate pair in a string"));
+                expect_low_surrogate_ = false;
+                state_ = State::String;
+            } else if (code_unit_ >= 0xD800 && code_unit_ <= 0xDBFF) {
+                expect_low_surrogate_ = true;
+                state_ = State::SurrogateBackslash;
+            } else {
+                state_ = State::String;
+            }
+            return true;
+        }
+
+        case State::SurrogateBackslash:
+            if (c != '\\')
+                fail(lth_loc::translate("invalid surrogate pair in a string"));
+            state_ = State::SurrogateU;
+            return true;
+
+        case State::SurrogateU:
+            if (c != 'u')
+                fail(lth_loc::translate("invalid surrogate pair in a string"));
+            hex_digits_ = 0;
+            code_unit_ = 0;
+            state_ = State::StringUnicode;
+            return true;
+
+        case State::Literal:
+            if (c != literal_[literal_pos_])
+                fail(lth_loc::translate("invalid value"));
+            if (literal_[++literal_pos_] == '\0')
+                endValue();
+            return true;
+
+        case State::NumberMinus:
+            if (c == '0')
+                state_ = State::NumberZero;
+            else if (isDigit(c))
+                state_ = State::NumberInt;
+            else
+                fail(lth_loc::translate("invalid number"));
+            return true;
+
+        case State::NumberZero:
+        case State::NumberInt:
+            if (isDigit(c)) {
+                if (state_ == State::NumberZero)
+                    fail(lth_loc::translate("invalid number"));
+            } else if (c == '.') {
+                state_ = State::NumberDot;
+            } else if (c == 'e' || c == 'E') {
+                state_ = State::NumberExp;
+            } else {
+                endValue();
+                return false;
+            }
+            return true;
+
+        case State::NumberDot:
+            if (!isDigit(c))
+                fail(lth_loc::translate("invalid number"));
+            state_ = State::NumberFrac;
+            return true;
+
+        case State::NumberFrac:
+            if (c == 'e' || c == 'E') {
+                state_ = State::NumberExp;
+            } else if (!isDigit(c)) {
+                endValue();
+                return false;
+            }
+            return true;
+
+        case State::NumberExp:
+            if (c == '+' || c == '-')
+                state_ = State::NumberExpSign;
+            else if (isDigit(c))
+                state_ = State::NumberExpDigits;
+            else
+                fail(lth_loc::translate("invalid number"));
+            return true;
+
+        case State::NumberExpSign:
+            if (!isDigit(c))
+                fail(lth_loc::translate("invalid number"));
+            state_ = State::NumberExpDigits;
+            return true;
+
+        case State::NumberExpDigits:
+            if (!isDigit(c)) {
+                endValue();
+                return false;
+            }
+            return true;
+    }
+
+    return true;
+}
+
+void JsonStreamParser::startValue(char c)
+{
+    switch (c) {
+        case '{':
+            openContainer(c);
+            state_ = State::ObjectFirst;
+            break;
+        case '[':
+            openContainer(c);
+            state_ = State::ArrayFirst;
+            break;
+        case '"':
+            string_is_key_ = false;
+            state_ = State::String;
+            break;
+        case '-':
+            state_ = State::NumberMinus;
+            break;
+        case '0':
+            state_ = State::NumberZero;
+            break;
+        case 't':
+            literal_ = "true";
+            literal_pos_ = 1;
+            state_ = State::Literal;
+            break;
+        case 'f':
+            literal_ = "false";
+            literal_pos_ = 1;
+            state_ = State::Literal;
+            break;
+        case 'n':
+            literal_ = "null";
+            literal_pos_ = 1;
+            state_ = State::Literal;
+            break;
+        default:
+            if (!isDigit(c))
+                fail(lth_loc::translate("expected a value"));
+            state_ = State::NumberInt;
+    }
+}
+
+void JsonStreamParser::endValue()
+{
+    state_ = (containers_.empty() ? State::Done : State::AfterValue);
+}
+
+void JsonStreamParser::openContainer(char c)
+{
+    if (max_depth_ > 0 && containers_.size() >= max_depth_) {
+        error_ = lth_loc::format("the text exceeds the maximum nesting depth of {1}",
+                                 max_depth_);
+        throw JsonStreamParser::LimitError { error_ };
+    }
+    containers_.push_back(c);
+}
+
+void JsonStreamParser::closeContainer(char c)
+{
+    if ((c == '}') != (containers_.back() == '{'))
+        fail(lth_loc::translate("mismatched end of object or array"));
+    containers_.pop_back();
+    endValue();
+}
+
+void JsonStreamParser::fail(const std::string& reason)
+{
+    error_ = lth_loc::format("invalid JSON at offset {1}: {2}", offset_, reason);
+    throw JsonStreamParser::Error { error_ };
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,56 @@
+#include <pxp-agent/util/parallel.hpp>
+
+#include <cpp-pcp-client/util/thread.hpp>
+
+#include <algorithm>  // std::min, std::max
+#include <exception>
+#include <vector>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace pcp_util = PCPClient::Util;
+
+void runInParallel(size_t num_items,
+                   size_t max_parallel,
+                   std::function<void(size_t item_idx)> run_item)
+{
+    pcp_util::mutex next_item_mutex;
+    size_t next_item { 0 };
+    std::exception_ptr error;
+
+    auto run_items = [&]() {
+        while (true) {
+            size_t item_idx;
+            {
+                pcp_util::lock_guard<pcp_util::mutex> next_item_lock { next_item_mutex };
+                if (error || next_item == num_items)
+                    return;
+                item_idx = next_item++;
+            }
+
+            try {
+                run_item(item_idx);
+            } catch (...) {
+                pcp_util::lock_guard<pcp_util::mutex> next_item_lock { next_item_mutex };
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    // The calling thread runs items as well
+    std::vector<pcp_util::thread> runners;
+    auto num_runners = std::min(num_items, std::max<size_t>(max_parallel, 1));
+    for (size_t i = 1; i < num_runners; i++)
+        runners.emplace_back(run_items);
+    run_items();
+    for (auto& runner : runners)
+        runner.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
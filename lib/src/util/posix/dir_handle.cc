@@ -0,0 +1,246 @@
+#include <pxp-agent/util/dir_handle.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstring>          // strerror()
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>       // fstatat(), mkdirat(), fchmodat()
+#include <fcntl.h>          // openat() and its flags
+#include <dirent.h>         // fdopendir(), readdir()
+#include <stdio.h>          // renameat()
+#include <unistd.h>         // read(), write(), close(), unlinkat()
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs = boost::filesystem;
+namespace lth_loc = leatherman::locale;
+
+// The descriptors are not inherited by the processes we spawn
+static const int DIR_OPEN_FLAGS { O_RDONLY | O_DIRECTORY | O_CLOEXEC };
+
+static std::string errnoMessage()
+{
+    return lth_loc::format("{1} ({2})", strerror(errno), errno);
+}
+
+DirHandle::DirHandle(const std::string& dir_path)
+        : path_ { dir_path },
+          fd_ { ::open(dir_path.c_str(), DIR_OPEN_FLAGS) }
+{
+    if (fd_ == -1)
+        throw DirHandle::Error {
+            lth_loc::format("failed to open directory '{1}': {2}",
+                            path_, errnoMessage()) };
+}
+
+DirHandle::DirHandle(const DirHandle& parent, const std::string& name)
+        : path_ { parent.entryPath(name) },
+          fd_ { ::openat(parent.fd_, name.c_str(), DIR_OPEN_FLAGS) }
+{
+    if (fd_ == -1)
+        throw DirHandle::Error {
+            lth_loc::format("failed to open directory '{1}': {2}",
+                            path_, errnoMessage()) };
+}
+
+DirHandle::~DirHandle()
+{
+    ::close(fd_);
+}
+
+std::string DirHandle::entryPath(const std::string& name) const
+{
+    return (fs::path(path_) / name).string();
+}
+
+bool DirHandle::isStale() const
+{
+    // A removed directory has no links left
+    struct stat st;
+    return ::fstat(fd_, &st) != 0 || st.st_nlink == 0;
+}
+
+bool DirHandle::exists(const std::string& name) const
+{
+    struct stat st;
+    return ::fstatat(fd_, name.c_str(), &st, 0) == 0;
+}
+
+bool DirHandle::isDirectory(const std::string& name) const
+{
+    struct stat st;
+    return ::fstatat(fd_, name.c_str(), &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool DirHandle::read(const std::string& name, std::string& content) const
+{
+    int fd = ::openat(fd_, name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    // Size the buffer upfront, so that a single read() is usually enough
+    struct stat st;
+    std::string buffer {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        buffer.reserve(static_cast<size_t>(st.st_size));
+
+    char chunk[0x8000];  // 32 kB
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            ::close(fd);
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    ::close(fd);
+    content = std::move(buffer);
+    return true;
+}
+
+bool DirHandle::readChunks(const std::string& name,
+                           std::function<void(const char* data, size_t size)> callback) const
+{
+    int fd = ::openat(fd_, name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    char chunk[0x10000];  // 64 kB
+    ssize_t n;
+
+    try {
+        do {
+            n = ::read(fd, chunk, sizeof(chunk));
+
+            if (n == -1) {
+                if (errno == EINTR)
+                    continue;
+                ::close(fd);
+                return false;
+            }
+
+            if (n > 0)
+                callback(chunk, static_cast<size_t>(n));
+        } while (n != 0);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+    return true;
+}
+
+void DirHandle::atomicWrite(const std::string& name,
+                            const std::string& content,
+                            fs::perms perms) const
+{
+    auto tmp_name = "." + name + "." + fs::unique_path("%%%%-%%%%-%%%%").string();
+    auto mode = static_cast<mode_t>(perms);
+    int fd = ::openat(fd_, tmp_name.c_str(),
+                      O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+
+    if (fd == -1)
+        throw DirHandle::Error {
+            lth_loc::format("failed to create '{1}': {2}",
+                            entryPath(tmp_name), errnoMessage()) };
+
+    auto fail = [&](const std::string& action) {
+        auto err = errnoMessage();
+        ::close(fd);
+        ::unlinkat(fd_, tmp_name.c_str(), 0);
+        throw DirHandle::Error {
+            lth_loc::format("failed to {1} '{2}': {3}",
+                            action, entryPath(name), err) };
+    };
+
+    // Don't let the umask restrict the requested permissions
+    if (::fchmod(fd, mode) != 0)
+        fail(lth_loc::translate("set the permissions of"));
+
+    const char* data = content.data();
+    size_t left = content.size();
+    while (left > 0) {
+        auto n = ::write(fd, data, left);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            fail(lth_loc::translate("write"));
+        }
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+
+    if (::close(fd) != 0) {
+        auto err = errnoMessage();
+        ::unlinkat(fd_, tmp_name.c_str(), 0);
+        throw DirHandle::Error {
+            lth_loc::format("failed to write '{1}': {2}", entryPath(name), err) };
+    }
+
+    if (::renameat(fd_, tmp_name.c_str(), fd_, name.c_str()) != 0) {
+        auto err = errnoMessage();
+        ::unlinkat(fd_, tmp_name.c_str(), 0);
+        throw DirHandle::Error {
+            lth_loc::format("failed to rename '{1}': {2}", entryPath(name), err) };
+    }
+}
+
+void DirHandle::createDirectory(const std::string& name, fs::perms perms) const
+{
+    auto mode = static_cast<mode_t>(perms);
+
+    if (::mkdirat(fd_, name.c_str(), mode) != 0
+            && !(errno == EEXIST && isDirectory(name)))
+        throw DirHandle::Error {
+            lth_loc::format("failed to create directory '{1}': {2}",
+                            entryPath(name), errnoMessage()) };
+
+    if (::fchmodat(fd_, name.c_str(), mode, 0) != 0)
+        throw DirHandle::Error {
+            lth_loc::format("failed to set the permissions of '{1}': {2}",
+                            entryPath(name), errnoMessage()) };
+}
+
+void DirHandle::eachSubdirectory(std::function<bool(const std::string& name)> callback) const
+{
+    // fdopendir() takes ownership of the descriptor; use a new one so
+    // that this handle stays valid and its offset is not shared
+    int dir_fd = ::openat(fd_, ".", DIR_OPEN_FLAGS);
+    DIR* dir = (dir_fd == -1 ? nullptr : ::fdopendir(dir_fd));
+
+    if (dir == nullptr) {
+        auto err = errnoMessage();
+        if (dir_fd != -1)
+            ::close(dir_fd);
+        throw DirHandle::Error {
+            lth_loc::format("failed to list directory '{1}': {2}", path_, err) };
+    }
+
+    // NB: d_type is not available on every platform (e.g. Solaris),
+    // so we rely on fstatat() to find the sub-directories
+    struct dirent* entry;
+    while ((entry = ::readdir(dir)) != nullptr) {
+        std::string name { entry->d_name };
+        if (name == "." || name == ".." || !isDirectory(name))
+            continue;
+        if (!callback(name))
+            break;
+    }
+
+    ::closedir(dir);
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
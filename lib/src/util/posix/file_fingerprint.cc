@@ -0,0 +1,40 @@
+#include <pxp-agent/util/file_fingerprint.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace PXPAgent {
+namespace Util {
+
+static const int64_t NS_PER_S { 1000000000 };
+
+// The nanoseconds part of the timestamps is not exposed with the
+// same name on every platform
+#if defined(__APPLE__)
+#define PXP_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#define PXP_CTIME_NSEC(st) ((st).st_ctimespec.tv_nsec)
+#elif defined(_AIX)
+#define PXP_MTIME_NSEC(st) ((st).st_mtime_n)
+#define PXP_CTIME_NSEC(st) ((st).st_ctime_n)
+#else
+#define PXP_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#define PXP_CTIME_NSEC(st) ((st).st_ctim.tv_nsec)
+#endif
+
+bool getFileFingerprint(const std::string& file_path, FileFingerprint& fingerprint)
+{
+    struct stat st;
+
+    if (::stat(file_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    fingerprint.size = static_cast<uint64_t>(st.st_size);
+    fingerprint.mtime_ns = static_cast<int64_t>(st.st_mtime) * NS_PER_S + PXP_MTIME_NSEC(st);
+    fingerprint.ctime_ns = static_cast<int64_t>(st.st_ctime) * NS_PER_S + PXP_CTIME_NSEC(st);
+    fingerprint.inode = static_cast<uint64_t>(st.st_ino);
+    fingerprint.device = static_cast<uint64_t>(st.st_dev);
+    return true;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,146 @@
+#include <pxp-agent/util/file_staging.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>  // std::min
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>   // FICLONE
+#include <cerrno>
+#endif
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs = boost::filesystem;
+
+// Clones the source file; returns false in case the filesystem does
+// not support it, leaving no destination file behind
+static bool reflinkFile(const fs::path& source, const fs::path& destination)
+{
+#ifdef FICLONE
+    int src_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0)
+        return false;
+
+    struct stat src_stat;
+    if (fstat(src_fd, &src_stat) != 0) {
+        close(src_fd);
+        return false;
+    }
+
+    int dst_fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                      src_stat.st_mode & 07777);
+    if (dst_fd < 0) {
+        close(src_fd);
+        return false;
+    }
+
+    bool cloned = ioctl(dst_fd, FICLONE, src_fd) == 0;
+    close(dst_fd);
+    close(src_fd);
+
+    if (!cloned)
+        unlink(destination.c_str());
+
+    return cloned;
+#else
+    (void) source;
+    (void) destination;
+    return false;
+#endif
+}
+
+// Copies the data of the source file without going through user space,
+// with copy_file_range (which may still share the blocks, e.g. on NFS)
+// or, where it's not supported (before Linux 4.5, or across filesystems
+// before 5.3), with sendfile; returns false in case neither can copy
+// it, leaving no destination file behind
+static bool kernelCopyFile(const fs::path& source, const fs::path& destination)
+{
+#ifdef __linux__
+    int src_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0)
+        return false;
+
+    struct stat src_stat;
+    if (fstat(src_fd, &src_stat) != 0 || !S_ISREG(src_stat.st_mode)) {
+        close(src_fd);
+        return false;
+    }
+
+    int dst_fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                      src_stat.st_mode & 07777);
+    if (dst_fd < 0) {
+        close(src_fd);
+        return false;
+    }
+
+    // Both calls advance the offsets of the descriptors, so that the
+    // copy can switch from one to the other
+    constexpr size_t CHUNK_SIZE = 0x40000000;  // 1 GB
+#ifdef SYS_copy_file_range
+    bool use_copy_range { true };
+#endif
+    off_t remaining { src_stat.st_size };
+    while (remaining > 0) {
+        auto chunk = static_cast<size_t>(std::min<off_t>(remaining, CHUNK_SIZE));
+        ssize_t copied;
+#ifdef SYS_copy_file_range
+        if (use_copy_range) {
+            copied = syscall(SYS_copy_file_range, src_fd, nullptr, dst_fd, nullptr, chunk, 0u);
+            if (copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+                               || errno == EOPNOTSUPP || errno == EPERM)) {
+                use_copy_range = false;
+                continue;
+            }
+        } else
+#endif
+        {
+            copied = sendfile(dst_fd, src_fd, nullptr, chunk);
+        }
+        if (copied < 0 && errno == EINTR)
+            continue;
+        // Failed, or the file was truncated meanwhile
+        if (copied <= 0)
+            break;
+        remaining -= copied;
+    }
+
+    bool copied_all = remaining == 0;
+    copied_all = close(dst_fd) == 0 && copied_all;
+    close(src_fd);
+
+    if (!copied_all)
+        unlink(destination.c_str());
+
+    return copied_all;
+#else
+    (void) source;
+    (void) destination;
+    return false;
+#endif
+}
+
+StagingMethod stageFile(const fs::path& source, const fs::path& destination)
+{
+    if (reflinkFile(source, destination))
+        return StagingMethod::Reflink;
+
+    if (kernelCopyFile(source, destination))
+        return StagingMethod::KernelCopy;
+
+    fs::copy_file(source, destination);
+    return StagingMethod::Copy;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
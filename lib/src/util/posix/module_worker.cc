@@ -0,0 +1,204 @@
+#include <pxp-agent/util/module_worker.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#include <cstring>          // strerror(), memset()
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>         // kill(), sigaction(), sigprocmask()
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>       // waitpid()
+#include <unistd.h>         // fork(), execve(), close()
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+extern char** environ;
+
+namespace PXPAgent {
+namespace Util {
+
+namespace lth_loc = leatherman::locale;
+
+static constexpr size_t READ_CHUNK_SIZE = 0x10000;  // 64 kB
+
+static std::string errnoMessage()
+{
+    return lth_loc::format("{1} ({2})", strerror(errno), errno);
+}
+
+// Creates the socket pair, not inherited by the processes we spawn
+// other than the worker itself
+static void createSocketPair(int fds[2])
+{
+#ifdef SOCK_CLOEXEC
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+        throw ModuleWorker::Error {
+            lth_loc::format("failed to create the worker socket: {1}", errnoMessage()) };
+#else
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        throw ModuleWorker::Error {
+            lth_loc::format("failed to create the worker socket: {1}", errnoMessage()) };
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+#ifdef SO_NOSIGPIPE
+    int enabled { 1 };
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+}
+
+ModuleWorker::ModuleWorker(const std::string& exec_path)
+        : pid_ { -1 },
+          fd_ { -1 },
+          exited_ { false },
+          buffer_ {}
+{
+    int fds[2];
+    createSocketPair(fds);
+
+    // Prepared before forking, as the child may only call
+    // async-signal-safe functions until it execs
+    std::string worker_arg { "worker" };
+    std::vector<char*> argv { const_cast<char*>(exec_path.c_str()), &worker_arg[0], nullptr };
+    int dev_null = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    struct sigaction default_action;
+    memset(&default_action, 0, sizeof(default_action));
+    default_action.sa_handler = SIG_DFL;
+    sigemptyset(&default_action.sa_mask);
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    // As for the actions run by a process of their own, the worker
+    // gets the environment of pxp-agent, locale included (see the
+    // merge_environment and inherit_locale execution options)
+    char** envp = environ;
+
+    pid_ = fork();
+    if (pid_ == 0) {
+        // The child only has the thread that forked; it must not keep
+        // the signals ignored or blocked by pxp-agent (e.g. SIGPIPE)
+        for (int sig = 1; sig < NSIG; sig++)
+            sigaction(sig, &default_action, nullptr);
+        sigprocmask(SIG_SETMASK, &empty_mask, nullptr);
+
+        if (dup2(fds[1], STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0
+                || (dev_null >= 0 && dup2(dev_null, STDERR_FILENO) < 0))
+            _exit(127);
+        for (long fd = STDERR_FILENO + 1; fd < max_fd; fd++)
+            close(static_cast<int>(fd));
+        execve(argv[0], argv.data(), envp);
+        _exit(127);
+    }
+
+    auto fork_error = errnoMessage();
+    close(fds[1]);
+    if (dev_null >= 0)
+        close(dev_null);
+
+    if (pid_ < 0) {
+        close(fds[0]);
+        throw ModuleWorker::Error {
+            lth_loc::format("failed to start '{1}': {2}", exec_path, fork_error) };
+    }
+    fd_ = fds[0];
+}
+
+ModuleWorker::~ModuleWorker()
+{
+    close(fd_);
+
+    for (int i = 0; i < 20 && isRunning(); i++)
+        usleep(50000);
+
+    if (!exited_) {
+        kill(pid_, SIGKILL);
+        waitpid(pid_, nullptr, 0);
+    }
+}
+
+bool ModuleWorker::isRunning()
+{
+    if (!exited_ && waitpid(pid_, nullptr, WNOHANG) == pid_)
+        exited_ = true;
+    return !exited_;
+}
+
+void ModuleWorker::writeLine(const std::string& line)
+{
+    auto data = line + "\n";
+    size_t written { 0 };
+
+#ifdef MSG_NOSIGNAL
+    constexpr int SEND_FLAGS { MSG_NOSIGNAL };
+#else
+    constexpr int SEND_FLAGS { 0 };
+#endif
+
+    while (written < data.size()) {
+        auto size = send(fd_, data.data() + written, data.size() - written, SEND_FLAGS);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0)
+            throw ModuleWorker::Error {
+                lth_loc::format("failed to write to the worker {1}: {2}", pid_, errnoMessage()) };
+        written += static_cast<size_t>(size);
+    }
+}
+
+std::string ModuleWorker::readLine(std::chrono::milliseconds timeout, size_t max_size)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+        auto newline = buffer_.find('\n');
+        if (max_size > 0 && (newline == std::string::npos ? buffer_.size() : newline) > max_size)
+            throw ModuleWorker::Error {
+                lth_loc::format("the worker {1} wrote a line larger than {2} bytes",
+                                pid_, max_size) };
+        if (newline != std::string::npos) {
+            auto line = buffer_.substr(0, newline);
+            buffer_.erase(0, newline + 1);
+            return line;
+        }
+
+        int poll_timeout_ms { -1 };
+        if (timeout.count() > 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0)
+                throw ModuleWorker::Error {
+                    lth_loc::format("the worker {1} did not answer within {2} ms",
+                                    pid_, timeout.count()) };
+            poll_timeout_ms = static_cast<int>(remaining.count());
+        }
+
+        pollfd poll_fd { fd_, POLLIN, 0 };
+        auto ready = poll(&poll_fd, 1, poll_timeout_ms);
+        if (ready < 0 && errno != EINTR)
+            throw ModuleWorker::Error {
+                lth_loc::format("failed to read from the worker {1}: {2}", pid_, errnoMessage()) };
+        if (ready <= 0)
+            continue;
+
+        char chunk[READ_CHUNK_SIZE];
+        auto size = recv(fd_, chunk, sizeof(chunk), 0);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0)
+            throw ModuleWorker::Error {
+                lth_loc::format("failed to read from the worker {1}: {2}", pid_, errnoMessage()) };
+        if (size == 0)
+            throw ModuleWorker::Error {
+                lth_loc::format("the worker {1} closed its stdout", pid_) };
+        buffer_.append(chunk, static_cast<size_t>(size));
+    }
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
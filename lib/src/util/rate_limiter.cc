@@ -0,0 +1,47 @@
+#include <pxp-agent/util/rate_limiter.hpp>
+
+#include <cpp-pcp-client/util/chrono.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace pcp_util = PCPClient::Util;
+
+// Bytes that can be consumed at once after an idle period
+static const RateLimiter::clock::duration BURST { std::chrono::seconds(1) };
+
+RateLimiter::RateLimiter(uint64_t bytes_per_second)
+        : bytes_per_second_ { bytes_per_second },
+          available_at_ {}
+{
+}
+
+RateLimiter::clock::duration RateLimiter::reserve(uint64_t bytes, clock::time_point now)
+{
+    if (bytes_per_second_ == 0)
+        return clock::duration::zero();
+
+    auto cost = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(bytes_per_second_)));
+
+    pcp_util::lock_guard<pcp_util::mutex> the_lock { mutex_ };
+
+    // The time not used while idle is credited, up to the burst
+    if (available_at_ < now - BURST)
+        available_at_ = now - BURST;
+
+    available_at_ += cost;
+    return available_at_ > now ? available_at_ - now : clock::duration::zero();
+}
+
+void RateLimiter::consume(uint64_t bytes)
+{
+    auto wait = reserve(bytes);
+    if (wait > clock::duration::zero())
+        pcp_util::this_thread::sleep_for(
+            pcp_util::chrono::milliseconds(
+                std::chrono::duration_cast<std::chrono::milliseconds>(wait).count()));
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,136 @@
+#include <pxp-agent/util/server_selector.hpp>
+
+#include <algorithm>  // std::stable_sort, std::min, std::max
+#include <random>
+#include <tuple>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace pcp_util = PCPClient::Util;
+
+const ServerSelector::clock::duration ServerSelector::EJECTION_BASE { std::chrono::seconds(10) };
+const ServerSelector::clock::duration ServerSelector::EJECTION_MAX { std::chrono::minutes(5) };
+
+// Weight of a new sample in the latency moving average
+static const double LATENCY_ALPHA { 0.3 };
+
+std::vector<std::string> ServerSelector::order(const std::vector<std::string>& servers,
+                                               clock::time_point now)
+{
+    // Sort keys: ejected, restore time (if ejected), latency
+    std::vector<std::tuple<bool, clock::time_point, double, std::string>> keyed {};
+    keyed.reserve(servers.size());
+
+    {
+        pcp_util::lock_guard<pcp_util::mutex> servers_lock { servers_mutex_ };
+        for (const auto& server : servers) {
+            auto it = servers_.find(server);
+            if (it == servers_.end()) {
+                keyed.emplace_back(false, clock::time_point {}, -1.0, server);
+            } else if (it->second.ejected_until > now) {
+                keyed.emplace_back(true, it->second.ejected_until, 0.0, server);
+            } else {
+                keyed.emplace_back(false, clock::time_point {}, it->second.latency_ms, server);
+            }
+        }
+    }
+
+    std::stable_sort(keyed.begin(), keyed.end(),
+                     [](const std::tuple<bool, clock::time_point, double, std::string>& a,
+                        const std::tuple<bool, clock::time_point, double, std::string>& b) {
+                         return std::tie(std::get<0>(a), std::get<1>(a), std::get<2>(a))
+                                < std::tie(std::get<0>(b), std::get<1>(b), std::get<2>(b));
+                     });
+
+    std::vector<std::string> ordered {};
+    ordered.reserve(keyed.size());
+
+    for (auto& k : keyed)
+        ordered.push_back(std::move(std::get<3>(k)));
+
+    return ordered;
+}
+
+void ServerSelector::recordSuccess(const std::string& server,
+                                   std::chrono::milliseconds time_to_first_byte)
+{
+    auto sample = static_cast<double>(time_to_first_byte.count());
+    pcp_util::lock_guard<pcp_util::mutex> servers_lock { servers_mutex_ };
+    auto it = servers_.find(server);
+
+    if (it == servers_.end()) {
+        servers_.emplace(server, Health { sample, 0, clock::time_point {}, clock::time_point {} });
+        return;
+    }
+
+    auto& health = it->second;
+    health.latency_ms = health.latency_ms < 0
+        ? sample
+        : LATENCY_ALPHA * sample + (1 - LATENCY_ALPHA) * health.latency_ms;
+    health.consecutive_failures = 0;
+    health.ejected_until = clock::time_point {};
+    health.retry_after_until = clock::time_point {};
+}
+
+void ServerSelector::recordFailure(const std::string& server,
+                                   clock::time_point now,
+                                   clock::duration retry_after)
+{
+    pcp_util::lock_guard<pcp_util::mutex> servers_lock { servers_mutex_ };
+    auto it = servers_.find(server);
+
+    if (it == servers_.end())
+        it = servers_.emplace(server, Health { -1.0, 0, clock::time_point {}, clock::time_point {} }).first;
+
+    auto& health = it->second;
+    health.consecutive_failures++;
+
+    auto ejection = EJECTION_BASE;
+    for (unsigned int i = 1; i < health.consecutive_failures && ejection < EJECTION_MAX; i++)
+        ejection *= 2;
+
+    health.ejected_until = now + std::min(ejection, EJECTION_MAX);
+
+    if (retry_after > clock::duration::zero()) {
+        health.retry_after_until = now + std::min(retry_after, EJECTION_MAX);
+        health.ejected_until = std::max(health.ejected_until, health.retry_after_until);
+    }
+}
+
+bool ServerSelector::isEjected(const std::string& server, clock::time_point now)
+{
+    pcp_util::lock_guard<pcp_util::mutex> servers_lock { servers_mutex_ };
+    auto it = servers_.find(server);
+    return it != servers_.end() && it->second.ejected_until > now;
+}
+
+ServerSelector::clock::duration ServerSelector::retryAfter(const std::string& server,
+                                                           clock::time_point now)
+{
+    pcp_util::lock_guard<pcp_util::mutex> servers_lock { servers_mutex_ };
+    auto it = servers_.find(server);
+    if (it == servers_.end() || it->second.retry_after_until <= now)
+        return clock::duration::zero();
+    return it->second.retry_after_until - now;
+}
+
+std::chrono::milliseconds jitteredBackoff(unsigned int attempt,
+                                          std::chrono::milliseconds base,
+                                          std::chrono::milliseconds max)
+{
+    auto backoff = base;
+    for (unsigned int i = 1; i < attempt && backoff < max; i++)
+        backoff *= 2;
+    backoff = std::min(backoff, max);
+
+    static pcp_util::mutex generator_mutex;
+    static std::mt19937 generator { std::random_device {}() };
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter { 0, backoff.count() / 2 };
+
+    pcp_util::lock_guard<pcp_util::mutex> generator_lock { generator_mutex };
+    return backoff - std::chrono::milliseconds(jitter(generator));
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
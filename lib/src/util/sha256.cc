@@ -0,0 +1,50 @@
+#include <pxp-agent/util/sha256.hpp>
+
+#include <boost/algorithm/hex.hpp>
+
+#include <openssl/evp.h>
+
+#include <algorithm>  // std::transform
+#include <cctype>     // ::tolower
+#include <iterator>   // std::back_inserter
+
+namespace PXPAgent {
+namespace Util {
+
+namespace alg = boost::algorithm;
+
+Sha256::Sha256()
+        : ctx_ { EVP_MD_CTX_create() }
+{
+    EVP_DigestInit_ex(static_cast<EVP_MD_CTX*>(ctx_), EVP_sha256(), nullptr);
+}
+
+Sha256::~Sha256()
+{
+    EVP_MD_CTX_destroy(static_cast<EVP_MD_CTX*>(ctx_));
+}
+
+void Sha256::update(const char* data, size_t size)
+{
+    EVP_DigestUpdate(static_cast<EVP_MD_CTX*>(ctx_), data, size);
+}
+
+std::string Sha256::hexDigest()
+{
+    unsigned char md_value[EVP_MAX_MD_SIZE];
+    unsigned int md_len;
+
+    EVP_DigestFinal_ex(static_cast<EVP_MD_CTX*>(ctx_), md_value, &md_len);
+
+    std::string md_value_hex;
+
+    md_value_hex.reserve(2*md_len);
+    // TODO use boost::algorithm::hex_lower and drop the std::transform below when we upgrade to boost 1.62.0 or newer
+    alg::hex(md_value, md_value+md_len, std::back_inserter(md_value_hex));
+    std::transform(md_value_hex.begin(), md_value_hex.end(), md_value_hex.begin(), ::tolower);
+
+    return md_value_hex;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,343 @@
+#include <pxp-agent/util/tar_reader.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>  // std::all_of, std::min
+#include <cstring>    // std::memcpy
+
+namespace PXPAgent {
+namespace Util {
+
+namespace lth_loc = leatherman::locale;
+
+static constexpr size_t BLOCK_SIZE = 512;
+static constexpr size_t CHUNK_SIZE = 0x8000;  // 32 kB
+
+// Adding 16 to the window bits makes zlib expect a gzip header and
+// trailer rather than the zlib ones
+static constexpr int GZIP_WINDOW_BITS = 15 + 16;
+
+// Long names and pax records are held in memory; they are expected to
+// be small
+static constexpr uint64_t MAX_METADATA_SIZE = 0x100000;  // 1 MB
+
+// ustar header fields: offset and length
+static constexpr size_t NAME_OFFSET = 0, NAME_LENGTH = 100;
+static constexpr size_t SIZE_OFFSET = 124, SIZE_LENGTH = 12;
+static constexpr size_t CHECKSUM_OFFSET = 148, CHECKSUM_LENGTH = 8;
+static constexpr size_t TYPE_OFFSET = 156;
+static constexpr size_t MAGIC_OFFSET = 257, MAGIC_LENGTH = 5;
+static constexpr size_t PREFIX_OFFSET = 345, PREFIX_LENGTH = 155;
+
+static std::string getField(const char* header, size_t offset, size_t length)
+{
+    const char* field = header + offset;
+    size_t size { 0 };
+    while (size < length && field[size] != '\0')
+        size++;
+    return std::string(field, size);
+}
+
+// Numbers are octal, padded with spaces or NULs, or base-256 (big
+// endian) when the high bit of their first byte is set
+static bool parseNumber(const char* header, size_t offset, size_t length, uint64_t& value)
+{
+    auto field = reinterpret_cast<const unsigned char*>(header + offset);
+    value = 0;
+
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < length; i++) {
+            if (value >> 56)
+                return false;
+            value = (value << 8) | field[i];
+        }
+        return (field[0] & 0x7f) == 0;
+    }
+
+    size_t i { 0 };
+    while (i < length && field[i] == ' ')
+        i++;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        if (value >> 61)
+            return false;
+        value = (value << 3) | static_cast<uint64_t>(field[i] - '0');
+    }
+    for (; i < length; i++) {
+        if (field[i] != ' ' && field[i] != '\0')
+            return false;
+    }
+    return true;
+}
+
+static bool isValidChecksum(const char* header)
+{
+    uint64_t expected;
+    if (!parseNumber(header, CHECKSUM_OFFSET, CHECKSUM_LENGTH, expected))
+        return false;
+
+    // The checksum field itself counts as spaces
+    uint64_t sum { 0 };
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        bool in_checksum { i >= CHECKSUM_OFFSET && i < CHECKSUM_OFFSET + CHECKSUM_LENGTH };
+        sum += in_checksum ? static_cast<unsigned char>(' ') : static_cast<unsigned char>(header[i]);
+    }
+    return sum == expected;
+}
+
+// Returns the value of the path record of pax extended header data,
+// made of "<length> <key>=<value>\n" records; empty if none
+static std::string getPaxPath(const std::string& records)
+{
+    std::string path;
+    size_t pos { 0 };
+
+    while (pos < records.size()) {
+        auto space = records.find(' ', pos);
+        if (space == std::string::npos)
+            break;
+
+        size_t record_length;
+        try {
+            record_length = std::stoul(records.substr(pos, space - pos));
+        } catch (const std::exception&) {
+            break;
+        }
+        if (record_length <= space - pos || pos + record_length > records.size())
+            break;
+
+        auto record = records.substr(space + 1, pos + record_length - space - 2);
+        auto equal = record.find('=');
+        if (equal != std::string::npos && record.substr(0, equal) == "path")
+            path = record.substr(equal + 1);
+
+        pos += record_length;
+    }
+
+    return path;
+}
+
+TarReader::TarReader(const std::string& archive_path)
+        : archive_name_ { archive_path },
+          ifs_ { new boost::nowide::ifstream { archive_path, std::ios::binary } },
+          source_ {},
+          zstrm_ { nullptr },
+          in_buffer_ {},
+          in_pos_ { 0 },
+          in_size_ { 0 },
+          z_stream_end_ { false },
+          remaining_ { 0 },
+          padding_ { 0 }
+{
+    if (!*ifs_)
+        throw TarError { lth_loc::format("failed to open '{1}'", archive_name_) };
+
+    source_ = [this](char* buffer, size_t size) -> size_t {
+        ifs_->read(buffer, static_cast<std::streamsize>(size));
+        if (ifs_->bad())
+            throw TarError { lth_loc::format("failed to read '{1}'", archive_name_) };
+        return static_cast<size_t>(ifs_->gcount());
+    };
+    init();
+}
+
+TarReader::TarReader(std::string archive_name, Source source)
+        : archive_name_ { std::move(archive_name) },
+          ifs_ {},
+          source_ { std::move(source) },
+          zstrm_ { nullptr },
+          in_buffer_ {},
+          in_pos_ { 0 },
+          in_size_ { 0 },
+          z_stream_end_ { false },
+          remaining_ { 0 },
+          padding_ { 0 }
+{
+    init();
+}
+
+void TarReader::init()
+{
+    // The magic number of gzip is looked up in the input buffer, as the
+    // source can't be rewound
+    in_buffer_.resize(CHUNK_SIZE);
+    while (in_size_ < 2) {
+        auto size = source_(in_buffer_.data() + in_size_, in_buffer_.size() - in_size_);
+        if (size == 0)
+            break;
+        in_size_ += size;
+    }
+
+    auto magic = reinterpret_cast<const unsigned char*>(in_buffer_.data());
+    if (in_size_ < 2 || magic[0] != 0x1f || magic[1] != 0x8b)
+        return;
+
+    auto strm = new z_stream {};
+    if (inflateInit2(strm, GZIP_WINDOW_BITS) != Z_OK) {
+        delete strm;
+        throw TarError { lth_loc::format("failed to initialize zlib to read '{1}'",
+                                         archive_name_) };
+    }
+    strm->next_in = reinterpret_cast<Bytef*>(in_buffer_.data());
+    strm->avail_in = static_cast<uInt>(in_size_);
+    zstrm_ = strm;
+}
+
+TarReader::~TarReader()
+{
+    if (zstrm_ != nullptr) {
+        auto strm = static_cast<z_stream*>(zstrm_);
+        inflateEnd(strm);
+        delete strm;
+    }
+}
+
+bool TarReader::fillInput()
+{
+    in_pos_ = 0;
+    in_size_ = source_(in_buffer_.data(), in_buffer_.size());
+    return in_size_ > 0;
+}
+
+bool TarReader::readArchive(char* buffer, size_t size)
+{
+    if (zstrm_ == nullptr) {
+        while (size > 0) {
+            if (in_pos_ == in_size_ && !fillInput())
+                return false;
+            auto chunk = std::min(size, in_size_ - in_pos_);
+            std::memcpy(buffer, in_buffer_.data() + in_pos_, chunk);
+            in_pos_ += chunk;
+            buffer += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    auto strm = static_cast<z_stream*>(zstrm_);
+    strm->next_out = reinterpret_cast<Bytef*>(buffer);
+    strm->avail_out = static_cast<uInt>(size);
+
+    while (strm->avail_out > 0) {
+        if (z_stream_end_)
+            return false;
+
+        if (strm->avail_in == 0) {
+            if (!fillInput())
+                return false;
+            strm->next_in = reinterpret_cast<Bytef*>(in_buffer_.data());
+            strm->avail_in = static_cast<uInt>(in_size_);
+        }
+
+        auto ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            z_stream_end_ = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw TarError { lth_loc::format("invalid gzip data in '{1}': {2}",
+                                             archive_name_, (strm->msg ? strm->msg : "")) };
+        }
+    }
+
+    return true;
+}
+
+void TarReader::skip(uint64_t size)
+{
+    char buffer[CHUNK_SIZE];
+    while (size > 0) {
+        auto chunk = static_cast<size_t>(std::min<uint64_t>(size, CHUNK_SIZE));
+        if (!readArchive(buffer, chunk))
+            throw TarError { lth_loc::format("unexpected end of '{1}'", archive_name_) };
+        size -= chunk;
+    }
+}
+
+std::string TarReader::readContent(uint64_t size)
+{
+    if (size > MAX_METADATA_SIZE)
+        throw TarError { lth_loc::format("invalid extended header in '{1}'", archive_name_) };
+
+    std::string content(static_cast<size_t>(size), '\0');
+    if (size > 0 && !readArchive(&content[0], content.size()))
+        throw TarError { lth_loc::format("unexpected end of '{1}'", archive_name_) };
+    skip((BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE);
+    return content;
+}
+
+bool TarReader::next(Entry& entry)
+{
+    skip(remaining_ + padding_);
+    remaining_ = 0;
+    padding_ = 0;
+
+    std::string long_path;
+    char header[BLOCK_SIZE];
+
+    while (true) {
+        // An archive may lack the end-of-archive blocks
+        if (!readArchive(header, BLOCK_SIZE))
+            return false;
+
+        if (std::all_of(header, header + BLOCK_SIZE, [](char c) { return c == '\0'; }))
+            return false;
+
+        uint64_t size;
+        if (!isValidChecksum(header) || !parseNumber(header, SIZE_OFFSET, SIZE_LENGTH, size))
+            throw TarError { lth_loc::format("invalid tar header in '{1}'", archive_name_) };
+
+        auto type = header[TYPE_OFFSET];
+
+        if (type == 'L') {
+            // GNU long name of the next entry
+            long_path = readContent(size);
+            long_path = long_path.substr(0, long_path.find('\0'));
+            continue;
+        }
+        if (type == 'x' || type == 'g') {
+            // pax extended header of the next entry, or global one
+            auto records = readContent(size);
+            if (type == 'x') {
+                auto pax_path = getPaxPath(records);
+                if (!pax_path.empty())
+                    long_path = pax_path;
+            }
+            continue;
+        }
+
+        std::string path { long_path };
+        if (path.empty()) {
+            path = getField(header, NAME_OFFSET, NAME_LENGTH);
+            auto prefix = getField(header, PREFIX_OFFSET, PREFIX_LENGTH);
+            if (getField(header, MAGIC_OFFSET, MAGIC_LENGTH) == "ustar" && !prefix.empty())
+                path = prefix + "/" + path;
+        }
+        while (path.compare(0, 2, "./") == 0)
+            path.erase(0, 2);
+
+        entry.path = path;
+        entry.size = size;
+        entry.is_file = type == '0' || type == '\0' || type == '7';
+        entry.is_directory = type == '5';
+
+        remaining_ = size;
+        padding_ = (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+        return true;
+    }
+}
+
+size_t TarReader::read(char* buffer, size_t size)
+{
+    auto chunk = static_cast<size_t>(std::min<uint64_t>(size, remaining_));
+    if (chunk == 0)
+        return 0;
+
+    if (!readArchive(buffer, chunk))
+        throw TarError { lth_loc::format("unexpected end of '{1}'", archive_name_) };
+
+    remaining_ -= chunk;
+    return chunk;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,124 @@
+#include <pxp-agent/util/dir_handle.hpp>
+
+#include <leatherman/file_util/file.hpp>
+#include <leatherman/locale/locale.hpp>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/nowide/fstream.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs = boost::filesystem;
+namespace lth_file = leatherman::file_util;
+namespace lth_loc  = leatherman::locale;
+
+// There's no equivalent of the *at() system calls on Windows; the
+// entries are accessed by path. We still check that the directory
+// exists when the handle is created, to provide the same semantics.
+
+DirHandle::DirHandle(const std::string& dir_path)
+        : path_ { dir_path }
+{
+    boost::system::error_code ec;
+    if (!fs::is_directory(path_, ec))
+        throw DirHandle::Error {
+            lth_loc::format("failed to open directory '{1}'", path_) };
+}
+
+DirHandle::DirHandle(const DirHandle& parent, const std::string& name)
+        : DirHandle(parent.entryPath(name))
+{
+}
+
+DirHandle::~DirHandle()
+{
+}
+
+std::string DirHandle::entryPath(const std::string& name) const
+{
+    return (fs::path(path_) / name).string();
+}
+
+bool DirHandle::isStale() const
+{
+    boost::system::error_code ec;
+    return !fs::is_directory(path_, ec);
+}
+
+bool DirHandle::exists(const std::string& name) const
+{
+    boost::system::error_code ec;
+    return fs::exists(entryPath(name), ec);
+}
+
+bool DirHandle::isDirectory(const std::string& name) const
+{
+    boost::system::error_code ec;
+    return fs::is_directory(entryPath(name), ec);
+}
+
+bool DirHandle::read(const std::string& name, std::string& content) const
+{
+    auto file_path = entryPath(name);
+    return exists(name) && lth_file::read(file_path, content);
+}
+
+bool DirHandle::readChunks(const std::string& name,
+                           std::function<void(const char* data, size_t size)> callback) const
+{
+    if (!exists(name))
+        return false;
+
+    boost::nowide::ifstream file { entryPath(name), std::ios::binary };
+    if (!file)
+        return false;
+
+    char chunk[0x10000];  // 64 kB
+    while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0)
+        callback(chunk, static_cast<size_t>(file.gcount()));
+
+    return file.eof();
+}
+
+void DirHandle::atomicWrite(const std::string& name,
+                            const std::string& content,
+                            fs::perms perms) const
+{
+    // Permissions are inherited from the directory ACLs on Windows
+    try {
+        lth_file::atomic_write_to_file(content, entryPath(name), std::ios::binary);
+    } catch (const std::exception& e) {
+        throw DirHandle::Error {
+            lth_loc::format("failed to write '{1}': {2}", entryPath(name), e.what()) };
+    }
+}
+
+void DirHandle::createDirectory(const std::string& name, fs::perms perms) const
+{
+    try {
+        fs::create_directory(entryPath(name));
+    } catch (const fs::filesystem_error& e) {
+        throw DirHandle::Error {
+            lth_loc::format("failed to create directory '{1}': {2}",
+                            entryPath(name), e.what()) };
+    }
+}
+
+void DirHandle::eachSubdirectory(std::function<bool(const std::string& name)> callback) const
+{
+    try {
+        fs::directory_iterator end;
+        for (auto it = fs::directory_iterator(path_); it != end; ++it) {
+            if (fs::is_directory(it->status())
+                    && !callback(it->path().filename().string()))
+                break;
+        }
+    } catch (const fs::filesystem_error& e) {
+        throw DirHandle::Error {
+            lth_loc::format("failed to list directory '{1}': {2}", path_, e.what()) };
+    }
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
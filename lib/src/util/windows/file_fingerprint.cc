@@ -0,0 +1,36 @@
+#include <pxp-agent/util/file_fingerprint.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs = boost::filesystem;
+
+static const int64_t NS_PER_S { 1000000000 };
+
+bool getFileFingerprint(const std::string& file_path, FileFingerprint& fingerprint)
+{
+    boost::system::error_code ec;
+
+    if (!fs::is_regular_file(file_path, ec))
+        return false;
+
+    auto size = fs::file_size(file_path, ec);
+    if (ec)
+        return false;
+
+    auto mtime = fs::last_write_time(file_path, ec);
+    if (ec)
+        return false;
+
+    fingerprint.size = static_cast<uint64_t>(size);
+    fingerprint.mtime_ns = static_cast<int64_t>(mtime) * NS_PER_S;
+    fingerprint.ctime_ns = 0;
+    fingerprint.inode = 0;
+    fingerprint.device = 0;
+    return true;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
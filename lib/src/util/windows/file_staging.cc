@@ -0,0 +1,19 @@
+#include <pxp-agent/util/file_staging.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace fs = boost::filesystem;
+
+// Block cloning is only available on ReFS; just copy (CopyFile already
+// copies the data without going through the caller's buffers)
+StagingMethod stageFile(const fs::path& source, const fs::path& destination)
+{
+    fs::copy_file(source, destination);
+    return StagingMethod::Copy;
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
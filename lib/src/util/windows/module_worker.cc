@@ -0,0 +1,42 @@
+#include <pxp-agent/util/module_worker.hpp>
+
+#include <leatherman/locale/locale.hpp>
+
+namespace PXPAgent {
+namespace Util {
+
+namespace lth_loc = leatherman::locale;
+
+// The actions of the external modules are always run by a process of
+// their own on Windows
+ModuleWorker::ModuleWorker(const std::string&)
+        : pid_ { -1 },
+          fd_ { -1 },
+          exited_ { true },
+          buffer_ {}
+{
+    throw ModuleWorker::Error {
+        lth_loc::translate("module workers are not supported on Windows") };
+}
+
+ModuleWorker::~ModuleWorker() {}
+
+bool ModuleWorker::isRunning()
+{
+    return false;
+}
+
+void ModuleWorker::writeLine(const std::string&)
+{
+    throw ModuleWorker::Error {
+        lth_loc::translate("module workers are not supported on Windows") };
+}
+
+std::string ModuleWorker::readLine(std::chrono::milliseconds, size_t)
+{
+    throw ModuleWorker::Error {
+        lth_loc::translate("module workers are not supported on Windows") };
+}
+
+}  // namespace Util
+}  // namespace PXPAgent
@@ -0,0 +1,200 @@
+#include "https_stand_in.hpp"
+
+#include "root_path.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <stdexcept>
+
+static const std::string SSL_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                   + "/lib/tests/resources/ssl" };
+
+std::string HttpsStandIn::caPath() {
+    return SSL_DIR + "/ca.pem";
+}
+
+HttpsStandIn::HttpsStandIn(std::string content, Options options)
+        : content_ { std::move(content) },
+          options_ (options),
+          ssl_ctx_ { SSL_CTX_new(SSLv23_server_method()) },
+          listen_fd_ { socket(AF_INET, SOCK_STREAM, 0) },
+          port_ { 0 },
+          stopping_ { false },
+          client_fd_ { -1 },
+          ranges_ {},
+          connections_ { 0 }
+{
+    if (ssl_ctx_ == nullptr
+        || SSL_CTX_use_certificate_file(ssl_ctx_, (SSL_DIR + "/server_crt.pem").c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_use_PrivateKey_file(ssl_ctx_, (SSL_DIR + "/server_key.pem").c_str(), SSL_FILETYPE_PEM) != 1)
+        throw std::runtime_error("failed to set up the TLS context of the stand-in server");
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+
+    if (listen_fd_ < 0
+        || bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || listen(listen_fd_, 8) != 0
+        || getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0)
+        throw std::runtime_error("failed to set up the socket of the stand-in server");
+
+    port_ = ntohs(addr.sin_port);
+    server_thread_ = std::thread { &HttpsStandIn::serve, this };
+}
+
+HttpsStandIn::~HttpsStandIn() {
+    stopping_ = true;
+    // Wakes up the accept() call and the reads of a kept alive
+    // connection
+    shutdown(listen_fd_, SHUT_RDWR);
+    int client_fd = client_fd_;
+    if (client_fd >= 0)
+        shutdown(client_fd, SHUT_RDWR);
+    server_thread_.join();
+    close(listen_fd_);
+    SSL_CTX_free(ssl_ctx_);
+}
+
+std::string HttpsStandIn::uri() const {
+    return "https://127.0.0.1:" + std::to_string(port_);
+}
+
+std::vector<std::string> HttpsStandIn::ranges() {
+    std::lock_guard<std::mutex> ranges_lock { ranges_mutex_ };
+    return ranges_;
+}
+
+size_t HttpsStandIn::connections() {
+    std::lock_guard<std::mutex> ranges_lock { ranges_mutex_ };
+    return connections_;
+}
+
+void HttpsStandIn::serve() {
+    // Writing to a connection closed by the client (e.g. the TLS
+    // close_notify) must fail with EPIPE rather than kill the tests
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+    while (!stopping_) {
+        int client_fd = accept(listen_fd_, nullptr, nullptr);
+        if (client_fd < 0)
+            continue;
+        client_fd_ = client_fd;
+        if (stopping_)
+            shutdown(client_fd, SHUT_RDWR);
+        handle(client_fd);
+        client_fd_ = -1;
+        close(client_fd);
+    }
+}
+
+void HttpsStandIn::handle(int client_fd) {
+    SSL* ssl = SSL_new(ssl_ctx_);
+    SSL_set_fd(ssl, client_fd);
+    if (SSL_accept(ssl) != 1) {
+        SSL_free(ssl);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> ranges_lock { ranges_mutex_ };
+        connections_++;
+    }
+
+    bool keep_open { true };
+    while (keep_open) {
+        keep_open = respond(ssl);
+    }
+    SSL_free(ssl);
+}
+
+bool HttpsStandIn::respond(SSL* ssl) {
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        int n = SSL_read(ssl, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+        request.append(buffer, static_cast<size_t>(n));
+    }
+
+    std::string range;
+    std::istringstream request_stream { request };
+    std::string line;
+    while (std::getline(request_stream, line)) {
+        if (boost::istarts_with(line, "range:")) {
+            range = boost::trim_copy(line.substr(6));
+        }
+    }
+
+    size_t request_idx;
+    {
+        std::lock_guard<std::mutex> ranges_lock { ranges_mutex_ };
+        request_idx = ranges_.size();
+        ranges_.push_back(range);
+    }
+
+    if (request_idx == 0 && options_.retry_first_after_s > 0) {
+        std::ostringstream unavailable;
+        unavailable << "HTTP/1.1 503 Service Unavailable\r\n"
+                    << "Retry-After: " << options_.retry_first_after_s << "\r\n"
+                    << "Content-Length: 0\r\n"
+                    << "Connection: close\r\n\r\n";
+        auto response = unavailable.str();
+        SSL_write(ssl, response.data(), static_cast<int>(response.size()));
+        SSL_shutdown(ssl);
+        return false;
+    }
+
+    size_t offset { 0 };
+    std::ostringstream headers;
+    if (options_.support_ranges && boost::starts_with(range, "bytes=")) {
+        offset = std::stoul(range.substr(6));
+    }
+    if (offset > 0 && offset < content_.size()) {
+        headers << "HTTP/1.1 206 Partial Content\r\n"
+                << "Content-Range: bytes " << offset << "-" << content_.size() - 1
+                << "/" << content_.size() << "\r\n";
+    } else if (offset > 0) {
+        headers << "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                << "Content-Range: bytes */" << content_.size() << "\r\n";
+        offset = content_.size();
+    } else {
+        headers << "HTTP/1.1 200 OK\r\n";
+    }
+    headers << "Content-Length: " << content_.size() - offset << "\r\n"
+            << "Connection: " << (options_.keep_alive ? "keep-alive" : "close") << "\r\n\r\n";
+
+    auto body = content_.substr(offset);
+    bool drop = request_idx == 0 && options_.drop_first_after > 0;
+    if (drop && options_.drop_first_after < body.size()) {
+        body.resize(options_.drop_first_after);
+    }
+
+    auto response = headers.str() + body;
+    SSL_write(ssl, response.data(), static_cast<int>(response.size()));
+
+    if (drop) {
+        // Dropping the connection skips the TLS close_notify
+        return false;
+    }
+    if (options_.keep_alive) {
+        return true;
+    }
+    SSL_shutdown(ssl);
+    return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Minimal HTTPS server standing in for a primary server in the
+// download tests: it serves the same content for any path, honouring
+// "Range: bytes=N-" requests if configured to, and can drop the
+// connection of the first request after sending part of the content,
+// or answer it with a Retry-After hint.
+// Connections are closed after each response, unless keep_alive is
+// set. POSIX only.
+class HttpsStandIn {
+  public:
+    struct Options {
+        bool support_ranges;
+        // Bytes of the content sent before dropping the connection of
+        // the first request; 0 to never drop it
+        size_t drop_first_after;
+        bool keep_alive;
+        // Seconds of the Retry-After header of a 503 response to the
+        // first request; 0 to serve it
+        unsigned int retry_first_after_s;
+    };
+
+    HttpsStandIn(std::string content, Options options);
+    ~HttpsStandIn();
+
+    HttpsStandIn(const HttpsStandIn&) = delete;
+    HttpsStandIn& operator=(const HttpsStandIn&) = delete;
+
+    // https://127.0.0.1:<port>
+    std::string uri() const;
+
+    // The value of the Range header of each request received so far
+    // (empty if it had none)
+    std::vector<std::string> ranges();
+
+    // The number of connections accepted so far
+    size_t connections();
+
+    static std::string caPath();
+
+  private:
+    std::string content_;
+    Options options_;
+    SSL_CTX* ssl_ctx_;
+    int listen_fd_;
+    int port_;
+    std::atomic<bool> stopping_;
+    // The connection being served, if any
+    std::atomic<int> client_fd_;
+    std::mutex ranges_mutex_;
+    std::vector<std::string> ranges_;
+    size_t connections_;
+    std::thread server_thread_;
+
+    void serve();
+    void handle(int client_fd);
+    // Returns false in case the connection must be closed
+    bool respond(SSL* ssl);
+};
@@ -60,6 +60,20 @@ static Configuration::Agent AGENT_CONFIGURATION { MODULES,
                                                   30,    // task download connection timeout
                                                   120,   // task download timeout
                                                   64 * 1024 * 1024,  // default max-message-size
+                                                  0,     // no output head limit
+                                                  0,     // no output tail limit
+                                                  false, // don't compress output
+                                                  0,     // no spool quota
+                                                  0,     // no task cache quota
+                                                  4,     // default task-download-concurrency
+                                                  "0d",  // don't verify cached files again
+                                                  0,     // no download rate limit
+                                                  0,     // no download splay
+                                                  8,     // default file-download-parallelism
+                                                  0,     // no module workers
+                                                  "",    // no modules metadata cache
+                                                  0,     // no module results size limit
+                                                  0,     // no module results depth limit
                                                   leatherman::logging::log_level::none };
 
 static const std::string VALID_ENVELOPE_TXT {
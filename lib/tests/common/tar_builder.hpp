@@ -0,0 +1,64 @@
+#pragma once
+
+#include <boost/nowide/fstream.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+// Builds ustar archives in memory for the tests of the archive readers;
+// GNU long name entries are added for the paths longer than 100 bytes.
+class TarBuilder {
+  public:
+    void addFile(const std::string& path, const std::string& content) {
+        if (path.size() > 100)
+            addEntry("././@LongLink", 'L', path + '\0');
+        addEntry(path, '0', content);
+    }
+
+    void addDirectory(const std::string& path) {
+        addEntry(path, '5', "");
+    }
+
+    // Returns the archive, with its end-of-archive blocks
+    std::string str() const {
+        return archive_ + std::string(1024, '\0');
+    }
+
+    void write(const std::string& path) const {
+        boost::nowide::ofstream ofs { path, std::ios::binary };
+        ofs << str();
+    }
+
+  private:
+    std::string archive_;
+
+    void addEntry(const std::string& path, char type, const std::string& content) {
+        std::string header(512, '\0');
+        header.replace(0, std::min<size_t>(path.size(), 100), path, 0, 100);
+        header.replace(100, 7, "0000644");
+        header.replace(108, 7, "0000000");
+        header.replace(116, 7, "0000000");
+        header.replace(124, 11, toOctal(content.size(), 11));
+        header.replace(136, 11, toOctal(0, 11));
+        header.replace(148, 8, "        ");
+        header[156] = type;
+        header.replace(257, 6, std::string("ustar\0", 6));
+        header.replace(263, 2, "00");
+
+        unsigned int checksum { 0 };
+        for (auto c : header)
+            checksum += static_cast<unsigned char>(c);
+        header.replace(148, 7, toOctal(checksum, 6) + '\0');
+
+        archive_ += header + content;
+        archive_ += std::string((512 - content.size() % 512) % 512, '\0');
+    }
+
+    static std::string toOctal(size_t value, size_t width) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%0*lo", static_cast<int>(width),
+                      static_cast<unsigned long>(value));
+        return buffer;
+    }
+};
@@ -87,6 +87,21 @@ TEST_CASE("ActionResponse::toJSON", "[response]") {
                 "{\"transaction_id\":\"04352987\",\"results\":{\"transaction_id\":\"\",\"exitcode\":0,\"status\":\"success\",\"stdout\":\"{\\\"foo\\\": true}\"}}");
     }
 
+    SECTION("serializes the total size of the truncated output in a status response") {
+        auto output = ActionOutput{0, "{\"foo\": true}", "", 3000000000, 0};
+        auto metadata = ActionResponse::getMetadataFromRequest(req);
+        auto resp = ActionResponse(ModuleType::External, RequestType::Blocking, output, std::move(metadata));
+
+        auto results = lth_jc::JsonContainer{"{\"transaction_id\":\"123456\",\"status\":\"success\"}"};
+        resp.setValidResultsAndEnd(std::move(results), "");
+
+        auto status_results = resp.toJSON(R_T::StatusOutput).get<lth_jc::JsonContainer>("results");
+        REQUIRE(status_results.get<bool>("stdout_truncated"));
+        REQUIRE(status_results.get<double>("stdout_total_bytes") == 3000000000.0);
+        REQUIRE_FALSE(status_results.includes("stderr_truncated"));
+        REQUIRE_FALSE(status_results.includes("stderr_total_bytes"));
+    }
+
     SECTION("serializes errors if present in a status response") {
         auto output = ActionOutput{0, "{\"foo\": true}", ""};
         auto metadata = ActionResponse::getMetadataFromRequest(req);
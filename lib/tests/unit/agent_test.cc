@@ -39,7 +39,11 @@ TEST_CASE("Agent::Agent", "[agent]") {
                                                "test_agent",
                                                "",    // don't set broker proxy
                                                "",    // don't set master proxy
-                                               5000, 10, 5, 5, 2, 15, 30, 120, 1024,
+                                               5000, 10, 5, 5, 2, 15, 30, 120, 1024, 0, 0,
+                                               false, // don't compress output
+                                               0, 0,  // no quotas
+                                               4,     // task-download-concurrency
+                                               "0d",  // task-cache-dir-reverify-ttl
                                                leatherman::logging::log_level::none };
 
     SECTION("does not throw if it fails to find the external modules directory") {
@@ -78,7 +82,11 @@ TEST_CASE("Agent::Agent without CRL", "[agent]") {
                                                "test_agent",
                                                "",    // don't set broker proxy
                                                "",    // don't set master proxy
-                                               5000, 10, 5, 5, 2, 15, 30, 120, 1024,
+                                               5000, 10, 5, 5, 2, 15, 30, 120, 1024, 0, 0,
+                                               false, // don't compress output
+                                               0, 0,  // no quotas
+                                               4,     // task-download-concurrency
+                                               "0d",  // task-cache-dir-reverify-ttl
                                                leatherman::logging::log_level::none };
 
     SECTION("does not throw if it fails to find the external modules directory") {
@@ -369,6 +369,60 @@ TEST_CASE("Configuration::validate", "[configuration]") {
                           Configuration::Error);
     }
 
+    SECTION("it fails when --task-cache-dir-reverify-ttl is not a valid timestamp") {
+        HW::SetFlag<std::string>("task-cache-dir-reverify-ttl", "1w");
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --task-download-rate-limit is not a valid size") {
+        HW::SetFlag<std::string>("task-download-rate-limit", "1x");
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --task-download-splay is negative") {
+        HW::SetFlag<int>("task-download-splay", -1);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --file-download-parallelism is negative") {
+        HW::SetFlag<int>("file-download-parallelism", -1);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --module-workers is negative") {
+        HW::SetFlag<int>("module-workers", -1);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --module-results-max-size is invalid") {
+        HW::SetFlag<std::string>("module-results-max-size", "64x");
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --module-results-max-depth is negative") {
+        HW::SetFlag<int>("module-results-max-depth", -1);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --modules-metadata-cache is a directory") {
+        HW::SetFlag<std::string>("modules-metadata-cache", TASK_CACHE_DIR);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --import-task-cache-bundle is not a file") {
+        HW::SetFlag<std::string>("import-task-cache-bundle", TASK_CACHE_DIR);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
     SECTION("it fails when --spool-dir is empty") {
         HW::SetFlag<std::string>("spool-dir", "");
         REQUIRE_THROWS_AS(Configuration::Instance().validate(),
@@ -398,6 +452,24 @@ TEST_CASE("Configuration::validate", "[configuration]") {
                           Configuration::Error);
     }
 
+    SECTION("it fails when --spool-dir-quota is not a valid size") {
+        HW::SetFlag<std::string>("spool-dir-quota", "10x");
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --task-cache-dir-quota is not a valid size") {
+        HW::SetFlag<std::string>("task-cache-dir-quota", "-1g");
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
+    SECTION("it fails when --task-download-concurrency is negative") {
+        HW::SetFlag<int>("task-download-concurrency", -1);
+        REQUIRE_THROWS_AS(Configuration::Instance().validate(),
+                          Configuration::Error);
+    }
+
     SECTION("it fails when --task-download-connect-timeout is negative") {
         HW::SetFlag<int>("task-download-connect-timeout", -1);
         REQUIRE_THROWS_AS(Configuration::Instance().validate(),
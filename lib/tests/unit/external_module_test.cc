@@ -151,6 +151,16 @@ TEST_CASE("ExternalModule::callAction - blocking", "[modules]") {
             REQUIRE(response.output.std_out.find("anodaram") != std::string::npos);
             REQUIRE(response.output.std_err.empty());
         }
+
+        SECTION("mark the results as invalid if they exceed the limits") {
+            reverse_module.setResultsLimits(8, 0);
+            ActionRequest request { RequestType::Blocking, CONTENT };
+            auto response = reverse_module.executeAction(request);
+
+            REQUIRE_FALSE(response.action_metadata.get<bool>("results_are_valid"));
+            REQUIRE(response.action_metadata.get<std::string>("execution_error").find("too large")
+                    != std::string::npos);
+        }
     }
 
     SECTION("it should handle module failures") {
@@ -200,6 +210,34 @@ TEST_CASE("ExternalModule::callAction - blocking", "[modules]") {
             REQUIRE(response.output.std_err.find("we failed, sorry ☹") != std::string::npos);
         }
     }
+
+#ifndef _WIN32
+    SECTION("it runs the actions in the workers of the module, if enabled") {
+        auto worker_module = PXP_AGENT_ROOT_PATH "/lib/tests/resources/worker_modules/reverse_worker";
+        std::string string_txt { (DATA_FORMAT % "\"0987\""
+                                               % "\"reverse_worker\""
+                                               % "\"string\""
+                                               % "{\"argument\" : \"maradona\"}").str() };
+        PCPClient::ParsedChunks string_content {
+                lth_jc::JsonContainer(ENVELOPE_TXT),
+                lth_jc::JsonContainer(string_txt),
+                NO_DEBUG,
+                0 };
+        ActionRequest request { RequestType::Blocking, string_content };
+        auto getPid = [&](ExternalModule& e_m) {
+            auto response = e_m.executeAction(request);
+            REQUIRE(response.action_metadata.get<bool>("results_are_valid"));
+            return response.action_metadata.get<int>({ "results", "pid" });
+        };
+
+        ExternalModule with_workers { worker_module, STORAGE, 1 };
+        auto pid = getPid(with_workers);
+        REQUIRE(getPid(with_workers) == pid);
+
+        ExternalModule without_workers { worker_module, STORAGE, 0 };
+        REQUIRE(getPid(without_workers) != getPid(without_workers));
+    }
+#endif
 }
 
 TEST_CASE("ExternalModule::callAction - non blocking", "[modules]") {
@@ -228,6 +266,61 @@ TEST_CASE("ExternalModule::callAction - non blocking", "[modules]") {
             FAIL("fail to get pid");
         }
     }
+
+#ifndef _WIN32
+    SECTION("it runs the actions by a detached process, even if the module has workers") {
+        ExternalModule e_m { PXP_AGENT_ROOT_PATH
+                             "/lib/tests/resources/worker_modules/reverse_worker",
+                             STORAGE, 1 };
+        std::string string_txt { (NON_BLOCKING_DATA_FORMAT % "\"1988\""
+                                                           % "\"reverse_worker\""
+                                                           % "\"string\""
+                                                           % "{\"argument\" : \"zico\"}"
+                                                           % "false").str() };
+        PCPClient::ParsedChunks string_content {
+                lth_jc::JsonContainer(ENVELOPE_TXT),
+                lth_jc::JsonContainer(string_txt),
+                NO_DEBUG,
+                0 };
+        fs::path spool_path { SPOOL_DIR };
+        auto getPid = [&]() {
+            ActionRequest request { RequestType::NonBlocking, string_content };
+            auto results_dir = spool_path / request.transactionId();
+            fs::remove_all(results_dir);
+            fs::create_directories(results_dir);
+            request.setResultsDir(results_dir.string());
+
+            auto response = e_m.executeAction(request);
+            REQUIRE(response.action_metadata.get<bool>("results_are_valid"));
+            auto pid = response.action_metadata.get<int>({ "results", "pid" });
+            REQUIRE(std::stoi(lth_file::read((results_dir / "pid").string())) == pid);
+            return pid;
+        };
+
+        REQUIRE(getPid() != getPid());
+    }
+#endif
+
+    SECTION("the results on file are not read if they exceed the limits") {
+        ExternalModule e_m { PXP_AGENT_ROOT_PATH
+                             "/lib/tests/resources/modules/reverse_valid"
+                             EXTENSION,
+                             STORAGE };
+        e_m.setResultsLimits(8, 0);
+        ActionRequest request { RequestType::NonBlocking, NON_BLOCKING_CONTENT };
+        fs::path spool_path { SPOOL_DIR };
+        auto results_dir = (spool_path / request.transactionId()).string();
+        fs::create_directories(results_dir);
+        request.setResultsDir(results_dir);
+
+        auto response = e_m.executeAction(request);
+
+        REQUIRE_FALSE(response.action_metadata.get<bool>("results_are_valid"));
+        REQUIRE(response.action_metadata.get<std::string>("execution_error").find("too large")
+                != std::string::npos);
+        REQUIRE(response.output.std_out.empty());
+        REQUIRE(fs::file_size(spool_path / request.transactionId() / "stdout") > 8u);
+    }
 }
 
 TEST_CASE("ExternalModule::getModuleMetadata", "[modules][metadata]") {
@@ -273,6 +366,23 @@ TEST_CASE("ExternalModule::getModuleMetadata", "[modules][metadata]") {
                            STORAGE),
             Module::LoadingError);
     }
+
+    SECTION("uses the metadata cache, if any") {
+        auto metadata_cache = std::make_shared<ModuleMetadataCache>(SPOOL_DIR + "/metadata.json");
+        std::vector<std::string> expected_actions { "string", "hash" };
+        ExternalModule first { PXP_AGENT_ROOT_PATH
+                               "/lib/tests/resources/modules/reverse_valid"
+                               EXTENSION,
+                               STORAGE, 0, metadata_cache };
+        REQUIRE_FALSE(first.hasCachedMetadata());
+
+        ExternalModule second { PXP_AGENT_ROOT_PATH
+                                "/lib/tests/resources/modules/reverse_valid"
+                                EXTENSION,
+                                STORAGE, 0, metadata_cache };
+        REQUIRE(second.hasCachedMetadata());
+        REQUIRE(second.actions == expected_actions);
+    }
 }
 
 TEST_CASE("ExternalModule::validateConfiguration", "[modules][configuration]") {
@@ -1,8 +1,13 @@
 #include "root_path.hpp"
+#ifndef _WIN32
+#include "../common/https_stand_in.hpp"
+#endif
+#include "../common/tar_builder.hpp"
 
 #include <pxp-agent/module_cache_dir.hpp>
 #include <pxp-agent/module.hpp>
 #include <pxp-agent/configuration.hpp>
+#include <pxp-agent/util/sha256.hpp>
 
 #include <leatherman/json_container/json_container.hpp>
 #include <leatherman/util/scope_exit.hpp>
@@ -111,4 +116,461 @@ TEST_CASE("ModuleCacheDir::purgeCache", "[modules]") {
 
         REQUIRE_NOTHROW(mod_cd.purgeCache("1h", {}, failedCallback));
     }
+    SECTION("Does not purge the entries in use") {
+        num_purged_results = 0;
+        auto now = pt::second_clock::universal_time();
+        auto old = now - pt::minutes(61);
+        fs::last_write_time(fs::path(PURGE_TASK_CACHE)/OLD_TRANSACTION, my_to_time_t(old));
+        fs::last_write_time(fs::path(PURGE_TASK_CACHE)/RECENT_TRANSACTION, my_to_time_t(old));
+
+        {
+            ModuleCacheDir::EntryPin pin { mod_cd, { OLD_TRANSACTION } };
+            REQUIRE(mod_cd.purgeCache("1h", {}, purgeCallback) == 1);
+        }
+
+        REQUIRE(mod_cd.purgeCache("1h", {}, purgeCallback) == 2);
+    }
+
+    SECTION("Keeps the entries used since their last write and flushes their last use") {
+        num_purged_results = 0;
+        auto now = pt::second_clock::universal_time();
+        auto old = now - pt::minutes(61);
+        fs::last_write_time(fs::path(PURGE_TASK_CACHE)/OLD_TRANSACTION, my_to_time_t(old));
+        fs::last_write_time(fs::path(PURGE_TASK_CACHE)/RECENT_TRANSACTION, my_to_time_t(old));
+
+        mod_cd.createCacheDir(OLD_TRANSACTION);
+        REQUIRE(fs::last_write_time(fs::path(PURGE_TASK_CACHE)/OLD_TRANSACTION) == my_to_time_t(old));
+
+        REQUIRE(mod_cd.purgeCache("1h", {}, purgeCallback) == 1);
+        REQUIRE(fs::last_write_time(fs::path(PURGE_TASK_CACHE)/OLD_TRANSACTION) > my_to_time_t(old));
+    }
+}
+
+TEST_CASE("ModuleCacheDir::getDerivedEntry", "[modules]") {
+    const std::string DERIVED_ENTRY { "installdir_test" };
+    ModuleCacheDir mod_cd { CACHE_DIR, CACHE_TTL };
+    lth_util::scope_exit entry_cleaner {
+        [&]() {
+            ModuleCacheDir::makeEntryWritable(fs::path(CACHE_DIR) / DERIVED_ENTRY);
+            fs::remove_all(fs::path(CACHE_DIR) / DERIVED_ENTRY);
+            std::vector<fs::path> replaced_dirs;
+            for (fs::directory_iterator it { CACHE_DIR }, end; it != end; ++it) {
+                if (boost::starts_with(it->path().filename().string(), "replaced_"))
+                    replaced_dirs.push_back(it->path());
+            }
+            for (const auto& dir : replaced_dirs) {
+                ModuleCacheDir::makeEntryWritable(dir);
+                fs::remove_all(dir);
+            }
+        }
+    };
+
+    unsigned int num_builds { 0 };
+    auto buildDir = [&num_builds](const fs::path& dir) -> void {
+        num_builds++;
+        lth_file::atomic_write_to_file("content", (dir / "file").string());
+    };
+
+    SECTION("builds the entry once and then reuses it") {
+        auto entry_dir = mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir);
+        REQUIRE(entry_dir == fs::path(CACHE_DIR) / DERIVED_ENTRY);
+        REQUIRE(lth_file::read((entry_dir / "file").string()) == "content");
+
+        REQUIRE(mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir) == entry_dir);
+        REQUIRE(num_builds == 1);
+    }
+
+    SECTION("makes the entry read-only") {
+        auto entry_dir = mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir);
+        auto write_perms = fs::owner_write | fs::group_write | fs::others_write;
+        REQUIRE((fs::status(entry_dir).permissions() & write_perms) == fs::no_perms);
+        REQUIRE((fs::status(entry_dir / "file").permissions() & write_perms) == fs::no_perms);
+    }
+
+    SECTION("builds the entry again once it was modified") {
+        auto entry_dir = mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir);
+        ModuleCacheDir::makeEntryWritable(entry_dir);
+
+        SECTION("when a file changed") {
+            lth_file::atomic_write_to_file("modified", (entry_dir / "file").string());
+        }
+
+        SECTION("when a file was removed") {
+            fs::remove(entry_dir / "file");
+        }
+
+        REQUIRE(mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir) == entry_dir);
+        REQUIRE(num_builds == 2);
+        REQUIRE(lth_file::read((entry_dir / "file").string()) == "content");
+
+        for (fs::directory_iterator it { CACHE_DIR }, end; it != end; ++it) {
+            REQUIRE_FALSE(boost::starts_with(it->path().filename().string(), "temp_"));
+        }
+    }
+
+    SECTION("reuses the entry when files were added to it") {
+        auto entry_dir = mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir);
+        // As a task run by root could, despite the permissions
+        fs::permissions(entry_dir, fs::add_perms | fs::owner_write);
+        fs::create_directory(entry_dir / "__pycache__");
+        lth_file::atomic_write_to_file("bytecode", (entry_dir / "__pycache__" / "file.pyc").string());
+
+        REQUIRE(mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir) == entry_dir);
+        REQUIRE(num_builds == 1);
+    }
+
+    SECTION("keeps the replaced tree while the entry is in use") {
+        auto entry_dir = mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir);
+        ModuleCacheDir::makeEntryWritable(entry_dir);
+        lth_file::atomic_write_to_file("modified", (entry_dir / "file").string());
+        auto remove_dir = [](const std::string& dir_path) {
+            ModuleCacheDir::makeEntryWritable(dir_path);
+            fs::remove_all(dir_path);
+        };
+        auto replaced_dirs = [&]() {
+            std::vector<fs::path> dirs;
+            for (fs::directory_iterator it { CACHE_DIR }, end; it != end; ++it) {
+                if (boost::starts_with(it->path().filename().string(), "replaced_"))
+                    dirs.push_back(it->path());
+            }
+            return dirs;
+        };
+
+        {
+            ModuleCacheDir::EntryPin pin { mod_cd, { DERIVED_ENTRY } };
+            mod_cd.getDerivedEntry(DERIVED_ENTRY, buildDir);
+            REQUIRE(num_builds == 2);
+            auto dirs = replaced_dirs();
+            REQUIRE(dirs.size() == 1u);
+            REQUIRE(lth_file::read((dirs[0] / "file").string()) == "modified");
+
+            fs::last_write_time(dirs[0], time(nullptr) - 2 * 3600);
+            mod_cd.purgeCache("1h", {}, remove_dir);
+            REQUIRE(replaced_dirs().size() == 1u);
+        }
+
+        mod_cd.purgeCache("1h", {}, remove_dir);
+        REQUIRE(replaced_dirs().empty());
+    }
+
+    SECTION("does not leave a partial entry when the build fails") {
+        REQUIRE_THROWS_AS(
+            mod_cd.getDerivedEntry(DERIVED_ENTRY,
+                                   [](const fs::path&) -> void { throw Module::ProcessingError("error"); }),
+            Module::ProcessingError);
+        REQUIRE_FALSE(fs::exists(fs::path(CACHE_DIR) / DERIVED_ENTRY));
+
+        for (fs::directory_iterator it { CACHE_DIR }, end; it != end; ++it) {
+            REQUIRE_FALSE(boost::starts_with(it->path().filename().string(), "temp_" + DERIVED_ENTRY));
+        }
+    }
+}
+
+static std::string sha256Of(const std::string& content)
+{
+    Util::Sha256 digest;
+    digest.update(content.data(), content.size());
+    return digest.hexDigest();
+}
+
+TEST_CASE("ModuleCacheDir::importBundle", "[modules]") {
+    auto bundle = CACHE_DIR + "/../test_bundle.tar";
+    auto good_sha = sha256Of("good content");
+    auto other_sha = sha256Of("other content");
+    ModuleCacheDir mod_cd { CACHE_DIR, CACHE_TTL };
+    lth_util::scope_exit bundle_cleaner {
+        [&]() {
+            fs::remove(bundle);
+            fs::remove_all(fs::path(CACHE_DIR) / good_sha);
+            fs::remove_all(fs::path(CACHE_DIR) / other_sha);
+        }
+    };
+
+    TarBuilder builder;
+    builder.addDirectory(good_sha + "/");
+    builder.addFile(good_sha + "/good.sh", "good content");
+
+    auto isCached = [&](const std::string& sha256, const std::string& filename) {
+        lth_jc::JsonContainer file;
+        file.set<std::string>("sha256", sha256);
+        file.set<std::string>("filename", filename);
+        return mod_cd.isCached(fs::path(CACHE_DIR) / sha256, file);
+    };
+
+    SECTION("imports the files into their cache entries") {
+        builder.write(bundle);
+        auto result = mod_cd.importBundle(bundle);
+        REQUIRE(result.imported == 1);
+        REQUIRE(result.rejected == 0);
+        REQUIRE(result.bytes == 12);
+        REQUIRE(isCached(good_sha, "good.sh"));
+    }
+
+    SECTION("does not import the files already cached") {
+        builder.write(bundle);
+        mod_cd.importBundle(bundle);
+        auto result = mod_cd.importBundle(bundle);
+        REQUIRE(result.imported == 0);
+        REQUIRE(result.already_cached == 1);
+    }
+
+    SECTION("rejects the files that don't match their sha256") {
+        builder.addFile(other_sha + "/other.sh", "tampered content");
+        builder.write(bundle);
+        auto result = mod_cd.importBundle(bundle);
+        REQUIRE(result.imported == 1);
+        REQUIRE(result.rejected == 1);
+        REQUIRE_FALSE(isCached(other_sha, "other.sh"));
+        REQUIRE_FALSE(fs::exists(fs::path(CACHE_DIR) / other_sha));
+
+        for (fs::directory_iterator it { CACHE_DIR }, end; it != end; ++it) {
+            REQUIRE_FALSE(boost::starts_with(it->path().filename().string(), "temp_"));
+        }
+    }
+
+    SECTION("rejects the entries that are not in a sha256 directory") {
+        builder.addFile("other.sh", "other content");
+        builder.addFile("../" + other_sha + "/other.sh", "other content");
+        builder.write(bundle);
+        auto result = mod_cd.importBundle(bundle);
+        REQUIRE(result.imported == 1);
+        REQUIRE(result.rejected == 2);
+    }
+
+    SECTION("throws in case the bundle can't be read") {
+        REQUIRE_THROWS_AS(mod_cd.importBundle(CACHE_DIR + "/../does_not_exist.tar"),
+                          Module::ProcessingError);
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("ModuleCacheDir::downloadFileFromMaster resumes interrupted downloads", "[modules]") {
+    std::string content;
+    for (int i = 0; content.size() < 256 * 1024; i++) {
+        content += std::to_string(i) + "\n";
+    }
+    Util::Sha256 digest {};
+    digest.update(content.data(), content.size());
+    auto sha256 = digest.hexDigest();
+
+    lth_jc::JsonContainer file {};
+    file.set<std::string>("filename", "resumed.txt");
+    file.set<std::string>("sha256", sha256);
+    file.set<int>("size_bytes", static_cast<int>(content.size()));
+    lth_jc::JsonContainer uri {};
+    uri.set<std::string>("path", "/resumed.txt");
+    file.set<lth_jc::JsonContainer>("uri", uri);
+
+    ModuleCacheDir mod_cd { CACHE_DIR, CACHE_TTL };
+    ModuleCacheDir::ClientSettings client_settings { HttpsStandIn::caPath(), "", "", "", "" };
+    auto cache_dir = mod_cd.createCacheDir(sha256);
+    auto destination = cache_dir / "resumed.txt";
+    lth_util::scope_exit entry_cleaner { [&]() { fs::remove_all(cache_dir); } };
+
+    SECTION("requests the rest of the file after the connection drops") {
+        HttpsStandIn server { content, { true, 100000, false, 0 } };
+        uint64_t bytes_received { 0 };
+
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri(), server.uri() }, 5, 10,
+                                              client_settings, cache_dir, destination, file,
+                                              false, &bytes_received)
+                == destination);
+        REQUIRE(lth_file::read(destination.string()) == content);
+        REQUIRE(server.ranges() == std::vector<std::string>({ "", "bytes=100000-" }));
+        REQUIRE(bytes_received == content.size());
+
+        // Already cached
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10,
+                                              client_settings, cache_dir, destination, file,
+                                              false, &bytes_received)
+                == destination);
+        REQUIRE(bytes_received == content.size());
+    }
+
+    SECTION("starts over in case the server does not support ranges") {
+        HttpsStandIn server { content, { false, 100000, false, 0 } };
+
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri(), server.uri() }, 5, 10,
+                                              client_settings, cache_dir, destination, file)
+                == destination);
+        REQUIRE(lth_file::read(destination.string()) == content);
+        REQUIRE(server.ranges() == std::vector<std::string>({ "", "bytes=100000-", "" }));
+    }
+
+    SECTION("keeps the partial download when all the servers fail") {
+        HttpsStandIn server { content, { true, 100000, false, 0 } };
+
+        REQUIRE_THROWS_AS(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10,
+                                                        client_settings, cache_dir, destination, file),
+                          Module::ProcessingError);
+        REQUIRE_FALSE(fs::exists(destination));
+
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10,
+                                              client_settings, cache_dir, destination, file)
+                == destination);
+        REQUIRE(lth_file::read(destination.string()) == content);
+        REQUIRE(server.ranges() == std::vector<std::string>({ "", "bytes=100000-" }));
+    }
+
+    SECTION("reuses the open connection for the next download") {
+        HttpsStandIn server { content, { true, 0, true, 0 } };
+
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10,
+                                              client_settings, cache_dir, destination, file)
+                == destination);
+        auto other_destination = cache_dir / "resumed_copy.txt";
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10,
+                                              client_settings, cache_dir, other_destination, file)
+                == other_destination);
+        REQUIRE(lth_file::read(other_destination.string()) == content);
+
+        REQUIRE(server.connections() == 1u);
+        auto stats = mod_cd.getDownloadStats();
+        REQUIRE(stats.requests == 2u);
+        REQUIRE(stats.handshakesSaved() == 1u);
+    }
+}
+
+TEST_CASE("ModuleCacheDir::downloadFileFromMaster throttles the downloads", "[modules]") {
+    std::string content(256 * 1024, 'x');
+    auto sha256 = sha256Of(content);
+
+    lth_jc::JsonContainer file {};
+    file.set<std::string>("filename", "throttled.txt");
+    file.set<std::string>("sha256", sha256);
+    lth_jc::JsonContainer uri {};
+    uri.set<std::string>("path", "/throttled.txt");
+    file.set<lth_jc::JsonContainer>("uri", uri);
+
+    ModuleCacheDir::ClientSettings client_settings { HttpsStandIn::caPath(), "", "", "", "" };
+    lth_util::scope_exit entry_cleaner { [&]() { fs::remove_all(fs::path(CACHE_DIR) / sha256); } };
+
+    SECTION("does not contact a master-uri again before the time it asked to retry after") {
+        ModuleCacheDir mod_cd { CACHE_DIR, CACHE_TTL };
+        auto cache_dir = mod_cd.createCacheDir(sha256);
+        HttpsStandIn server { content, { false, 0, false, 60 } };
+
+        REQUIRE_THROWS_AS(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10, client_settings,
+                                                        cache_dir, cache_dir / "throttled.txt", file),
+                          Module::ProcessingError);
+        REQUIRE_THROWS_AS(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10, client_settings,
+                                                        cache_dir, cache_dir / "throttled.txt", file),
+                          Module::ProcessingError);
+        REQUIRE(server.ranges().size() == 1u);
+    }
+
+    SECTION("limits the rate of the downloads") {
+        ModuleCacheDir mod_cd { CACHE_DIR, CACHE_TTL, 0, ModuleCacheDir::UNLIMITED_DOWNLOADS, "0d", 128 * 1024 };
+        auto cache_dir = mod_cd.createCacheDir(sha256);
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(mod_cd.downloadFileFromMaster({ server.uri() }, 5, 10, client_settings,
+                                              cache_dir, cache_dir / "throttled.txt", file)
+                == cache_dir / "throttled.txt");
+        // The first second worth of bytes is received at once
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(800));
+    }
+}
+
+TEST_CASE("ModuleCacheDir::downloadArchiveFromMaster", "[modules]") {
+    TarBuilder builder;
+    builder.addDirectory("tree/");
+    builder.addFile("tree/first", "first content");
+    builder.addFile("tree/sub/second", "second content");
+    builder.addFile("top", "top content");
+    auto content = builder.str();
+
+    lth_jc::JsonContainer file {};
+    file.set<std::string>("sha256", sha256Of(content));
+    lth_jc::JsonContainer uri {};
+    uri.set<std::string>("path", "/tree.tar");
+    file.set<lth_jc::JsonContainer>("uri", uri);
+
+    ModuleCacheDir mod_cd { CACHE_DIR, CACHE_TTL };
+    ModuleCacheDir::ClientSettings client_settings { HttpsStandIn::caPath(), "", "", "", "" };
+    auto archive_dir = fs::path(CACHE_DIR) / "archive_test";
+    auto destination = archive_dir / "destination";
+    lth_util::scope_exit archive_dir_cleaner { [&]() { fs::remove_all(archive_dir); } };
+
+    SECTION("extracts the archive into a new destination") {
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+
+        mod_cd.downloadArchiveFromMaster({ server.uri() }, 5, 10, client_settings, destination, file);
+        REQUIRE(lth_file::read((destination / "tree" / "first").string()) == "first content");
+        REQUIRE(lth_file::read((destination / "tree" / "sub" / "second").string()) == "second content");
+        REQUIRE(lth_file::read((destination / "top").string()) == "top content");
+        // Only the destination is left
+        REQUIRE(std::distance(fs::directory_iterator(archive_dir), fs::directory_iterator()) == 1);
+    }
+
+    SECTION("merges the archive into an existing destination") {
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+        fs::create_directories(destination / "tree");
+        lth_file::atomic_write_to_file("old content", (destination / "top").string());
+        lth_file::atomic_write_to_file("kept content", (destination / "tree" / "kept").string());
+
+        mod_cd.downloadArchiveFromMaster({ server.uri() }, 5, 10, client_settings, destination, file);
+        REQUIRE(lth_file::read((destination / "top").string()) == "top content");
+        REQUIRE(lth_file::read((destination / "tree" / "kept").string()) == "kept content");
+        REQUIRE(lth_file::read((destination / "tree" / "first").string()) == "first content");
+    }
+
+    SECTION("starts over with the next master-uri after the connection drops") {
+        HttpsStandIn server { content, { false, 1000, false, 0 } };
+
+        mod_cd.downloadArchiveFromMaster({ server.uri(), server.uri() }, 5, 10, client_settings, destination, file);
+        REQUIRE(lth_file::read((destination / "tree" / "sub" / "second").string()) == "second content");
+        REQUIRE(server.ranges() == std::vector<std::string>({ "", "" }));
+    }
+
+    SECTION("tries the next master-uri in case the archive is not valid") {
+        HttpsStandIn bad_server { std::string(2048, 'x'), { false, 0, false, 0 } };
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+
+        mod_cd.downloadArchiveFromMaster({ bad_server.uri(), server.uri() }, 5, 10, client_settings, destination, file);
+        REQUIRE(lth_file::read((destination / "top").string()) == "top content");
+        REQUIRE(std::distance(fs::directory_iterator(archive_dir), fs::directory_iterator()) == 1);
+    }
+
+    SECTION("tries the next master-uri in case the archive can't be extracted") {
+        TarBuilder bad_builder;
+        bad_builder.addFile("top", "top content");
+        bad_builder.addFile("top/nested", "nested content");
+        HttpsStandIn bad_server { bad_builder.str(), { false, 0, false, 0 } };
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+
+        REQUIRE_THROWS_AS(mod_cd.downloadArchiveFromMaster({ bad_server.uri() }, 5, 10, client_settings, destination, file),
+                          Module::ProcessingError);
+        REQUIRE(fs::is_empty(archive_dir));
+
+        mod_cd.downloadArchiveFromMaster({ bad_server.uri(), server.uri() }, 5, 10, client_settings, destination, file);
+        REQUIRE(lth_file::read((destination / "top").string()) == "top content");
+        REQUIRE(std::distance(fs::directory_iterator(archive_dir), fs::directory_iterator()) == 1);
+    }
+
+    SECTION("does not change the destination in case the sha256 does not match") {
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+        file.set<std::string>("sha256", sha256Of("other content"));
+
+        REQUIRE_THROWS_AS(mod_cd.downloadArchiveFromMaster({ server.uri() }, 5, 10, client_settings, destination, file),
+                          Module::ProcessingError);
+        REQUIRE_FALSE(fs::exists(destination));
+        REQUIRE(fs::is_empty(archive_dir));
+    }
+
+    SECTION("rejects the entries out of the destination") {
+        TarBuilder evil_builder;
+        evil_builder.addFile("tree/../../escaped", "escaped content");
+        auto evil_content = evil_builder.str();
+        file.set<std::string>("sha256", sha256Of(evil_content));
+        HttpsStandIn server { evil_content, { false, 0, false, 0 } };
+
+        REQUIRE_THROWS_AS(mod_cd.downloadArchiveFromMaster({ server.uri() }, 5, 10, client_settings, destination, file),
+                          Module::ProcessingError);
+        REQUIRE_FALSE(fs::exists(destination));
+        REQUIRE_FALSE(fs::exists(archive_dir / "escaped"));
+        REQUIRE_FALSE(fs::exists(fs::path(CACHE_DIR) / "escaped"));
+    }
 }
+#endif
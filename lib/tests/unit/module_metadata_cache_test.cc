@@ -0,0 +1,106 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/module_metadata_cache.hpp>
+
+#include <leatherman/json_container/json_container.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/nowide/fstream.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+
+using namespace PXPAgent;
+
+namespace fs = boost::filesystem;
+namespace lth_jc = leatherman::json_container;
+
+static const std::string METADATA_CACHE_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                                   + "/lib/tests/resources/test_metadata_cache" };
+
+static void writeFile(const std::string& path, const std::string& content)
+{
+    boost::nowide::ofstream ofs { path, std::ios::binary };
+    ofs << content;
+}
+
+TEST_CASE("ModuleMetadataCache", "[modules][metadata]") {
+    fs::create_directories(METADATA_CACHE_TEST_DIR);
+    auto cache_file = METADATA_CACHE_TEST_DIR + "/cache/metadata.json";
+    auto module_path = METADATA_CACHE_TEST_DIR + "/module";
+    writeFile(module_path, "#!/bin/sh\necho '{}'\n");
+
+    lth_jc::JsonContainer metadata { "{\"description\" : \"test\", \"actions\" : []}" };
+    ModuleMetadataCache::Key key;
+    REQUIRE(ModuleMetadataCache::getKey(module_path, key));
+
+    SECTION("returns the metadata stored before a restart") {
+        {
+            ModuleMetadataCache cache { cache_file };
+            lth_jc::JsonContainer cached;
+            REQUIRE_FALSE(cache.get(module_path, key, cached));
+            cache.set(module_path, key, metadata);
+            cache.save();
+        }
+
+        ModuleMetadataCache cache { cache_file };
+        lth_jc::JsonContainer cached;
+        REQUIRE(cache.get(module_path, key, cached));
+        REQUIRE(cached.get<std::string>("description") == "test");
+    }
+
+    SECTION("does not return the metadata of a module that changed") {
+        ModuleMetadataCache cache { cache_file };
+        cache.set(module_path, key, metadata);
+
+        writeFile(module_path, "#!/bin/sh\necho '{ }'\n");
+        ModuleMetadataCache::Key new_key;
+        REQUIRE(ModuleMetadataCache::getKey(module_path, new_key));
+        REQUIRE_FALSE(new_key == key);
+
+        lth_jc::JsonContainer cached;
+        REQUIRE_FALSE(cache.get(module_path, new_key, cached));
+        REQUIRE_FALSE(cache.get(METADATA_CACHE_TEST_DIR + "/other_module", key, cached));
+    }
+
+    SECTION("drops the modules that were not loaded since the last restart") {
+        {
+            ModuleMetadataCache cache { cache_file };
+            cache.set(module_path, key, metadata);
+            cache.set(module_path + "_removed", key, metadata);
+            cache.save();
+        }
+        {
+            ModuleMetadataCache cache { cache_file };
+            lth_jc::JsonContainer cached;
+            REQUIRE(cache.get(module_path, key, cached));
+            cache.save();
+        }
+
+        ModuleMetadataCache cache { cache_file };
+        lth_jc::JsonContainer cached;
+        REQUIRE(cache.get(module_path, key, cached));
+        REQUIRE_FALSE(cache.get(module_path + "_removed", key, cached));
+    }
+
+    SECTION("ignores an invalid cache file") {
+        fs::create_directories(METADATA_CACHE_TEST_DIR + "/cache");
+        writeFile(cache_file, "{\"version\" : 1, \"modules\" : ");
+
+        ModuleMetadataCache cache { cache_file };
+        lth_jc::JsonContainer cached;
+        REQUIRE_FALSE(cache.get(module_path, key, cached));
+        cache.set(module_path, key, metadata);
+        cache.save();
+
+        ModuleMetadataCache reloaded { cache_file };
+        REQUIRE(reloaded.get(module_path, key, cached));
+    }
+
+    SECTION("can't get the key of a module that does not exist") {
+        REQUIRE_FALSE(ModuleMetadataCache::getKey(METADATA_CACHE_TEST_DIR + "/other_module", key));
+    }
+
+    fs::remove_all(METADATA_CACHE_TEST_DIR);
+}
@@ -0,0 +1,119 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/module_worker_pool.hpp>
+#include <pxp-agent/module.hpp>
+
+#include <leatherman/json_container/json_container.hpp>
+
+#include <catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <signal.h>
+
+using namespace PXPAgent;
+
+namespace lth_jc = leatherman::json_container;
+
+static const std::string WORKER_MODULE { std::string { PXP_AGENT_ROOT_PATH }
+                                         + "/lib/tests/resources/worker_modules/reverse_worker" };
+
+static const std::string NO_WORKER_MODULE { std::string { PXP_AGENT_ROOT_PATH }
+                                            + "/lib/tests/resources/modules/reverse_valid" };
+
+static const std::string ARGUMENTS { "{\"input\" : {\"argument\" : \"maradona\"}}" };
+
+static const std::chrono::seconds ACTION_TIMEOUT { 10 };
+
+// Returns the pid of the process that ran the action
+static int runString(ModuleWorkerPool& pool)
+{
+    ModuleWorkerPool::Result result;
+    REQUIRE(pool.run("string", ARGUMENTS, 0, result));
+    REQUIRE(result.exitcode == 0);
+    REQUIRE(result.std_err.empty());
+
+    lth_jc::JsonContainer output { result.std_out };
+    REQUIRE(output.get<std::string>("output") == "anodaram");
+    return output.get<int>("pid");
+}
+
+TEST_CASE("ModuleWorkerPool::run", "[modules]") {
+    SECTION("runs the actions in the same worker") {
+        ModuleWorkerPool pool { WORKER_MODULE, 2, 10, ACTION_TIMEOUT };
+        auto pid = runString(pool);
+
+        REQUIRE(runString(pool) == pid);
+        REQUIRE(runString(pool) == pid);
+        REQUIRE(pool.size() == 1);
+    }
+
+    SECTION("replaces a worker after the maximum number of requests") {
+        ModuleWorkerPool pool { WORKER_MODULE, 1, 2, ACTION_TIMEOUT };
+        auto pid = runString(pool);
+
+        REQUIRE(runString(pool) == pid);
+        REQUIRE(runString(pool) != pid);
+    }
+
+    SECTION("replaces a worker that exited while idle") {
+        ModuleWorkerPool pool { WORKER_MODULE, 1, 10, ACTION_TIMEOUT };
+        auto pid = runString(pool);
+        kill(pid, SIGKILL);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        REQUIRE(runString(pool) != pid);
+        REQUIRE(pool.size() == 1);
+    }
+
+    SECTION("throws in case the worker fails while running an action") {
+        ModuleWorkerPool pool { WORKER_MODULE, 1, 10, ACTION_TIMEOUT };
+        ModuleWorkerPool::Result result;
+
+        REQUIRE_THROWS_AS(pool.run("crash", "{\"input\" : {}}", 0, result),
+                          Module::ProcessingError);
+        REQUIRE(pool.size() == 0);
+        runString(pool);
+    }
+
+    SECTION("replaces a worker that does not answer within the action timeout") {
+        ModuleWorkerPool pool { WORKER_MODULE, 1, 10, std::chrono::seconds(1) };
+        ModuleWorkerPool::Result result;
+
+        REQUIRE_THROWS_AS(pool.run("hang", "{\"input\" : {}}", 0, result),
+                          Module::ProcessingError);
+        REQUIRE(pool.size() == 0);
+        runString(pool);
+    }
+
+    SECTION("replaces a worker whose response exceeds the maximum size") {
+        ModuleWorkerPool pool { WORKER_MODULE, 1, 10, ACTION_TIMEOUT };
+        ModuleWorkerPool::Result result;
+        auto pid = runString(pool);
+
+        REQUIRE_THROWS_AS(pool.run("string", ARGUMENTS, 16, result),
+                          Module::ProcessingError);
+        REQUIRE(pool.size() == 0);
+        REQUIRE(runString(pool) != pid);
+    }
+
+    SECTION("does not run the action when no worker is available") {
+        ModuleWorkerPool pool { WORKER_MODULE, 0, 10, ACTION_TIMEOUT };
+        ModuleWorkerPool::Result result;
+
+        REQUIRE_FALSE(pool.run("string", ARGUMENTS, 0, result));
+    }
+
+    SECTION("gives up starting workers that don't answer the ping") {
+        ModuleWorkerPool pool { NO_WORKER_MODULE, 1, 10, ACTION_TIMEOUT };
+        ModuleWorkerPool::Result result;
+
+        for (unsigned int i = 0; i < ModuleWorkerPool::MAX_START_FAILURES; i++) {
+            REQUIRE(pool.enabled());
+            REQUIRE_FALSE(pool.run("string", ARGUMENTS, 0, result));
+        }
+        REQUIRE_FALSE(pool.enabled());
+        REQUIRE(pool.size() == 0);
+    }
+}
@@ -212,6 +212,23 @@ TEST_CASE("Modules::File::callAction", "[modules]") {
             // Remove the newly created directory after testing
             fs::remove(fs::path(TEST_NEW_DIR));
         }
+
+        SECTION("Reports the outcome of each entry") {
+            lth_jc::JsonContainer report { response.action_metadata.get<std::string>({ "results", "stdout" }) };
+            auto entries = report.get<std::vector<lth_jc::JsonContainer>>("files");
+            REQUIRE(entries.size() == 2);
+            REQUIRE(entries[0].get<std::string>("destination") == TEST_FILE_DIR + "/file.txt");
+            REQUIRE(entries[0].includes("duration_ms"));
+            REQUIRE(entries[1].get<std::string>("kind") == "directory");
+            REQUIRE(entries[1].get<std::string>("status") == "created");
+
+            // The destinations are left as they are by the next request
+            auto second_response = mod.executeAction(request);
+            lth_jc::JsonContainer second_report { second_response.action_metadata.get<std::string>({ "results", "stdout" }) };
+            REQUIRE(second_report.get<int>("changed") == 0);
+            REQUIRE(second_report.get<int>("unchanged") == 2);
+            fs::remove(fs::path(TEST_NEW_DIR));
+        }
     }
 
     SECTION("Correctly fails if the new directory requested is already a file") {
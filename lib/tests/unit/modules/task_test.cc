@@ -1,5 +1,6 @@
 #include "root_path.hpp"
 #include "../../common/content_format.hpp"
+#include "../../common/tar_builder.hpp"
 
 #include <pxp-agent/modules/task.hpp>
 #include <pxp-agent/configuration.hpp>
@@ -109,6 +110,8 @@ TEST_CASE("Modules::Task::hasAction", "[modules]") {
 
     SECTION("correctly reports true") {
         REQUIRE(mod.hasAction("run"));
+        REQUIRE(mod.hasAction("prefetch"));
+        REQUIRE(mod.hasAction("import_bundle"));
     }
 }
 
@@ -125,6 +128,16 @@ static void configureTest() {
         });
 }
 
+static std::vector<fs::path> getInstallDirs() {
+    std::vector<fs::path> install_dirs;
+    for (fs::directory_iterator it { TASK_CACHE_DIR }, end; it != end; ++it) {
+        if (boost::starts_with(it->path().filename().string(), "installdir_")) {
+            install_dirs.push_back(it->path());
+        }
+    }
+    return install_dirs;
+}
+
 static void resetTest() {
     if (fs::exists(SPOOL_DIR)) {
         fs::remove_all(SPOOL_DIR);
@@ -132,6 +145,10 @@ static void resetTest() {
     if (fs::exists(TEMP_TASK_CACHE_DIR)) {
         fs::remove_all(TEMP_TASK_CACHE_DIR);
     }
+    for (auto& install_dir : getInstallDirs()) {
+        ModuleCacheDir::makeEntryWritable(install_dir);
+        fs::remove_all(install_dir);
+    }
 }
 
 TEST_CASE("Modules::Task::callAction", "[modules]") {
@@ -261,6 +278,15 @@ TEST_CASE("Modules::Task::executeAction", "[modules][output]") {
         boost::trim(output);
         boost::trim(task_content);
         REQUIRE(output == "file1\nfile2\nfile3\n"+task_content);
+        REQUIRE(getInstallDirs().size() == 1u);
+
+        SECTION("reuses the installdir of a previous run") {
+            auto install_dir = getInstallDirs().front();
+            output = e_m.executeAction(request).action_metadata.get<std::string>({"results", "stdout"});
+            boost::trim(output);
+            REQUIRE(output == "file1\nfile2\nfile3\n"+task_content);
+            REQUIRE(getInstallDirs() == std::vector<fs::path> { install_dir });
+        }
     }
 
     SECTION("passes input only on stdin when input_method is stdin") {
@@ -676,6 +702,102 @@ static std::time_t my_to_time_t(pt::ptime t)
     return (t - pt::ptime(boost::gregorian::date(1970, 1, 1))).total_seconds();
 }
 
+TEST_CASE("Modules::Task::executeAction prefetch", "[modules][output]") {
+    configureTest();
+    lth_util::scope_exit config_cleaner { resetTest };
+    Modules::Task e_m { PXP_AGENT_BIN_PATH, {}, CA, CRT, KEY, CRL, "", 10, 20, MODULE_CACHE_DIR, STORAGE };
+
+    auto getPrefetchReport = [&](const std::string& files) {
+        auto prefetch_txt = (DATA_FORMAT % "\"0632\""
+                                         % "\"task\""
+                                         % "\"prefetch\""
+                                         % ("{\"files\": " + files + "}")).str();
+        PCPClient::ParsedChunks prefetch_content {
+            lth_jc::JsonContainer(ENVELOPE_TXT),
+            lth_jc::JsonContainer(prefetch_txt),
+            {},
+            0 };
+        ActionRequest request { RequestType::Blocking, prefetch_content };
+        auto response = e_m.executeAction(request);
+        REQUIRE(response.action_metadata.get<bool>("results_are_valid"));
+        return std::make_pair(response.action_metadata.get<int>({ "results", "exitcode" }),
+                              lth_jc::JsonContainer(response.action_metadata.get<std::string>({ "results", "stdout" })));
+    };
+
+    SECTION("reports the files already in the cache as hits") {
+        auto report = getPrefetchReport(
+#ifndef _WIN32
+            "[{\"sha256\": \"15f26bdeea9186293d256db95fed616a7b823de947f4e9bd0d8d23c5ac786d13\", \"filename\": \"init\", "
+#else
+            "[{\"sha256\": \"e1c10f8c709f06f4327ac6a07a918e297a039a24a788fabf4e2ebc31d16e8dc3\", \"filename\": \"init.bat\", "
+#endif
+              "\"uri\": {\"path\": \"/init\", \"params\": {}}}]");
+
+        REQUIRE(report.first == 0);
+        REQUIRE(report.second.get<int>("hits") == 1);
+        REQUIRE(report.second.get<int>("misses") == 0);
+        REQUIRE(report.second.get<double>("bytes_transferred") == 0);
+        auto files = report.second.get<std::vector<lth_jc::JsonContainer>>("files");
+        REQUIRE(files.size() == 1u);
+        REQUIRE(files[0].get<std::string>("status") == "hit");
+    }
+
+    SECTION("reports the files that could not be fetched, without failing the action") {
+        auto report = getPrefetchReport(
+            "[{\"sha256\": \"some_sha\", \"filename\": \"some_file\", "
+              "\"uri\": {\"path\": \"/some_file\", \"params\": {}}}]");
+
+        REQUIRE(report.first == 1);
+        REQUIRE(report.second.get<int>("failures") == 1);
+        auto files = report.second.get<std::vector<lth_jc::JsonContainer>>("files");
+        REQUIRE(files[0].get<std::string>("status") == "failed");
+        REQUIRE(boost::contains(files[0].get<std::string>("error"), "No master-uris were provided"));
+        fs::remove_all(fs::path(TASK_CACHE_DIR) / "some_sha");
+    }
+}
+
+TEST_CASE("Modules::Task::executeAction import_bundle", "[modules][output]") {
+    configureTest();
+    lth_util::scope_exit config_cleaner { resetTest };
+    Modules::Task e_m { PXP_AGENT_BIN_PATH, {}, CA, CRT, KEY, CRL, "", 10, 20, MODULE_CACHE_DIR, STORAGE };
+
+    auto importBundle = [&](const std::string& path) {
+        auto import_txt = (DATA_FORMAT % "\"0633\""
+                                       % "\"task\""
+                                       % "\"import_bundle\""
+                                       % ("{\"path\": \"" + path + "\"}")).str();
+        PCPClient::ParsedChunks import_content {
+            lth_jc::JsonContainer(ENVELOPE_TXT),
+            lth_jc::JsonContainer(import_txt),
+            {},
+            0 };
+        ActionRequest request { RequestType::Blocking, import_content };
+        return e_m.executeAction(request);
+    };
+
+    SECTION("reports the rejected files and fails") {
+        auto bundle = TASK_CACHE_DIR + "/../test_bundle.tar";
+        lth_util::scope_exit bundle_cleaner { [&]() { fs::remove(bundle); } };
+        TarBuilder builder;
+        builder.addFile("some_file", "some content");
+        builder.write(bundle);
+
+        auto response = importBundle(bundle);
+        REQUIRE(response.action_metadata.get<bool>("results_are_valid"));
+        REQUIRE(response.action_metadata.get<int>({ "results", "exitcode" }) == 1);
+        lth_jc::JsonContainer report { response.action_metadata.get<std::string>({ "results", "stdout" }) };
+        REQUIRE(report.get<int>("imported") == 0);
+        REQUIRE(report.get<int>("rejected") == 1);
+    }
+
+    SECTION("fails in case the bundle can't be read") {
+        auto response = importBundle(TASK_CACHE_DIR + "/../does_not_exist.tar");
+        REQUIRE_FALSE(response.action_metadata.get<bool>("results_are_valid"));
+        REQUIRE(boost::contains(response.action_metadata.get<std::string>("execution_error"),
+                                "does_not_exist.tar"));
+    }
+}
+
 TEST_CASE("purge old tasks", "[modules]") {
     const std::string PURGE_TASK_CACHE { std::string { PXP_AGENT_ROOT_PATH }
         + "/lib/tests/resources/purge_test" };
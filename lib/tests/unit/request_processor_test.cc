@@ -23,6 +23,11 @@ namespace lth_jc = leatherman::json_container;
 namespace pcp_util = PCPClient::Util;
 namespace fs = boost::filesystem;
 
+static const std::string RELOAD_MODULES { PXP_AGENT_ROOT_PATH
+            + std::string { "/lib/tests/resources/tmp_reload_modules" } };
+static const std::string RELOAD_MODULES_CONFIG { PXP_AGENT_ROOT_PATH
+            + std::string { "/lib/tests/resources/tmp_reload_modules_config" } };
+
 TEST_CASE("RequestProcessor::RequestProcessor", "[agent]") {
     auto c_ptr = std::make_shared<MockConnector>();
 
@@ -154,3 +159,87 @@ TEST_CASE("RequestProcessor::processRequest", "[agent]") {
 
     fs::remove_all(SPOOL);
 }
+
+// NB: on Windows, the module files run scripts that would have to be
+// copied as well
+#ifndef _WIN32
+TEST_CASE("RequestProcessor::reloadExternalModules", "[agent]") {
+    fs::create_directories(RELOAD_MODULES);
+    fs::create_directories(RELOAD_MODULES_CONFIG);
+    auto module_path = [](const std::string& module_name) {
+        return (fs::path { RELOAD_MODULES } / module_name).string();
+    };
+    auto config_path = (fs::path { RELOAD_MODULES_CONFIG } / "reverse_valid.conf").string();
+    auto copy_module = [&](const std::string& from, const std::string& to) {
+        fs::copy_file(fs::path { MODULES } / from, module_path(to),
+                      fs::copy_option::overwrite_if_exists);
+    };
+    // Required by the test modules; not a module itself
+    fs::copy_file(fs::path { MODULES } / "check_output.rb",
+                  fs::path { RELOAD_MODULES } / "check_output.rb",
+                  fs::copy_option::overwrite_if_exists);
+    copy_module("reverse_valid", "reverse_valid");
+
+    Configuration::Agent a_c = AGENT_CONFIGURATION;
+    a_c.modules_dir = RELOAD_MODULES;
+    a_c.modules_config_dir = RELOAD_MODULES_CONFIG;
+    auto c_ptr = std::make_shared<MockConnector>();
+    RequestProcessor r_p { c_ptr, a_c };
+    REQUIRE(r_p.hasModule("reverse_valid"));
+
+    SECTION("loads the modules added") {
+        copy_module("failures_test", "failures_test");
+        r_p.reloadExternalModules({ module_path("failures_test") });
+
+        REQUIRE(r_p.hasModule("failures_test"));
+    }
+
+    SECTION("replaces the modules updated; the actions in progress keep the previous one") {
+        auto previous = r_p.getModule("reverse_valid");
+        std::vector<std::string> previous_actions { "string", "hash" };
+        copy_module("failures_test", "reverse_valid");
+        r_p.reloadExternalModules({ module_path("reverse_valid") });
+
+        auto current = r_p.getModule("reverse_valid");
+        REQUIRE(current != nullptr);
+        REQUIRE(current != previous);
+        REQUIRE(current->actions != previous_actions);
+        REQUIRE(previous->actions == previous_actions);
+    }
+
+    SECTION("unloads the modules removed") {
+        fs::remove(module_path("reverse_valid"));
+        r_p.reloadExternalModules({ module_path("reverse_valid") });
+
+        REQUIRE_FALSE(r_p.hasModule("reverse_valid"));
+    }
+
+    SECTION("reloads the modules whose configuration changed") {
+        auto previous = r_p.getModule("reverse_valid");
+        fs::copy_file(fs::path { VALID_MODULES_CONFIG } / "reverse_valid.conf", config_path);
+        r_p.reloadExternalModules({ config_path });
+
+        REQUIRE(r_p.hasModuleConfig("reverse_valid"));
+        REQUIRE(r_p.getModule("reverse_valid") != previous);
+
+        fs::remove(config_path);
+        r_p.reloadExternalModules({ config_path });
+
+        REQUIRE_FALSE(r_p.hasModuleConfig("reverse_valid"));
+        REQUIRE(r_p.hasModule("reverse_valid"));
+    }
+
+    SECTION("does not replace the internal modules") {
+        auto previous = r_p.getModule("ping");
+        copy_module("reverse_valid", "ping");
+        r_p.reloadExternalModules({ module_path("ping") });
+
+        REQUIRE(r_p.getModule("ping") == previous);
+        REQUIRE(r_p.getModule("ping")->type() == ModuleType::Internal);
+    }
+
+    fs::remove_all(RELOAD_MODULES);
+    fs::remove_all(RELOAD_MODULES_CONFIG);
+    fs::remove_all(SPOOL);
+}
+#endif
@@ -1,12 +1,14 @@
 #include "root_path.hpp"
 
 #include <pxp-agent/results_storage.hpp>
+#include <pxp-agent/results_mutex.hpp>
 #include <pxp-agent/action_response.hpp>
 #include <pxp-agent/module_type.hpp>
 #include <pxp-agent/request_type.hpp>
 
 #include <leatherman/json_container/json_container.hpp>
 #include <leatherman/util/time.hpp>
+#include <leatherman/file_util/file.hpp>
 
 #include <boost/filesystem/operations.hpp>
 
@@ -21,6 +23,7 @@ using namespace PXPAgent;
 namespace fs = boost::filesystem;
 namespace lth_jc = leatherman::json_container;
 namespace lth_util = leatherman::util;
+namespace lth_file = leatherman::file_util;
 
 TEST_CASE("ResultsStorage ctor", "[module]") {
     SECTION("can instantiate") {
@@ -85,8 +88,12 @@ TEST_CASE("ResultsStorage::initializeMetadataFile", "[module][results]") {
 static const std::string TESTING_RESULTS { std::string { PXP_AGENT_ROOT_PATH}
                                            + "/lib/tests/resources/action_results" };
 
+static const std::string PURGE_TEST_RESULTS { std::string { PXP_AGENT_ROOT_PATH}
+                                              + "/lib/tests/resources/purge_test" };
+
 static const std::string VALID_TRANSACTION { "valid" };
 static const std::string BROKEN_TRANSACTION { "broken" };
+static const std::string TRUNCATED_TRANSACTION { "truncated" };
 
 TEST_CASE("ResultsStorage::getActionMetadata", "[module][results]") {
     ResultsStorage st { TESTING_RESULTS, SPOOL_TTL };
@@ -184,11 +191,128 @@ TEST_CASE("ResultsStorage::getOutput", "[module][results]") {
         REQUIRE(output.exitcode == 0);
         REQUIRE(output.std_err == "Hey, all good here!");
         REQUIRE(output.std_out == "{\"spam\":\"eggs\"}");
+        REQUIRE(output.std_out_total_bytes == 0);
+        REQUIRE(output.std_err_total_bytes == 0);
+    }
+
+    SECTION("Retrieves the total size of truncated streams") {
+        auto output = st.getOutput(TRUNCATED_TRANSACTION);
+
+        REQUIRE(output.exitcode == 0);
+        REQUIRE(output.std_out_total_bytes == 9010);
+        REQUIRE(output.std_err_total_bytes == 0);
     }
 }
 
-static const std::string PURGE_TEST_RESULTS { std::string { PXP_AGENT_ROOT_PATH}
-                                              + "/lib/tests/resources/purge_test" };
+TEST_CASE("ResultsStorage::compressOutput", "[module][results]") {
+    configureTest();
+    auto results_dir = fs::path(SPOOL_DIR) / VALID_TRANSACTION;
+    fs::create_directories(results_dir);
+
+    for (auto name : { "exitcode", "stdout", "stderr" })
+        fs::copy_file(fs::path(TESTING_RESULTS) / VALID_TRANSACTION / name,
+                      results_dir / name);
+
+    SECTION("Does nothing if compression is disabled") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL };
+        st.compressOutput(VALID_TRANSACTION);
+
+        REQUIRE(fs::exists(results_dir / "stdout"));
+        REQUIRE_FALSE(fs::exists(results_dir / "stdout.gz"));
+    }
+
+    SECTION("Replaces the output files with their gzip version") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL, true };
+        st.compressOutput(VALID_TRANSACTION);
+
+        REQUIRE_FALSE(fs::exists(results_dir / "stdout"));
+        REQUIRE_FALSE(fs::exists(results_dir / "stderr"));
+        REQUIRE(fs::exists(results_dir / "stdout.gz"));
+        REQUIRE(fs::exists(results_dir / "stderr.gz"));
+        REQUIRE(st.getCompressionStats().num_files == 2);
+    }
+
+    SECTION("The output is transparently decompressed") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL, true };
+        st.compressOutput(VALID_TRANSACTION);
+        auto output = st.getOutput(VALID_TRANSACTION);
+
+        REQUIRE(output.exitcode == 0);
+        REQUIRE(output.std_err == "Hey, all good here!");
+        REQUIRE(output.std_out == "{\"spam\":\"eggs\"}");
+    }
+
+    resetTest();
+}
+
+TEST_CASE("ResultsStorage::updateDiskUsage", "[module][results]") {
+    configureTest();
+    auto old_results = fs::path(SPOOL_DIR) / "old";
+    auto running_results = fs::path(SPOOL_DIR) / "running";
+    auto new_results = fs::path(SPOOL_DIR) / "new";
+    lth_jc::JsonContainer metadata {
+        lth_file::read(PURGE_TEST_RESULTS + "/valid_old/metadata") };
+
+    for (auto results_dir : { old_results, running_results, new_results }) {
+        fs::create_directories(results_dir);
+        lth_file::atomic_write_to_file(std::string(4000, 'a'),
+                                       (results_dir / "stdout").string());
+        metadata.set<std::string>("status",
+                                  results_dir == running_results ? "running" : "success");
+        lth_file::atomic_write_to_file(metadata.toString(),
+                                       (results_dir / "metadata").string());
+    }
+
+    auto now = time(nullptr);
+    fs::last_write_time(old_results, now - 200);
+    fs::last_write_time(running_results, now - 300);
+
+    SECTION("Does nothing if no quota is set") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL };
+        st.updateDiskUsage("new");
+
+        REQUIRE(st.getDiskUsage() == 0);
+        REQUIRE(fs::exists(old_results));
+    }
+
+    SECTION("Tracks the size of the results directories") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL, false, 100 * 1024 };
+        st.updateDiskUsage("new");
+
+        REQUIRE(st.getDiskUsage() == 3 * (4000 + metadata.toString().size()));
+    }
+
+    SECTION("Removes the oldest completed results above the high-water mark") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL, false, 13500 };
+        st.updateDiskUsage("new");
+
+        REQUIRE_FALSE(fs::exists(old_results));
+        REQUIRE(fs::exists(running_results));
+        REQUIRE(fs::exists(new_results));
+        REQUIRE(st.getDiskUsage() == 2 * (4000 + metadata.toString().size()));
+    }
+
+    SECTION("Makes room for the output of an action as it starts") {
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL, false, 13500 };
+        st.updateDiskUsage("running");
+
+        REQUIRE_FALSE(fs::exists(old_results));
+        REQUIRE(fs::exists(running_results));
+    }
+
+    SECTION("Does not remove the results of the actions in progress") {
+        ResultsMutex::Instance().reset();
+        ResultsMutex::Instance().add("old");
+        ResultsStorage st { SPOOL_DIR, SPOOL_TTL, false, 13500 };
+        st.updateDiskUsage("new");
+
+        REQUIRE(fs::exists(old_results));
+        REQUIRE(fs::exists(running_results));
+        ResultsMutex::Instance().reset();
+    }
+
+    resetTest();
+}
 
 static const std::string OLD_TRANSACTION { "valid_old" };
 static const std::string RECENT_TRANSACTION { "valid_recent" };
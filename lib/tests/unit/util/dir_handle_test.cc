@@ -0,0 +1,220 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/util/dir_handle.hpp>
+#include <pxp-agent/configuration.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <leatherman/file_util/file.hpp>
+
+#include <catch.hpp>
+
+#include <vector>
+#include <algorithm>
+
+using namespace PXPAgent;
+using namespace Util;
+
+namespace fs = boost::filesystem;
+namespace lth_file = leatherman::file_util;
+
+static const std::string DIR_HANDLE_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                               + "/lib/tests/resources/test_dir_handle" };
+
+static void createTestDir() {
+    if (!fs::exists(DIR_HANDLE_TEST_DIR) && !fs::create_directories(DIR_HANDLE_TEST_DIR))
+        FAIL("failed to create the test directory");
+}
+
+TEST_CASE("DirHandle ctor", "[util]") {
+    SECTION("throws an Error if the directory does not exist") {
+        REQUIRE_THROWS_AS(DirHandle { DIR_HANDLE_TEST_DIR + "/does_not_exist" },
+                          DirHandle::Error);
+    }
+
+    SECTION("throws an Error if the path is a file") {
+        createTestDir();
+        lth_file::atomic_write_to_file("foo\n", DIR_HANDLE_TEST_DIR + "/a_file");
+        REQUIRE_THROWS_AS(DirHandle { DIR_HANDLE_TEST_DIR + "/a_file" },
+                          DirHandle::Error);
+    }
+
+    SECTION("can open a directory and its sub-directories") {
+        createTestDir();
+        fs::create_directories(DIR_HANDLE_TEST_DIR + "/sub");
+        DirHandle dir { DIR_HANDLE_TEST_DIR };
+        REQUIRE_NOTHROW(DirHandle(dir, "sub"));
+        REQUIRE_THROWS_AS(DirHandle(dir, "nope"), DirHandle::Error);
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
+
+TEST_CASE("DirHandle::atomicWrite", "[util]") {
+    createTestDir();
+    DirHandle dir { DIR_HANDLE_TEST_DIR };
+
+    SECTION("writes the file, so that it can be read") {
+        std::string content {};
+        dir.atomicWrite("foo", "spam\neggs\n", NIX_FILE_PERMS);
+
+        REQUIRE(dir.exists("foo"));
+        REQUIRE_FALSE(dir.isDirectory("foo"));
+        REQUIRE(dir.read("foo", content));
+        REQUIRE(content == "spam\neggs\n");
+        REQUIRE(lth_file::read(DIR_HANDLE_TEST_DIR + "/foo") == "spam\neggs\n");
+    }
+
+    SECTION("replaces the existing content") {
+        std::string content {};
+        dir.atomicWrite("foo", "spam", NIX_FILE_PERMS);
+        dir.atomicWrite("foo", "eggs", NIX_FILE_PERMS);
+
+        REQUIRE(dir.read("foo", content));
+        REQUIRE(content == "eggs");
+    }
+
+    SECTION("does not leave temporary files behind") {
+        dir.atomicWrite("foo", "spam", NIX_FILE_PERMS);
+        REQUIRE(std::distance(fs::directory_iterator(DIR_HANDLE_TEST_DIR),
+                              fs::directory_iterator()) == 1);
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
+
+TEST_CASE("DirHandle::read", "[util]") {
+    createTestDir();
+    DirHandle dir { DIR_HANDLE_TEST_DIR };
+
+    SECTION("returns false if the file does not exist") {
+        std::string content { "untouched" };
+        REQUIRE_FALSE(dir.exists("foo"));
+        REQUIRE_FALSE(dir.read("foo", content));
+        REQUIRE(content == "untouched");
+    }
+
+    SECTION("reads files larger than its buffer") {
+        std::string big(100000, 'x');
+        std::string content {};
+        dir.atomicWrite("big", big, NIX_FILE_PERMS);
+        REQUIRE(dir.read("big", content));
+        REQUIRE(content == big);
+    }
+
+    SECTION("reads empty files") {
+        std::string content { "untouched" };
+        dir.atomicWrite("empty", "", NIX_FILE_PERMS);
+        REQUIRE(dir.read("empty", content));
+        REQUIRE(content.empty());
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
+
+TEST_CASE("DirHandle::readChunks", "[util]") {
+    createTestDir();
+    DirHandle dir { DIR_HANDLE_TEST_DIR };
+    std::string content {};
+    size_t num_chunks { 0 };
+    auto append = [&](const char* data, size_t size) {
+        content.append(data, size);
+        num_chunks++;
+    };
+
+    SECTION("returns false if the file does not exist") {
+        REQUIRE_FALSE(dir.readChunks("foo", append));
+        REQUIRE(num_chunks == 0u);
+    }
+
+    SECTION("passes the whole content, in chunks") {
+        std::string big(200000, 'x');
+        dir.atomicWrite("big", big, NIX_FILE_PERMS);
+        REQUIRE(dir.readChunks("big", append));
+        REQUIRE(content == big);
+        REQUIRE(num_chunks > 1u);
+    }
+
+    SECTION("propagates the exceptions of the callback") {
+        dir.atomicWrite("small", "content", NIX_FILE_PERMS);
+        REQUIRE_THROWS_AS(dir.readChunks("small",
+                                         [](const char*, size_t) {
+                                             throw DirHandle::Error { "stop" };
+                                         }),
+                          DirHandle::Error);
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
+
+TEST_CASE("DirHandle::createDirectory", "[util]") {
+    createTestDir();
+    DirHandle dir { DIR_HANDLE_TEST_DIR };
+
+    SECTION("creates the sub-directory") {
+        dir.createDirectory("sub", NIX_DIR_PERMS);
+        REQUIRE(dir.isDirectory("sub"));
+        REQUIRE(fs::is_directory(DIR_HANDLE_TEST_DIR + "/sub"));
+    }
+
+    SECTION("does not fail if the sub-directory exists") {
+        dir.createDirectory("sub", NIX_DIR_PERMS);
+        REQUIRE_NOTHROW(dir.createDirectory("sub", NIX_DIR_PERMS));
+    }
+
+    SECTION("throws an Error if a file with the same name exists") {
+        dir.atomicWrite("sub", "spam", NIX_FILE_PERMS);
+        REQUIRE_THROWS_AS(dir.createDirectory("sub", NIX_DIR_PERMS),
+                          DirHandle::Error);
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
+
+TEST_CASE("DirHandle::eachSubdirectory", "[util]") {
+    createTestDir();
+    DirHandle dir { DIR_HANDLE_TEST_DIR };
+    dir.createDirectory("one", NIX_DIR_PERMS);
+    dir.createDirectory("two", NIX_DIR_PERMS);
+    dir.atomicWrite("a_file", "spam", NIX_FILE_PERMS);
+
+    SECTION("lists only the sub-directories") {
+        std::vector<std::string> names {};
+        dir.eachSubdirectory([&](const std::string& name) -> bool {
+            names.push_back(name);
+            return true;
+        });
+        std::sort(names.begin(), names.end());
+
+        REQUIRE(names == (std::vector<std::string> { "one", "two" }));
+    }
+
+    SECTION("stops when the callback returns false") {
+        int count { 0 };
+        dir.eachSubdirectory([&](const std::string&) -> bool {
+            count++;
+            return false;
+        });
+
+        REQUIRE(count == 1);
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
+
+TEST_CASE("DirHandle::isStale", "[util]") {
+    createTestDir();
+    DirHandle dir { DIR_HANDLE_TEST_DIR };
+
+    SECTION("returns false while the directory exists") {
+        REQUIRE_FALSE(dir.isStale());
+    }
+
+    SECTION("returns true after the directory is removed") {
+        fs::remove_all(DIR_HANDLE_TEST_DIR);
+        REQUIRE(dir.isStale());
+    }
+
+    fs::remove_all(DIR_HANDLE_TEST_DIR);
+}
@@ -0,0 +1,70 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/util/directory_watcher.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/nowide/fstream.hpp>
+
+#include <catch.hpp>
+
+#include <chrono>
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+namespace fs = boost::filesystem;
+
+static const std::string WATCHER_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                            + "/lib/tests/resources/test_directory_watcher" };
+
+static const std::chrono::milliseconds WAIT_TIME { 3000 };
+
+static void writeFile(const std::string& path, const std::string& content)
+{
+    boost::nowide::ofstream ofs { path, std::ios::binary };
+    ofs << content;
+}
+
+TEST_CASE("DirectoryWatcher::waitForChanges", "[util]") {
+    auto first_dir = (fs::path(WATCHER_TEST_DIR) / "first").string();
+    auto second_dir = (fs::path(WATCHER_TEST_DIR) / "second").string();
+    auto first_file = (fs::path(first_dir) / "file").string();
+    auto second_file = (fs::path(second_dir) / "file").string();
+    fs::create_directories(first_dir);
+    fs::create_directories(second_dir);
+    writeFile(first_file, "content");
+
+    DirectoryWatcher watcher { { first_dir, second_dir, WATCHER_TEST_DIR + "/missing" } };
+
+    SECTION("reports nothing in case nothing changed") {
+        REQUIRE(watcher.waitForChanges(std::chrono::milliseconds(100)).empty());
+    }
+
+    SECTION("reports the files created in any of the directories") {
+        writeFile(second_file, "content");
+        auto changes = watcher.waitForChanges(WAIT_TIME);
+        REQUIRE(changes == std::set<std::string> { second_file });
+    }
+
+    SECTION("reports the files written") {
+        writeFile(first_file, "new content");
+        auto changes = watcher.waitForChanges(WAIT_TIME);
+        REQUIRE(changes == std::set<std::string> { first_file });
+    }
+
+    SECTION("reports the files removed") {
+        fs::remove(first_file);
+        auto changes = watcher.waitForChanges(WAIT_TIME);
+        REQUIRE(changes == std::set<std::string> { first_file });
+    }
+
+    SECTION("reports both names of the files renamed") {
+        fs::rename(first_file, second_file);
+        auto changes = watcher.waitForChanges(WAIT_TIME);
+        REQUIRE(changes == std::set<std::string> { first_file, second_file });
+    }
+
+    fs::remove_all(WATCHER_TEST_DIR);
+}
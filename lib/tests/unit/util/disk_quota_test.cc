@@ -0,0 +1,112 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/util/disk_quota.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <leatherman/file_util/file.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace PXPAgent;
+using namespace Util;
+
+namespace fs = boost::filesystem;
+namespace lth_file = leatherman::file_util;
+
+static const std::string DISK_QUOTA_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                               + "/lib/tests/resources/test_disk_quota" };
+
+TEST_CASE("DiskQuota::parseSize", "[util]") {
+    SECTION("parses a number of bytes") {
+        REQUIRE(DiskQuota::parseSize("0") == 0);
+        REQUIRE(DiskQuota::parseSize("1234") == 1234);
+    }
+
+    SECTION("applies the binary multiplier suffixes") {
+        REQUIRE(DiskQuota::parseSize("2k") == 2 * 1024);
+        REQUIRE(DiskQuota::parseSize("3M") == 3 * 1024 * 1024);
+        REQUIRE(DiskQuota::parseSize("1g") == 1024 * 1024 * 1024);
+        REQUIRE(DiskQuota::parseSize("1t") == 1024ULL * 1024 * 1024 * 1024);
+    }
+
+    SECTION("throws an Error in case of invalid size") {
+        for (auto size_txt : { "", "k", "-1", "1.5g", "10x", "10mb", "99999999999999999999" })
+            REQUIRE_THROWS_AS(DiskQuota::parseSize(size_txt), DiskQuota::Error);
+    }
+
+    SECTION("throws an Error in case of overflow") {
+        REQUIRE_THROWS_AS(DiskQuota::parseSize("17179869184t"), DiskQuota::Error);
+    }
+}
+
+TEST_CASE("DiskQuota usage", "[util]") {
+    DiskQuota quota { 1000 };
+
+    SECTION("a quota of zero bytes is disabled") {
+        DiskQuota no_quota { 0 };
+        no_quota.update("a", 5000, 1);
+        REQUIRE_FALSE(no_quota.enabled());
+        REQUIRE_FALSE(no_quota.isAboveHighWaterMark());
+    }
+
+    SECTION("tracks the total size of the entries") {
+        quota.update("a", 100, 1);
+        quota.update("b", 200, 2);
+        REQUIRE(quota.usage() == 300);
+
+        quota.update("a", 50, 3);
+        REQUIRE(quota.usage() == 250);
+
+        quota.remove("b");
+        REQUIRE(quota.usage() == 50);
+
+        quota.remove("does_not_exist");
+        REQUIRE(quota.usage() == 50);
+
+        quota.clear();
+        REQUIRE(quota.usage() == 0);
+    }
+
+    SECTION("checks the usage against the water marks") {
+        quota.update("a", 700, 1);
+        REQUIRE_FALSE(quota.isAboveLowWaterMark());
+
+        quota.update("a", 800, 1);
+        REQUIRE(quota.isAboveLowWaterMark());
+        REQUIRE_FALSE(quota.isAboveHighWaterMark());
+
+        quota.update("b", 200, 1);
+        REQUIRE(quota.isAboveHighWaterMark());
+    }
+
+    SECTION("returns the entries, least recently used first") {
+        quota.update("a", 1, 30);
+        quota.update("b", 1, 10);
+        quota.update("c", 1, 20);
+        quota.touch("b", 40);
+        quota.touch("does_not_exist", 5);
+
+        REQUIRE(quota.entriesByLastUse() == std::vector<std::string>({ "c", "a", "b" }));
+    }
+}
+
+TEST_CASE("DiskQuota::directorySize", "[util]") {
+    fs::create_directories(DISK_QUOTA_TEST_DIR + "/sub");
+    lth_file::atomic_write_to_file(std::string(100, 'a'), DISK_QUOTA_TEST_DIR + "/a");
+    lth_file::atomic_write_to_file(std::string(20, 'b'), DISK_QUOTA_TEST_DIR + "/sub/b");
+
+    SECTION("sums the size of the files in the whole tree") {
+        REQUIRE(DiskQuota::directorySize(DISK_QUOTA_TEST_DIR) == 120);
+    }
+
+    SECTION("returns zero if the directory does not exist") {
+        REQUIRE(DiskQuota::directorySize(DISK_QUOTA_TEST_DIR + "/does_not_exist") == 0);
+    }
+
+    fs::remove_all(DISK_QUOTA_TEST_DIR);
+}
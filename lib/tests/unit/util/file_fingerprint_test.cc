@@ -0,0 +1,64 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/util/file_fingerprint.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <leatherman/file_util/file.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+namespace fs = boost::filesystem;
+namespace lth_file = leatherman::file_util;
+
+static const std::string FINGERPRINT_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                                + "/lib/tests/resources/test_file_fingerprint" };
+
+TEST_CASE("FileFingerprint::toString", "[util]") {
+    FileFingerprint fingerprint { 42, 1500000000123456789, -5, 1234, 77 };
+
+    SECTION("can be parsed back") {
+        FileFingerprint parsed {};
+        REQUIRE(FileFingerprint::fromString(fingerprint.toString(), parsed));
+        REQUIRE(parsed == fingerprint);
+    }
+
+    SECTION("fails to parse invalid strings") {
+        FileFingerprint parsed {};
+        for (auto fingerprint_txt : { "", "42", "42 1 2 3", "42 1 2 3 x", "42 1 2 3 4 5" })
+            REQUIRE_FALSE(FileFingerprint::fromString(fingerprint_txt, parsed));
+    }
+}
+
+TEST_CASE("getFileFingerprint", "[util]") {
+    fs::create_directories(FINGERPRINT_TEST_DIR);
+    auto file_path = FINGERPRINT_TEST_DIR + "/file";
+    lth_file::atomic_write_to_file("some content", file_path);
+
+    SECTION("returns the size of the file") {
+        FileFingerprint fingerprint {};
+        REQUIRE(getFileFingerprint(file_path, fingerprint));
+        REQUIRE(fingerprint.size == 12);
+    }
+
+    SECTION("changes when the file is replaced") {
+        FileFingerprint before {}, after {};
+        REQUIRE(getFileFingerprint(file_path, before));
+        lth_file::atomic_write_to_file("other content", file_path);
+        REQUIRE(getFileFingerprint(file_path, after));
+        REQUIRE(before != after);
+    }
+
+    SECTION("fails if the file does not exist") {
+        FileFingerprint fingerprint {};
+        REQUIRE_FALSE(getFileFingerprint(FINGERPRINT_TEST_DIR + "/does_not_exist", fingerprint));
+    }
+
+    fs::remove_all(FINGERPRINT_TEST_DIR);
+}
@@ -0,0 +1,72 @@
+#include "root_path.hpp"
+
+#include <pxp-agent/util/file_staging.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/nowide/fstream.hpp>
+
+#include <leatherman/file_util/file.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+namespace fs = boost::filesystem;
+namespace lth_file = leatherman::file_util;
+
+static const std::string STAGING_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                            + "/lib/tests/resources/test_file_staging" };
+
+TEST_CASE("stageFile", "[util]") {
+    fs::create_directories(STAGING_TEST_DIR);
+    auto source = STAGING_TEST_DIR + "/source";
+    auto destination = STAGING_TEST_DIR + "/destination";
+    lth_file::atomic_write_to_file("some content", source);
+
+    SECTION("makes the content available at the destination") {
+        stageFile(source, destination);
+        REQUIRE(lth_file::read(destination) == "some content");
+    }
+
+    SECTION("gives the destination its own inode") {
+        auto method = stageFile(source, destination);
+        REQUIRE_FALSE(fs::equivalent(source, destination));
+        REQUIRE(lth_file::read(destination) == "some content");
+        {
+            // Modifies the source in place
+            boost::nowide::ofstream ofs { source, std::ios::binary | std::ios::trunc };
+            ofs << "new content";
+        }
+        REQUIRE(lth_file::read(destination) == "some content");
+#ifdef __linux__
+        REQUIRE(method != StagingMethod::Copy);
+#endif
+    }
+
+    SECTION("copies the whole content of large files") {
+        std::string content;
+        for (int i = 0; content.size() < 3 * 1024 * 1024; i++)
+            content += std::to_string(i) + "\n";
+        lth_file::atomic_write_to_file(content, source);
+
+        stageFile(source, destination);
+        REQUIRE(lth_file::read(destination) == content);
+    }
+
+    SECTION("throws in case the destination exists") {
+        lth_file::atomic_write_to_file("other content", destination);
+        REQUIRE_THROWS_AS(stageFile(source, destination), fs::filesystem_error);
+        REQUIRE(lth_file::read(destination) == "other content");
+    }
+
+    SECTION("throws in case the source does not exist") {
+        REQUIRE_THROWS_AS(stageFile(STAGING_TEST_DIR + "/does_not_exist", destination),
+                          fs::filesystem_error);
+    }
+
+    fs::remove_all(STAGING_TEST_DIR);
+}
@@ -0,0 +1,70 @@
+#include "../../common/https_stand_in.hpp"
+
+#include <pxp-agent/util/http_client_pool.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+static size_t discardData(char*, size_t size, size_t nmemb, void*) {
+    return size * nmemb;
+}
+
+static void get(HttpClientPool& pool, const std::string& uri) {
+    auto client = pool.acquire();
+    CURL* curl = client.handle();
+    REQUIRE(curl != nullptr);
+    curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CAINFO, HttpsStandIn::caPath().c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discardData);
+    REQUIRE(curl_easy_perform(curl) == CURLE_OK);
+    pool.recordTransfer(curl);
+}
+
+TEST_CASE("HttpClientPool::acquire", "[util]") {
+    SECTION("hands out the idle handles first") {
+        HttpClientPool pool { 1 };
+        CURL* first_handle;
+        {
+            auto client = pool.acquire();
+            first_handle = client.handle();
+            REQUIRE(first_handle != nullptr);
+        }
+        auto client = pool.acquire();
+        REQUIRE(client.handle() == first_handle);
+
+        auto other_client = pool.acquire();
+        REQUIRE(other_client.handle() != nullptr);
+        REQUIRE(other_client.handle() != first_handle);
+    }
+}
+
+TEST_CASE("HttpClientPool stats", "[util]") {
+    HttpClientPool pool {};
+    std::string content(1000, 'a');
+
+    SECTION("accounts the handshakes saved by reusing open connections") {
+        HttpsStandIn server { content, { false, 0, true, 0 } };
+        get(pool, server.uri() + "/one");
+        get(pool, server.uri() + "/two");
+
+        REQUIRE(server.connections() == 1u);
+        REQUIRE(pool.stats().requests == 2u);
+        REQUIRE(pool.stats().new_connections == 1u);
+        REQUIRE(pool.stats().handshakesSaved() == 1u);
+    }
+
+    SECTION("opens a new connection when the server closed it") {
+        HttpsStandIn server { content, { false, 0, false, 0 } };
+        get(pool, server.uri() + "/one");
+        get(pool, server.uri() + "/two");
+
+        REQUIRE(server.connections() == 2u);
+        REQUIRE(pool.stats().requests == 2u);
+        REQUIRE(pool.stats().handshakesSaved() == 0u);
+    }
+}
@@ -0,0 +1,77 @@
+#include <pxp-agent/util/json_stream_parser.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+static void parse(const std::string& text, uint64_t max_size = 0, uint32_t max_depth = 0)
+{
+    JsonStreamParser parser { max_size, max_depth };
+    parser.feed(text);
+    parser.finish();
+}
+
+// Feeds the text one byte at a time
+static void parseBytes(const std::string& text)
+{
+    JsonStreamParser parser {};
+    for (const auto& c : text)
+        parser.feed(&c, 1);
+    parser.finish();
+}
+
+TEST_CASE("JsonStreamParser", "[util]") {
+    SECTION("accepts valid JSON") {
+        for (const auto& text : { "{}", "[]", "null", "true", "false", "0", "-12",
+                                  "3.25e+10", "1E-2", "\"txt\"", "  42  \n",
+                                  "{\"a\" : [1, {\"b\" : null}, \"c\\\"\\u00e9\"], \"d\" : -0.5}",
+                                  "\"\\ud83d\\ude00\"" }) {
+            REQUIRE_NOTHROW(parse(text));
+            REQUIRE_NOTHROW(parseBytes(text));
+        }
+    }
+
+    SECTION("rejects invalid JSON") {
+        for (const auto& text : { "", "  ", "{", "[1,]", "{\"a\" 1}", "{1 : 2}", "[1 2]",
+                                  "01", "1.", "-", "1e", "tru", "nul", "[}", "{]",
+                                  "{} {}", "\"unterminated", "\"\\x\"", "\"\\u12g4\"",
+                                  "\"\\ud83d\"", "\"line\nbreak\"", "NaN", "// comment" }) {
+            REQUIRE_THROWS_AS(parse(text), JsonStreamParser::Error);
+            REQUIRE_THROWS_AS(parseBytes(text), JsonStreamParser::Error);
+        }
+    }
+
+    SECTION("rejects the invalid text as soon as it's consumed") {
+        JsonStreamParser parser {};
+        parser.feed("{\"a\" : ");
+        REQUIRE_THROWS_AS(parser.feed("]"), JsonStreamParser::Error);
+        REQUIRE_THROWS_AS(parser.feed("1}"), JsonStreamParser::Error);
+    }
+
+    SECTION("enforces the maximum size") {
+        REQUIRE_NOTHROW(parse("[1, 2]", 6));
+        REQUIRE_THROWS_AS(parse("[1, 2] ", 6), JsonStreamParser::LimitError);
+
+        JsonStreamParser parser { 6 };
+        parser.feed("[1, 2");
+        REQUIRE_THROWS_AS(parser.feed(", 3]"), JsonStreamParser::LimitError);
+        REQUIRE(parser.size() == 5u);
+    }
+
+    SECTION("enforces the maximum size before consuming the text") {
+        JsonStreamParser parser { 6 };
+        REQUIRE_NOTHROW(parser.checkSize(6));
+        REQUIRE_THROWS_AS(parser.checkSize(7), JsonStreamParser::LimitError);
+        REQUIRE_THROWS_AS(parser.feed("[1]"), JsonStreamParser::Error);
+    }
+
+    SECTION("enforces the maximum nesting depth") {
+        REQUIRE_NOTHROW(parse("[{\"a\" : [1]}]", 0, 3));
+        REQUIRE_THROWS_AS(parse("[{\"a\" : [[1]]}]", 0, 3), JsonStreamParser::LimitError);
+        REQUIRE_THROWS_AS(parse(std::string(100000, '['), 0, 64),
+                          JsonStreamParser::LimitError);
+    }
+}
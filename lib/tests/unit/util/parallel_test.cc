@@ -0,0 +1,60 @@
+#include <pxp-agent/util/parallel.hpp>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace PXPAgent;
+using namespace Util;
+
+TEST_CASE("runInParallel", "[util]") {
+    SECTION("runs each item once") {
+        std::vector<std::atomic<int>> runs(20);
+        for (auto& run : runs)
+            run = 0;
+
+        runInParallel(runs.size(), 4, [&](size_t item_idx) { runs[item_idx]++; });
+
+        for (auto& run : runs)
+            REQUIRE(run == 1);
+    }
+
+    SECTION("does not run more than max_parallel items at once") {
+        std::atomic<int> running { 0 }, max_running { 0 };
+
+        runInParallel(12, 3, [&](size_t) {
+            auto now_running = ++running;
+            auto seen = max_running.load();
+            while (now_running > seen && !max_running.compare_exchange_weak(seen, now_running)) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            running--;
+        });
+
+        REQUIRE(max_running > 1);
+        REQUIRE(max_running <= 3);
+    }
+
+    SECTION("runs the items in turn when max_parallel is 0") {
+        std::vector<size_t> order;
+
+        runInParallel(5, 0, [&](size_t item_idx) { order.push_back(item_idx); });
+
+        REQUIRE(order == (std::vector<size_t> { 0, 1, 2, 3, 4 }));
+    }
+
+    SECTION("rethrows the first error and does not start further items") {
+        std::atomic<int> runs { 0 };
+
+        REQUIRE_THROWS_AS(runInParallel(10, 1, [&](size_t item_idx) {
+                              runs++;
+                              if (item_idx == 2)
+                                  throw std::runtime_error { "failed" };
+                          }),
+                          std::runtime_error);
+        REQUIRE(runs == 3);
+    }
+}
@@ -0,0 +1,49 @@
+#include <pxp-agent/util/rate_limiter.hpp>
+
+#include <catch.hpp>
+
+using namespace PXPAgent;
+using namespace Util;
+
+using ms = std::chrono::milliseconds;
+
+TEST_CASE("RateLimiter::reserve", "[util]") {
+    auto now = RateLimiter::clock::now();
+
+    SECTION("never waits when disabled") {
+        RateLimiter limiter { 0 };
+        REQUIRE(limiter.reserve(1000000000, now) == RateLimiter::clock::duration::zero());
+    }
+
+    SECTION("allows a burst of one second worth of bytes after an idle period") {
+        RateLimiter limiter { 1000 };
+        REQUIRE(limiter.reserve(1000, now) == RateLimiter::clock::duration::zero());
+        REQUIRE(std::chrono::duration_cast<ms>(limiter.reserve(500, now)) == ms(500));
+    }
+
+    SECTION("serves the callers in turn") {
+        RateLimiter limiter { 1000 };
+        limiter.reserve(1000, now);
+        REQUIRE(std::chrono::duration_cast<ms>(limiter.reserve(100, now)) == ms(100));
+        REQUIRE(std::chrono::duration_cast<ms>(limiter.reserve(100, now)) == ms(200));
+        REQUIRE(std::chrono::duration_cast<ms>(limiter.reserve(100, now + ms(200))) == ms(100));
+    }
+
+    SECTION("does not credit more than the burst") {
+        RateLimiter limiter { 1000 };
+        limiter.reserve(1000, now);
+        auto later = now + std::chrono::seconds(10);
+        REQUIRE(limiter.reserve(1000, later) == RateLimiter::clock::duration::zero());
+        REQUIRE(std::chrono::duration_cast<ms>(limiter.reserve(1000, later)) == ms(1000));
+    }
+}
+
+TEST_CASE("RateLimiter::consume", "[util]") {
+    SECTION("waits for the bytes above the rate") {
+        RateLimiter limiter { 10000 };
+        auto start = RateLimiter::clock::now();
+        limiter.consume(10000);
+        limiter.consume(2000);
+        REQUIRE(RateLimiter::clock::now() - start >= ms(150));
+    }
+}
@@ -0,0 +1,113 @@
+#include <pxp-agent/util/server_selector.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace PXPAgent;
+using namespace Util;
+
+using ms = std::chrono::milliseconds;
+
+TEST_CASE("ServerSelector::order", "[util]") {
+    ServerSelector selector {};
+    auto now = ServerSelector::clock::now();
+    std::vector<std::string> servers { "a", "b", "c" };
+
+    SECTION("keeps the configuration order of unknown servers") {
+        REQUIRE(selector.order(servers, now) == servers);
+    }
+
+    SECTION("prefers the fastest servers") {
+        selector.recordSuccess("a", ms(300));
+        selector.recordSuccess("b", ms(100));
+        selector.recordSuccess("c", ms(200));
+        REQUIRE(selector.order(servers, now) == std::vector<std::string>({ "b", "c", "a" }));
+    }
+
+    SECTION("tries the unknown servers before the measured ones") {
+        selector.recordSuccess("a", ms(10));
+        REQUIRE(selector.order(servers, now) == std::vector<std::string>({ "b", "c", "a" }));
+    }
+
+    SECTION("smooths the latency of a server") {
+        selector.recordSuccess("a", ms(100));
+        selector.recordSuccess("b", ms(150));
+        selector.recordSuccess("c", ms(300));
+        selector.recordSuccess("a", ms(200));
+        REQUIRE(selector.order(servers, now) == servers);
+
+        selector.recordSuccess("a", ms(500));
+        REQUIRE(selector.order(servers, now) == std::vector<std::string>({ "b", "a", "c" }));
+    }
+
+    SECTION("tries the ejected servers last, until their ejection ends") {
+        selector.recordSuccess("a", ms(1));
+        selector.recordSuccess("b", ms(2));
+        selector.recordSuccess("c", ms(3));
+        selector.recordFailure("a", now);
+
+        REQUIRE(selector.isEjected("a", now));
+        REQUIRE(selector.order(servers, now) == std::vector<std::string>({ "b", "c", "a" }));
+
+        auto later = now + ServerSelector::EJECTION_BASE;
+        REQUIRE_FALSE(selector.isEjected("a", later));
+        REQUIRE(selector.order(servers, later) == servers);
+    }
+
+    SECTION("ejects the servers for longer at each consecutive failure") {
+        selector.recordFailure("a", now);
+        selector.recordFailure("a", now);
+        REQUIRE(selector.isEjected("a", now + ServerSelector::EJECTION_BASE));
+        REQUIRE_FALSE(selector.isEjected("a", now + 2 * ServerSelector::EJECTION_BASE));
+
+        for (int i = 0; i < 20; i++)
+            selector.recordFailure("a", now);
+        REQUIRE_FALSE(selector.isEjected("a", now + ServerSelector::EJECTION_MAX));
+
+        selector.recordSuccess("a", ms(1));
+        REQUIRE_FALSE(selector.isEjected("a", now));
+    }
+
+    SECTION("orders the ejected servers by the end of their ejection") {
+        selector.recordFailure("a", now);
+        selector.recordFailure("a", now);
+        selector.recordFailure("b", now);
+        REQUIRE(selector.order(servers, now) == std::vector<std::string>({ "c", "b", "a" }));
+    }
+
+    SECTION("ejects the servers that ask to retry later until then") {
+        selector.recordFailure("a", now, std::chrono::seconds(60));
+        REQUIRE(selector.retryAfter("a", now) == std::chrono::seconds(60));
+        REQUIRE(selector.isEjected("a", now + std::chrono::seconds(59)));
+        REQUIRE_FALSE(selector.isEjected("a", now + std::chrono::seconds(60)));
+        REQUIRE(selector.retryAfter("a", now + std::chrono::seconds(60)) == ServerSelector::clock::duration::zero());
+        REQUIRE(selector.retryAfter("b", now) == ServerSelector::clock::duration::zero());
+    }
+
+    SECTION("caps the time the servers ask to retry after") {
+        selector.recordFailure("a", now, std::chrono::hours(24));
+        REQUIRE(selector.retryAfter("a", now) == ServerSelector::EJECTION_MAX);
+
+        selector.recordSuccess("a", ms(1));
+        REQUIRE(selector.retryAfter("a", now) == ServerSelector::clock::duration::zero());
+    }
+}
+
+TEST_CASE("jitteredBackoff", "[util]") {
+    SECTION("doubles the wait at each attempt, with a jitter of up to half of it") {
+        for (unsigned int attempt = 1; attempt <= 4; attempt++) {
+            auto backoff = ms(1000 << (attempt - 1));
+            auto wait = jitteredBackoff(attempt, ms(1000), ms(8000));
+            REQUIRE(wait <= backoff);
+            REQUIRE(wait >= backoff / 2);
+        }
+    }
+
+    SECTION("caps the wait") {
+        auto wait = jitteredBackoff(30, ms(1000), ms(8000));
+        REQUIRE(wait <= ms(8000));
+        REQUIRE(wait >= ms(4000));
+    }
+}
@@ -0,0 +1,25 @@
+#include <pxp-agent/util/sha256.hpp>
+
+#include <catch.hpp>
+
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+TEST_CASE("Sha256::hexDigest", "[util]") {
+    Sha256 digest {};
+
+    SECTION("returns the digest of no data") {
+        REQUIRE(digest.hexDigest()
+                == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    }
+
+    SECTION("returns the same digest regardless of how the data is split") {
+        std::string data { "abc" };
+        digest.update(data.data(), 1);
+        digest.update(data.data() + 1, 2);
+        REQUIRE(digest.hexDigest()
+                == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    }
+}
@@ -0,0 +1,178 @@
+#include "root_path.hpp"
+#include "../../common/tar_builder.hpp"
+
+#include <pxp-agent/util/tar_reader.hpp>
+#include <pxp-agent/util/gzip.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <catch.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace PXPAgent;
+using namespace Util;
+
+namespace fs = boost::filesystem;
+
+static const std::string TAR_TEST_DIR { std::string { PXP_AGENT_ROOT_PATH }
+                                        + "/lib/tests/resources/test_tar_reader" };
+
+static std::string readContent(TarReader& reader)
+{
+    std::string content;
+    char buffer[7];
+    size_t size;
+    while ((size = reader.read(buffer, sizeof(buffer))) > 0)
+        content.append(buffer, size);
+    return content;
+}
+
+TEST_CASE("TarReader", "[util]") {
+    fs::create_directories(TAR_TEST_DIR);
+    auto archive = TAR_TEST_DIR + "/archive.tar";
+
+    TarBuilder builder;
+    builder.addDirectory("./dir/");
+    builder.addFile("./dir/first", "first content");
+    builder.addFile("dir/second", std::string(1500, 'x'));
+
+    SECTION("reads the entries in order") {
+        builder.write(archive);
+        TarReader reader { archive };
+        TarReader::Entry entry;
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(entry.path == "dir/");
+        REQUIRE_FALSE(entry.is_file);
+        REQUIRE(entry.is_directory);
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(entry.path == "dir/first");
+        REQUIRE(entry.is_file);
+        REQUIRE_FALSE(entry.is_directory);
+        REQUIRE(entry.size == 13);
+        REQUIRE(readContent(reader) == "first content");
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(entry.path == "dir/second");
+        REQUIRE(readContent(reader) == std::string(1500, 'x'));
+
+        REQUIRE_FALSE(reader.next(entry));
+    }
+
+    SECTION("skips the content that is not read") {
+        builder.write(archive);
+        TarReader reader { archive };
+        TarReader::Entry entry;
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(reader.next(entry));
+        REQUIRE(reader.next(entry));
+        REQUIRE(entry.path == "dir/second");
+        REQUIRE_FALSE(reader.next(entry));
+    }
+
+    SECTION("reads gzip compressed archives") {
+        builder.write(TAR_TEST_DIR + "/archive.plain.tar");
+        gzipFile(TAR_TEST_DIR + "/archive.plain.tar", archive);
+        TarReader reader { archive };
+        TarReader::Entry entry;
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(reader.next(entry));
+        REQUIRE(readContent(reader) == "first content");
+        REQUIRE(reader.next(entry));
+        REQUIRE(readContent(reader) == std::string(1500, 'x'));
+        REQUIRE_FALSE(reader.next(entry));
+    }
+
+    SECTION("reads the long names") {
+        std::string long_path { "dir/" + std::string(150, 'a') };
+        builder.addFile(long_path, "long");
+        builder.write(archive);
+        TarReader reader { archive };
+        TarReader::Entry entry;
+
+        for (int i = 0; i < 4; i++)
+            REQUIRE(reader.next(entry));
+        REQUIRE(entry.path == long_path);
+        REQUIRE(readContent(reader) == "long");
+    }
+
+    SECTION("throws in case a header is corrupted") {
+        auto data = builder.str();
+        data[512 + 10] = 'z';
+        {
+            boost::nowide::ofstream ofs { archive, std::ios::binary };
+            ofs << data;
+        }
+        TarReader reader { archive };
+        TarReader::Entry entry;
+
+        REQUIRE(reader.next(entry));
+        REQUIRE_THROWS_AS(reader.next(entry), TarError);
+    }
+
+    SECTION("throws in case the archive is truncated") {
+        auto data = builder.str().substr(0, 512 * 4 + 100);
+        {
+            boost::nowide::ofstream ofs { archive, std::ios::binary };
+            ofs << data;
+        }
+        TarReader reader { archive };
+        TarReader::Entry entry;
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(reader.next(entry));
+        REQUIRE(reader.next(entry));
+        REQUIRE_THROWS_AS(readContent(reader), TarError);
+    }
+
+    SECTION("reads the archives from a source, in chunks of any size") {
+        builder.write(TAR_TEST_DIR + "/archive.plain.tar");
+        gzipFile(TAR_TEST_DIR + "/archive.plain.tar", archive);
+
+        for (auto path : { TAR_TEST_DIR + "/archive.plain.tar", archive }) {
+            boost::nowide::ifstream ifs { path, std::ios::binary };
+            TarReader reader { "source", [&ifs](char* buffer, size_t size) -> size_t {
+                ifs.read(buffer, static_cast<std::streamsize>(std::min<size_t>(size, 3)));
+                return static_cast<size_t>(ifs.gcount());
+            } };
+            TarReader::Entry entry;
+
+            REQUIRE(reader.next(entry));
+            REQUIRE(reader.next(entry));
+            REQUIRE(readContent(reader) == "first content");
+            REQUIRE(reader.next(entry));
+            REQUIRE(readContent(reader) == std::string(1500, 'x'));
+            REQUIRE_FALSE(reader.next(entry));
+        }
+    }
+
+    SECTION("passes on the errors of the source") {
+        auto data = builder.str();
+        size_t offset { 0 };
+        TarReader reader { "source", [&](char* buffer, size_t size) -> size_t {
+            if (offset >= 1024)
+                throw std::runtime_error { "connection dropped" };
+            size = std::min<size_t>(size, 512);
+            data.copy(buffer, size, offset);
+            offset += size;
+            return size;
+        } };
+        TarReader::Entry entry;
+
+        REQUIRE(reader.next(entry));
+        REQUIRE(reader.next(entry));
+        REQUIRE_THROWS_WITH(reader.next(entry), "connection dropped");
+    }
+
+    SECTION("throws in case the archive does not exist") {
+        REQUIRE_THROWS_AS(TarReader { TAR_TEST_DIR + "/does_not_exist" }, TarError);
+    }
+
+    fs::remove_all(TAR_TEST_DIR);
+}